@@ -40,6 +40,8 @@
 #include "app/resource_finder.h"
 #include "app/send_crash.h"
 #include "app/site.h"
+#include "app/startup_trace.h"
+#include "app/trace.h"
 #include "app/tools/active_tool.h"
 #include "app/tools/tool_box.h"
 #include "app/ui/backup_indicator.h"
@@ -128,6 +130,7 @@ class App::LoadLanguage {
 public:
   LoadLanguage(Preferences& pref,
                Extensions& exts) {
+    StartupTrace::Phase phase("Language");
     Strings::createInstance(pref, exts);
   }
 };
@@ -253,6 +256,11 @@ int App::initialize(const AppOptions& options)
 {
   os::System* system = os::instance();
 
+  if (!options.traceFilename().empty())
+    Trace::start(options.traceFilename());
+  if (options.startupTrace())
+    StartupTrace::enable();
+
   m_isGui = options.startUI() && !options.previewCLI();
 
   // Notify the scripting engine that we're going to enter to GUI
@@ -265,7 +273,10 @@ int App::initialize(const AppOptions& options)
 #endif
 
   m_isShell = options.startShell();
-  m_coreModules = std::make_unique<CoreModules>();
+  {
+    StartupTrace::Phase phase("Core modules");
+    m_coreModules = std::make_unique<CoreModules>();
+  }
 
   auto& pref = preferences();
 
@@ -332,9 +343,18 @@ int App::initialize(const AppOptions& options)
 #endif
 
   // Load modules
-  m_modules = std::make_unique<Modules>(createLogInDesktop, pref);
-  m_legacy = std::make_unique<LegacyModules>(isGui() ? REQUIRE_INTERFACE: 0);
-  m_brushes = std::make_unique<AppBrushes>();
+  {
+    StartupTrace::Phase phase("Modules");
+    m_modules = std::make_unique<Modules>(createLogInDesktop, pref);
+  }
+  {
+    StartupTrace::Phase phase("Legacy modules (GUI, theme)");
+    m_legacy = std::make_unique<LegacyModules>(isGui() ? REQUIRE_INTERFACE: 0);
+  }
+  {
+    StartupTrace::Phase phase("Brushes");
+    m_brushes = std::make_unique<AppBrushes>();
+  }
 
   // Data recovery is enabled only in GUI mode
   if (isGui() && pref.general.dataRecovery())
@@ -345,11 +365,15 @@ int App::initialize(const AppOptions& options)
 
   // Load or create the default palette, or migrate the default
   // palette from an old format palette to the new one, etc.
-  load_default_palette();
+  {
+    StartupTrace::Phase phase("Default palette");
+    load_default_palette();
+  }
 
   // Initialize GUI interface
   if (isGui()) {
     LOG("APP: GUI mode\n");
+    StartupTrace::Phase phase("Main window");
 
     // Set the ClipboardDelegate impl to copy/paste text in the native
     // clipboard from the ui::Entry control.
@@ -399,11 +423,22 @@ int App::initialize(const AppOptions& options)
   }
 
 #ifdef ENABLE_SCRIPTING
+  // Profile all scripts (including plugins) with --script-profile
+  if (!options.scriptProfileFilename().empty()) {
+    LOG("APP: Profiling scripts...\n");
+    m_engine->startProfiler(options.scriptProfileFilename());
+  }
+
   // Call the init() function from all plugins
   LOG("APP: Initializing scripts...\n");
-  extensions().executeInitActions();
+  {
+    StartupTrace::Phase phase("Plugins init()");
+    extensions().executeInitActions();
+  }
 #endif
 
+  StartupTrace::printReport();
+
   // Process options
   LOG("APP: Processing options...\n");
   int code;
@@ -660,6 +695,9 @@ App::~App()
     // no re-throw
   }
 
+  // Save the --trace file
+  Trace::stop();
+
   m_instance = nullptr;
 }
 
@@ -72,6 +72,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
 #ifdef ENABLE_SCRIPTING
   , m_script(m_po.add("script").requiresValue("<filename>").description("Execute a specific script"))
   , m_scriptParam(m_po.add("script-param").requiresValue("name=value").description("Parameter for a script executed from the\nCLI that you can access with app.params"))
+  , m_scriptProfile(m_po.add("script-profile").requiresValue("<filename>").description("Profile the executed scripts (with hooks on\neach function call, which slows them down)\nand save the time spent in each Lua/native\nfunction in folded stacks format (flamegraphs)"))
 #endif
   , m_listLayers(m_po.add("list-layers").description("List layers of the next given sprite\nor include layers in JSON data"))
   , m_listLayerHierarchy(m_po.add("list-layer-hierarchy").description("List layers with groups of the next given sprite\nor include layers hierarchy in JSON data"))
@@ -81,6 +82,8 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_exportTileset(m_po.add("export-tileset").description("Export only tilesets from visible tilemap layers"))
   , m_verbose(m_po.add("verbose").mnemonic('v').description("Explain what is being done"))
   , m_debug(m_po.add("debug").description("Extreme verbose mode and\ncopy log to desktop"))
+  , m_startupTrace(m_po.add("startup-trace").description("Print the time spent in each\nstartup phase"))
+  , m_trace(m_po.add("trace").requiresValue("<filename>").description("Save a trace of the time spent in\nstartup, load/save, rendering, tools,\nfilters, exports, and backups in Chrome\ntrace event format (JSON)"))
 #ifdef ENABLE_STEAM
   , m_noInApp(m_po.add("noinapp").description("Disable \"in game\" visibility on Steam\nDoesn't count playtime"))
 #endif
@@ -126,6 +129,23 @@ bool AppOptions::hasExporterParams() const
     m_po.enabled(m_sheet);
 }
 
+#ifdef ENABLE_SCRIPTING
+std::string AppOptions::scriptProfileFilename() const
+{
+  return m_po.value_of(m_scriptProfile);
+}
+#endif
+
+bool AppOptions::startupTrace() const
+{
+  return m_po.enabled(m_startupTrace);
+}
+
+std::string AppOptions::traceFilename() const
+{
+  return m_po.value_of(m_trace);
+}
+
 #ifdef ENABLE_STEAM
 bool AppOptions::noInApp() const
 {
@@ -88,6 +88,7 @@ public:
 #ifdef ENABLE_SCRIPTING
   const Option& script() const { return m_script; }
   const Option& scriptParam() const { return m_scriptParam; }
+  const Option& scriptProfile() const { return m_scriptProfile; }
 #endif
   const Option& listLayers() const { return m_listLayers; }
   const Option& listLayerHierarchy() const { return m_listLayerHierarchy; }
@@ -97,6 +98,11 @@ public:
   const Option& exportTileset() const { return m_exportTileset; }
 
   bool hasExporterParams() const;
+  bool startupTrace() const;
+  std::string traceFilename() const;
+#ifdef ENABLE_SCRIPTING
+  std::string scriptProfileFilename() const;
+#endif
 #ifdef ENABLE_STEAM
   bool noInApp() const;
 #endif
@@ -163,6 +169,7 @@ private:
 #ifdef ENABLE_SCRIPTING
   Option& m_script;
   Option& m_scriptParam;
+  Option& m_scriptProfile;
 #endif
   Option& m_listLayers;
   Option& m_listLayerHierarchy;
@@ -173,6 +180,8 @@ private:
 
   Option& m_verbose;
   Option& m_debug;
+  Option& m_startupTrace;
+  Option& m_trace;
 #ifdef ENABLE_STEAM
   Option& m_noInApp;
 #endif
@@ -132,6 +132,10 @@ void DefaultCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
 {
   LOG("APP: Exporting sheet...\n");
 
+  // The sprite sheet document isn't used, so the texture can be
+  // saved without keeping all its pixels in memory.
+  exporter.setStreamTexture(true);
+
   base::task_token token;
   std::unique_ptr<Doc> spriteSheet(
     exporter.exportSheet(ctx, token));
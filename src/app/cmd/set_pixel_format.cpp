@@ -23,12 +23,18 @@
 #include "doc/document.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/rgbmap.h"
 #include "doc/sprite.h"
 #include "doc/tilesets.h"
 #include "render/quantization.h"
 #include "render/task_delegate.h"
 
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -36,35 +42,70 @@ using namespace doc;
 
 namespace {
 
+// Delegate used by each thread that converts images. The progress
+// is reported as the number of converted images (plus the progress
+// of the current one), and the original delegate is called from one
+// thread at a time.
 class SuperDelegate : public render::TaskDelegate {
 public:
-  SuperDelegate(int nimages, render::TaskDelegate* delegate)
-    : m_nimages(nimages)
-    , m_curImage(0)
-    , m_delegate(delegate) {
+  struct Shared {
+    Shared(int nimages, render::TaskDelegate* delegate)
+      : nimages(nimages)
+      , delegate(delegate) {
+    }
+    const int nimages;
+    render::TaskDelegate* delegate;
+    std::mutex mutex;
+    std::atomic<int> doneImages = 0;
+    std::atomic<bool> canceled = false;
+    double lastProgress = 0.0;
+  };
+
+  SuperDelegate(Shared& shared)
+    : m_shared(shared) {
   }
 
   void notifyTaskProgress(double progress) override {
-    if (m_delegate)
-      m_delegate->notifyTaskProgress(
-        (progress + m_curImage) / m_nimages);
+    if (!m_shared.delegate)
+      return;
+
+    progress = (progress + m_shared.doneImages) / m_shared.nimages;
+
+    const std::lock_guard lock(m_shared.mutex);
+    if (progress > m_shared.lastProgress) {
+      m_shared.lastProgress = progress;
+      m_shared.delegate->notifyTaskProgress(progress);
+    }
   }
 
   bool continueTask() override {
-    if (m_delegate)
-      return m_delegate->continueTask();
-    else
-      return true;
+    if (m_shared.canceled)
+      return false;
+    if (m_shared.delegate) {
+      const std::lock_guard lock(m_shared.mutex);
+      if (!m_shared.delegate->continueTask()) {
+        m_shared.canceled = true;
+        return false;
+      }
+    }
+    return true;
   }
 
   void nextImage() {
-    ++m_curImage;
+    ++m_shared.doneImages;
+    notifyTaskProgress(0.0);
   }
 
 private:
-  int m_nimages;
-  int m_curImage;
-  TaskDelegate* m_delegate;
+  Shared& m_shared;
+};
+
+// An image to be converted (a cel image or a tile)
+struct ConvertItem {
+  ImageRef oldImage;
+  frame_t frame;
+  bool isBackground;
+  ImageRef newImage;
 };
 
 } // anonymous namespace
@@ -83,40 +124,15 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
   if (sprite->pixelFormat() == newFormat)
     return;
 
-  // Calculate the number of images to convert just to show a proper
-  // progress bar.
-  tile_index nimages = 0;
-  for (Cel* cel : sprite->uniqueCels())
-    if (!cel->layer()->isTilemap())
-      ++nimages;
-  if (sprite->hasTilesets()) {
-    for (Tileset* tileset : *sprite->tilesets()) {
-      if (tileset)
-        nimages += tileset->size();
-    }
-  }
-
-  SuperDelegate superDel(nimages, delegate);
-
-  // Convert cel images
+  // Collect all the images to convert (cels and tiles) in the same
+  // order we'll add the cmd::ReplaceImage commands.
+  std::vector<ConvertItem> items;
   for (Cel* cel : sprite->uniqueCels()) {
-    if (cel->layer()->isTilemap())
-      continue;
-
-    ImageRef oldImage = cel->imageRef();
-    convertImage(sprite, dithering,
-                 oldImage,
-                 cel->frame(),
-                 cel->layer()->isBackground(),
-                 mapAlgorithm,
-                 toGray,
-                 &superDel,
-                 fitCriteria);
-
-    superDel.nextImage();
+    if (!cel->layer()->isTilemap())
+      items.push_back({ cel->imageRef(),
+                        cel->frame(),
+                        cel->layer()->isBackground() });
   }
-
-  // Convert tileset images
   if (sprite->hasTilesets()) {
     for (Tileset* tileset : *sprite->tilesets()) {
       if (!tileset)
@@ -124,19 +140,75 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
 
       for (tile_index i=0; i<tileset->size(); ++i) {
         ImageRef oldImage = tileset->get(i);
-        if (oldImage) {
-          convertImage(sprite, dithering,
-                       oldImage,
-                       0,     // TODO select a frame or generate other tilesets?
-                       false, // TODO is background? it depends of the layer where this tileset is used
-                       mapAlgorithm,
-                       toGray,
-                       &superDel,
-                       fitCriteria);
+        if (oldImage)
+          items.push_back({ oldImage,
+                            0,        // TODO select a frame or generate other tilesets?
+                            false }); // TODO is background? it depends of the layer where this tileset is used
+      }
+    }
+  }
+
+  // The sprite RgbMap remembers the algorithm/fit criteria to be
+  // used in the future (each thread will use its own RgbMap).
+  if (newFormat == IMAGE_INDEXED && !items.empty())
+    sprite->rgbMap(items.front().frame,
+                   sprite->rgbMapForSprite(),
+                   mapAlgorithm,
+                   fitCriteria);
+
+  // Convert images from several threads, each thread takes the next
+  // image that is not converted yet. If a conversion fails (e.g.
+  // std::bad_alloc) the other threads are stopped and the exception
+  // is rethrown from this thread.
+  SuperDelegate::Shared shared(int(items.size()), delegate);
+  std::atomic<int> nextItem = 0;
+  std::mutex errorMutex;
+  std::exception_ptr error;
+  const int nthreads = std::min<int>(doc::parallel_max_threads(), items.size());
+
+  doc::parallel_ranges(
+    nthreads, 1,
+    [&](int, int) {
+      SuperDelegate superDel(shared);
+      std::unique_ptr<RgbMap> rgbmap;
+
+      for (int i=nextItem++; i<int(items.size()); i=nextItem++) {
+        if (shared.canceled)
+          break;
+
+        ConvertItem& item = items[i];
+        try {
+          item.newImage =
+            convertImage(sprite, dithering,
+                         item.oldImage,
+                         item.frame,
+                         item.isBackground,
+                         mapAlgorithm,
+                         toGray,
+                         &superDel,
+                         fitCriteria,
+                         rgbmap);
+        }
+        catch (...) {
+          const std::lock_guard lock(errorMutex);
+          if (!error)
+            error = std::current_exception();
+          shared.canceled = true;
+          break;
         }
+
         superDel.nextImage();
       }
-    }
+    });
+
+  if (error)
+    std::rethrow_exception(error);
+
+  // Replace images in a deterministic order (if the task was
+  // canceled some images might not be converted).
+  for (const ConvertItem& item : items) {
+    if (item.newImage)
+      m_pre.add(new cmd::ReplaceImage(sprite, item.oldImage, item.newImage));
   }
 
   // By default, when converting to RGB or grayscale, the mask color
@@ -226,48 +298,49 @@ void SetPixelFormat::setFormat(PixelFormat format)
   doc->notify_observers<DocEvent&>(&DocObserver::onPixelFormatChanged, ev);
 }
 
-void SetPixelFormat::convertImage(doc::Sprite* sprite,
-                                  const render::Dithering& dithering,
-                                  const doc::ImageRef& oldImage,
-                                  const doc::frame_t frame,
-                                  const bool isBackground,
-                                  const doc::RgbMapAlgorithm mapAlgorithm,
-                                  doc::rgba_to_graya_func toGray,
-                                  render::TaskDelegate* delegate,
-                                  const doc::FitCriteria fitCriteria)
+ImageRef SetPixelFormat::convertImage(const doc::Sprite* sprite,
+                                      const render::Dithering& dithering,
+                                      const doc::ImageRef& oldImage,
+                                      const doc::frame_t frame,
+                                      const bool isBackground,
+                                      const doc::RgbMapAlgorithm mapAlgorithm,
+                                      doc::rgba_to_graya_func toGray,
+                                      render::TaskDelegate* delegate,
+                                      const doc::FitCriteria fitCriteria,
+                                      std::unique_ptr<doc::RgbMap>& rgbmap) const
 {
   ASSERT(oldImage);
   ASSERT(oldImage->pixelFormat() != IMAGE_TILEMAP);
 
-  // Making the RGBMap for Image->INDEXDED conversion.
-  // TODO: this is needed only when newImage
-  RgbMap* rgbmap;
+  // Making the RGBMap for Image->INDEXDED conversion (we use the
+  // given "rgbmap" because the sprite one cannot be used from
+  // several threads).
+  const RgbMap* map;
   int newMaskIndex = (isBackground ? -1 : 0);
   if (m_newFormat == IMAGE_INDEXED) {
-    rgbmap = sprite->rgbMap(frame,
-                            sprite->rgbMapForSprite(),
-                            mapAlgorithm,
-                            fitCriteria);
+    map = sprite->rgbMap(frame,
+                         sprite->rgbMapForSprite(),
+                         mapAlgorithm,
+                         fitCriteria,
+                         rgbmap);
     if (m_oldFormat == IMAGE_INDEXED)
       newMaskIndex = sprite->transparentColor();
     else
-      newMaskIndex = rgbmap->maskIndex();
+      newMaskIndex = map->maskIndex();
   }
   else {
-    rgbmap = nullptr;
+    map = nullptr;
   }
-  ImageRef newImage(
+  return ImageRef(
     render::convert_pixel_format
     (oldImage.get(), nullptr, m_newFormat,
      dithering,
-     rgbmap,
+     map,
      sprite->palette(frame),
      isBackground,
      newMaskIndex,
      toGray,
      delegate));
-
-  m_pre.add(new cmd::ReplaceImage(sprite, oldImage, newImage));
 }
 
 } // namespace cmd
@@ -18,7 +18,10 @@
 #include "doc/pixel_format.h"
 #include "doc/rgbmap_algorithm.h"
 
+#include <memory>
+
 namespace doc {
+  class RgbMap;
   class Sprite;
 }
 
@@ -51,15 +54,16 @@ namespace cmd {
 
   private:
     void setFormat(doc::PixelFormat format);
-    void convertImage(doc::Sprite* sprite,
-                      const render::Dithering& dithering,
-                      const doc::ImageRef& oldImage,
-                      const doc::frame_t frame,
-                      const bool isBackground,
-                      const doc::RgbMapAlgorithm mapAlgorithm,
-                      doc::rgba_to_graya_func toGray,
-                      render::TaskDelegate* delegate,
-                      const doc::FitCriteria fitCriteria = doc::FitCriteria::DEFAULT);
+    doc::ImageRef convertImage(const doc::Sprite* sprite,
+                               const render::Dithering& dithering,
+                               const doc::ImageRef& oldImage,
+                               const doc::frame_t frame,
+                               const bool isBackground,
+                               const doc::RgbMapAlgorithm mapAlgorithm,
+                               doc::rgba_to_graya_func toGray,
+                               render::TaskDelegate* delegate,
+                               const doc::FitCriteria fitCriteria,
+                               std::unique_ptr<doc::RgbMap>& rgbmap) const;
 
     doc::PixelFormat m_oldFormat;
     doc::PixelFormat m_newFormat;
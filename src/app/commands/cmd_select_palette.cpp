@@ -100,7 +100,7 @@ void SelectPaletteColorsCommand::selectTiles(
   // For each tile on each cel's tilemap
   for (frame_t frame : selectedFrames) {
     if (Cel* cel = layer->cel(frame)) {
-      for (const doc::tile_t t : LockImageBits<TilemapTraits>(cel->image())) {
+      for (const doc::tile_t t : LockImageBits<TilemapTraits>(cel->image(), Image::ReadLock)) {
         tile_index ti = doc::tile_geti(t);
         if (ti >= 0 && ti < usedTiles.size())
           usedTiles[ti] = true;
@@ -269,11 +269,15 @@ public:
 
     static_assert(doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR == 0 &&
                   doc::algorithm::RESIZE_METHOD_BILINEAR == 1 &&
-                  doc::algorithm::RESIZE_METHOD_ROTSPRITE == 2,
+                  doc::algorithm::RESIZE_METHOD_ROTSPRITE == 2 &&
+                  doc::algorithm::RESIZE_METHOD_AREA_AVERAGE == 3 &&
+                  doc::algorithm::RESIZE_METHOD_LANCZOS3 == 4,
                   "ResizeMethod enum has changed");
     method()->addItem(Strings::sprite_size_method_nearest_neighbor());
     method()->addItem(Strings::sprite_size_method_bilinear());
     method()->addItem(Strings::sprite_size_method_rotsprite());
+    method()->addItem(Strings::sprite_size_method_area_average());
+    method()->addItem(Strings::sprite_size_method_lanczos3());
     int resize_method;
     if (params.method.isSet())
       resize_method = (int)params.method();
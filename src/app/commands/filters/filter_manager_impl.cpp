@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,7 @@
 #include "app/ini_file.h"
 #include "app/modules/palettes.h"
 #include "app/site.h"
+#include "app/trace.h"
 #include "app/transaction.h"
 #include "app/ui/color_bar.h"
 #include "app/ui/editor/editor.h"
@@ -204,6 +205,7 @@ bool FilterManagerImpl::applyStep()
 
 void FilterManagerImpl::apply()
 {
+  TraceZone zone("FilterManager::apply", m_filter->getName());
   CommandResult result;
   bool cancelled = false;
 
@@ -269,6 +271,7 @@ void FilterManagerImpl::apply()
 
 void FilterManagerImpl::applyToTarget()
 {
+  TraceZone zone("FilterManager::applyToTarget", m_filter->getName());
   applyToPaletteIfNeeded();
 
   const bool paletteChange = paletteHasChanged();
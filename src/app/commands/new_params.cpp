@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -99,6 +99,12 @@ void Param<doc::algorithm::ResizeMethod>::fromString(const std::string& value)
     setValue(doc::algorithm::RESIZE_METHOD_BILINEAR);
   else if (base::utf8_icmp(value, "rotsprite") == 0)
     setValue(doc::algorithm::RESIZE_METHOD_ROTSPRITE);
+  else if (base::utf8_icmp(value, "area") == 0 ||
+           base::utf8_icmp(value, "box") == 0)
+    setValue(doc::algorithm::RESIZE_METHOD_AREA_AVERAGE);
+  else if (base::utf8_icmp(value, "lanczos3") == 0 ||
+           base::utf8_icmp(value, "lanczos") == 0)
+    setValue(doc::algorithm::RESIZE_METHOD_LANCZOS3);
   else
     setValue(doc::algorithm::ResizeMethod::RESIZE_METHOD_NEAREST_NEIGHBOR);
 }
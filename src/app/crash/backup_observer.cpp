@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -27,6 +27,7 @@
 #include "app/doc_access.h"
 #include "app/doc_diff.h"
 #include "app/pref/preferences.h"
+#include "app/trace.h"
 #include "base/chrono.h"
 #include "base/remove_from_container.h"
 #include "base/thread.h"
@@ -189,6 +190,8 @@ bool BackupObserver::saveDocData(Doc* doc)
     if (!doc->needsBackup())
       return true;
 
+    TraceZone zone("Backup document", doc->filename());
+
     if (doc->inhibitBackup()) {
       RECO_TRACE("RECO: Document '%d' backup is temporarily inhibited\n", doc->id());
     }
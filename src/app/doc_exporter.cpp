@@ -20,7 +20,10 @@
 #include "app/filename_formatter.h"
 #include "app/restore_visible_layers.h"
 #include "app/snap_to_grid.h"
+#include "app/trace.h"
 #include "app/util/autocrop.h"
+#include "app/util/rects_packer.h"
+#include "base/chrono.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
@@ -39,7 +42,6 @@
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "doc/tag.h"
-#include "gfx/packing_rects.h"
 #include "gfx/rect_io.h"
 #include "gfx/size.h"
 #include "render/dithering.h"
@@ -48,6 +50,7 @@
 #include "ver/info.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <fstream>
 #include <iomanip>
@@ -88,6 +91,21 @@ std::ostream& operator<<(std::ostream& os, const doc::UserData& data)
   return os;
 }
 
+// Clips the destination area of "clip" to the "dst" image bounds
+// (the source area is moved in the same way). Returns false if
+// there is nothing to draw.
+bool clip_to_image(const doc::Image* dst, gfx::Clip& clip)
+{
+  const gfx::Rect bounds = (clip.dstBounds() & dst->bounds());
+  if (bounds.isEmpty())
+    return false;
+
+  clip.src += bounds.origin() - clip.dst;
+  clip.dst = bounds.origin();
+  clip.size = bounds.size();
+  return true;
+}
+
 } // anonymous namespace
 
 namespace app {
@@ -288,6 +306,9 @@ public:
       for (int j=0; j<3; ++j) {
         for (int i=0; i<3; ++i) {
           gfx::Clip clip(x+dx[i], y+dy[j], gfx::RectT<int>(srcx[i], srcy[j], szx[i], szy[j]));
+          if (!clip_to_image(dst, clip))
+            continue;
+
           if (m_image) {
             dst->copy(m_image.get(), clip);
           }
@@ -299,6 +320,9 @@ public:
     }
     else {
       gfx::Clip clip(x, y, m_trimmedBounds);
+      if (!clip_to_image(dst, clip))
+        return;
+
       if (m_image) {
         dst->copy(m_image.get(), clip);
       }
@@ -353,6 +377,43 @@ private:
   List m_samples;
 };
 
+// Renders the rows of the texture that are requested by the encoder
+// (only samples that intersect those rows are rendered).
+class DocExporter::TextureRowsRenderer : public FileRowsRenderer {
+public:
+  TextureRowsRenderer(const Samples& samples,
+                      const int innerPadding,
+                      const bool extrude)
+    : m_samples(samples)
+    , m_innerPadding(innerPadding)
+    , m_extrude(extrude) {
+  }
+
+  void renderRows(const gfx::Rect& bounds,
+                  doc::Image* dst) override {
+    dst->clear(dst->maskColor());
+
+    for (const auto& sample : m_samples) {
+      if (sample.isLinked() ||
+          sample.isDuplicated() ||
+          sample.isEmpty() ||
+          !sample.inTextureBounds().intersects(bounds))
+        continue;
+
+      sample.renderSample(
+        dst,
+        sample.inTextureBounds().x+m_innerPadding-bounds.x,
+        sample.inTextureBounds().y+m_innerPadding-bounds.y,
+        m_extrude);
+    }
+  }
+
+private:
+  const Samples& m_samples;
+  const int m_innerPadding;
+  const bool m_extrude;
+};
+
 class DocExporter::LayoutSamples {
 public:
   virtual ~LayoutSamples() { }
@@ -533,7 +594,7 @@ public:
                      int shapePadding,
                      int& width, int& height,
                      base::task_token& token) override {
-    gfx::PackingRects pr(borderPadding, shapePadding);
+    RectsPacker pr(borderPadding, shapePadding);
     doc::ImagesMap duplicates;
 
     uint32_t i = 0;
@@ -625,6 +686,8 @@ void DocExporter::reset()
   m_listLayers = false;
   m_listLayerHierarchy = false;
   m_listSlices = false;
+  m_streamTexture = false;
+  m_packingTime = 0.0;
   m_documents.clear();
 }
 
@@ -635,6 +698,8 @@ void DocExporter::setDocImageBuffer(const doc::ImageBufferPtr& docBuf)
 
 Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
 {
+  TraceZone zone("DocExporter::exportSheet", m_textureFilename);
+
   // We output the metadata to std::cout if the user didn't specify a file.
   std::ofstream fos;
   std::streambuf* osbuf = nullptr;
@@ -692,10 +757,29 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   token.set_progress(0.6f);
 
   Sprite* texture = textureDocument->sprite();
-  Image* textureImage = texture->root()->firstLayer()
-    ->cel(frame_t(0))->image();
 
-  renderTexture(ctx, samples, textureImage, token);
+  // A streamed texture is rendered by bands when it's saved, here
+  // we just prepare the samples to be rendered.
+  const bool streamTexture = (m_streamTexture &&
+                              !m_textureFilename.empty());
+  if (streamTexture) {
+    for (const auto& sample : samples) {
+      if (token.canceled())
+        return nullptr;
+
+      if (!sample.isLinked() &&
+          !sample.isDuplicated() &&
+          !sample.isEmpty()) {
+        makeSampleCompatible(ctx, sample, texture->pixelFormat());
+      }
+    }
+  }
+  else {
+    Image* textureImage = texture->root()->firstLayer()
+      ->cel(frame_t(0))->image();
+
+    renderTexture(ctx, samples, textureImage, token);
+  }
   if (token.canceled())
     return nullptr;
   token.set_progress(0.8f);
@@ -714,7 +798,9 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   if (!m_textureFilename.empty()) {
     DX_TRACE("DX: exportSheet", m_textureFilename);
     textureDocument->setFilename(m_textureFilename.c_str());
-    int ret = save_document(ctx, textureDocument.get());
+    int ret = (streamTexture ?
+               saveStreamedTexture(ctx, samples, textureDocument.get(), token):
+               save_document(ctx, textureDocument.get()));
     if (ret == 0)
       textureDocument->markAsSaved();
   }
@@ -1115,10 +1201,12 @@ void DocExporter::layoutSamples(Samples& samples,
 
   switch (m_sheetType) {
     case SpriteSheetType::Packed: {
+      base::Chrono chrono;
       BestFitLayoutSamples layout;
       layout.layoutSamples(
         samples, m_borderPadding, m_shapePadding,
         width, height, token);
+      m_packingTime = chrono.elapsed();
       break;
     }
     default: {
@@ -1247,15 +1335,26 @@ Doc* DocExporter::createEmptyTexture(const Samples& samples,
   if (token.canceled())
     return nullptr;
 
-  std::unique_ptr<Sprite> sprite(
-    Sprite::MakeStdSprite(
-      ImageSpec(colorMode,
-                std::max(textureSize.w, m_textureWidth),
-                std::max(textureSize.h, m_textureHeight),
-                transparentColor,
-                (colorSpace ? colorSpace: gfx::ColorSpace::MakeNone())),
-      maxColors,
-      m_docBuf));
+  const ImageSpec spec(colorMode,
+                       std::max(textureSize.w, m_textureWidth),
+                       std::max(textureSize.h, m_textureHeight),
+                       transparentColor,
+                       (colorSpace ? colorSpace: gfx::ColorSpace::MakeNone()));
+  std::unique_ptr<Sprite> sprite;
+
+  // The pixels of a streamed texture are never stored in the sprite
+  // (only in the saved file), so we create a layer without cels.
+  if (m_streamTexture && !m_textureFilename.empty()) {
+    sprite = std::make_unique<Sprite>(spec, maxColors);
+    sprite->setTotalFrames(frame_t(1));
+
+    auto layer = new LayerImage(sprite.get());
+    layer->setName("Layer 1");
+    sprite->root()->addLayer(layer);
+  }
+  else {
+    sprite.reset(Sprite::MakeStdSprite(spec, maxColors, m_docBuf));
+  }
 
   if (palette.size() > 0)
     sprite->setPalette(&palette, false);
@@ -1266,6 +1365,30 @@ Doc* DocExporter::createEmptyTexture(const Samples& samples,
   return document.release();
 }
 
+// Makes the sprite compatible with the texture so the render()
+// works correctly.
+void DocExporter::makeSampleCompatible(Context* ctx,
+                                       const Sample& sample,
+                                       const doc::PixelFormat pixelFormat) const
+{
+  if (sample.sprite()->pixelFormat() == pixelFormat)
+    return;
+
+  RgbMapAlgorithm rgbmapAlgo =
+    Preferences::instance().quantization.rgbmapAlgorithm();
+  FitCriteria fc =
+    Preferences::instance().quantization.fitCriteria();
+  cmd::SetPixelFormat(
+    sample.sprite(),
+    pixelFormat,
+    render::Dithering(),
+    rgbmapAlgo,
+    nullptr, // toGray is not needed because the texture is Indexed or RGB
+    nullptr, // TODO add a delegate to show progress
+    fc)
+    .execute(ctx);
+}
+
 void DocExporter::renderTexture(Context* ctx,
                                 const Samples& samples,
                                 Image* textureImage,
@@ -1286,23 +1409,7 @@ void DocExporter::renderTexture(Context* ctx,
       continue;
     }
 
-    // Make the sprite compatible with the texture so the render()
-    // works correctly.
-    if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
-      RgbMapAlgorithm rgbmapAlgo =
-        Preferences::instance().quantization.rgbmapAlgorithm();
-      FitCriteria fc =
-        Preferences::instance().quantization.fitCriteria();
-      cmd::SetPixelFormat(
-        sample.sprite(),
-        textureImage->pixelFormat(),
-        render::Dithering(),
-        rgbmapAlgo,
-        nullptr, // toGray is not needed because the texture is Indexed or RGB
-        nullptr, // TODO add a delegate to show progress
-        fc)
-        .execute(ctx);
-    }
+    makeSampleCompatible(ctx, sample, textureImage->pixelFormat());
 
     sample.renderSample(
       textureImage,
@@ -1313,6 +1420,52 @@ void DocExporter::renderTexture(Context* ctx,
   }
 }
 
+// Saves the texture rendering it by bands of rows (e.g. for PNG
+// files), or rendering the whole texture if the file format
+// doesn't support it.
+int DocExporter::saveStreamedTexture(Context* ctx,
+                                     const Samples& samples,
+                                     Doc* textureDocument,
+                                     base::task_token& token) const
+{
+  // Approximated size in bytes of each band of rows
+  const int kBandBytes = 16*1024*1024;
+
+  Sprite* texture = textureDocument->sprite();
+  std::unique_ptr<FileOp> fop(
+    FileOp::createSaveDocumentOperation(
+      ctx,
+      FileOpROI(textureDocument, texture->bounds(),
+                "", "", FramesSequence(), false),
+      textureDocument->filename(), "",
+      false));
+  if (!fop)
+    return -1;
+
+  TextureRowsRenderer rowsRenderer(samples, m_innerPadding, m_extrude);
+  const int bandHeight =
+    std::max(1, kBandBytes / std::max(1, texture->spec().widthBytes()));
+
+  if (!fop->setRowsRenderer(&rowsRenderer, bandHeight)) {
+    ImageRef textureImage(Image::create(texture->spec(), m_docBuf));
+    renderTexture(ctx, samples, textureImage.get(), token);
+
+    auto layer = static_cast<LayerImage*>(texture->root()->firstLayer());
+    layer->addCel(new Cel(frame_t(0), textureImage));
+  }
+
+  // Operate in this same thread
+  fop->operate();
+  fop->done();
+
+  if (fop->hasError()) {
+    Console console(ctx);
+    console.printf(fop->error().c_str());
+  }
+
+  return (!fop->hasError() ? 0: -1);
+}
+
 void DocExporter::trimTexture(const Samples& samples,
                               doc::Sprite* texture) const
 {
@@ -1440,6 +1593,26 @@ void DocExporter::createDataFile(const Samples& samples,
      << "\"h\": " << texture->height() << " },\n"
      << "  \"scale\": \"1\"";
 
+  // meta.packing (ratio of the texture used by samples, and time in
+  // milliseconds to pack them)
+  if (m_sheetType == SpriteSheetType::Packed) {
+    int64_t samplesArea = 0;
+    for (const auto& sample : samples) {
+      if (sample.isLinked() ||
+          sample.isDuplicated() ||
+          sample.isEmpty())
+        continue;
+
+      samplesArea += int64_t(sample.trimmedBounds().w) * sample.trimmedBounds().h;
+    }
+
+    const double textureArea = double(texture->width()) * texture->height();
+    os << ",\n"
+       << "  \"packing\": { "
+       << "\"efficiency\": " << std::round(10000.0 * samplesArea / textureArea) / 10000.0 << ", "
+       << "\"time\": " << int(1000.0 * m_packingTime) << " }";
+  }
+
   // meta.frameTags
   if (m_listTags) {
     os << ",\n"
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,7 @@
 #include "doc/image_buffer.h"
 #include "doc/object_id.h"
 #include "doc/object_version.h"
+#include "doc/pixel_format.h"
 #include "gfx/fwd.h"
 #include "gfx/rect.h"
 
@@ -80,6 +81,12 @@ namespace app {
     void setListLayerHierarchy(bool value) { m_listLayerHierarchy = value; }
     void setListSlices(bool value) { m_listSlices = value; }
 
+    // Renders and saves the texture by bands of rows when the file
+    // format supports it (e.g. PNG files), so huge textures don't
+    // need to be in memory. In this case the document returned by
+    // exportSheet() doesn't contain the texture pixels.
+    void setStreamTexture(bool stream) { m_streamTexture = stream; }
+
     void addImage(
       Doc* doc,
       const doc::ImageRef& image);
@@ -106,6 +113,7 @@ namespace app {
     class LayoutSamples;
     class SimpleLayoutSamples;
     class BestFitLayoutSamples;
+    class TextureRowsRenderer;
 
     void addDocument(
       Doc* doc,
@@ -121,10 +129,17 @@ namespace app {
                                  base::task_token& token) const;
     Doc* createEmptyTexture(const Samples& samples,
                             base::task_token& token) const;
+    void makeSampleCompatible(Context* ctx,
+                              const Sample& sample,
+                              const doc::PixelFormat pixelFormat) const;
     void renderTexture(Context* ctx,
                        const Samples& samples,
                        doc::Image* textureImage,
                        base::task_token& token) const;
+    int saveStreamedTexture(Context* ctx,
+                            const Samples& samples,
+                            Doc* textureDocument,
+                            base::task_token& token) const;
     void trimTexture(const Samples& samples, doc::Sprite* texture) const;
     void createDataFile(const Samples& samples, std::ostream& os, doc::Sprite* texture);
 
@@ -183,8 +198,12 @@ namespace app {
     bool m_listLayers;
     bool m_listLayerHierarchy;
     bool m_listSlices;
+    bool m_streamTexture;
     Items m_documents;
 
+    // Seconds used to layout the samples of a packed sprite sheet
+    double m_packingTime;
+
     // Buffers used
     doc::ImageBufferPtr m_docBuf;
     doc::ImageBufferPtr m_sampleBuf;
@@ -20,11 +20,13 @@
 #include "app/load_matrix.h"
 #include "app/pref/preferences.h"
 #include "app/resource_finder.h"
+#include "app/startup_trace.h"
 #include "base/exception.h"
 #include "base/file_content.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
+#include "base/time.h"
 #include "render/dithering_matrix.h"
 #include "ui/widget.h"
 
@@ -59,6 +61,7 @@ namespace {
 const char* kPackageJson = "package.json";
 const char* kInfoJson = "__info.json";
 const char* kPrefLua = "__pref.lua";
+const char* kExtensionsIndexJson = "extensions-index.json";
 
 class ReadArchive {
 public:
@@ -202,6 +205,83 @@ void write_json_file(const std::string& path, const json11::Json& json)
   out.write(text.c_str(), text.size());
 }
 
+// Index with the content of all package.json files (and their
+// size/modification time to validate the cached data), so we can
+// avoid reading/parsing all the package.json files of each extension
+// directory on startup.
+class PackagesIndex {
+public:
+  PackagesIndex(const std::string& filename)
+    : m_filename(filename) {
+    if (m_filename.empty() || !base::is_file(m_filename))
+      return;
+    try {
+      json11::Json json;
+      read_json_file(m_filename, json);
+      m_oldPackages = json["packages"].object_items();
+    }
+    catch (const std::exception& ex) {
+      LOG(ERROR, "EXT: Error loading extensions index %s: %s\n",
+          m_filename.c_str(), ex.what());
+    }
+  }
+
+  ~PackagesIndex() {
+    // Save the index only if something has changed (a package.json
+    // was added/removed/modified)
+    if (m_filename.empty() ||
+        (!m_modified && m_newPackages.size() == m_oldPackages.size()))
+      return;
+    try {
+      json11::Json::object obj;
+      obj["packages"] = json11::Json(m_newPackages);
+      write_json_file(m_filename, json11::Json(obj));
+    }
+    catch (const std::exception& ex) {
+      LOG(ERROR, "EXT: Error saving extensions index %s: %s\n",
+          m_filename.c_str(), ex.what());
+    }
+  }
+
+  // Returns the content of the given package.json file, it's read
+  // from the disk only if it's not in the index or it was modified.
+  json11::Json get(const std::string& packageFn) {
+    const json11::Json stamp = fileStamp(packageFn);
+
+    json11::Json package;
+    auto it = m_oldPackages.find(packageFn);
+    if (it != m_oldPackages.end() &&
+        it->second["stamp"] == stamp) {
+      package = it->second["package"];
+    }
+    else {
+      read_json_file(packageFn, package);
+      m_modified = true;
+    }
+
+    m_newPackages[packageFn] = json11::Json::object{
+      { "stamp", stamp },
+      { "package", package }
+    };
+    return package;
+  }
+
+private:
+  static json11::Json fileStamp(const std::string& fn) {
+    const base::Time t = base::get_modification_time(fn);
+    return json11::Json::array{
+      double(base::file_size(fn)),
+      t.year, t.month, t.day,
+      t.hour, t.minute, t.second
+    };
+  }
+
+  std::string m_filename;
+  json11::Json::object m_oldPackages;
+  json11::Json::object m_newPackages;
+  bool m_modified = false;
+};
+
 } // anonymous namespace
 
 //////////////////////////////////////////////////////////////////////
@@ -791,6 +871,8 @@ void Extension::addScript(const std::string& fn)
 
 Extensions::Extensions()
 {
+  StartupTrace::Phase phase("Extensions");
+
   // Create and get the user extensions directory
   {
     ResourceFinder rf2;
@@ -804,6 +886,12 @@ Extensions::Extensions()
     LOG("EXT: User extensions path '%s'\n", m_userExtensionsPath.c_str());
   }
 
+  // The index is saved next to the user extensions directory
+  PackagesIndex index(
+    m_userExtensionsPath.empty() ? std::string():
+    base::join_path(base::get_file_path(m_userExtensionsPath),
+                    kExtensionsIndexJson));
+
   ResourceFinder rf;
   rf.includeUserDir("extensions");
   rf.includeDataDir("extensions");
@@ -831,7 +919,7 @@ Extensions::Extensions()
       }
 
       try {
-        loadExtension(dir, fullFn, isBuiltinExtension);
+        loadExtensionFromJson(dir, index.get(fullFn), isBuiltinExtension);
       }
       catch (const std::exception& ex) {
         LOG("EXT: Error loading JSON file: %s\n",
@@ -1110,6 +1198,13 @@ Extension* Extensions::loadExtension(const std::string& path,
 {
   json11::Json json;
   read_json_file(fullPackageFilename, json);
+  return loadExtensionFromJson(path, json, isBuiltinExtension);
+}
+
+Extension* Extensions::loadExtensionFromJson(const std::string& path,
+                                             const json11::Json& json,
+                                             const bool isBuiltinExtension)
+{
   auto name = json["name"].string_value();
   auto version = json["version"].string_value();
   auto displayName = json["displayName"].string_value();
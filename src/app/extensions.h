@@ -17,6 +17,10 @@
 #include <string>
 #include <vector>
 
+namespace json11 {
+  class Json;
+}
+
 namespace ui {
   class Widget;
 }
@@ -242,6 +246,9 @@ namespace app {
     Extension* loadExtension(const std::string& path,
                              const std::string& fullPackageFilename,
                              const bool isBuiltinExtension);
+    Extension* loadExtensionFromJson(const std::string& path,
+                                     const json11::Json& json,
+                                     const bool isBuiltinExtension);
     void generateExtensionSignals(Extension* extension);
 
     List m_extensions;
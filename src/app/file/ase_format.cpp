@@ -281,7 +281,7 @@ FileFormat* CreateAseFormat()
 bool AseFormat::onLoad(FileOp* fop)
 {
   FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
-  dio::StdioFileInterface fileInterface(handle.get());
+  dio::MappedFileInterface fileInterface(handle.get());
 
   DecodeDelegate delegate(fop);
   dio::AsepriteDecoder decoder;
@@ -27,6 +27,7 @@
 #include "app/modules/gui.h"
 #include "app/modules/palettes.h"
 #include "app/pref/preferences.h"
+#include "app/trace.h"
 #include "app/tx.h"
 #include "app/ui/incompat_file_window.h"
 #include "app/ui/optional_alert.h"
@@ -48,8 +49,12 @@
 #include "open_sequence.xml.h"
 
 #include <algorithm>
+#include <condition_variable>
 #include <cstring>
 #include <cstdarg>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace app {
 
@@ -145,6 +150,14 @@ public:
   }
 
   const uint8_t* getScanline(int y) const override {
+    if (m_rowsRenderer) {
+      if (!m_band ||
+          y < m_bandY ||
+          y >= m_bandY + m_band->height()) {
+        renderBand(y);
+      }
+      return m_band->getPixelAddress(0, y - m_bandY);
+    }
     return m_tmpScaledImage->getPixelAddress(0, y);
   }
 
@@ -187,11 +200,42 @@ public:
     m_spec.setHeight(m_spec.height() * m_scale.y);
   }
 
-private:
+  const gfx::PointF& scale() const {
+    return m_scale;
+  }
+
   bool needResize() const {
     return (m_scale != gfx::PointF(1.0, 1.0));
   }
 
+  // Each getScanline() will use the band of rows that contains the
+  // requested row, rendered with the given "rowsRenderer" (the
+  // "origin" is the position of this image in the sprite).
+  void setRowsRenderer(FileRowsRenderer* rowsRenderer,
+                       const int bandHeight,
+                       const gfx::Point& origin) {
+    ASSERT(!needResize());
+    m_rowsRenderer = rowsRenderer;
+    m_bandHeight = bandHeight;
+    m_origin = origin;
+  }
+
+private:
+  void renderBand(const int y) const {
+    m_bandY = y - (y % m_bandHeight);
+    const int h = std::min(m_bandHeight, m_spec.height() - m_bandY);
+
+    if (!m_band || m_band->height() != h) {
+      doc::ImageSpec spec = m_spec;
+      spec.setHeight(h);
+      m_band.reset(doc::Image::create(spec));
+    }
+
+    m_rowsRenderer->renderRows(
+      gfx::Rect(m_origin.x, m_origin.y + m_bandY, m_spec.width(), h),
+      m_band.get());
+  }
+
   const Doc* m_doc;
   const doc::Sprite* m_sprite;
   doc::ImageSpec m_spec;
@@ -200,8 +244,101 @@ private:
   doc::ImageRef m_tmpScaledImage = nullptr;
   mutable doc::ImageRef m_tmpUnscaledRender = nullptr;
   gfx::PointF m_scale = gfx::PointF(1.0, 1.0);
+
+  // To render the image to save by bands.
+  FileRowsRenderer* m_rowsRenderer = nullptr;
+  int m_bandHeight = 0;
+  gfx::Point m_origin;
+  mutable doc::ImageRef m_band = nullptr;
+  mutable int m_bandY = 0;
 };
 
+namespace {
+
+// Calls work(i) for each i in [0, n) from "nthreads" threads, and
+// then done(i, result) from the calling thread in order (0, 1,
+// 2...) as soon as each result is ready. When done() returns false,
+// the items that weren't started yet are skipped.
+//
+// Workers don't go more than 2*nthreads items ahead of the last
+// done() call, so if one item is slow (or done() is slow) we don't
+// keep the results of the whole sequence in memory.
+template<typename Result, typename Work, typename Done>
+void for_each_in_order(const int n, const int nthreads,
+                       Work&& work, Done&& done)
+{
+  if (nthreads <= 1) {
+    for (int i=0; i<n; ++i) {
+      Result result = work(i);
+      if (!done(i, result))
+        break;
+    }
+    return;
+  }
+
+  const int window = 2*nthreads;
+  std::vector<Result> results(n);
+  std::vector<bool> ready(n, false);
+  std::mutex mutex;
+  std::condition_variable readyCV;  // A result is ready
+  std::condition_variable windowCV; // A result was consumed by done()
+  int next = 0;                     // Next item to start
+  int consumed = 0;                 // Items already passed to done()
+  bool cancel = false;
+
+  std::vector<std::thread> threads;
+  threads.reserve(nthreads);
+  for (int t=0; t<nthreads; ++t) {
+    threads.emplace_back([&]{
+      while (true) {
+        int i;
+        {
+          std::unique_lock lock(mutex);
+          windowCV.wait(lock, [&]{
+            return (cancel || next >= n || next < consumed + window);
+          });
+          if (cancel || next >= n)
+            break;
+          i = next++;
+        }
+
+        Result result = work(i);
+        {
+          const std::lock_guard lock(mutex);
+          results[i] = std::move(result);
+          ready[i] = true;
+        }
+        readyCV.notify_all();
+      }
+    });
+  }
+
+  for (int i=0; i<n; ++i) {
+    Result result;
+    {
+      std::unique_lock lock(mutex);
+      readyCV.wait(lock, [&]{ return ready[i]; });
+      result = std::move(results[i]);
+      consumed = i+1;
+    }
+    windowCV.notify_all();
+
+    if (!done(i, result)) {
+      {
+        const std::lock_guard lock(mutex);
+        cancel = true;
+      }
+      windowCV.notify_all();
+      break;
+    }
+  }
+
+  for (auto& thread : threads)
+    thread.join();
+}
+
+} // anonymous namespace
+
 base::paths get_readable_extensions()
 {
   base::paths paths;
@@ -838,123 +975,11 @@ void FileOp::operate(IFileOpProgress* progress)
   if (m_type == FileOpLoad &&
       m_format != NULL &&
       m_format->support(FILE_SUPPORT_LOAD)) {
+    TraceZone zone("FileOp load", m_filename);
+
     // Load a sequence
     if (isSequence()) {
-      // Default palette
-      m_seq.palette->makeBlack();
-
-      // Load the sequence
-      frame_t frames(m_seq.filename_list.size());
-      frame_t frame(0);
-      Image* old_image = nullptr;
-      gfx::Size canvasSize(0, 0);
-
-      // TODO setPalette for each frame???
-      auto add_image = [&]() {
-        canvasSize |= m_seq.image->size();
-
-        m_seq.last_cel->data()->setImage(m_seq.image,
-                                         m_seq.layer);
-        m_seq.layer->addCel(m_seq.last_cel);
-
-        if (m_document->sprite()->palette(frame)
-            ->countDiff(m_seq.palette, NULL, NULL) > 0) {
-          m_seq.palette->setFrame(frame);
-          m_document->sprite()->setPalette(m_seq.palette, true);
-        }
-
-        old_image = m_seq.image.get();
-        m_seq.image.reset();
-        m_seq.last_cel = NULL;
-      };
-
-      m_seq.has_alpha = false;
-      m_seq.progress_offset = 0.0f;
-      m_seq.progress_fraction = 1.0f / (double)frames;
-
-      auto it = m_seq.filename_list.begin(),
-           end = m_seq.filename_list.end();
-      for (; it != end; ++it) {
-        m_filename = it->c_str();
-
-        // Call the "load" procedure to read the first bitmap.
-        bool loadres = m_format->load(this);
-        if (!loadres) {
-          setError("Error loading frame %d from file \"%s\"\n",
-                   frame+1, m_filename.c_str());
-        }
-
-        // For the first frame...
-        if (!old_image) {
-          // Error reading the first frame
-          if (!loadres || !m_document || !m_seq.last_cel) {
-            m_seq.image.reset();
-            delete m_seq.last_cel;
-            delete m_document;
-            m_document = nullptr;
-            break;
-          }
-          // Read ok
-          else {
-            // Add the keyframe
-            add_image();
-          }
-        }
-        // For other frames
-        else {
-          // All done (or maybe not enough memory)
-          if (!loadres || !m_seq.last_cel) {
-            m_seq.image.reset();
-            delete m_seq.last_cel;
-            break;
-          }
-
-          // Compare the old frame with the new one
-#if USE_LINK // TODO this should be configurable through a check-box
-          if (count_diff_between_images(old_image, m_seq.image)) {
-            add_image();
-          }
-          // We don't need this image
-          else {
-            m_seq.image.reset();
-
-            // But add a link frame
-            m_seq.last_cel->image = image_index;
-            layer_add_frame(m_seq.layer, m_seq.last_cel);
-
-            m_seq.last_image = NULL;
-            m_seq.last_cel = NULL;
-          }
-#else
-          add_image();
-#endif
-        }
-
-        m_document->sprite()->setFrameDuration(frame, m_seq.duration);
-
-        ++frame;
-        m_seq.progress_offset += m_seq.progress_fraction;
-      }
-      m_filename = *m_seq.filename_list.begin();
-
-      // Final setup
-      if (m_document) {
-        // Configure the layer as the 'Background'
-        if (!m_seq.has_alpha)
-          m_seq.layer->configureAsBackground();
-
-        // Set the final canvas size (as the bigger loaded
-        // frame/image).
-        m_document->sprite()->setSize(canvasSize.w,
-                                      canvasSize.h);
-
-        // Set the frames range
-        m_document->sprite()->setTotalFrames(frame);
-
-        // Sets special options from the specific format (e.g. BMP
-        // file can contain the number of bits per pixel).
-        m_document->setFormatOptions(m_formatOptions);
-      }
+      loadSequence();
     }
     // Direct load from one file.
     else {
@@ -984,6 +1009,7 @@ void FileOp::operate(IFileOpProgress* progress)
            m_format != NULL &&
            m_format->support(FILE_SUPPORT_SAVE)) {
 #ifdef ENABLE_SAVE
+    TraceZone zone("FileOp save", m_filename);
 
 #if defined(ENABLE_TRIAL_MODE)
     DRM_INVALID{
@@ -1001,72 +1027,7 @@ void FileOp::operate(IFileOpProgress* progress)
     // Save a sequence
     if (isSequence()) {
       ASSERT(m_format->support(FILE_SUPPORT_SEQUENCES));
-
-      Sprite* sprite = m_document->sprite();
-
-      // Create a temporary bitmap
-      m_seq.image.reset(Image::create(sprite->pixelFormat(),
-                                      m_roi.fileCanvasSize().w,
-                                      m_roi.fileCanvasSize().h));
-
-      m_seq.progress_offset = 0.0f;
-      m_seq.progress_fraction = 1.0f / (double)sprite->totalFrames();
-
-      // For each frame in the sprite.
-      render::Render render;
-      render.setNewBlend(m_config.newBlend);
-
-      frame_t outputFrame = 0;
-      for (frame_t frame : m_roi.framesSequence()) {
-        gfx::Rect bounds = m_roi.frameBounds(frame);
-        if (bounds.isEmpty())
-          continue; // Skip frame because there is no slice key
-
-        if (m_abstractImage) {
-          m_abstractImage->setSpecSize(m_roi.fileCanvasSize(),
-                                       bounds.size());
-        }
-
-        // Render the (unscaled) sequenced image.
-        render.renderSprite(
-          m_seq.image.get(), sprite, frame,
-          gfx::Clip(gfx::Point(0, 0), bounds));
-
-        bool save = true;
-
-        // Check if we have to ignore empty frames
-        if (m_ignoreEmpty &&
-            !sprite->isOpaque() &&
-            doc::is_empty_image(m_seq.image.get())) {
-          save = false;
-        }
-
-        if (save) {
-          // Setup the palette.
-          sprite->palette(frame)->copyColorsTo(m_seq.palette);
-
-          // Setup the filename to be used.
-          m_filename = m_seq.filename_list[outputFrame];
-
-          // Make directories
-          makeDirectories();
-
-          // Call the "save" procedure... did it fail?
-          if (!m_format->save(this)) {
-            setError("Error saving frame %d in the file \"%s\"\n",
-                     outputFrame+1, m_filename.c_str());
-            break;
-          }
-        }
-
-        m_seq.progress_offset += m_seq.progress_fraction;
-        ++outputFrame;
-      }
-
-      m_filename = *m_seq.filename_list.begin();
-
-      // Destroy the image
-      m_seq.image.reset();
+      saveSequence();
     }
     // Direct save to a file.
     else {
@@ -1108,6 +1069,277 @@ void FileOp::operate(IFileOpProgress* progress)
   setProgress(1.0f);
 }
 
+// Loads all the files of the sequence. Each file is decoded in its
+// own FileOp (with a temporary document) so several files can be
+// decoded at the same time, but frames and palettes are added to the
+// final sprite in order from this thread.
+void FileOp::loadSequence()
+{
+  struct Item {
+    std::unique_ptr<FileOp> fop;
+    bool loaded = false;
+
+    Item() = default;
+    Item(Item&&) = default;
+    Item& operator=(Item&&) = default;
+    ~Item() {
+      // Delete the temporary document and the cel that weren't used
+      if (fop) {
+        delete fop->m_seq.last_cel;
+        delete fop->releaseDocument();
+      }
+    }
+  };
+
+  // Default palette
+  m_seq.palette->makeBlack();
+
+  const frame_t frames(m_seq.filename_list.size());
+  frame_t frame(0);
+  gfx::Size canvasSize(0, 0);
+
+  m_seq.has_alpha = false;
+  m_seq.progress_offset = 0.0f;
+  m_seq.progress_fraction = 1.0f / (double)frames;
+
+  for_each_in_order<Item>(
+    frames, sequenceThreads(frames),
+    // Decode one file (from a worker thread)
+    [this](const int i) -> Item {
+      Item item;
+      if (isStop())
+        return item;
+
+      item.fop.reset(createSequenceItemOperation(m_seq.filename_list[i]));
+      item.fop->m_seq.frame = i;
+      try {
+        item.loaded = m_format->load(item.fop.get());
+      }
+      catch (const std::exception& ex) {
+        item.fop->setError("%s", ex.what());
+      }
+      return item;
+    },
+    // Add the decoded image as a new frame
+    [&](const int, Item& item) -> bool {
+      FileOp* fop = item.fop.get();
+      if (!fop)                 // Stopped
+        return false;
+
+      if (fop->hasError())
+        setError("%s", fop->error().c_str());
+
+      if (!item.loaded) {
+        setError("Error loading frame %d from file \"%s\"\n",
+                 frame+1, fop->m_filename.c_str());
+        return false;
+      }
+
+      // All done (or maybe not enough memory)
+      if (!fop->m_document || !fop->m_seq.last_cel)
+        return false;
+
+      // The first frame creates the final document
+      if (!m_document) {
+        m_document = fop->releaseDocument();
+        m_seq.layer = fop->m_seq.layer;
+      }
+      else if (fop->m_document->sprite()->pixelFormat() !=
+               m_document->sprite()->pixelFormat()) {
+        setError("Error: image does not match color mode\n");
+        return false;
+      }
+
+      m_seq.image = fop->m_seq.image;
+      m_seq.last_cel = fop->m_seq.last_cel;
+      fop->m_seq.last_cel = nullptr;
+      fop->m_seq.palette->copyColorsTo(m_seq.palette);
+      if (fop->m_seq.has_alpha)
+        m_seq.has_alpha = true;
+      if (fop->m_formatOptions)
+        setLoadedFormatOptions(fop->m_formatOptions);
+      if (fop->m_embeddedColorProfile)
+        m_embeddedColorProfile = true;
+
+      canvasSize |= m_seq.image->size();
+
+      m_seq.last_cel->data()->setImage(m_seq.image,
+                                       m_seq.layer);
+      m_seq.layer->addCel(m_seq.last_cel);
+
+      // TODO setPalette for each frame???
+      if (m_document->sprite()->palette(frame)
+          ->countDiff(m_seq.palette, NULL, NULL) > 0) {
+        m_seq.palette->setFrame(frame);
+        m_document->sprite()->setPalette(m_seq.palette, true);
+      }
+
+      m_seq.image.reset();
+      m_seq.last_cel = nullptr;
+
+      m_document->sprite()->setFrameDuration(frame, m_seq.duration);
+
+      ++frame;
+      m_seq.progress_offset += m_seq.progress_fraction;
+      setProgress(0.0);
+      return true;
+    });
+
+  m_filename = *m_seq.filename_list.begin();
+
+  // Final setup
+  if (m_document) {
+    // Configure the layer as the 'Background'
+    if (!m_seq.has_alpha)
+      m_seq.layer->configureAsBackground();
+
+    // Set the final canvas size (as the bigger loaded
+    // frame/image).
+    m_document->sprite()->setSize(canvasSize.w,
+                                  canvasSize.h);
+
+    // Set the frames range
+    m_document->sprite()->setTotalFrames(frame);
+
+    // Sets special options from the specific format (e.g. BMP
+    // file can contain the number of bits per pixel).
+    m_document->setFormatOptions(m_formatOptions);
+  }
+}
+
+// Saves each frame of the sprite in its own file. Frames are
+// rendered and encoded from worker threads (each one with its own
+// FileOp), and errors are reported in order.
+void FileOp::saveSequence()
+{
+  struct Result {
+    bool stopped = false;
+    bool saved = true;
+    std::string error;
+  };
+
+  const Sprite* sprite = m_document->sprite();
+
+  // Frames to save with the index of their output file (frames
+  // without a slice key are skipped).
+  std::vector<std::pair<frame_t, int>> items;
+  for (frame_t frame : m_roi.framesSequence()) {
+    if (!m_roi.frameBounds(frame).isEmpty())
+      items.push_back(std::make_pair(frame, int(items.size())));
+  }
+  if (items.empty())
+    return;
+
+  // Make directories from this thread (it's not safe to create the
+  // same directory from different threads at the same time)
+  std::string lastDir;
+  for (const auto& item : items) {
+    m_filename = m_seq.filename_list[item.second];
+    std::string dir = base::get_file_path(m_filename);
+    if (dir != lastDir) {
+      makeDirectories();
+      lastDir = std::move(dir);
+    }
+  }
+
+  m_seq.progress_offset = 0.0f;
+  m_seq.progress_fraction = 1.0f / (double)items.size();
+
+  // Resizing frames on the fly uses the sprite RgbMap, which cannot
+  // be used from several threads.
+  const int nthreads =
+    (m_abstractImage && m_abstractImage->needResize() ?
+     1: sequenceThreads(int(items.size())));
+
+  for_each_in_order<Result>(
+    int(items.size()), nthreads,
+    // Render and encode one frame (from a worker thread)
+    [this, sprite, &items](const int i) -> Result {
+      Result result;
+      if (isStop()) {
+        result.stopped = true;
+        return result;
+      }
+
+      const frame_t frame = items[i].first;
+      const gfx::Rect bounds = m_roi.frameBounds(frame);
+
+      std::unique_ptr<FileOp> fop(
+        createSequenceItemOperation(m_seq.filename_list[items[i].second]));
+      fop->m_document = m_document;
+      fop->m_seq.frame = frame;
+
+      if (m_format->support(FILE_ENCODE_ABSTRACT_IMAGE)) {
+        fop->makeAbstractImage();
+        if (m_abstractImage)
+          fop->m_abstractImage->setScale(m_abstractImage->scale());
+        fop->m_abstractImage->setSpecSize(m_roi.fileCanvasSize(),
+                                          bounds.size());
+      }
+
+      // The encoder will ask for the rows that it needs (so the full
+      // image is never rendered).
+      if (m_rowsRenderer) {
+        fop->m_abstractImage->setRowsRenderer(m_rowsRenderer,
+                                              m_rowsBandHeight,
+                                              bounds.origin());
+      }
+      else {
+        fop->m_seq.image.reset(Image::create(sprite->pixelFormat(),
+                                             m_roi.fileCanvasSize().w,
+                                             m_roi.fileCanvasSize().h));
+
+        // Render the (unscaled) sequenced image.
+        render::Render render;
+        render.setNewBlend(m_config.newBlend);
+        render.renderSprite(
+          fop->m_seq.image.get(), sprite, frame,
+          gfx::Clip(gfx::Point(0, 0), bounds));
+
+        // Check if we have to ignore empty frames
+        if (m_ignoreEmpty &&
+            !sprite->isOpaque() &&
+            doc::is_empty_image(fop->m_seq.image.get())) {
+          return result;
+        }
+      }
+
+      // Setup the palette.
+      sprite->palette(frame)->copyColorsTo(fop->m_seq.palette);
+
+      try {
+        result.saved = m_format->save(fop.get());
+      }
+      catch (const std::exception& ex) {
+        fop->setError("%s", ex.what());
+        result.saved = false;
+      }
+      result.error = fop->error();
+      return result;
+    },
+    // Report errors in order
+    [this, &items](const int i, Result& result) -> bool {
+      if (result.stopped)
+        return false;
+
+      if (!result.error.empty())
+        setError("%s", result.error.c_str());
+
+      if (!result.saved) {
+        setError("Error saving frame %d in the file \"%s\"\n",
+                 items[i].second+1,
+                 m_seq.filename_list[items[i].second].c_str());
+        return false;
+      }
+
+      m_seq.progress_offset += m_seq.progress_fraction;
+      setProgress(0.0);
+      return true;
+    });
+
+  m_filename = *m_seq.filename_list.begin();
+}
+
 // After mark the 'fop' as 'done' you must to free it calling fop_free().
 void FileOp::done()
 {
@@ -1419,6 +1651,25 @@ void FileOp::setOnTheFlyScale(const gfx::PointF& scale)
   m_abstractImage->setScale(scale);
 }
 
+bool FileOp::setRowsRenderer(FileRowsRenderer* rowsRenderer,
+                             const int bandHeight)
+{
+  ASSERT(rowsRenderer);
+  ASSERT(bandHeight > 0);
+
+  if (!m_format ||
+      !m_format->support(FILE_ENCODE_SCANLINES) ||
+      !isSequence() ||
+      m_roi.frames() != 1 ||
+      (m_abstractImage && m_abstractImage->needResize())) {
+    return false;
+  }
+
+  m_rowsRenderer = rowsRenderer;
+  m_rowsBandHeight = std::max(1, bandHeight);
+  return true;
+}
+
 void FileOp::setError(const char *format, ...)
 {
   char buf_error[4096];         // TODO possible stack overflow
@@ -1463,7 +1714,7 @@ void FileOp::setProgress(double progress)
   }
 
   if (m_progressInterface)
-    m_progressInterface->ackFileOpProgress(progress);
+    m_progressInterface->ackFileOpProgress(m_progress);
 }
 
 void FileOp::getFilenameList(base::paths& output) const
@@ -1524,6 +1775,8 @@ FileOp::FileOp(FileOpType type,
   , m_ignoreEmpty(false)
   , m_embeddedColorProfile(false)
   , m_embeddedGridBounds(false)
+  , m_rowsRenderer(nullptr)
+  , m_rowsBandHeight(0)
 {
   if (config)
     m_config = *config;
@@ -1550,6 +1803,35 @@ void FileOp::prepareForSequence()
   m_formatOptions.reset();
 }
 
+// Creates a FileOp to load/save just one file of this sequence. The
+// new FileOp doesn't access the preferences, so it can be used from
+// a worker thread.
+FileOp* FileOp::createSequenceItemOperation(const std::string& filename) const
+{
+  auto fop = new FileOp(m_type, m_context, &m_config);
+  fop->m_format = m_format;
+  fop->m_filename = filename;
+  fop->m_roi = m_roi;
+  fop->m_oneframe = m_oneframe;
+  fop->m_ignoreEmpty = m_ignoreEmpty;
+  fop->m_seq.filename_list.push_back(filename);
+  fop->m_seq.duration = m_seq.duration;
+  fop->m_seq.flags = m_seq.flags;
+  fop->prepareForSequence();
+  fop->m_formatOptions = m_formatOptions;
+  return fop;
+}
+
+// Returns the number of threads to load/save the given number of
+// files of a sequence.
+int FileOp::sequenceThreads(const int items) const
+{
+  int n = m_config.sequenceThreads;
+  if (n <= 0)
+    n = int(std::thread::hardware_concurrency());
+  return std::clamp(n, 1, std::max(1, items));
+}
+
 void FileOp::makeDirectories()
 {
   std::string dir = base::get_file_path(m_filename);
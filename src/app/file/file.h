@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -144,6 +144,19 @@ namespace app {
                              doc::Image* dst) const = 0;
   };
 
+  // Renders the rows of a static image to be saved on demand (see
+  // FileOp::setRowsRenderer()), so the whole image doesn't need to
+  // be in memory at the same time.
+  class FileRowsRenderer {
+  public:
+    virtual ~FileRowsRenderer() { }
+
+    // Must fill all the pixels of "dst" (which has the same size as
+    // "bounds") with the rows of the image inside "bounds".
+    virtual void renderRows(const gfx::Rect& bounds,
+                            doc::Image* dst) = 0;
+  };
+
   // Structure to load & save files.
   //
   // TODO This class do to many things. There should be a previous
@@ -265,6 +278,14 @@ namespace app {
     FileAbstractImage* abstractImageToSave();
     void setOnTheFlyScale(const gfx::PointF& scale);
 
+    // Renders the image to save in bands of "bandHeight" rows
+    // instead of rendering the whole sprite first. It can be used
+    // only to save one frame in a format with the
+    // FILE_ENCODE_SCANLINES flag (and without on the fly scale),
+    // returns false in other case.
+    bool setRowsRenderer(FileRowsRenderer* rowsRenderer,
+                         const int bandHeight);
+
     const std::string& error() const { return m_error; }
     void setError(const char *error, ...);
     bool hasError() const { return !m_error.empty(); }
@@ -326,6 +347,11 @@ namespace app {
     // Options
     FormatOptionsPtr m_formatOptions;
 
+    // Used to render the image to save by bands (instead of
+    // m_seq.image).
+    FileRowsRenderer* m_rowsRenderer;
+    int m_rowsBandHeight;
+
     // Data for sequences.
     struct {
       base::paths filename_list;  // All file names to load/save.
@@ -348,6 +374,10 @@ namespace app {
     std::unique_ptr<FileAbstractImageImpl> m_abstractImage;
 
     void prepareForSequence();
+    FileOp* createSequenceItemOperation(const std::string& filename) const;
+    int sequenceThreads(const int items) const;
+    void loadSequence();
+    void saveSequence();
     void makeAbstractImage();
     void makeDirectories();
   };
@@ -0,0 +1,316 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+// Measures the encoding/decoding throughput of the file formats
+// through FileOp (the same path used to load/save files from the UI
+// and CLI) with synthetic sprites of different sizes, frames,
+// layers, and color modes.
+//
+// The output is JSON by default (use --benchmark_format=console to
+// see a table). Each result includes "bytes_per_second" (uncompressed
+// pixels), "frames_per_second", and the "file_size" in bytes.
+//
+// Formats without encoder (e.g. PSD) can be measured loading
+// existing files with --load=file.psd (the option can be repeated).
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/file/file_format.h"
+#include "app/file/file_formats_manager.h"
+#include "base/fs.h"
+#include "dio/file_format.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "fmt/format.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+struct SpriteParams {
+  int w, h;
+  frame_t frames;
+  int layers;
+  ColorMode colorMode;
+};
+
+const SpriteParams kSprites[] = {
+  { 64,   64,   1,  1, ColorMode::RGB },
+  { 512,  512,  1,  1, ColorMode::RGB },
+  { 2048, 2048, 1,  1, ColorMode::RGB },
+  { 512,  512,  1,  1, ColorMode::GRAYSCALE },
+  { 512,  512,  1,  1, ColorMode::INDEXED },
+  { 256,  256,  32, 1, ColorMode::RGB },
+  { 256,  256,  32, 1, ColorMode::INDEXED },
+  { 256,  256,  8,  8, ColorMode::RGB },
+};
+
+struct FormatParams {
+  const char* ext;
+  dio::FileFormat dioFormat;
+};
+
+const FormatParams kFormats[] = {
+  { "aseprite", dio::FileFormat::ASE_ANIMATION },
+  { "png",      dio::FileFormat::PNG_IMAGE },
+  { "gif",      dio::FileFormat::GIF_ANIMATION },
+  { "webp",     dio::FileFormat::WEBP_ANIMATION },
+  { "qoi",      dio::FileFormat::QOI_IMAGE },
+  { "bmp",      dio::FileFormat::BMP_IMAGE },
+  { "tga",      dio::FileFormat::TARGA_IMAGE },
+};
+
+const char* color_mode_name(const ColorMode colorMode)
+{
+  switch (colorMode) {
+    case ColorMode::RGB: return "rgb";
+    case ColorMode::GRAYSCALE: return "gray";
+    case ColorMode::INDEXED: return "indexed";
+    default: return "unknown";
+  }
+}
+
+bool format_supports(const FileFormat* format, const SpriteParams& p)
+{
+  if (!format->support(FILE_SUPPORT_SAVE))
+    return false;
+  if (p.frames > 1 && !format->support(FILE_SUPPORT_FRAMES))
+    return false;
+  switch (p.colorMode) {
+    case ColorMode::RGB: return (format->support(FILE_SUPPORT_RGB) ||
+                                 format->support(FILE_SUPPORT_RGBA));
+    case ColorMode::GRAYSCALE: return (format->support(FILE_SUPPORT_GRAY) ||
+                                       format->support(FILE_SUPPORT_GRAYA));
+    case ColorMode::INDEXED: return format->support(FILE_SUPPORT_INDEXED);
+    default: return false;
+  }
+}
+
+// Fills the image with something similar to pixel art: flat areas
+// with some noise, so it's not too easy/hard to compress.
+void fill_image(Image* image, const int seed, const int ncolors)
+{
+  uint32_t rnd = 2166136261u ^ seed;
+  for (int y=0; y<image->height(); ++y) {
+    for (int x=0; x<image->width(); ++x) {
+      rnd = rnd*1664525u + 1013904223u;
+      const int v = ((x/8 + y/8 + seed) % 16) * 16 + ((rnd >> 24) & 7);
+      color_t c;
+      switch (image->pixelFormat()) {
+        case IMAGE_RGB:
+          c = rgba(v, (v*3 + seed) & 255, (x ^ y) & 255,
+                   (rnd >> 20) & 1 ? 255: 128);
+          break;
+        case IMAGE_GRAYSCALE:
+          c = graya(v, 255);
+          break;
+        case IMAGE_INDEXED:
+          c = v % ncolors;
+          break;
+        default:
+          c = 0;
+          break;
+      }
+      put_pixel(image, x, y, c);
+    }
+  }
+}
+
+Doc* create_doc(Context* ctx, const SpriteParams& p)
+{
+  Sprite* spr = new Sprite(ImageSpec(p.colorMode, p.w, p.h), 256);
+  spr->setTotalFrames(p.frames);
+
+  Palette pal(frame_t(0), 256);
+  for (int i=0; i<256; ++i)
+    pal.setEntry(i, rgba(i, (i*7) & 255, (i*13) & 255, 255));
+  spr->setPalette(&pal, false);
+
+  for (int i=0; i<p.layers; ++i) {
+    LayerImage* layer = new LayerImage(spr);
+    layer->setName(fmt::format("Layer {}", i+1));
+    spr->root()->addLayer(layer);
+
+    for (frame_t f=0; f<p.frames; ++f) {
+      ImageRef image(Image::create(spr->pixelFormat(), p.w, p.h));
+      fill_image(image.get(), i*1000 + f, pal.size());
+      layer->addCel(new Cel(f, image));
+    }
+  }
+
+  Doc* doc = new Doc(spr);
+  doc->setContext(ctx);
+  return doc;
+}
+
+std::string bench_filename(const char* ext)
+{
+  return fmt::format("_file_benchmark.{}", ext);
+}
+
+void set_counters(benchmark::State& state,
+                  const Sprite* spr,
+                  const std::string& fn)
+{
+  const int64_t frames = state.iterations() * spr->totalFrames();
+  const int64_t bytes =
+    frames * int64_t(spr->root()->layersCount()) *
+    spr->width() * spr->height() * spr->spec().bytesPerPixel();
+
+  state.SetBytesProcessed(bytes);
+  state.counters["frames_per_second"] =
+    benchmark::Counter(double(frames), benchmark::Counter::kIsRate);
+  state.counters["file_size"] = double(base::file_size(fn));
+}
+
+void BM_Save(benchmark::State& state,
+             const char* ext,
+             const SpriteParams p)
+{
+  Context ctx;
+  std::unique_ptr<Doc> doc(create_doc(&ctx, p));
+  const std::string fn = bench_filename(ext);
+  doc->setFilename(fn);
+
+  for (auto _ : state) {
+    if (save_document(&ctx, doc.get()) != 0) {
+      state.SkipWithError("error saving the file");
+      break;
+    }
+  }
+
+  set_counters(state, doc->sprite(), fn);
+  doc->close();
+  base::delete_file(fn);
+}
+
+void BM_Load(benchmark::State& state,
+             const char* ext,
+             const SpriteParams p)
+{
+  Context ctx;
+  const std::string fn = bench_filename(ext);
+  {
+    std::unique_ptr<Doc> doc(create_doc(&ctx, p));
+    doc->setFilename(fn);
+    if (save_document(&ctx, doc.get()) != 0) {
+      state.SkipWithError("error saving the file");
+      return;
+    }
+    doc->close();
+  }
+
+  std::unique_ptr<Doc> doc;
+  for (auto _ : state) {
+    doc.reset(load_document(&ctx, fn));
+    if (!doc) {
+      state.SkipWithError("error loading the file");
+      break;
+    }
+    doc->close();
+  }
+
+  if (doc)
+    set_counters(state, doc->sprite(), fn);
+  base::delete_file(fn);
+}
+
+// Loads an existing file given in the command line
+void BM_LoadFile(benchmark::State& state,
+                 const std::string fn)
+{
+  Context ctx;
+  std::unique_ptr<Doc> doc;
+  for (auto _ : state) {
+    doc.reset(load_document(&ctx, fn));
+    if (!doc) {
+      state.SkipWithError("error loading the file");
+      break;
+    }
+    doc->close();
+  }
+
+  if (doc)
+    set_counters(state, doc->sprite(), fn);
+}
+
+} // anonymous namespace
+
+int app_main(int argc, char* argv[])
+{
+  auto formats = FileFormatsManager::instance();
+
+  // Process our own --load=file options, and use JSON as the
+  // default output format.
+  std::vector<char*> args;
+  std::vector<std::string> loadFiles;
+  bool hasFormat = false;
+  for (int i=0; i<argc; ++i) {
+    if (std::strncmp(argv[i], "--load=", 7) == 0) {
+      loadFiles.push_back(argv[i]+7);
+      continue;
+    }
+    if (std::strncmp(argv[i], "--benchmark_format=", 19) == 0)
+      hasFormat = true;
+    args.push_back(argv[i]);
+  }
+  char jsonFormat[] = "--benchmark_format=json";
+  if (!hasFormat)
+    args.push_back(jsonFormat);
+  argc = int(args.size());
+
+  for (const FormatParams& f : kFormats) {
+    // The format might not be available in this build (e.g. WebP)
+    const FileFormat* format = formats->getFileFormat(f.dioFormat);
+    if (!format)
+      continue;
+
+    const char* ext = f.ext;
+
+    for (const SpriteParams& p : kSprites) {
+      if (!format_supports(format, p))
+        continue;
+
+      const std::string name =
+        fmt::format("{}/{}x{}/frames:{}/layers:{}/{}",
+                    ext, p.w, p.h, p.frames, p.layers,
+                    color_mode_name(p.colorMode));
+
+      benchmark::RegisterBenchmark(("BM_Save/" + name).c_str(), BM_Save, ext, p)
+        ->Unit(benchmark::kMillisecond);
+      benchmark::RegisterBenchmark(("BM_Load/" + name).c_str(), BM_Load, ext, p)
+        ->Unit(benchmark::kMillisecond);
+    }
+  }
+
+  for (const std::string& fn : loadFiles) {
+    benchmark::RegisterBenchmark(("BM_LoadFile/" + fn).c_str(), BM_LoadFile, fn)
+      ->Unit(benchmark::kMillisecond);
+  }
+
+  ::benchmark::Initialize(&argc, args.data());
+  int status = ::benchmark::RunSpecifiedBenchmarks();
+
+  FileFormatsManager::destroyInstance();
+  return status;
+}
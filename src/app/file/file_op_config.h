@@ -47,6 +47,11 @@ namespace app {
     // compressed data that was loaded as-is).
     bool cacheCompressedTilesets = true;
 
+    // Max number of threads used to decode/encode the files of a
+    // sequence concurrently (0 means one thread per CPU core, 1 to
+    // load/save the files one after another).
+    int sequenceThreads = 0;
+
     void fillFromPreferences();
   };
 
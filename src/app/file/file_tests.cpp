@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,7 @@
 #include "app/file/file.h"
 #include "app/file/file_formats_manager.h"
 #include "base/base64.h"
+#include "base/fs.h"
 #include "doc/doc.h"
 #include "doc/user_data.h"
 #include "fmt/format.h"
@@ -84,6 +85,85 @@ TEST(File, SeveralSizes)
   }
 }
 
+TEST(File, SequenceLoadSave)
+{
+  app::Context ctx;
+  const int w = 32, h = 16;
+  const frame_t frames = 9;
+  auto frameColor = [](const frame_t frame) {
+    return rgba(20*frame, 255-20*frame, frame, 255);
+  };
+
+  base::paths filenames;
+  {
+    std::unique_ptr<Doc> doc(
+      ctx.documents().add(w, h, doc::ColorMode::RGB, 256));
+    doc->setFilename("seqtest_1.png");
+
+    Sprite* sprite = doc->sprite();
+    LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+    sprite->setTotalFrames(frames);
+    for (frame_t frame=0; frame<frames; ++frame) {
+      Cel* cel = layer->cel(frame);
+      if (!cel) {
+        cel = new Cel(frame, ImageRef(Image::create(IMAGE_RGB, w, h)));
+        layer->addCel(cel);
+      }
+      clear_image(cel->image(), frameColor(frame));
+    }
+
+    // Several frames are encoded at the same time
+    std::unique_ptr<FileOp> fop(
+      FileOp::createSaveDocumentOperation(
+        &ctx,
+        FileOpROI(doc.get(), sprite->bounds(),
+                  "", "", FramesSequence(), false),
+        doc->filename(), "seqtest_{frame1}.png",
+        false));
+    ASSERT_TRUE(fop != nullptr);
+    fop->operate();
+    fop->done();
+    ASSERT_FALSE(fop->hasError());
+
+    filenames = fop->filenames();
+    ASSERT_EQ(frames, frame_t(filenames.size()));
+    doc->close();
+  }
+
+  // Load the sequence with several threads, frames must be in order
+  {
+    FileOpConfig config;
+    config.sequenceThreads = 4;
+
+    std::unique_ptr<FileOp> fop(
+      FileOp::createLoadDocumentOperation(
+        &ctx, filenames[0], FILE_LOAD_SEQUENCE_YES, &config));
+    ASSERT_TRUE(fop != nullptr);
+    fop->operate();
+    fop->done();
+    ASSERT_FALSE(fop->hasError());
+
+    std::unique_ptr<Doc> doc(fop->releaseDocument());
+    ASSERT_TRUE(doc != nullptr);
+    Sprite* sprite = doc->sprite();
+    ASSERT_EQ(frames, sprite->totalFrames());
+    ASSERT_EQ(w, sprite->width());
+    ASSERT_EQ(h, sprite->height());
+
+    Layer* layer = sprite->root()->firstLayer();
+    for (frame_t frame=0; frame<frames; ++frame) {
+      Cel* cel = layer->cel(frame);
+      ASSERT_TRUE(cel != nullptr);
+      EXPECT_EQ(frameColor(frame), get_pixel(cel->image(), 0, 0));
+      EXPECT_EQ(frameColor(frame), get_pixel(cel->image(), w-1, h-1));
+    }
+    doc->close();
+  }
+
+  for (const auto& fn : filenames)
+    base::delete_file(fn);
+}
+
 TEST(File, CustomProperties)
 {
   app::Context ctx;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -10,8 +10,10 @@
 
 #include "app/render/simple_renderer.h"
 
+#include "app/trace.h"
 #include "app/ui/editor/editor_render.h"
 #include "app/util/conversion_to_surface.h"
+#include "os/surface.h"
 
 namespace app {
 
@@ -20,6 +22,10 @@ using namespace doc;
 SimpleRenderer::SimpleRenderer()
 {
   m_properties.outputsUnpremultiplied = true;
+
+  // This renderer is used by the editor to paint the same sprite
+  // again and again, so it's worth to keep the flattened tilemaps
+  m_render.setCacheTilemaps(true);
 }
 
 void SimpleRenderer::setRefLayersVisiblity(const bool visible)
@@ -99,6 +105,23 @@ void SimpleRenderer::renderSprite(os::Surface* dstSurface,
                                   const doc::frame_t frame,
                                   const gfx::ClipF& area)
 {
+  TraceZone zone("Render::renderSprite");
+
+  // Render directly in the surface pixels when it's possible (the
+  // whole area is filled by renderSprite(), so we don't need to
+  // clear it first)
+  {
+    os::SurfaceLock lock(dstSurface);
+    ImageRef dstImage(create_rgb_image_view_from_surface(
+                        dstSurface, gfx::Size(area.size.w, area.size.h),
+                        EditorRender::getRenderImageBuffer()));
+    if (dstImage) {
+      m_render.renderSprite(dstImage.get(), sprite, frame, area);
+      notify_surface_pixels_changed(dstSurface);
+      return;
+    }
+  }
+
   ImageRef dstImage(Image::create(
                       IMAGE_RGB, area.size.w, area.size.h,
                       EditorRender::getRenderImageBuffer()));
@@ -18,6 +18,7 @@
 #include "app/pref/preferences.h"
 #include "app/script/blend_mode.h"
 #include "app/script/luacpp.h"
+#include "app/script/profiler.h"
 #include "app/script/require.h"
 #include "app/script/security.h"
 #include "app/sprite_sheet_type.h"
@@ -535,6 +536,7 @@ Engine::~Engine()
 
 void Engine::destroy()
 {
+  stopProfiler();
   close_all_dialogs();
   lua_close(L);
   L = nullptr;
@@ -600,6 +602,10 @@ bool Engine::evalCode(const std::string& code,
     m_returnCode = -1;
   }
 
+  // The script finished (maybe with an error)
+  if (m_profiler)
+    m_profiler->setIdle();
+
   // Collect script garbage.
   lua_gc(L, LUA_GCCOLLECT);
   return ok;
@@ -674,6 +680,31 @@ void Engine::startDebugger(DebuggerDelegate* debuggerDelegate)
 void Engine::stopDebugger()
 {
   lua_sethook(L, nullptr, 0, 0);
+
+  // Resume the profiler (the debugger replaced its hook)
+  if (m_profiler)
+    m_profiler->start(L);
+}
+
+void Engine::startProfiler(const std::string& filename)
+{
+  stopProfiler();
+
+  m_profiler = std::make_unique<Profiler>(filename);
+  m_profiler->start(L);
+}
+
+void Engine::stopProfiler()
+{
+  if (!m_profiler)
+    return;
+
+  m_profiler->stop(L);
+  if (!m_profiler->saveReport()) {
+    std::string msg = "Cannot save the script profile in " + m_profiler->filename();
+    onConsoleError(msg.c_str());
+  }
+  m_profiler.reset();
 }
 
 void Engine::onConsoleError(const char* text)
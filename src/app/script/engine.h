@@ -27,6 +27,7 @@
 #include <cstdio>
 #include <functional>
 #include <map>
+#include <memory>
 #include <string>
 
 struct lua_State;
@@ -85,6 +86,8 @@ namespace app {
     virtual void endFile(const std::string& file) = 0;
   };
 
+  class Profiler;
+
   class Engine {
   public:
     Engine();
@@ -123,6 +126,12 @@ namespace app {
     void startDebugger(DebuggerDelegate* debuggerDelegate);
     void stopDebugger();
 
+    // Profiles all the Lua code executed from now on, the report is
+    // saved in the given file when the profiler is stopped (or the
+    // engine is destroyed).
+    void startProfiler(const std::string& filename);
+    void stopProfiler();
+
   private:
     void onConsoleError(const char* text);
     void onConsolePrint(const char* text);
@@ -131,6 +140,7 @@ namespace app {
     EngineDelegate* m_delegate;
     bool m_printLastResult;
     int m_returnCode;
+    std::unique_ptr<Profiler> m_profiler;
   };
 
   class ScopedEngineDelegate {
@@ -0,0 +1,205 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/script/profiler.h"
+
+#include "app/script/luacpp.h"
+#include "base/fstream_path.h"
+#include "fmt/format.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// There is only one Lua state, so one active profiler is enough.
+Profiler* g_profiler = nullptr;
+
+// Returns the name of the class of the "self" argument of a native
+// method, e.g. "Image" for Image:drawPixel(), using the __name field
+// of the userdata metatable (with the "Obj" suffix and C++
+// namespaces removed).
+std::string self_class_name(lua_State* L, lua_Debug* ar)
+{
+  std::string name;
+  if (lua_getlocal(L, ar, 1)) {
+    const int type = luaL_getmetafield(L, -1, "__name");
+    if (type != LUA_TNIL) {
+      if (type == LUA_TSTRING)
+        name = lua_tostring(L, -1);
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+  }
+
+  const size_t i = name.rfind("::");
+  if (i != std::string::npos)
+    name.erase(0, i+2);
+  if (name.size() > 3 && name.compare(name.size()-3, 3, "Obj") == 0)
+    name.erase(name.size()-3);
+  return name;
+}
+
+// Returns the label of a stack frame, e.g. "[C] Image:drawPixel" or
+// "onClick (script.lua:12)". The ';' character is the frame
+// separator in folded stacks, so it's replaced.
+std::string frame_label(lua_State* L, lua_Debug* ar)
+{
+  std::string label;
+  if (*ar->what == 'C') {
+    std::string cls;
+    if (ar->namewhat && std::strcmp(ar->namewhat, "method") == 0)
+      cls = self_class_name(L, ar);
+    label = fmt::format("[C] {}{}{}",
+                        cls, (cls.empty() ? "": ":"),
+                        (ar->name ? ar->name: "?"));
+  }
+  else if (*ar->what == 'm') {
+    label = fmt::format("main ({})", ar->short_src);
+  }
+  else {
+    label = fmt::format("{} ({}:{})",
+                        (ar->name ? ar->name: "?"),
+                        ar->short_src, ar->linedefined);
+  }
+
+  for (char& chr : label)
+    if (chr == ';')
+      chr = ':';
+  return label;
+}
+
+} // anonymous namespace
+
+Profiler::Profiler(const std::string& filename)
+  : m_filename(filename)
+{
+}
+
+Profiler::~Profiler()
+{
+  if (g_profiler == this)
+    g_profiler = nullptr;
+}
+
+void Profiler::start(lua_State* L)
+{
+  g_profiler = this;
+  m_idle = true;
+  lua_sethook(L, &Profiler::hook,
+              LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT,
+              kSampleInstructions);
+}
+
+void Profiler::stop(lua_State* L)
+{
+  if (g_profiler == this) {
+    lua_sethook(L, nullptr, 0, 0);
+    g_profiler = nullptr;
+  }
+}
+
+bool Profiler::saveReport() const
+{
+  std::ofstream f(FSTREAM_PATH(m_filename));
+  if (!f)
+    return false;
+
+  for (const auto& it : m_stacks) {
+    const auto us = std::llround(it.second);
+    if (us > 0)
+      f << it.first << ' ' << us << '\n';
+  }
+  return f.good();
+}
+
+// static
+void Profiler::hook(lua_State* L, lua_Debug* ar)
+{
+  if (g_profiler)
+    g_profiler->onHook(L, ar);
+}
+
+void Profiler::onHook(lua_State* L, lua_Debug* ar)
+{
+  switch (ar->event) {
+
+    case LUA_HOOKCALL:
+    case LUA_HOOKTAILCALL: {
+      // First call after being idle: start measuring from here. An
+      // outermost call is always the start of a new run (e.g. a
+      // callback after a previous one failed with an error, which
+      // doesn't generate the return hooks).
+      lua_Debug caller;
+      if (m_idle || lua_getstack(L, 1, &caller) == 0) {
+        m_idle = false;
+        m_lastTime = Clock::now();
+        break;
+      }
+      // Entering a native function, the previous time belongs to
+      // the caller.
+      lua_getinfo(L, "S", ar);
+      if (*ar->what == 'C')
+        addSample(L, 1);
+      break;
+    }
+
+    case LUA_HOOKRET: {
+      lua_getinfo(L, "S", ar);
+      lua_Debug caller;
+      const bool outermost = (lua_getstack(L, 1, &caller) == 0);
+      if (*ar->what == 'C' || outermost)
+        addSample(L, 0);
+      if (outermost)
+        m_idle = true;
+      break;
+    }
+
+    case LUA_HOOKCOUNT:
+      if (!m_idle)
+        addSample(L, 0);
+      break;
+  }
+}
+
+void Profiler::addSample(lua_State* L, int level)
+{
+  const Clock::time_point now = Clock::now();
+  const double elapsed =
+    std::chrono::duration<double, std::micro>(now - m_lastTime).count();
+
+  // Collect the frames from the leaf to the root
+  std::vector<std::string> frames;
+  lua_Debug ar;
+  for (; lua_getstack(L, level, &ar); ++level) {
+    if (lua_getinfo(L, "Sn", &ar))
+      frames.push_back(frame_label(L, &ar));
+  }
+  if (!frames.empty()) {
+    std::string stack;
+    for (auto it=frames.rbegin(); it!=frames.rend(); ++it) {
+      if (!stack.empty())
+        stack.push_back(';');
+      stack += *it;
+    }
+    m_stacks[stack] += elapsed;
+  }
+
+  // Don't count the time spent in the profiler itself
+  m_lastTime = Clock::now();
+}
+
+} // namespace script
+} // namespace app
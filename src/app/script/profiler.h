@@ -0,0 +1,84 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SCRIPT_PROFILER_H_INCLUDED
+#define APP_SCRIPT_PROFILER_H_INCLUDED
+#pragma once
+
+#ifndef ENABLE_SCRIPTING
+  #error ENABLE_SCRIPTING must be defined
+#endif
+
+#include <chrono>
+#include <map>
+#include <string>
+
+struct lua_State;
+struct lua_Debug;
+
+namespace app {
+namespace script {
+
+  // Instrumenting profiler for Lua scripts (--script-profile
+  // option).
+  //
+  // Call/return hooks run on each Lua and native function call to
+  // measure the time spent inside native functions (e.g.
+  // Image:drawPixel() or app.command.*). A count hook also
+  // attributes the time of long running Lua code to its call stack
+  // each N instructions. As the hooks run on every call, scripts with
+  // a lot of small function calls are slower while they are being
+  // profiled (the reported times are useful to compare functions,
+  // not as absolute times).
+  //
+  // The report is saved in the "folded stacks" format (one line per
+  // stack with the total microseconds spent on it), which can be
+  // used directly with flamegraph.pl or speedscope.
+  class Profiler {
+  public:
+    // Number of Lua instructions between count hooks.
+    static constexpr int kSampleInstructions = 1000;
+
+    Profiler(const std::string& filename);
+    ~Profiler();
+
+    const std::string& filename() const { return m_filename; }
+
+    // Installs/uninstalls the Lua hook. The hook can be replaced
+    // temporarily by the debugger, so start() can be called again to
+    // resume the profiling.
+    void start(lua_State* L);
+    void stop(lua_State* L);
+
+    // Must be called when the script finishes (even with an error,
+    // where the Lua stack is unwound without return hooks).
+    void setIdle() { m_idle = true; }
+
+    bool saveReport() const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    static void hook(lua_State* L, lua_Debug* ar);
+    void onHook(lua_State* L, lua_Debug* ar);
+
+    // Adds the time elapsed since the last sample to the stack that
+    // starts in the given "level" (0 is the running function).
+    void addSample(lua_State* L, int level);
+
+    std::string m_filename;
+    std::map<std::string, double> m_stacks; // Microseconds per stack
+    Clock::time_point m_lastTime;
+
+    // True when there is no Lua code running (e.g. waiting events in
+    // the UI), so the next elapsed time is not attributed to any stack.
+    bool m_idle = true;
+  };
+
+} // namespace script
+} // namespace app
+
+#endif
@@ -0,0 +1,89 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/startup_trace.h"
+
+#include "base/chrono.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace app {
+
+namespace {
+
+struct PhaseInfo {
+  std::string name;
+  int depth;
+  double start;
+  double end;
+};
+
+bool g_enabled = false;
+base::Chrono g_chrono;
+std::vector<PhaseInfo> g_phases;
+int g_depth = 0;
+
+} // anonymous namespace
+
+StartupTrace::Phase::Phase(const char* name)
+  : m_zone(name)
+  , m_index(-1)
+{
+  if (!g_enabled)
+    return;
+
+  m_index = int(g_phases.size());
+  const double t = g_chrono.elapsed();
+  g_phases.push_back(PhaseInfo{ name, g_depth++, t, t });
+}
+
+StartupTrace::Phase::~Phase()
+{
+  if (m_index < 0)
+    return;
+
+  g_phases[m_index].end = g_chrono.elapsed();
+  --g_depth;
+}
+
+// static
+void StartupTrace::enable()
+{
+  g_enabled = true;
+  g_chrono.reset();
+}
+
+// static
+bool StartupTrace::isEnabled()
+{
+  return g_enabled;
+}
+
+// static
+void StartupTrace::printReport()
+{
+  if (!g_enabled)
+    return;
+
+  std::printf("Startup trace:\n");
+  for (const auto& phase : g_phases) {
+    std::printf("%*s%-*s %9.2f ms\n",
+                2+2*phase.depth, "",
+                40-2*phase.depth, phase.name.c_str(),
+                1000.0 * (phase.end - phase.start));
+  }
+  std::printf("  %-40s %9.2f ms\n", "Total",
+              1000.0 * g_chrono.elapsed());
+  std::fflush(stdout);
+}
+
+} // namespace app
@@ -0,0 +1,39 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_STARTUP_TRACE_H_INCLUDED
+#define APP_STARTUP_TRACE_H_INCLUDED
+#pragma once
+
+#include "app/trace.h"
+
+namespace app {
+
+  // Measures the time spent in each phase of the program startup to
+  // print a report with the --startup-trace option. Phases can be
+  // nested (e.g. "Extensions" is measured inside "Modules"), and
+  // they are recorded as zones in the --trace file too.
+  class StartupTrace {
+  public:
+    class Phase {
+    public:
+      Phase(const char* name);
+      ~Phase();
+    private:
+      TraceZone m_zone;
+      int m_index;
+    };
+
+    static void enable();
+    static bool isEnabled();
+
+    // Prints the time spent in each phase in stdout.
+    static void printReport();
+  };
+
+} // namespace app
+
+#endif
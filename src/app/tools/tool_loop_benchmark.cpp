@@ -0,0 +1,307 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+// Replays pointer sequences through the ToolLoopManager (the same
+// path used by the Editor and app.useTool()) to measure the latency
+// of each loop step with different tools.
+//
+// A recorded stroke can be replayed with --stroke=file.txt, where
+// each line of the file is "x y pressure" (pressure in [0, 1]).
+// Without this option a synthetic hand-drawn stroke is used.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/cli/app_options.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_undo.h"
+#include "app/pref/preferences.h"
+#include "app/site.h"
+#include "app/tools/active_tool.h"
+#include "app/tools/ink.h"
+#include "app/tools/pointer.h"
+#include "app/tools/tool.h"
+#include "app/tools/tool_box.h"
+#include "app/tools/tool_loop.h"
+#include "app/tools/tool_loop_manager.h"
+#include "app/ui/editor/tool_loop_impl.h"
+#include "doc/brush.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "os/system.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+#ifdef ENABLE_SCRIPTING
+
+namespace {
+
+struct StrokePoint {
+  gfx::Point pt;
+  float pressure;
+};
+
+struct StrokeCase {
+  const char* name;
+  const char* toolId;
+  int brushSize;
+  bool dynamics;
+  gen::SymmetryMode symmetry;
+};
+
+const StrokeCase kCases[] = {
+  { "pencil",          "pencil",  1,  false, gen::SymmetryMode::NONE },
+  { "brush",           "pencil",  16, false, gen::SymmetryMode::NONE },
+  { "brush_dynamics",  "pencil",  16, true,  gen::SymmetryMode::NONE },
+  { "spray",           "spray",   1,  false, gen::SymmetryMode::NONE },
+  { "blur",            "blur",    16, false, gen::SymmetryMode::NONE },
+  { "jumble",          "jumble",  16, false, gen::SymmetryMode::NONE },
+  { "contour",         "contour", 1,  false, gen::SymmetryMode::NONE },
+  { "pencil_symmetry", "pencil",  4,  false, gen::SymmetryMode::BOTH },
+};
+
+const int kLayers = 8;
+
+// Recorded stroke loaded with --stroke=file.txt
+std::vector<StrokePoint> g_recordedStroke;
+
+// Generates a stroke similar to a hand-drawn one: a loop around the
+// center of the sprite with some wobble and changing pressure.
+std::vector<StrokePoint> make_stroke(const int w, const int h)
+{
+  std::vector<StrokePoint> stroke;
+  const int n = 256;
+  stroke.reserve(n);
+  for (int i=0; i<n; ++i) {
+    const double t = double(i) / (n-1);
+    const double a = 2.0 * 3.14159265358979 * 1.5 * t;
+    const double r = 0.35 * (0.6 + 0.4*std::sin(7.0*a));
+    stroke.push_back({
+        gfx::Point(int(w * (0.5 + r*std::cos(a))),
+                   int(h * (0.5 + r*std::sin(a)))),
+        float(0.5 + 0.5*std::sin(3.14159265358979 * t)) });
+  }
+  return stroke;
+}
+
+bool load_stroke(const std::string& fn, std::vector<StrokePoint>& stroke)
+{
+  std::ifstream f(fn);
+  StrokePoint p;
+  while (f >> p.pt.x >> p.pt.y >> p.pressure)
+    stroke.push_back(p);
+  return !stroke.empty();
+}
+
+// Creates a sprite with several layers with content (so the
+// rendering, blur/jumble inks, and contour fill have real pixels to
+// work with).
+Doc* create_doc(Context* ctx, const int w, const int h)
+{
+  Sprite* spr = new Sprite(ImageSpec(ColorMode::RGB, w, h), 256);
+  for (int i=0; i<kLayers; ++i) {
+    LayerImage* layer = new LayerImage(spr);
+    spr->root()->addLayer(layer);
+
+    ImageRef image(Image::create(IMAGE_RGB, w, h));
+    clear_image(image.get(), 0);
+    for (int j=0; j<16; ++j) {
+      const int x = (j*131 + i*57) % w;
+      const int y = (j*71 + i*113) % h;
+      const int r = 4 + (j*37 + i*13) % std::max(5, w/8);
+      fill_ellipse(image.get(), x-r, y-r, x+r, y+r, 0, 0,
+                   rgba((i*40+j*13) & 255, (j*29) & 255, (i*77) & 255,
+                        128 + (j*8 & 127)));
+    }
+    layer->addCel(new Cel(0, image));
+  }
+
+  Doc* doc = new Doc(spr);
+  doc->setContext(ctx);
+  return doc;
+}
+
+} // anonymous namespace
+
+void BM_Stroke(benchmark::State& state) {
+  const StrokeCase& c = kCases[state.range(0)];
+  const int w = state.range(1);
+  const int h = state.range(2);
+  state.SetLabel(c.name);
+
+  auto app = App::instance();
+  auto ctx = app->context();
+  std::unique_ptr<Doc> doc(create_doc(ctx, w, h));
+  Sprite* spr = doc->sprite();
+
+  Preferences& pref = Preferences::instance();
+  pref.symmetryMode.enabled(c.symmetry != gen::SymmetryMode::NONE);
+  pref.document(doc.get()).symmetry.mode(c.symmetry);
+  pref.document(doc.get()).symmetry.xAxis(w/2.0);
+  pref.document(doc.get()).symmetry.yAxis(h/2.0);
+
+  Site site;
+  site.document(doc.get());
+  site.sprite(spr);
+  site.layer(spr->root()->layers()[kLayers/2]);
+  site.frame(0);
+
+  ToolLoopParams params;
+  params.tool = app->toolBox()->getToolById(c.toolId);
+  params.ink = params.tool->getInk(0);
+  params.controller = params.tool->getController(0);
+  params.inkType = tools::InkType::SIMPLE;
+  params.fg = app::Color::fromRgb(255, 0, 0);
+  params.bg = app::Color::fromRgb(0, 0, 0);
+  params.ink = app->activeToolManager()->adjustToolInkDependingOnSelectedInkType(
+    params.ink, params.inkType, params.fg);
+  params.brush.reset(new Brush(BrushType::kCircleBrushType, c.brushSize, 0));
+  if (c.dynamics) {
+    tools::DynamicsOptions dynamics;
+    dynamics.size = tools::DynamicSensor::Pressure;
+    dynamics.minSize = 1;
+    params.dynamics = dynamics;
+  }
+
+  const std::vector<StrokePoint> stroke =
+    (g_recordedStroke.empty() ? make_stroke(w, h): g_recordedStroke);
+
+  using clock = std::chrono::steady_clock;
+  std::vector<double> latencies; // In microseconds
+  double dirtyPixels = 0.0;
+
+  for (auto _ : state) {
+    std::unique_ptr<tools::ToolLoop> loop(
+      create_tool_loop_for_script(ctx, site, params));
+    if (!loop) {
+      state.SkipWithError("cannot create the tool loop");
+      break;
+    }
+
+    tools::ToolLoopManager manager(loop.get());
+
+    // Measures one call to the ToolLoopManager (each call executes
+    // one loop step).
+    auto step = [&](auto&& func) {
+      const auto t0 = clock::now();
+      func();
+      latencies.push_back(
+        std::chrono::duration<double, std::micro>(clock::now() - t0).count());
+      for (const gfx::Rect& rc : manager.dirtyArea())
+        dirtyPixels += double(rc.w) * double(rc.h);
+    };
+
+    for (size_t i=0; i<stroke.size(); ++i) {
+      const tools::Pointer pointer(
+        stroke[i].pt, tools::Vec2(0.0f, 0.0f),
+        tools::Pointer::Button::Left,
+        tools::Pointer::Type::Pen,
+        stroke[i].pressure);
+      if (i == 0) {
+        manager.prepareLoop(pointer);
+        step([&]{ manager.pressButton(pointer); });
+      }
+      else {
+        step([&]{ manager.movement(pointer); });
+      }
+    }
+    const tools::Pointer last(
+      stroke.back().pt, tools::Vec2(0.0f, 0.0f),
+      tools::Pointer::Button::Left,
+      tools::Pointer::Type::Pen,
+      stroke.back().pressure);
+    step([&]{ manager.releaseButton(last); });
+    manager.end();
+
+    // Restore the original document for the next iteration
+    state.PauseTiming();
+    loop.reset();
+    if (doc->undoHistory()->canUndo()) {
+      doc->undoHistory()->undo();
+      doc->undoHistory()->clearRedo();
+    }
+    state.ResumeTiming();
+  }
+
+  if (!latencies.empty()) {
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](const double p) {
+      return latencies[std::min(latencies.size()-1,
+                                size_t(p * latencies.size()))];
+    };
+    state.counters["steps"] = latencies.size();
+    state.counters["p50_us"] = percentile(0.50);
+    state.counters["p90_us"] = percentile(0.90);
+    state.counters["p99_us"] = percentile(0.99);
+    state.counters["max_us"] = latencies.back();
+    state.counters["dirty_px"] = dirtyPixels / latencies.size();
+  }
+
+  pref.symmetryMode.enabled(false);
+}
+
+static void StrokeArgs(benchmark::internal::Benchmark* b) {
+  for (int i=0; i<int(sizeof(kCases)/sizeof(kCases[0])); ++i) {
+    b->Args({ i, 256, 256 });
+    b->Args({ i, 1024, 1024 });
+  }
+}
+
+BENCHMARK(BM_Stroke)
+  ->Apply(StrokeArgs)
+  ->Unit(benchmark::kMillisecond);
+
+#endif // ENABLE_SCRIPTING
+
+int app_main(int argc, char* argv[])
+{
+  // Our own --stroke=file.txt option (removed from argv before
+  // passing the arguments to the benchmark library)
+  std::vector<char*> args;
+  for (int i=0; i<argc; ++i) {
+    if (std::strncmp(argv[i], "--stroke=", 9) == 0) {
+#ifdef ENABLE_SCRIPTING
+      if (!load_stroke(argv[i]+9, g_recordedStroke)) {
+        std::fprintf(stderr, "Cannot load stroke from %s\n", argv[i]+9);
+        return 1;
+      }
+#endif
+      continue;
+    }
+    args.push_back(argv[i]);
+  }
+  argc = int(args.size());
+
+  os::SystemRef system(os::make_system());
+  App app;
+  const char* argv2[] = { argv[0], "--batch" };
+  app.initialize(AppOptions(2, argv2));
+
+  ::benchmark::Initialize(&argc, args.data());
+  int status = ::benchmark::RunSpecifiedBenchmarks();
+
+  app.close();
+  return status;
+}
@@ -20,6 +20,7 @@
 #include "app/tools/symmetry.h"
 #include "app/tools/tool_loop.h"
 #include "app/tools/velocity.h"
+#include "app/trace.h"
 #include "doc/brush.h"
 #include "doc/image.h"
 #include "doc/primitives.h"
@@ -217,6 +218,8 @@ void ToolLoopManager::disableMouseStabilizer()
 
 void ToolLoopManager::doLoopStep(bool lastStep)
 {
+  TraceZone zone("ToolLoopManager::doLoopStep");
+
   // Original set of points to interwine (original user stroke,
   // relative to sprite origin).
   Stroke main_stroke;
@@ -84,6 +84,9 @@ public:
 
   const Pointer& lastPointer() const { return m_lastPointer; }
 
+  // Area of the sprite modified in the last loop step.
+  const gfx::Region& dirtyArea() const { return m_dirtyArea; }
+
 private:
   void doLoopStep(bool lastStep);
   void snapToGrid(Stroke::Pt& pt);
@@ -0,0 +1,170 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/trace.h"
+
+#include "base/fstream_path.h"
+#include "base/log.h"
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace app {
+
+namespace {
+
+struct Event {
+  const char* name;
+  std::string detail;
+  int tid;
+  int64_t ts;                   // Start time in microseconds
+  int64_t dur;                  // Duration in microseconds
+};
+
+// Events are written in the file each time we have kFlushEvents
+// events (and when the trace is stopped), so the memory usage is
+// bounded and the file contains the events recorded before a crash.
+constexpr std::size_t kFlushEvents = 4096;
+
+std::mutex g_mutex;
+std::string g_filename;
+std::ofstream g_out;
+std::vector<Event> g_events;
+int g_savedEvents = 0;
+std::chrono::steady_clock::time_point g_startTime;
+std::atomic<int> g_nextTid(0);
+
+int64_t now_us()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - g_startTime).count();
+}
+
+int current_tid()
+{
+  thread_local int tid = ++g_nextTid;
+  return tid;
+}
+
+void write_json_string(std::ostream& out, const char* s)
+{
+  out << '"';
+  for (; *s; ++s) {
+    const unsigned char c = *s;
+    switch (c) {
+      case '"':  out << "\\\""; break;
+      case '\\': out << "\\\\"; break;
+      case '\n': out << "\\n"; break;
+      case '\r': out << "\\r"; break;
+      case '\t': out << "\\t"; break;
+      default:
+        if (c < 0x20) {
+          const char* hex = "0123456789abcdef";
+          out << "\\u00" << hex[c >> 4] << hex[c & 15];
+        }
+        else
+          out << c;
+        break;
+    }
+  }
+  out << '"';
+}
+
+// Writes the events in the JSON Array Format (the closing bracket is
+// optional in this format, so a file that was not closed because of a
+// crash can be opened too).
+void write_events()
+{
+  for (const Event& ev : g_events) {
+    if (g_savedEvents++ > 0)
+      g_out << ",\n";
+
+    g_out << "{\"name\":";
+    write_json_string(g_out, ev.name);
+    g_out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << ev.tid
+          << ",\"ts\":" << ev.ts
+          << ",\"dur\":" << ev.dur;
+    if (!ev.detail.empty()) {
+      g_out << ",\"args\":{\"detail\":";
+      write_json_string(g_out, ev.detail.c_str());
+      g_out << '}';
+    }
+    g_out << '}';
+  }
+  g_out.flush();
+  g_events.clear();
+}
+
+} // anonymous namespace
+
+std::atomic<bool> Trace::s_enabled(false);
+
+// static
+void Trace::start(const std::string& filename)
+{
+  const std::lock_guard lock(g_mutex);
+  g_out.open(FSTREAM_PATH(filename), std::ofstream::binary);
+  if (!g_out) {
+    LOG(ERROR, "TRACE: Cannot save trace file %s\n", filename.c_str());
+    return;
+  }
+  g_out << "[\n";
+
+  g_filename = filename;
+  g_events.clear();
+  g_events.reserve(kFlushEvents);
+  g_savedEvents = 0;
+  g_startTime = std::chrono::steady_clock::now();
+  s_enabled = true;
+}
+
+// static
+void Trace::stop()
+{
+  if (!isEnabled())
+    return;
+
+  const std::lock_guard lock(g_mutex);
+  s_enabled = false;
+
+  write_events();
+  g_out << "\n]\n";
+  g_out.close();
+
+  LOG("TRACE: %d events saved in %s\n",
+      g_savedEvents, g_filename.c_str());
+}
+
+void TraceZone::begin(const char* name, const std::string* detail)
+{
+  m_name = name;
+  if (detail)
+    m_detail = *detail;
+  m_start = now_us();
+}
+
+void TraceZone::end()
+{
+  const int64_t t = now_us();
+  const int tid = current_tid();
+
+  const std::lock_guard lock(g_mutex);
+  // The trace could be stopped while this zone was running
+  if (!Trace::isEnabled())
+    return;
+  g_events.push_back(Event{ m_name, std::move(m_detail), tid,
+                            m_start, t - m_start });
+  if (g_events.size() >= kFlushEvents)
+    write_events();
+}
+
+} // namespace app
@@ -0,0 +1,71 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_TRACE_H_INCLUDED
+#define APP_TRACE_H_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace app {
+
+  // Records zones of time (from any thread) to be saved in the
+  // Chrome trace event format (a JSON file that can be opened with
+  // Perfetto or chrome://tracing). It's enabled with the --trace
+  // <filename> option, when it's disabled a TraceZone costs just one
+  // atomic load.
+  //
+  // Events are saved in the file by chunks while the program is
+  // running, so long sessions don't accumulate them in memory.
+  class Trace {
+  public:
+    static bool isEnabled() {
+      return s_enabled.load(std::memory_order_acquire);
+    }
+
+    // Starts recording zones in the given file, the file is
+    // completed when stop() is called.
+    static void start(const std::string& filename);
+    static void stop();
+
+  private:
+    static std::atomic<bool> s_enabled;
+  };
+
+  // Measures the time spent in the current scope. The name must be
+  // a string literal, the optional detail (e.g. a filename) is
+  // copied only when the trace is enabled.
+  class TraceZone {
+  public:
+    TraceZone(const char* name) {
+      if (Trace::isEnabled())
+        begin(name, nullptr);
+    }
+
+    TraceZone(const char* name, const std::string& detail) {
+      if (Trace::isEnabled())
+        begin(name, &detail);
+    }
+
+    ~TraceZone() {
+      if (m_name)
+        end();
+    }
+
+  private:
+    void begin(const char* name, const std::string* detail);
+    void end();
+
+    const char* m_name = nullptr;
+    std::string m_detail;
+    int64_t m_start = 0;
+  };
+
+} // namespace app
+
+#endif
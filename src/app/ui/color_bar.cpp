@@ -902,7 +902,7 @@ void ColorBar::onRemapPalButtonClick()
         PalettePicks usedEntries(256);
 
         for (ImageRef& image : images) {
-          for (const auto& i : LockImageBits<IndexedTraits>(image.get()))
+          for (const auto& i : LockImageBits<IndexedTraits>(image.get(), Image::ReadLock))
             usedEntries[i] = true;
         }
 
@@ -965,7 +965,7 @@ void ColorBar::onRemapTilesButtonClick()
 
     if (n > 0) {
       for (const ImageRef& tilemap : tilemaps) {
-        for (const doc::tile_t t : LockImageBits<TilemapTraits>(tilemap.get())) {
+        for (const doc::tile_t t : LockImageBits<TilemapTraits>(tilemap.get(), Image::ReadLock)) {
           const doc::tile_index ti = doc::tile_geti(t);
           if (ti > 0 && ti < n)
             usedTiles[ti] = true;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -19,6 +19,7 @@
 #include "app/app_menus.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/workspace.h"
+#include "doc/image_buffer_pool.h"
 #include "fmt/format.h"
 #include "ui/entry.h"
 #include "ui/message.h"
@@ -67,7 +68,8 @@ protected:
 
 DevConsoleView::DevConsoleView()
   : Box(VERTICAL)
-  , m_textBox(fmt::format("Welcome to {} v{} Console\n(Experimental)",
+  , m_textBox(fmt::format("Welcome to {} v{} Console\n(Experimental)\n"
+                          "Type :pool to show image buffer pool stats",
                           get_app_name(), get_app_version()), LEFT)
   , m_label(">")
   , m_entry(new CommmandEntry)
@@ -150,6 +152,19 @@ bool DevConsoleView::onProcessMessage(Message* msg)
 
 void DevConsoleView::onExecuteCommand(const std::string& cmd)
 {
+  // Internal console commands (not Lua code)
+  if (cmd == ":pool") {
+    const doc::ImageBufferPoolStats stats = doc::image_buffer_pool_stats();
+    onConsolePrint(
+      fmt::format("Image buffer pool: {:.1f}% hit rate ({} hits, {} misses), "
+                  "{:.2f}/{:.2f} MB resident in {} blocks",
+                  100.0 * stats.hitRate(), stats.hits, stats.misses,
+                  stats.residentBytes / 1024.0 / 1024.0,
+                  stats.limit / 1024.0 / 1024.0,
+                  stats.residentBlocks).c_str());
+    return;
+  }
+
   m_engine->printLastResult();
   m_engine->evalCode(cmd);
 }
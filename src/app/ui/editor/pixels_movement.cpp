@@ -131,6 +131,10 @@ PixelsMovement::PixelsMovement(
   , m_canHandleFrameChange(false)
   , m_fastMode(false)
   , m_needsRotSpriteRedraw(false)
+  , m_asyncRotSprite(false)
+  , m_extraImageVersion(0)
+  , m_rotSpriteTimer(10)
+  , m_rotSpriteResultVersion(0)
 {
   // Save and Lock the TilemapMode.
   // TODO: enable TilemapMode exchanges during PixelMovement.
@@ -159,6 +163,8 @@ PixelsMovement::PixelsMovement(
     Preferences::instance().selection.rotationAlgorithm.AfterChange.connect(
       [this]{ onRotationAlgorithmChange(); });
 
+  m_rotSpriteTimer.Tick.connect([this]{ onRotSpriteTaskTimer(); });
+
   // The extra cel must be null, because if it's not null, it means
   // that someone else is using it (e.g. the editor brush preview),
   // and its owner could destroy our new "extra cel".
@@ -179,6 +185,8 @@ PixelsMovement::PixelsMovement(
 
 PixelsMovement::~PixelsMovement()
 {
+  stopRotSpriteTask();
+
   if (ColorBar::instance())
     ColorBar::instance()->unlockTilemapMode();
 }
@@ -201,7 +209,12 @@ void PixelsMovement::setFastMode(const bool fastMode)
   bool redraw = (m_fastMode && !fastMode);
   m_fastMode = fastMode;
   if (m_needsRotSpriteRedraw && redraw) {
+    // Redraw the fast preview and start rendering RotSprite in the
+    // background (see onRotSpriteTaskTimer()).
+    m_asyncRotSprite = true;
     redrawExtraImage();
+    m_asyncRotSprite = false;
+
     update_screen_for_document(m_document);
     m_needsRotSpriteRedraw = false;
   }
@@ -815,6 +828,7 @@ void PixelsMovement::alignMasksAndTransformData(
   const gfx::Size& deltaA,
   const gfx::Size& deltaB)
 {
+  invalidateRotSpriteCache();
   m_initialMask0->replace(make_aligned_mask(&grid, initialMask0));
   m_initialMask->replace(make_aligned_mask(&grid, initialMask));
   m_currentMask->replace(make_aligned_mask(&grid, currentMask));
@@ -951,6 +965,7 @@ void PixelsMovement::stampImage(bool finalStamp)
     stampExtraCelImage();
   }
 
+  invalidateRotSpriteCache();
   m_initialMask0->replace(initialMask0);
   m_initialMask->replace(initialMask);
   m_currentMask->replace(currentMask);
@@ -1133,6 +1148,9 @@ void PixelsMovement::redrawExtraImage(Transformation* transformation)
   if (!transformation)
     transformation = &m_currentData;
 
+  // A RotSprite task that is still running will be discarded
+  ++m_extraImageVersion;
+
   int t, opacity = (m_site.layer()->isImage() ?
                     static_cast<LayerImage*>(m_site.layer())->opacity(): 255);
   Cel* cel = m_site.cel();
@@ -1241,7 +1259,8 @@ void PixelsMovement::drawImage(
     drawParallelogram(
       transformation,
       dst, m_originalImage.get(),
-      m_initialMask.get(), corners, pt);
+      m_initialMask.get(), corners, pt,
+      &m_rotSpriteCache);
   }
 }
 
@@ -1264,7 +1283,8 @@ void PixelsMovement::drawMask(doc::Mask* mask, bool shrink)
                     m_initialMask->bitmap(),
                     nullptr,
                     corners,
-                    gfx::PointF(bounds.origin()));
+                    gfx::PointF(bounds.origin()),
+                    nullptr);
   if (shrink)
     mask->unfreeze();
 }
@@ -1273,7 +1293,8 @@ void PixelsMovement::drawParallelogram(
   const Transformation& transformation,
   doc::Image* dst, const doc::Image* src, const doc::Mask* mask,
   const Transformation::Corners& corners,
-  const gfx::PointF& leftTop)
+  const gfx::PointF& leftTop,
+  doc::algorithm::RotSpriteCache* rotSpriteCache)
 {
   tools::RotationAlgorithm rotAlgo = Preferences::instance().selection.rotationAlgorithm();
 
@@ -1293,6 +1314,13 @@ void PixelsMovement::drawParallelogram(
     m_needsRotSpriteRedraw = true;
     rotAlgo = tools::RotationAlgorithm::FAST;
   }
+  // Render RotSprite in the background and show the fast version
+  // until it's ready.
+  else if (rotAlgo == tools::RotationAlgorithm::ROTSPRITE &&
+           m_asyncRotSprite && rotSpriteCache) {
+    startRotSpriteTask(dst, src, mask, corners, leftTop);
+    rotAlgo = tools::RotationAlgorithm::FAST;
+  }
 
 retry:;      // In case that we don't have enough memory for RotSprite
              // we can try with the fast algorithm anyway.
@@ -1313,6 +1341,10 @@ retry:;      // In case that we don't have enough memory for RotSprite
       break;
 
     case tools::RotationAlgorithm::ROTSPRITE:
+      // The cache cannot be used from two threads at the same time
+      if (rotSpriteCache)
+        stopRotSpriteTask();
+
       try {
         doc::algorithm::rotsprite_image(
           dst, src, (mask ? mask->bitmap(): nullptr),
@@ -1323,7 +1355,8 @@ retry:;      // In case that we don't have enough memory for RotSprite
           int(corners.rightBottom().x-leftTop.x),
           int(corners.rightBottom().y-leftTop.y),
           int(corners.leftBottom().x-leftTop.x),
-          int(corners.leftBottom().y-leftTop.y));
+          int(corners.leftBottom().y-leftTop.y),
+          rotSpriteCache);
       }
       catch (const std::bad_alloc&) {
         StatusBar::instance()->showTip(
@@ -1338,6 +1371,96 @@ retry:;      // In case that we don't have enough memory for RotSprite
   }
 }
 
+void PixelsMovement::startRotSpriteTask(
+  const doc::Image* dst, const doc::Image* src, const doc::Mask* mask,
+  const Transformation::Corners& corners,
+  const gfx::PointF& leftTop)
+{
+  stopRotSpriteTask();
+
+  // The task works with copies of the images because the originals
+  // can be modified from the UI thread (e.g. the mask color of the
+  // source image). "result" contains the original layer pixels
+  // already rendered by drawImage().
+  ImageRef result(Image::createCopy(dst));
+  ImageRef srcCopy(Image::createCopy(src));
+  ImageRef maskCopy(mask && mask->bitmap() ?
+                    Image::createCopy(mask->bitmap()): nullptr);
+  const int version = m_extraImageVersion;
+  const int xy[8] = {
+    int(corners.leftTop().x-leftTop.x),
+    int(corners.leftTop().y-leftTop.y),
+    int(corners.rightTop().x-leftTop.x),
+    int(corners.rightTop().y-leftTop.y),
+    int(corners.rightBottom().x-leftTop.x),
+    int(corners.rightBottom().y-leftTop.y),
+    int(corners.leftBottom().x-leftTop.x),
+    int(corners.leftBottom().y-leftTop.y)
+  };
+
+  m_rotSpriteResult.reset();
+  m_rotSpriteTask.run(
+    [this, result, srcCopy, maskCopy, version, xy](base::task_token& token) {
+      try {
+        doc::algorithm::rotsprite_image(
+          result.get(), srcCopy.get(), maskCopy.get(),
+          xy[0], xy[1], xy[2], xy[3], xy[4], xy[5], xy[6], xy[7],
+          &m_rotSpriteCache, &token);
+      }
+      catch (const std::bad_alloc&) {
+        // Keep the fast version
+        return;
+      }
+      if (token.canceled())
+        return;
+
+      m_rotSpriteResult = result;
+      m_rotSpriteResultVersion = version;
+    });
+  m_rotSpriteTimer.start();
+}
+
+// Cancels the RotSprite task (if it's running), waits it, and
+// discards its result.
+void PixelsMovement::stopRotSpriteTask()
+{
+  if (m_rotSpriteTimer.isRunning()) {
+    m_rotSpriteTimer.stop();
+    m_rotSpriteTask.cancel();
+    m_rotSpriteTask.wait();
+    m_rotSpriteResult.reset();
+  }
+}
+
+void PixelsMovement::onRotSpriteTaskTimer()
+{
+  if (!m_rotSpriteTask.completed())
+    return;
+
+  m_rotSpriteTimer.stop();
+
+  ImageRef result = m_rotSpriteResult;
+  m_rotSpriteResult.reset();
+
+  // Copy the result only if the extra cel wasn't re-drawn after
+  // starting the task.
+  if (result &&
+      m_rotSpriteResultVersion == m_extraImageVersion &&
+      m_extraCel &&
+      m_extraCel->image() &&
+      m_extraCel->image()->bounds() == result->bounds()) {
+    m_extraCel->image()->copy(result.get(),
+                              gfx::Clip(result->bounds()));
+    update_screen_for_document(m_document);
+  }
+}
+
+void PixelsMovement::invalidateRotSpriteCache()
+{
+  stopRotSpriteTask();
+  m_rotSpriteCache.invalidate();
+}
+
 static void merge_tilemaps(Image* dst, const Image* src, gfx::Clip area)
 {
   if (!area.clip(dst->width(), dst->height(), src->width(), src->height()))
@@ -1424,6 +1547,8 @@ void PixelsMovement::hideDocumentMask()
 
 void PixelsMovement::flipOriginalImage(const doc::algorithm::FlipType flipType)
 {
+  invalidateRotSpriteCache();
+
   // Flip the image.
   doc::algorithm::flip_image(
     m_originalImage.get(),
@@ -1442,6 +1567,7 @@ void PixelsMovement::flipOriginalImage(const doc::algorithm::FlipType flipType)
 void PixelsMovement::shiftOriginalImage(const int dx, const int dy,
                                         const double angle)
 {
+  invalidateRotSpriteCache();
   doc::algorithm::shift_image(
     m_originalImage.get(), dx, dy, angle);
 }
@@ -1556,6 +1682,7 @@ void PixelsMovement::reproduceAllTransformationsWithInnerCmds()
             "frame", m_site.frame());
   DUMP_INNER_CMDS();
 
+  invalidateRotSpriteCache();
   m_document->setMask(m_initialMask0.get());
   m_initialMask->copyFrom(m_initialMask0.get());
   if (m_site.layer()->isTilemap() && m_site.tilemapMode() == TilemapMode::Tiles) {
@@ -12,14 +12,17 @@
 #include "app/context_access.h"
 #include "app/extra_cel.h"
 #include "app/site.h"
+#include "app/task.h"
 #include "app/transformation.h"
 #include "app/tx.h"
 #include "app/ui/editor/handle_type.h"
 #include "doc/algorithm/flip_type.h"
+#include "doc/algorithm/rotsprite.h"
 #include "doc/frame.h"
 #include "doc/image_ref.h"
 #include "gfx/size.h"
 #include "obs/connection.h"
+#include "ui/timer.h"
 
 #include <memory>
 
@@ -150,7 +153,15 @@ namespace app {
       const Transformation& transformation,
       doc::Image* dst, const doc::Image* src, const doc::Mask* mask,
       const Transformation::Corners& corners,
+      const gfx::PointF& leftTop,
+      doc::algorithm::RotSpriteCache* rotSpriteCache);
+    void startRotSpriteTask(
+      const doc::Image* dst, const doc::Image* src, const doc::Mask* mask,
+      const Transformation::Corners& corners,
       const gfx::PointF& leftTop);
+    void stopRotSpriteTask();
+    void onRotSpriteTaskTimer();
+    void invalidateRotSpriteCache();
     void drawTransformedTilemap(
       const Transformation& transformation,
       doc::Image* dst, const doc::Image* src, const doc::Mask* mask);
@@ -203,6 +214,21 @@ namespace app {
     bool m_fastMode;
     bool m_needsRotSpriteRedraw;
 
+    // When the fast mode is disabled, RotSprite is rendered in a
+    // background task (the fast preview is displayed meanwhile) and
+    // then copied to the extra cel if it's still valid (i.e. if the
+    // extra cel wasn't redrawn in the meantime).
+    bool m_asyncRotSprite;
+    int m_extraImageVersion;
+    app::Task m_rotSpriteTask;
+    ui::Timer m_rotSpriteTimer;
+    doc::ImageRef m_rotSpriteResult;
+    int m_rotSpriteResultVersion;
+
+    // 8x upscaled version of m_originalImage, re-used while the user
+    // changes the angle/scale of the selection.
+    doc::algorithm::RotSpriteCache m_rotSpriteCache;
+
     // Commands used in the interaction with the transformed pixels.
     // This is used to re-create the whole interaction on each
     // modified cel when we are modifying multiples cels at the same
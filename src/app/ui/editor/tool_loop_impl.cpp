@@ -231,10 +231,12 @@ public:
     }
 
     if (m_controller->isFreehand() &&
-        !m_pointShape->isFloodFill() &&
-        // TODO add dynamics support when UI is not enabled
-        App::instance()->contextBar()) {
-      m_dynamics = App::instance()->contextBar()->getDynamics();
+        !m_pointShape->isFloodFill()) {
+      if (params.dynamics)
+        m_dynamics = *params.dynamics;
+      // TODO add dynamics support when UI is not enabled
+      else if (App::instance()->contextBar())
+        m_dynamics = App::instance()->contextBar()->getDynamics();
     }
 
     if (m_tracePolicy == tools::TracePolicy::Accumulate) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -45,6 +45,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -83,22 +84,112 @@ void mask_image(Image* image, Image* bitmap)
   }
 }
 
+// Size of the square blocks used to compare two images in
+// create_region_with_block_differences()
+constexpr int kDiffBlockSize = 32;
+
+// Returns the bounds of the pixels that are different between "a"
+// and "b" inside the given block. Rows are compared with memcmp()
+// (which compares several pixels at the same time), and only rows
+// with differences are compared pixel by pixel.
+template<typename ImageTraits>
+gfx::Rect block_differences_templ(const Image* a,
+                                  const Image* b,
+                                  const gfx::Rect& block)
+{
+  const std::size_t rowBytes = block.w * ImageTraits::bytes_per_pixel;
+  int x1 = block.x2(), x2 = block.x-1;
+  int y1 = block.y2(), y2 = block.y-1;
+
+  for (int y=block.y; y<block.y2(); ++y) {
+    auto aPtr = get_pixel_address_fast<ImageTraits>(a, block.x, y);
+    auto bPtr = get_pixel_address_fast<ImageTraits>(b, block.x, y);
+    if (std::memcmp(aPtr, bPtr, rowBytes) == 0)
+      continue;
+
+    y1 = std::min(y1, y);
+    y2 = y;
+
+    // The first and last different pixels in this row
+    int u = 0;
+    while (aPtr[u] == bPtr[u])
+      ++u;
+    x1 = std::min(x1, block.x+u);
+
+    u = block.w-1;
+    while (aPtr[u] == bPtr[u])
+      --u;
+    x2 = std::max(x2, block.x+u);
+  }
+
+  if (y1 > y2)
+    return gfx::Rect();
+  return gfx::Rect(x1, y1, x2-x1+1, y2-y1+1);
+}
+
+// Each row is compared with memcmp(), and only rows with differences
+// are compared pixel by pixel to add the runs of different pixels to
+// the output region.
 template<typename ImageTraits>
 void create_region_with_differences_templ(const Image* a,
                                           const Image* b,
                                           const gfx::Rect& bounds,
                                           gfx::Region& output)
 {
+  const std::size_t rowBytes = bounds.w * ImageTraits::bytes_per_pixel;
+
   for (int y=bounds.y; y<bounds.y2(); ++y) {
-    for (int x=bounds.x; x<bounds.x2(); ++x) {
-      if (get_pixel_fast<ImageTraits>(a, x, y) !=
-          get_pixel_fast<ImageTraits>(b, x, y)) {
-        output.createUnion(output, gfx::Region(gfx::Rect(x, y, 1, 1)));
+    auto aPtr = get_pixel_address_fast<ImageTraits>(a, bounds.x, y);
+    auto bPtr = get_pixel_address_fast<ImageTraits>(b, bounds.x, y);
+    if (std::memcmp(aPtr, bPtr, rowBytes) == 0)
+      continue;
+
+    for (int u=0; u<bounds.w; ) {
+      if (aPtr[u] == bPtr[u]) {
+        ++u;
+        continue;
       }
+      const int u1 = u;
+      while (u < bounds.w && aPtr[u] != bPtr[u])
+        ++u;
+      output |= gfx::Region(gfx::Rect(bounds.x+u1, y, u-u1, 1));
     }
   }
 }
 
+// Instead of creating a region with each different pixel (which is
+// too slow for big images), the image is divided in blocks, and
+// consecutive blocks of each row with differences are added to the
+// output region as one rectangle (the bounds of their differences).
+template<typename ImageTraits>
+void create_region_with_block_differences_templ(const Image* a,
+                                                const Image* b,
+                                                const gfx::Rect& bounds,
+                                                gfx::Region& output)
+{
+  for (int y=bounds.y; y<bounds.y2(); y+=kDiffBlockSize) {
+    const int h = std::min(kDiffBlockSize, bounds.y2()-y);
+    gfx::Rect run;
+
+    for (int x=bounds.x; x<bounds.x2(); x+=kDiffBlockSize) {
+      const int w = std::min(kDiffBlockSize, bounds.x2()-x);
+      const gfx::Rect diff =
+        block_differences_templ<ImageTraits>(a, b, gfx::Rect(x, y, w, h));
+
+      if (!diff.isEmpty()) {
+        run |= diff;
+      }
+      else if (!run.isEmpty()) {
+        output |= gfx::Region(run);
+        run = gfx::Rect();
+      }
+    }
+
+    if (!run.isEmpty())
+      output |= gfx::Region(run);
+  }
+}
+
 // TODO merge this with Sprite::getTilemapsByTileset()
 template<typename UnaryFunction>
 void for_each_tile_using_tileset(Tileset* tileset, UnaryFunction f)
@@ -258,10 +349,27 @@ void create_region_with_differences(const Image* a,
                                     gfx::Region& output)
 {
   ASSERT(a->pixelFormat() == b->pixelFormat());
+  const gfx::Rect rc = (bounds & a->bounds() & b->bounds());
+  switch (a->pixelFormat()) {
+    case IMAGE_RGB: create_region_with_differences_templ<RgbTraits>(a, b, rc, output); break;
+    case IMAGE_GRAYSCALE: create_region_with_differences_templ<GrayscaleTraits>(a, b, rc, output); break;
+    case IMAGE_INDEXED: create_region_with_differences_templ<IndexedTraits>(a, b, rc, output); break;
+    case IMAGE_TILEMAP: create_region_with_differences_templ<TilemapTraits>(a, b, rc, output); break;
+  }
+}
+
+void create_region_with_block_differences(const Image* a,
+                                          const Image* b,
+                                          const gfx::Rect& bounds,
+                                          gfx::Region& output)
+{
+  ASSERT(a->pixelFormat() == b->pixelFormat());
+  const gfx::Rect rc = (bounds & a->bounds() & b->bounds());
   switch (a->pixelFormat()) {
-    case IMAGE_RGB: create_region_with_differences_templ<RgbTraits>(a, b, bounds, output); break;
-    case IMAGE_GRAYSCALE: create_region_with_differences_templ<GrayscaleTraits>(a, b, bounds, output); break;
-    case IMAGE_INDEXED: create_region_with_differences_templ<IndexedTraits>(a, b, bounds, output); break;
+    case IMAGE_RGB:       create_region_with_block_differences_templ<RgbTraits>(a, b, rc, output); break;
+    case IMAGE_GRAYSCALE: create_region_with_block_differences_templ<GrayscaleTraits>(a, b, rc, output); break;
+    case IMAGE_INDEXED:   create_region_with_block_differences_templ<IndexedTraits>(a, b, rc, output); break;
+    case IMAGE_TILEMAP:   create_region_with_block_differences_templ<TilemapTraits>(a, b, rc, output); break;
   }
 }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -35,11 +35,21 @@ namespace app {
   typedef std::function<doc::ImageRef(const doc::ImageRef& origTile,
                                       const gfx::Rect& tileBoundsInCanvas)> GetTileImageFunc;
 
+  // Adds to "output" the pixels inside "bounds" where "a" and "b"
+  // are different.
   void create_region_with_differences(const doc::Image* a,
                                       const doc::Image* b,
                                       const gfx::Rect& bounds,
                                       gfx::Region& output);
 
+  // Faster version of create_region_with_differences() for big
+  // images, the region can include some equal pixels (it's formed by
+  // the bounds of the differences of blocks of pixels).
+  void create_region_with_block_differences(const doc::Image* a,
+                                            const doc::Image* b,
+                                            const gfx::Rect& bounds,
+                                            gfx::Region& output);
+
   // Creates a new image of the given cel
   doc::ImageRef crop_cel_image(
     const doc::Cel* cel,
@@ -0,0 +1,100 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/test_context.h"
+#include "app/tx.h"
+#include "app/util/cel_ops.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer_tilemap.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+
+using namespace app;
+using namespace doc;
+
+TEST(CelOps, RegionWithDifferences)
+{
+  ImageRef a(Image::create(IMAGE_RGB, 40, 40));
+  ImageRef b(Image::create(IMAGE_RGB, 40, 40));
+  clear_image(a.get(), 0);
+  clear_image(b.get(), 0);
+  for (int i=0; i<40; ++i)
+    put_pixel(b.get(), i, i, rgba(255, 0, 0, 255));
+  fill_rect(b.get(), 2, 30, 5, 31, rgba(0, 0, 255, 255));
+
+  // Only the different pixels are included
+  gfx::Region rgn;
+  create_region_with_differences(a.get(), b.get(), a->bounds(), rgn);
+  for (int y=0; y<40; ++y) {
+    for (int x=0; x<40; ++x) {
+      EXPECT_EQ(get_pixel(a.get(), x, y) != get_pixel(b.get(), x, y),
+                rgn.contains(gfx::Point(x, y)))
+        << " x=" << x << " y=" << y;
+    }
+  }
+
+  // All different pixels are included in the block version
+  gfx::Region blockRgn;
+  create_region_with_block_differences(a.get(), b.get(), a->bounds(), blockRgn);
+  EXPECT_TRUE(gfx::Region().createSubtraction(rgn, blockRgn).isEmpty());
+}
+
+TEST(CelOps, ModifyTwoCellsWithTheSameTile)
+{
+  const color_t red = rgba(255, 0, 0, 255);
+  const color_t blue = rgba(0, 0, 255, 255);
+
+  TestContextT<Context> ctx;
+  std::unique_ptr<Doc> doc(ctx.documents().add(16, 8));
+  Sprite* sprite = doc->sprite();
+
+  auto tileset = new Tileset(sprite, Grid(gfx::Size(8, 8)), 2);
+  sprite->tilesets()->add(tileset);
+  Image* tileImage = tileset->get(1).get();
+  clear_image(tileImage, 0);
+
+  auto layer = new LayerTilemap(sprite, 0);
+  sprite->root()->addLayer(layer);
+  ImageRef tilemap(Image::create(IMAGE_TILEMAP, 2, 1));
+  put_pixel(tilemap.get(), 0, 0, doc::tile(1, 0));
+  put_pixel(tilemap.get(), 1, 0, doc::tile(1, 0));
+  layer->addCel(new Cel(0, tilemap));
+
+  // A dot in the first cell and a diagonal line in the second one,
+  // both modifications must be applied to the same tile
+  ImageRef canvas(Image::create(IMAGE_RGB, 16, 8));
+  clear_image(canvas.get(), 0);
+  put_pixel(canvas.get(), 5, 2, blue);
+  for (int i=0; i<8; ++i)
+    put_pixel(canvas.get(), 8+i, i, red);
+
+  {
+    Tx tx(sprite, "");
+    modify_tilemap_cel_region(
+      tx, layer->cel(0), nullptr,
+      gfx::Region(canvas->bounds()),
+      TilesetMode::Manual,
+      [&canvas](const ImageRef& origTile,
+                const gfx::Rect& tileBoundsInCanvas) -> ImageRef {
+        return ImageRef(crop_image(canvas.get(), tileBoundsInCanvas, 0));
+      });
+    tx.commit();
+  }
+
+  tileImage = tileset->get(1).get();
+  EXPECT_EQ(blue, get_pixel(tileImage, 5, 2));
+  for (int i=0; i<8; ++i)
+    EXPECT_EQ(red, get_pixel(tileImage, i, i));
+
+  doc->close();
+}
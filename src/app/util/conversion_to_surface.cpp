@@ -16,6 +16,7 @@
 #include "doc/color_scales.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/rgbmap.h"
 #include "os/surface.h"
 #include "os/surface_format.h"
@@ -27,64 +28,156 @@
 #include <algorithm>
 #include <stdexcept>
 
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+#endif
+
 namespace app {
 
 using namespace doc;
 
 namespace {
 
-template<typename ImageTraits, os::SurfaceFormat format>
-uint32_t convert_color_to_surface(color_t color, const Palette* palette, const ImageSpec& spec, const os::SurfaceFormatData* fd) {
-  static_assert(false && sizeof(ImageTraits), "Invalid color conversion");
-  return 0;
-}
+// Minimum number of pixels to convert in each thread (chunks run in
+// the threads of doc::parallel_ranges() pool, so no thread is created
+// on each repaint)
+const int kMinPixelsPerThread = 64*1024;
+
+// Converts RGBA colors to the surface format (the shifts/masks are
+// copied from the SurfaceFormatData so the compiler knows they don't
+// change inside the loops).
+class RgbaToSurface {
+public:
+  RgbaToSurface(const os::SurfaceFormatData* fd)
+    : m_rs(fd->redShift), m_gs(fd->greenShift)
+    , m_bs(fd->blueShift), m_as(fd->alphaShift)
+    , m_rm(fd->redMask), m_gm(fd->greenMask)
+    , m_bm(fd->blueMask), m_am(fd->alphaMask) { }
+
+  uint32_t operator()(color_t c) const {
+    return
+      ((rgba_getr(c) << m_rs) & m_rm) |
+      ((rgba_getg(c) << m_gs) & m_gm) |
+      ((rgba_getb(c) << m_bs) & m_bm) |
+      ((rgba_geta(c) << m_as) & m_am);
+  }
 
-template<>
-uint32_t convert_color_to_surface<RgbTraits, os::kRgbaSurfaceFormat>(color_t c, const Palette* palette, const ImageSpec& spec, const os::SurfaceFormatData* fd) {
-  return
-    ((rgba_getr(c) << fd->redShift  ) & fd->redMask  ) |
-    ((rgba_getg(c) << fd->greenShift) & fd->greenMask) |
-    ((rgba_getb(c) << fd->blueShift ) & fd->blueMask ) |
-    ((rgba_geta(c) << fd->alphaShift) & fd->alphaMask);
-}
+private:
+  uint32_t m_rs, m_gs, m_bs, m_as;
+  uint32_t m_rm, m_gm, m_bm, m_am;
+};
 
-template<>
-uint32_t convert_color_to_surface<GrayscaleTraits, os::kRgbaSurfaceFormat>(color_t c, const Palette* palette, const ImageSpec& spec, const os::SurfaceFormatData* fd) {
-  return
-    ((graya_getv(c) << fd->redShift  ) & fd->redMask  ) |
-    ((graya_getv(c) << fd->greenShift) & fd->greenMask) |
-    ((graya_getv(c) << fd->blueShift ) & fd->blueMask ) |
-    ((graya_geta(c) << fd->alphaShift) & fd->alphaMask);
-}
+// Precalculated surface colors for each palette index (the mask
+// color is converted to transparent).
+class IndexedToSurface {
+public:
+  IndexedToSurface(const Palette* palette, const ImageSpec& spec,
+                   const os::SurfaceFormatData* fd) {
+    const RgbaToSurface convert(fd);
+    for (int i=0; i<256; ++i)
+      m_lut[i] = convert(color_t(i) == spec.maskColor() ? 0: palette->getEntry(i));
+  }
+
+  uint32_t operator()(IndexedTraits::pixel_t c) const {
+    return m_lut[c];
+  }
+
+private:
+  uint32_t m_lut[256];
+};
+
+// Precalculated surface colors for each gray value and alpha (each
+// channel is converted separately, so we can join them with OR).
+class GrayscaleToSurface {
+public:
+  GrayscaleToSurface(const os::SurfaceFormatData* fd) {
+    const RgbaToSurface convert(fd);
+    for (int i=0; i<256; ++i) {
+      m_lutV[i] = convert(rgba(i, i, i, 0));
+      m_lutA[i] = convert(rgba(0, 0, 0, i));
+    }
+  }
+
+  uint32_t operator()(GrayscaleTraits::pixel_t c) const {
+    return m_lutV[graya_getv(c)] | m_lutA[graya_geta(c)];
+  }
+
+private:
+  uint32_t m_lutV[256];
+  uint32_t m_lutA[256];
+};
+
+struct Address24bpp
+{
+  uint8_t* m_ptr;
+  Address24bpp(uint8_t* ptr) : m_ptr(ptr) { }
+  Address24bpp& operator++() { m_ptr += 3; return *this; }
+  Address24bpp& operator*() { return *this; }
+  Address24bpp& operator=(uint32_t c) {
+    base::write24bits(m_ptr, c);
+    return *this;
+  }
+};
 
-template<>
-uint32_t convert_color_to_surface<IndexedTraits, os::kRgbaSurfaceFormat>(color_t c0, const Palette* palette, const ImageSpec& spec, const os::SurfaceFormatData* fd) {
-  color_t c = (c0 == spec.maskColor() ? 0 : palette->getEntry(c0));
-  return
-    ((rgba_getr(c) << fd->redShift  ) & fd->redMask  ) |
-    ((rgba_getg(c) << fd->greenShift) & fd->greenMask) |
-    ((rgba_getb(c) << fd->blueShift ) & fd->blueMask ) |
-    ((rgba_geta(c) << fd->alphaShift) & fd->alphaMask);
+// Converts the rows of the image in parallel (for big areas) using
+// the given "convert" function for each pixel.
+template<typename ImageTraits, typename AddressType, typename Convert>
+void convert_image_to_surface_templ(const Image* image, os::Surface* dst,
+  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Convert& convert)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+
+  parallel_ranges(
+    h, kMinPixelsPerThread / w,
+    [&](const int v1, const int v2) {
+      for (int v=v1; v<v2; ++v) {
+        auto src_address = (const pixel_t*)image->getPixelAddress(src_x, src_y+v);
+        AddressType dst_address = AddressType(dst->getData(dst_x, dst_y+v));
+        for (int u=0; u<w; ++u, ++dst_address)
+          *dst_address = convert(src_address[u]);
+      }
+    });
 }
 
-template<>
-uint32_t convert_color_to_surface<BitmapTraits, os::kRgbaSurfaceFormat>(color_t c0, const Palette* palette, const ImageSpec& spec, const os::SurfaceFormatData* fd) {
-  color_t c = palette->getEntry(c0);
-  return
-    ((rgba_getr(c) << fd->redShift  ) & fd->redMask  ) |
-    ((rgba_getg(c) << fd->greenShift) & fd->greenMask) |
-    ((rgba_getb(c) << fd->blueShift ) & fd->blueMask ) |
-    ((rgba_geta(c) << fd->alphaShift) & fd->alphaMask);
+template<typename ImageTraits, typename Convert>
+void convert_image_to_surface_selector(const Image* image, os::Surface* surface,
+  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const os::SurfaceFormatData* fd,
+  const Convert& convert)
+{
+  switch (fd->bitsPerPixel) {
+
+    case 8:
+      convert_image_to_surface_templ<ImageTraits, uint8_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
+      break;
+
+    case 15:
+    case 16:
+      convert_image_to_surface_templ<ImageTraits, uint16_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
+      break;
+
+    case 24:
+      convert_image_to_surface_templ<ImageTraits, Address24bpp>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
+      break;
+
+    case 32:
+      convert_image_to_surface_templ<ImageTraits, uint32_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
+      break;
+  }
 }
 
-template<typename ImageTraits, typename AddressType>
-void convert_image_to_surface_templ(const Image* image, os::Surface* dst,
+// Bitmap pixels are not addressable, we use an iterator.
+template<typename AddressType>
+void convert_bitmap_to_surface_templ(const Image* image, os::Surface* dst,
   int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const os::SurfaceFormatData* fd)
 {
-  const LockImageBits<ImageTraits> bits(image, gfx::Rect(src_x, src_y, w, h));
-  typename LockImageBits<ImageTraits>::const_iterator src_it = bits.begin();
+  const RgbaToSurface convert(fd);
+  const uint32_t colors[2] = { convert(palette->getEntry(0)),
+                               convert(palette->getEntry(1)) };
+
+  const LockImageBits<BitmapTraits> bits(image, gfx::Rect(src_x, src_y, w, h));
+  LockImageBits<BitmapTraits>::const_iterator src_it = bits.begin();
 #ifdef _DEBUG
-  typename LockImageBits<ImageTraits>::const_iterator src_end = bits.end();
+  LockImageBits<BitmapTraits>::const_iterator src_end = bits.end();
 #endif
 
   for (int v=0; v<h; ++v, ++dst_y) {
@@ -92,50 +185,60 @@ void convert_image_to_surface_templ(const Image* image, os::Surface* dst,
     for (int u=0; u<w; ++u) {
       ASSERT(src_it != src_end);
 
-      *dst_address = convert_color_to_surface<ImageTraits, os::kRgbaSurfaceFormat>(*src_it, palette, image->spec(), fd);
+      *dst_address = colors[*src_it ? 1: 0];
       ++dst_address;
       ++src_it;
     }
   }
 }
 
-struct Address24bpp
-{
-  uint8_t* m_ptr;
-  Address24bpp(uint8_t* ptr) : m_ptr(ptr) { }
-  Address24bpp& operator++() { m_ptr += 3; return *this; }
-  Address24bpp& operator*() { return *this; }
-  Address24bpp& operator=(uint32_t c) {
-    base::write24bits(m_ptr, c);
-    return *this;
-  }
-};
-
-template<typename ImageTraits>
-void convert_image_to_surface_selector(const Image* image, os::Surface* surface,
+void convert_bitmap_to_surface(const Image* image, os::Surface* surface,
   int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const os::SurfaceFormatData* fd)
 {
   switch (fd->bitsPerPixel) {
 
     case 8:
-      convert_image_to_surface_templ<ImageTraits, uint8_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_bitmap_to_surface_templ<uint8_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
       break;
 
     case 15:
     case 16:
-      convert_image_to_surface_templ<ImageTraits, uint16_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_bitmap_to_surface_templ<uint16_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
       break;
 
     case 24:
-      convert_image_to_surface_templ<ImageTraits, Address24bpp>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_bitmap_to_surface_templ<Address24bpp>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
       break;
 
     case 32:
-      convert_image_to_surface_templ<ImageTraits, uint32_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_bitmap_to_surface_templ<uint32_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
       break;
   }
 }
 
+// Swaps the red and blue channels (RGBA <-> BGRA), the most common
+// case when the surface is not RGBA.
+void swap_red_blue(const uint32_t* src, uint32_t* dst, int w)
+{
+  int u = 0;
+#if defined(__x86_64__) || defined(_WIN64)
+  const __m128i ga = _mm_set1_epi32(0xff00ff00);
+  const __m128i ch = _mm_set1_epi32(0xff);
+  for (; u+4<=w; u+=4) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(src+u));
+    const __m128i r = _mm_and_si128(c, ch);
+    const __m128i b = _mm_and_si128(_mm_srli_epi32(c, 16), ch);
+    _mm_storeu_si128((__m128i*)(dst+u),
+                     _mm_or_si128(_mm_and_si128(c, ga),
+                                  _mm_or_si128(_mm_slli_epi32(r, 16), b)));
+  }
+#endif
+  for (; u<w; ++u) {
+    const uint32_t c = src[u];
+    dst[u] = (c & 0xff00ff00) | ((c & 0xff) << 16) | ((c >> 16) & 0xff);
+  }
+}
+
 } // anonymous namespace
 
 
@@ -190,19 +293,41 @@ void convert_image_to_surface(
         }
         return;
       }
-      convert_image_to_surface_selector<RgbTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+      // BGRA surface
+      if (fd.bitsPerPixel == 32 &&
+          fd.redShift == rgba_b_shift &&
+          fd.greenShift == rgba_g_shift &&
+          fd.blueShift == rgba_r_shift &&
+          fd.alphaShift == rgba_a_shift) {
+        parallel_ranges(
+          h, kMinPixelsPerThread / w,
+          [&](const int v1, const int v2) {
+            for (int v=v1; v<v2; ++v) {
+              swap_red_blue((const uint32_t*)image->getPixelAddress(src_x, src_y+v),
+                            (uint32_t*)surface->getData(dst_x, dst_y+v), w);
+            }
+          });
+        break;
+      }
+      convert_image_to_surface_selector<RgbTraits>(
+        image, surface, src_x, src_y, dst_x, dst_y, w, h, &fd,
+        RgbaToSurface(&fd));
       break;
 
     case IMAGE_GRAYSCALE:
-      convert_image_to_surface_selector<GrayscaleTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+      convert_image_to_surface_selector<GrayscaleTraits>(
+        image, surface, src_x, src_y, dst_x, dst_y, w, h, &fd,
+        GrayscaleToSurface(&fd));
       break;
 
     case IMAGE_INDEXED:
-      convert_image_to_surface_selector<IndexedTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+      convert_image_to_surface_selector<IndexedTraits>(
+        image, surface, src_x, src_y, dst_x, dst_y, w, h, &fd,
+        IndexedToSurface(palette, image->spec(), &fd));
       break;
 
     case IMAGE_BITMAP:
-      convert_image_to_surface_selector<BitmapTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+      convert_bitmap_to_surface(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
       break;
 
     default:
@@ -210,6 +335,42 @@ void convert_image_to_surface(
       throw std::runtime_error("conversion not supported");
   }
 
+  notify_surface_pixels_changed(surface);
+}
+
+Image* create_rgb_image_view_from_surface(
+  os::Surface* surface,
+  const gfx::Size& size,
+  const ImageBufferPtr& buffer)
+{
+  if (size.w < 1 || size.h < 1 ||
+      size.w > surface->width() ||
+      size.h > surface->height())
+    return nullptr;
+
+  os::SurfaceFormatData fd;
+  surface->getFormat(&fd);
+  if (fd.bitsPerPixel != 32 ||
+      gfx::ColorRShift != fd.redShift ||
+      gfx::ColorGShift != fd.greenShift ||
+      gfx::ColorBShift != fd.blueShift ||
+      gfx::ColorAShift != fd.alphaShift)
+    return nullptr;
+
+  uint8_t* pixels = surface->getData(0, 0);
+  const int rowBytes =
+    (surface->height() > 1 ? int(surface->getData(0, 1) - pixels):
+                             RgbTraits::rowstride_bytes(surface->width()));
+  if (!pixels ||
+      rowBytes < RgbTraits::rowstride_bytes(size.w))
+    return nullptr;
+
+  return Image::createView(ImageSpec(ColorMode::RGB, size.w, size.h),
+                           pixels, rowBytes, buffer);
+}
+
+void notify_surface_pixels_changed(os::Surface* surface)
+{
 #if LAF_SKIA
   // Increment SkBitmap generation ID so it's re-uploaded to the GPU
   // as a texture if it's needed.
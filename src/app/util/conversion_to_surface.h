@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2020  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2014 David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,9 @@
 #define APP_UTIL_CONVERSION_TO_SURFACE_H_INCLUDED
 #pragma once
 
+#include "doc/image_buffer.h"
+#include "gfx/size.h"
+
 namespace doc {
   class Image;
   class Palette;
@@ -28,6 +31,19 @@ namespace app {
     int dst_x, int dst_y,
     int w, int h);
 
+  // Returns an IMAGE_RGB image of the given size that uses the
+  // pixels of the surface directly (from its origin), or nullptr if
+  // the surface pixel format is not compatible with RgbTraits. The
+  // surface must be locked while the image is used, and
+  // notify_surface_pixels_changed() must be called after modifying
+  // the pixels.
+  doc::Image* create_rgb_image_view_from_surface(
+    os::Surface* surface,
+    const gfx::Size& size,
+    const doc::ImageBufferPtr& buffer = doc::ImageBufferPtr());
+
+  void notify_surface_pixels_changed(os::Surface* surface);
+
 } // namespace app
 
 #endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -301,11 +301,9 @@ void ExpandCelCanvas::commit()
     if (m_canCompareSrcVsDst) {
       ASSERT(gfx::Region().createSubtraction(m_validDstRegion, m_validSrcRegion).isEmpty());
 
-      for (gfx::Rect rc : m_validDstRegion) {
-        if (algorithm::shrink_bounds2(getSourceCanvas(),
-                                      getDestCanvas(), rc, rc)) {
-          reduced |= gfx::Region(rc);
-        }
+      for (const gfx::Rect& rc : m_validDstRegion) {
+        create_region_with_block_differences(getSourceCanvas(),
+                                             getDestCanvas(), rc, reduced);
       }
 
       regionToPatch = &reduced;
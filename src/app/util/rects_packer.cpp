@@ -0,0 +1,410 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/rects_packer.h"
+
+#include "base/task.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace app {
+
+namespace {
+
+// Where a rectangle is placed between all the free areas where it
+// fits.
+enum class FitRule {
+  BestShortSide,        // Minimize the shortest leftover side
+  BestArea,             // Minimize the leftover area
+};
+
+// Free areas of a texture that is being packed. Each free area is
+// the biggest possible rectangle, so they can overlap.
+class MaxRects {
+public:
+  MaxRects(const gfx::Size& size) {
+    m_free.push_back(gfx::Rect(size));
+  }
+
+  bool insert(const gfx::Size& size,
+              const FitRule rule,
+              gfx::Point& pos) {
+    const gfx::Rect* best = nullptr;
+    int64_t bestScore1 = std::numeric_limits<int64_t>::max();
+    int64_t bestScore2 = std::numeric_limits<int64_t>::max();
+
+    for (const gfx::Rect& rc : m_free) {
+      if (rc.w < size.w || rc.h < size.h)
+        continue;
+
+      const int leftoverW = rc.w - size.w;
+      const int leftoverH = rc.h - size.h;
+      const int shortSide = std::min(leftoverW, leftoverH);
+      const int longSide = std::max(leftoverW, leftoverH);
+      int64_t score1, score2;
+
+      switch (rule) {
+        case FitRule::BestShortSide:
+          score1 = shortSide;
+          score2 = longSide;
+          break;
+        case FitRule::BestArea:
+          score1 = int64_t(rc.w)*rc.h - int64_t(size.w)*size.h;
+          score2 = shortSide;
+          break;
+      }
+
+      if (score1 < bestScore1 ||
+          (score1 == bestScore1 && score2 < bestScore2)) {
+        best = &rc;
+        bestScore1 = score1;
+        bestScore2 = score2;
+      }
+    }
+
+    if (!best)
+      return false;
+
+    pos = best->origin();
+    place(gfx::Rect(pos, size));
+    return true;
+  }
+
+private:
+  // Splits all free areas that intersect the "used" rectangle.
+  void place(const gfx::Rect& used) {
+    m_new.clear();
+
+    for (std::size_t i=0; i<m_free.size(); ) {
+      const gfx::Rect rc = m_free[i];
+      if (!rc.intersects(used)) {
+        ++i;
+        continue;
+      }
+
+      m_free[i] = m_free.back();
+      m_free.pop_back();
+
+      if (used.x > rc.x)
+        m_new.push_back(gfx::Rect(rc.x, rc.y, used.x - rc.x, rc.h));
+      if (used.x2() < rc.x2())
+        m_new.push_back(gfx::Rect(used.x2(), rc.y, rc.x2() - used.x2(), rc.h));
+      if (used.y > rc.y)
+        m_new.push_back(gfx::Rect(rc.x, rc.y, rc.w, used.y - rc.y));
+      if (used.y2() < rc.y2())
+        m_new.push_back(gfx::Rect(rc.x, used.y2(), rc.w, rc.y2() - used.y2()));
+    }
+
+    // The new areas are inside old ones that were split, so an old
+    // area cannot be contained in a new one (we just have to discard
+    // new areas that are contained in other areas).
+    const std::size_t oldCount = m_free.size();
+    for (std::size_t i=0; i<m_new.size(); ++i) {
+      const gfx::Rect& rc = m_new[i];
+      bool contained = false;
+
+      for (std::size_t j=0; j<m_new.size() && !contained; ++j) {
+        // From two equal areas we keep the first one
+        if (i != j &&
+            m_new[j].contains(rc) &&
+            (j < i || m_new[j] != rc))
+          contained = true;
+      }
+      for (std::size_t j=0; j<oldCount && !contained; ++j) {
+        if (m_free[j].contains(rc))
+          contained = true;
+      }
+
+      if (!contained)
+        m_free.push_back(rc);
+    }
+  }
+
+  std::vector<gfx::Rect> m_free;
+  std::vector<gfx::Rect> m_new;
+};
+
+} // anonymous namespace
+
+RectsPacker::RectsPacker(const int borderPadding,
+                         const int shapePadding)
+  : m_borderPadding(borderPadding)
+  , m_shapePadding(shapePadding)
+  , m_area(0)
+{
+}
+
+void RectsPacker::add(const gfx::Size& size)
+{
+  m_rects.push_back(gfx::Rect(size));
+  m_orders.clear();
+}
+
+gfx::Size RectsPacker::bestFit(base::task_token& token,
+                               const int fixedWidth,
+                               const int fixedHeight)
+{
+  gfx::Size size(fixedWidth, fixedHeight);
+
+  // Nothing to do, the size is already specified
+  if (fixedWidth > 0 && fixedHeight > 0) {
+    pack(size, token);
+    return size;
+  }
+
+  if (m_rects.empty())
+    return gfx::Size(std::max(1, fixedWidth),
+                     std::max(1, fixedHeight));
+
+  prepare();
+
+  // Size of the texture with all rectangles in one row/column (which
+  // is the biggest size that we have to try).
+  const int extra = 2*m_borderPadding - m_shapePadding;
+  const int maxWidth = m_sumSize.w + extra;
+  const int maxHeight = m_sumSize.h + extra;
+
+  if (fixedWidth > 0) {
+    size.h = minLength(fixedWidth, true, maxHeight, true, token);
+  }
+  else if (fixedHeight > 0) {
+    size.w = minLength(fixedHeight, false, maxWidth, true, token);
+  }
+  else {
+    // Try several widths (around the side of a square texture) from
+    // different threads, each one with the (approximated) minimum
+    // height where all rectangles fit.
+    const double side = std::sqrt(double(m_area));
+    const int minWidth = m_maxSize.w + extra;
+    const int fromWidth = std::max(minWidth, int(side * 0.75) + extra);
+    const int toWidth = std::max(fromWidth, std::min(maxWidth, int(side * 1.5) + extra));
+    const int n = std::min(12, toWidth - fromWidth + 1);
+
+    std::vector<gfx::Size> candidates(n);
+    for (int i=0; i<n; ++i)
+      candidates[i].w = fromWidth + (n > 1 ? (toWidth - fromWidth) * i / (n-1): 0);
+
+    std::atomic<int> next(0);
+    auto work = [this, &candidates, &next, n, maxHeight, &token]{
+      for (int i; (i = next++) < n; ) {
+        candidates[i].h =
+          minLength(candidates[i].w, true, maxHeight, false, token);
+      }
+    };
+
+    const int nthreads =
+      std::clamp(int(std::thread::hardware_concurrency()), 1, n);
+    std::vector<std::thread> threads;
+    for (int i=1; i<nthreads; ++i)
+      threads.emplace_back(work);
+    work();
+    for (auto& thread : threads)
+      thread.join();
+
+    if (token.canceled())
+      return gfx::Size(0, 0);
+
+    // Choose the smallest area (or the more squared texture)
+    size = gfx::Size(0, 0);
+    for (const gfx::Size& candidate : candidates) {
+      if (candidate.h <= 0)
+        continue;
+
+      const int64_t area = int64_t(candidate.w) * candidate.h;
+      const int64_t bestArea = int64_t(size.w) * size.h;
+      if (size.h == 0 ||
+          area < bestArea ||
+          (area == bestArea &&
+           std::max(candidate.w, candidate.h) < std::max(size.w, size.h))) {
+        size = candidate;
+      }
+    }
+
+    // Find the exact minimum height for the chosen width, and then
+    // try to reduce the width for that height.
+    if (size.h > 0) {
+      size.h = minLength(size.w, true, size.h, true, token);
+      const int width = minLength(size.h, false, size.w, true, token);
+      if (width > 0)
+        size.w = width;
+    }
+  }
+
+  if (size.w > 0 && size.h > 0)
+    pack(size, token);
+
+  return size;
+}
+
+bool RectsPacker::pack(const gfx::Size& size,
+                       base::task_token& token)
+{
+  prepare();
+
+  std::vector<gfx::Point> positions;
+  if (!fits(size, token, &positions))
+    return false;
+
+  for (std::size_t i=0; i<m_rects.size(); ++i) {
+    m_rects[i].x = positions[i].x + m_borderPadding;
+    m_rects[i].y = positions[i].y + m_borderPadding;
+  }
+  return true;
+}
+
+// Calculates the different orders to pack the rectangles.
+void RectsPacker::prepare()
+{
+  if (!m_orders.empty() || m_rects.empty())
+    return;
+
+  m_area = 0;
+  m_maxSize = gfx::Size(0, 0);
+  m_sumSize = gfx::Size(0, 0);
+  for (const gfx::Rect& rc : m_rects) {
+    const int w = rc.w + m_shapePadding;
+    const int h = rc.h + m_shapePadding;
+    m_area += int64_t(w) * h;
+    m_maxSize.w = std::max(m_maxSize.w, w);
+    m_maxSize.h = std::max(m_maxSize.h, h);
+    m_sumSize.w += w;
+    m_sumSize.h += h;
+  }
+
+  auto sortBy = [this](auto&& key) {
+    std::vector<int> order(m_rects.size());
+    for (std::size_t i=0; i<order.size(); ++i)
+      order[i] = int(i);
+    std::stable_sort(order.begin(), order.end(),
+                     [this, &key](const int a, const int b) {
+                       return key(m_rects[a]) > key(m_rects[b]);
+                     });
+    m_orders.push_back(std::move(order));
+  };
+
+  // Bigger rectangles first using different criteria
+  sortBy([](const gfx::Rect& rc) {
+    return std::make_pair(std::max(rc.w, rc.h), std::min(rc.w, rc.h));
+  });
+  sortBy([](const gfx::Rect& rc) {
+    return std::make_pair(rc.h, rc.w);
+  });
+  sortBy([](const gfx::Rect& rc) {
+    return std::make_pair(rc.w, rc.h);
+  });
+}
+
+// Returns true if all rectangles can be packed in a texture of the
+// given size with any of the attempted sort orders and fit rules. It can be
+// called from several threads at the same time.
+bool RectsPacker::fits(const gfx::Size& textureSize,
+                       base::task_token& token,
+                       std::vector<gfx::Point>* positions) const
+{
+  // Each rectangle is packed with the shape padding at its
+  // right/bottom sides, so we can use the shape padding of the last
+  // rectangle of each row/column as part of the border.
+  const gfx::Size binSize(
+    textureSize.w - 2*m_borderPadding + m_shapePadding,
+    textureSize.h - 2*m_borderPadding + m_shapePadding);
+  if (binSize.w < m_maxSize.w ||
+      binSize.h < m_maxSize.h ||
+      int64_t(binSize.w) * binSize.h < m_area)
+    return false;
+
+  // Sort order (index of m_orders) and fit rule of each attempt
+  static const std::pair<int, FitRule> kAttempts[] = {
+    { 0, FitRule::BestShortSide },
+    { 1, FitRule::BestShortSide },
+    { 2, FitRule::BestShortSide },
+    { 0, FitRule::BestArea },
+  };
+
+  std::vector<gfx::Point> pos(m_rects.size());
+  for (const auto& attempt : kAttempts) {
+    if (token.canceled())
+      return false;
+
+    MaxRects bin(binSize);
+    bool ok = true;
+    for (const int i : m_orders[attempt.first]) {
+      const gfx::Size size(m_rects[i].w + m_shapePadding,
+                           m_rects[i].h + m_shapePadding);
+      if (!bin.insert(size, attempt.second, pos[i])) {
+        ok = false;
+        break;
+      }
+    }
+    if (ok) {
+      if (positions)
+        *positions = std::move(pos);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns the minimum height (or width if "fixedIsWidth" is false)
+// of a texture with the given "fixedLength" width (or height) where
+// all rectangles fit, or 0 if they don't fit in "maxLength". If
+// "exact" is false, the result can be ~1.5% bigger than the minimum
+// (which is faster to calculate).
+int RectsPacker::minLength(const int fixedLength,
+                           const bool fixedIsWidth,
+                           const int maxLength,
+                           const bool exact,
+                           base::task_token& token) const
+{
+  const int extra = 2*m_borderPadding - m_shapePadding;
+  const int64_t binFixed = fixedLength - extra;
+  if (binFixed < (fixedIsWidth ? m_maxSize.w: m_maxSize.h))
+    return 0;
+
+  auto fitsLength = [this, fixedLength, fixedIsWidth, &token](const int length) {
+    return fits(fixedIsWidth ? gfx::Size(fixedLength, length):
+                               gfx::Size(length, fixedLength), token);
+  };
+
+  // The minimum length needed to contain the area of all rectangles
+  int lo = int(std::max<int64_t>(
+                 (fixedIsWidth ? m_maxSize.h: m_maxSize.w),
+                 (m_area + binFixed - 1) / binFixed)) + extra;
+  lo = std::max(1, lo);
+
+  // Increase the length ~12% each time until all rectangles fit
+  int hi = lo;
+  while (!fitsLength(hi)) {
+    if (token.canceled() || hi >= maxLength)
+      return 0;
+    lo = hi+1;
+    hi = std::min(maxLength, hi + std::max(1, hi/8));
+  }
+
+  // Binary search between the last length that didn't fit and the
+  // first one that fits
+  const int tolerance = (exact ? 0: hi/64);
+  while (hi - lo > tolerance) {
+    if (token.canceled())
+      return 0;
+
+    const int mid = lo + (hi - lo) / 2;
+    if (fitsLength(mid))
+      hi = mid;
+    else
+      lo = mid+1;
+  }
+  return hi;
+}
+
+} // namespace app
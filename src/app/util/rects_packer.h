@@ -0,0 +1,84 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_RECTS_PACKER_H_INCLUDED
+#define APP_UTIL_RECTS_PACKER_H_INCLUDED
+#pragma once
+
+#include "gfx/point.h"
+#include "gfx/rect.h"
+#include "gfx/size.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace base {
+  class task_token;
+}
+
+namespace app {
+
+  // Packs rectangles in a texture (e.g. the samples of a packed
+  // sprite sheet) using the MaxRects algorithm. Several sort orders
+  // and placement rules are tried for each texture size, and the
+  // smallest texture is searched from several threads.
+  class RectsPacker {
+  public:
+    typedef std::vector<gfx::Rect> Rects;
+    typedef Rects::const_iterator const_iterator;
+
+    RectsPacker(const int borderPadding = 0,
+                const int shapePadding = 0);
+
+    std::size_t size() const { return m_rects.size(); }
+    const_iterator begin() const { return m_rects.begin(); }
+    const_iterator end() const { return m_rects.end(); }
+    const gfx::Rect& operator[](int i) const { return m_rects[i]; }
+
+    // Adds a new rectangle to be packed, its position is available
+    // (in the same order) after calling pack() or bestFit().
+    void add(const gfx::Size& size);
+
+    // Returns the smallest texture size (with the given fixed
+    // width/height if they are > 0) where all rectangles can be
+    // packed, and packs them in that texture.
+    gfx::Size bestFit(base::task_token& token,
+                      const int fixedWidth = 0,
+                      const int fixedHeight = 0);
+
+    // Packs all rectangles in a texture of the given size. Returns
+    // false if some rectangle doesn't fit (in this case their
+    // positions are undefined).
+    bool pack(const gfx::Size& size,
+              base::task_token& token);
+
+  private:
+    void prepare();
+    bool fits(const gfx::Size& textureSize,
+              base::task_token& token,
+              std::vector<gfx::Point>* positions = nullptr) const;
+    int minLength(const int fixedLength,
+                  const bool fixedIsWidth,
+                  const int maxLength,
+                  const bool exact,
+                  base::task_token& token) const;
+
+    int m_borderPadding;
+    int m_shapePadding;
+    Rects m_rects;
+
+    // Data calculated by prepare() for the current rectangles: the
+    // indexes of m_rects in each order to be tried, and the total
+    // area/max size of the rectangles including the shape padding.
+    std::vector<std::vector<int>> m_orders;
+    int64_t m_area;
+    gfx::Size m_maxSize;
+    gfx::Size m_sumSize;
+  };
+
+} // namespace app
+
+#endif
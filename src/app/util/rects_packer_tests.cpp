@@ -0,0 +1,100 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/util/rects_packer.h"
+#include "base/task.h"
+
+#include <cstdlib>
+
+using namespace app;
+
+static void expect_valid_packing(const RectsPacker& packer,
+                                 const gfx::Size& size,
+                                 const int borderPadding,
+                                 const int shapePadding)
+{
+  const gfx::Rect bounds(borderPadding, borderPadding,
+                         size.w - 2*borderPadding,
+                         size.h - 2*borderPadding);
+
+  for (std::size_t i=0; i<packer.size(); ++i) {
+    EXPECT_TRUE(bounds.contains(packer[i]));
+
+    gfx::Rect padded = packer[i];
+    padded.w += shapePadding;
+    padded.h += shapePadding;
+    for (std::size_t j=i+1; j<packer.size(); ++j)
+      EXPECT_FALSE(padded.intersects(packer[j]));
+  }
+}
+
+TEST(RectsPacker, Simple)
+{
+  base::task_token token;
+  RectsPacker packer;
+  for (int i=0; i<4; ++i)
+    packer.add(gfx::Size(10, 10));
+
+  EXPECT_EQ(gfx::Size(20, 20), packer.bestFit(token));
+  expect_valid_packing(packer, gfx::Size(20, 20), 0, 0);
+}
+
+TEST(RectsPacker, Padding)
+{
+  base::task_token token;
+  RectsPacker packer(1, 2);
+  packer.add(gfx::Size(10, 10));
+  packer.add(gfx::Size(10, 10));
+
+  const gfx::Size size = packer.bestFit(token);
+  EXPECT_EQ(2+10+2+10, std::max(size.w, size.h));
+  EXPECT_EQ(2+10, std::min(size.w, size.h));
+  EXPECT_EQ(gfx::Point(1, 1), packer[0].origin());
+  expect_valid_packing(packer, size, 1, 2);
+}
+
+TEST(RectsPacker, FixedSize)
+{
+  base::task_token token;
+  RectsPacker packer;
+  for (int i=0; i<6; ++i)
+    packer.add(gfx::Size(10, 5));
+
+  gfx::Size size = packer.bestFit(token, 10);
+  EXPECT_EQ(gfx::Size(10, 30), size);
+  expect_valid_packing(packer, size, 0, 0);
+
+  size = packer.bestFit(token, 0, 10);
+  EXPECT_EQ(gfx::Size(30, 10), size);
+  expect_valid_packing(packer, size, 0, 0);
+
+  EXPECT_TRUE(packer.pack(gfx::Size(20, 15), token));
+  expect_valid_packing(packer, gfx::Size(20, 15), 0, 0);
+  EXPECT_FALSE(packer.pack(gfx::Size(20, 14), token));
+}
+
+TEST(RectsPacker, RandomSizes)
+{
+  base::task_token token;
+  RectsPacker packer(2, 1);
+  std::srand(1);
+
+  int64_t area = 0;
+  for (int i=0; i<300; ++i) {
+    const gfx::Size size(1 + std::rand() % 64,
+                         1 + std::rand() % 64);
+    packer.add(size);
+    area += size.w * size.h;
+  }
+
+  const gfx::Size size = packer.bestFit(token);
+  expect_valid_packing(packer, size, 2, 1);
+
+  // Random sizes should use more than 3/4 of the texture
+  EXPECT_GT(4*area, 3*int64_t(size.w)*size.h);
+}
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -28,6 +28,7 @@
 #include "zlib.h"
 
 #include <cstdio>
+#include <cstring>
 #include <vector>
 
 namespace dio {
@@ -398,74 +399,46 @@ std::string AsepriteDecoder::readString()
   if (length == EOF)
     return "";
 
-  std::string string;
-  string.reserve(length+1);
-
-  for (int c=0; c<length; c++)
-    string.push_back(read8());
+  // Read all characters at once (unread characters are zero as
+  // read8() returns 0 at the end of the file)
+  std::string string(length, '\0');
+  if (length > 0)
+    readBytes((uint8_t*)&string[0], length);
 
   return string;
 }
 
 float AsepriteDecoder::readFloat()
 {
-  int b1, b2, b3, b4;
-
-  if ((b1 = read8()) == EOF)
-    return EOF;
-
-  if ((b2 = read8()) == EOF)
-    return EOF;
-
-  if ((b3 = read8()) == EOF)
-    return EOF;
-
-  if ((b4 = read8()) == EOF)
-    return EOF;
+  // Read the 4 bytes even when the file is not ok() (bytes after the
+  // end of the file are 0, as read8() returns), so we get the same
+  // value as reading the file byte by byte.
+  uint8_t b[4] = { 0, 0, 0, 0 };
+  readBytes(b, 4);
 
   // Little endian.
-  int v = ((b4 << 24) | (b3 << 16) | (b2 << 8) | b1);
-  return *reinterpret_cast<float*>(&v);
+  const uint32_t v = ((uint32_t(b[3]) << 24) |
+                      (uint32_t(b[2]) << 16) |
+                      (uint32_t(b[1]) << 8) |
+                      uint32_t(b[0]));
+  float f;
+  std::memcpy(&f, &v, sizeof(f));
+  return f;
 }
 
 double AsepriteDecoder::readDouble()
 {
-  int b1, b2, b3, b4, b5, b6, b7, b8;
-
-  if ((b1 = read8()) == EOF)
-    return EOF;
-
-  if ((b2 = read8()) == EOF)
-    return EOF;
-
-  if ((b3 = read8()) == EOF)
-    return EOF;
-
-  if ((b4 = read8()) == EOF)
-    return EOF;
-
-  if ((b5 = read8()) == EOF)
-    return EOF;
-
-  if ((b6 = read8()) == EOF)
-    return EOF;
-
-  if ((b7 = read8()) == EOF)
-    return EOF;
-
-  if ((b8 = read8()) == EOF)
-    return EOF;
+  // Same as readFloat(), bytes after the end of the file are 0
+  uint8_t b[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  readBytes(b, 8);
 
   // Little endian.
-  long long v = (((long long)b8 << 56) |
-                 ((long long)b7 << 48) |
-                 ((long long)b6 << 40) |
-                 ((long long)b5 << 32) |
-                 ((long long)b4 << 24) |
-                 ((long long)b3 << 16) |
-                 ((long long)b2 << 8) |
-                 (long long)b1);
-  return *reinterpret_cast<double*>(&v);
+  uint64_t v = 0;
+  for (int i=7; i>=0; --i)
+    v = (v << 8) | b[i];
+  double d;
+  std::memcpy(&d, &v, sizeof(d));
+  return d;
 }
 
 doc::Palette* AsepriteDecoder::readColorChunk(doc::Palette* prevPal,
@@ -1,4 +1,5 @@
 // Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +12,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <vector>
 
 namespace dio {
 
@@ -31,6 +33,22 @@ public:
   virtual uint8_t read8() = 0;
   virtual size_t readBytes(uint8_t* buf, size_t n) = 0;
 
+  // Returns the next 16/32-bit little-endian value in the file or 0
+  // if ok() = false. Implementations with direct access to the data
+  // can override these to avoid one read8() call per byte.
+  virtual uint16_t read16() {
+    int b1 = read8();
+    int b2 = read8();
+    return (ok() ? ((b2 << 8) | b1): 0);
+  }
+  virtual uint32_t read32() {
+    uint32_t b1 = read8();
+    uint32_t b2 = read8();
+    uint32_t b3 = read8();
+    uint32_t b4 = read8();
+    return (ok() ? ((b4 << 24) | (b3 << 16) | (b2 << 8) | b1): 0);
+  }
+
   // Writes one byte in the file (or do nothing if ok() = false)
   virtual void write8(uint8_t value) = 0;
 
@@ -50,6 +68,51 @@ private:
   bool m_ok;
 };
 
+// Reads a file from a memory buffer (the buffer is not copied, it
+// must be valid during the whole life of this object). It's
+// read-only, write8() does nothing.
+class MemoryFileInterface : public FileInterface {
+public:
+  MemoryFileInterface(const uint8_t* data = nullptr, size_t size = 0);
+  bool ok() const override;
+  size_t tell() override;
+  void seek(size_t absPos) override;
+  uint8_t read8() override;
+  uint16_t read16() override;
+  uint32_t read32() override;
+  size_t readBytes(uint8_t* buf, size_t n) override;
+  void write8(uint8_t value) override;
+
+  const uint8_t* data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+protected:
+  void reset(const uint8_t* data, size_t size);
+
+private:
+  const uint8_t* m_data;
+  size_t m_size;
+  size_t m_pos;
+  bool m_ok;
+};
+
+// Maps the whole file in memory to read it without one system/stdio
+// call per read operation. If the file cannot be mapped, it's read
+// completely in a memory buffer. The position of the given FILE is
+// not modified.
+class MappedFileInterface : public MemoryFileInterface {
+public:
+  MappedFileInterface(FILE* file);
+  ~MappedFileInterface();
+private:
+  void* m_map;
+  size_t m_mapSize;
+#ifdef _WIN32
+  void* m_mapping;
+#endif
+  std::vector<uint8_t> m_buffer;
+};
+
 } // namespace dio
 
 #endif
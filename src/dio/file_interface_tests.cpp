@@ -0,0 +1,130 @@
+// Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "dio/file_interface.h"
+
+#include <cstdio>
+#include <memory>
+
+using namespace dio;
+
+namespace {
+
+const uint8_t kData[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 };
+
+struct CloseFile {
+  void operator()(FILE* f) const { std::fclose(f); }
+};
+using FilePtr = std::unique_ptr<FILE, CloseFile>;
+
+FilePtr create_tmp_file()
+{
+  FilePtr f(std::tmpfile());
+  if (f) {
+    std::fwrite(kData, 1, sizeof(kData), f.get());
+    std::rewind(f.get());
+  }
+  return f;
+}
+
+} // anonymous namespace
+
+TEST(MemoryFileInterface, ReadLittleEndian)
+{
+  MemoryFileInterface f(kData, sizeof(kData));
+  EXPECT_EQ(0x01, f.read8());
+  EXPECT_EQ(0x0302, f.read16());
+  EXPECT_EQ(0x07060504u, f.read32());
+  EXPECT_TRUE(f.ok());
+  EXPECT_EQ(7, f.tell());
+}
+
+TEST(MemoryFileInterface, ReadPastTheEnd)
+{
+  MemoryFileInterface f(kData, sizeof(kData));
+  f.seek(6);
+  EXPECT_EQ(0x07, f.read8());
+  EXPECT_TRUE(f.ok());
+
+  EXPECT_EQ(0, f.read8());
+  EXPECT_FALSE(f.ok());
+  EXPECT_EQ(0, f.read16());
+  EXPECT_EQ(0u, f.read32());
+  EXPECT_EQ(7, f.tell());
+
+  // Incomplete values are 0 (even if some bytes were available)
+  MemoryFileInterface g(kData, sizeof(kData));
+  g.seek(5);
+  EXPECT_EQ(0u, g.read32());
+  EXPECT_FALSE(g.ok());
+  EXPECT_EQ(7, g.tell());
+
+  // readBytes() copies the available bytes
+  MemoryFileInterface h(kData, sizeof(kData));
+  h.seek(4);
+  uint8_t buf[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  EXPECT_EQ(3, h.readBytes(buf, 8));
+  EXPECT_FALSE(h.ok());
+  EXPECT_EQ(0x05, buf[0]);
+  EXPECT_EQ(0x07, buf[2]);
+  EXPECT_EQ(0, buf[3]);
+}
+
+TEST(MemoryFileInterface, SeekAndTell)
+{
+  MemoryFileInterface f(kData, sizeof(kData));
+  EXPECT_EQ(0, f.tell());
+
+  f.seek(3);
+  EXPECT_EQ(3, f.tell());
+  EXPECT_EQ(0x04, f.read8());
+  EXPECT_EQ(4, f.tell());
+
+  f.seek(0);
+  EXPECT_EQ(0x0201, f.read16());
+  EXPECT_EQ(2, f.tell());
+
+  // Like fseek() we can go beyond the end, the next read fails
+  f.seek(100);
+  EXPECT_EQ(100, f.tell());
+  EXPECT_TRUE(f.ok());
+  EXPECT_EQ(0, f.read8());
+  EXPECT_FALSE(f.ok());
+}
+
+// The memory backend must give the same values as the stdio one,
+// including the values read at the end of the file (and after it,
+// when the file is not ok() anymore).
+TEST(MemoryFileInterface, SameResultAsStdio)
+{
+  FilePtr file = create_tmp_file();
+  ASSERT_TRUE(file != nullptr);
+
+  StdioFileInterface a(file.get());
+  MemoryFileInterface b(kData, sizeof(kData));
+
+  for (size_t pos : { 0, 3, 5, 6, 7, 0, 2 }) {
+    a.seek(pos);
+    b.seek(pos);
+    EXPECT_EQ(a.tell(), b.tell());
+    EXPECT_EQ(a.read8(), b.read8()) << "pos=" << pos;
+    EXPECT_EQ(a.read16(), b.read16()) << "pos=" << pos;
+    EXPECT_EQ(a.read32(), b.read32()) << "pos=" << pos;
+    EXPECT_EQ(a.ok(), b.ok()) << "pos=" << pos;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
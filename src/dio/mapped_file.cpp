@@ -0,0 +1,102 @@
+// Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "dio/file_interface.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <io.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
+namespace dio {
+
+MappedFileInterface::MappedFileInterface(FILE* file)
+  : m_map(nullptr)
+  , m_mapSize(0)
+#ifdef _WIN32
+  , m_mapping(nullptr)
+#endif
+{
+  // Flush pending writes so the mapping contains all the data
+  fflush(file);
+
+#ifdef _WIN32
+  HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+  LARGE_INTEGER size;
+  if (handle != INVALID_HANDLE_VALUE &&
+      GetFileSizeEx(handle, &size) &&
+      size.QuadPart > 0 &&
+      uint64_t(size.QuadPart) <= SIZE_MAX) {
+    HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY,
+                                        0, 0, nullptr);
+    if (mapping) {
+      void* map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      if (map) {
+        m_mapping = mapping;
+        m_map = map;
+        m_mapSize = size_t(size.QuadPart);
+      }
+      else
+        CloseHandle(mapping);
+    }
+  }
+#else
+  struct stat st;
+  const int fd = fileno(file);
+  if (fd >= 0 &&
+      fstat(fd, &st) == 0 &&
+      S_ISREG(st.st_mode) &&
+      st.st_size > 0) {
+    void* map = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      m_map = map;
+      m_mapSize = size_t(st.st_size);
+    }
+  }
+#endif
+
+  if (m_map) {
+    reset((const uint8_t*)m_map, m_mapSize);
+    return;
+  }
+
+  // Fallback: read the whole file in memory (e.g. pipes or
+  // filesystems without mmap support)
+  const long oldPos = ftell(file);
+  if (oldPos >= 0)
+    fseek(file, 0, SEEK_SET);
+
+  uint8_t chunk[64*1024];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    m_buffer.insert(m_buffer.end(), chunk, chunk+n);
+
+  if (oldPos >= 0)
+    fseek(file, oldPos, SEEK_SET);
+
+  reset(m_buffer.data(), m_buffer.size());
+}
+
+MappedFileInterface::~MappedFileInterface()
+{
+  if (m_map) {
+#ifdef _WIN32
+    UnmapViewOfFile(m_map);
+    CloseHandle((HANDLE)m_mapping);
+#else
+    munmap(m_map, m_mapSize);
+#endif
+  }
+}
+
+} // namespace dio
@@ -0,0 +1,113 @@
+// Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "dio/file_interface.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace dio {
+
+MemoryFileInterface::MemoryFileInterface(const uint8_t* data, size_t size)
+  : m_data(data)
+  , m_size(size)
+  , m_pos(0)
+  , m_ok(true)
+{
+}
+
+void MemoryFileInterface::reset(const uint8_t* data, size_t size)
+{
+  m_data = data;
+  m_size = size;
+  m_pos = 0;
+  m_ok = true;
+}
+
+bool MemoryFileInterface::ok() const
+{
+  return m_ok;
+}
+
+size_t MemoryFileInterface::tell()
+{
+  return m_pos;
+}
+
+void MemoryFileInterface::seek(size_t absPos)
+{
+  // Like fseek(), we can move beyond the end of the file (the next
+  // read operation will fail).
+  m_pos = absPos;
+}
+
+uint8_t MemoryFileInterface::read8()
+{
+  if (m_pos < m_size)
+    return m_data[m_pos++];
+
+  m_ok = false;
+  return 0;
+}
+
+uint16_t MemoryFileInterface::read16()
+{
+  if (m_pos < m_size && m_size - m_pos >= 2) {
+    const uint8_t* p = m_data + m_pos;
+    m_pos += 2;
+    // Like FileInterface::read16(), values are 0 after a failed read
+    return (m_ok ? ((p[1] << 8) | p[0]): 0); // Little endian
+  }
+
+  m_pos = std::max(m_pos, m_size);
+  m_ok = false;
+  return 0;
+}
+
+uint32_t MemoryFileInterface::read32()
+{
+  if (m_pos < m_size && m_size - m_pos >= 4) {
+    const uint8_t* p = m_data + m_pos;
+    m_pos += 4;
+    if (!m_ok)
+      return 0;
+    // Little endian
+    return ((uint32_t(p[3]) << 24) |
+            (uint32_t(p[2]) << 16) |
+            (uint32_t(p[1]) << 8) |
+            uint32_t(p[0]));
+  }
+
+  m_pos = std::max(m_pos, m_size);
+  m_ok = false;
+  return 0;
+}
+
+size_t MemoryFileInterface::readBytes(uint8_t* buf, size_t n)
+{
+  size_t n2 = 0;
+  if (m_pos < m_size)
+    n2 = std::min(n, m_size - m_pos);
+
+  if (n2 > 0) {
+    std::memcpy(buf, m_data + m_pos, n2);
+    m_pos += n2;
+  }
+  if (n2 != n)
+    m_ok = false;
+  return n2;
+}
+
+void MemoryFileInterface::write8(uint8_t value)
+{
+  // Do nothing, this is a read-only file
+}
+
+} // namespace dio
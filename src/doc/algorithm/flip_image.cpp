@@ -30,6 +30,8 @@ namespace algorithm {
 template<typename ImageTraits>
 void flip_image_with_put_pixel_fast_templ(Image* image, const gfx::Rect& bounds, FlipType flipType)
 {
+  image->unsharePixels();
+
   switch (flipType) {
 
     case FlipHorizontal:
@@ -137,6 +139,7 @@ template<typename ImageTraits>
 void flip_image_with_mask_templ(Image* image, const Mask* mask, FlipType flipType, int bgcolor)
 {
   gfx::Rect bounds = mask->bounds();
+  image->unsharePixels();
 
   switch (flipType) {
 
@@ -1,382 +1,433 @@
-// The floodfill routine.
-// By Shawn Hargreaves.
-//
-// Changes by David Capello:
-// - Adapted to Aseprite
-// - Added non-contiguous mode
-// - Added mask parameter
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+// Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
-//
-// TODO rewrite this algorithm from scratch
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
-#include "base/base.h"
-#include "doc/algo.h"
+#include "doc/algorithm/floodfill.h"
+
+#include "base/debug.h"
 #include "doc/image.h"
+#include "doc/image_traits.h"
 #include "doc/mask.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
+#include "gfx/rect.h"
 
-#include <climits>
-#include <cmath>
-#include <limits>
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 
-namespace doc {
-namespace algorithm {
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+#endif
 
-struct FLOODED_LINE {   // store segments which have been flooded
-  char flags;           // status of the segment
-  int lpos, rpos;       // left and right ends of segment
-  int y;                // y coordinate of the segment
-  int next;             // linked list if several per line
-};
+#ifdef _MSC_VER
+  #include <intrin.h>
+#endif
 
-static std::vector<FLOODED_LINE> flood_buf;
-static int flood_count;          /* number of flooded segments */
+namespace doc {
+namespace algorithm {
 
-#define FLOOD_IN_USE             1
-#define FLOOD_TODO_ABOVE         2
-#define FLOOD_TODO_BELOW         4
+namespace {
 
-#define FLOOD_LINE(c)            (&flood_buf[c])
+// Min number of rows to process in each thread in the non-contiguous
+// mode.
+constexpr int kMinRowsPerThread = 64;
 
-static inline bool color_equal_32_raw(color_t c1, color_t c2)
+inline int ctz64(const uint64_t v)
 {
-  return (c1 == c2);
+  ASSERT(v != 0);
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanForward64(&i, v);
+  return int(i);
+#else
+  return __builtin_ctzll(v);
+#endif
 }
 
-static inline bool color_equal_32(color_t c1, color_t c2, int tolerance)
+inline int clz64(const uint64_t v)
 {
-  if (tolerance == 0)
-    return (c1 == c2) || (rgba_geta(c1) == 0 && rgba_geta(c2) == 0);
-  else {
-    int r1 = rgba_getr(c1);
-    int g1 = rgba_getg(c1);
-    int b1 = rgba_getb(c1);
-    int a1 = rgba_geta(c1);
-    int r2 = rgba_getr(c2);
-    int g2 = rgba_getg(c2);
-    int b2 = rgba_getb(c2);
-    int a2 = rgba_geta(c2);
-
-    if (a1 == 0 && a2 == 0)
-      return true;
-
-    return ((ABS(r1-r2) <= tolerance) &&
-            (ABS(g1-g2) <= tolerance) &&
-            (ABS(b1-b2) <= tolerance) &&
-            (ABS(a1-a2) <= tolerance));
-  }
+  ASSERT(v != 0);
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanReverse64(&i, v);
+  return 63 - int(i);
+#else
+  return __builtin_clzll(v);
+#endif
 }
 
-static inline bool color_equal_16(color_t c1, color_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2) || (graya_geta(c1) == 0 && graya_geta(c2) == 0);
-  else {
-    int k1 = graya_getv(c1);
-    int a1 = graya_geta(c1);
-    int k2 = graya_getv(c2);
-    int a2 = graya_geta(c2);
-
-    if (a1 == 0 && a2 == 0)
-      return true;
+// Packed bitset with one bit per pixel of the flood fill bounds (bit
+// 0 of each row is the bounds.x column). A bit is set if the pixel
+// matches the source color and wasn't filled yet, so the same bitset
+// is used as the visited map.
+class PixelBits {
+public:
+  PixelBits(const gfx::Rect& bounds)
+    : m_words((bounds.w + 63) / 64)
+    , m_bits(std::size_t(m_words) * bounds.h, 0) {
+  }
 
-    return ((ABS(k1-k2) <= tolerance) &&
-            (ABS(a1-a2) <= tolerance));
+  uint64_t* row(const int i) {
+    return &m_bits[std::size_t(i) * m_words];
   }
-}
 
-static inline bool color_equal_8(color_t c1, color_t c2, int tolerance)
+private:
+  int m_words;
+  std::vector<uint64_t> m_bits;
+};
+
+inline bool test_bit(const uint64_t* bits, const int x)
 {
-  if (tolerance == 0)
-    return (c1 == c2);
-  else
-    return ABS((int)c1 - (int)c2) <= tolerance;
+  return ((bits[x >> 6] >> (x & 63)) & 1);
 }
 
-template<typename ImageTraits>
-static inline bool color_equal(color_t c1, color_t c2, int tolerance)
+// Returns the first set bit in [x, end), or "end" if there is no one.
+int find_set_bit(const uint64_t* bits, int x, const int end)
 {
-  static_assert(false && sizeof(ImageTraits), "Invalid color comparison");
-  return false;
+  while (x < end) {
+    const uint64_t word = (bits[x >> 6] >> (x & 63));
+    if (word)
+      return std::min(end, x + ctz64(word));
+    x = (x | 63) + 1;
+  }
+  return end;
 }
 
-template<>
-inline bool color_equal<RgbTraits>(color_t c1, color_t c2, int tolerance)
+// Returns the first clear bit in [x, end), or "end" if there is no one.
+int find_clear_bit(const uint64_t* bits, int x, const int end)
 {
-  return color_equal_32(c1, c2, tolerance);
+  while (x < end) {
+    const uint64_t word = (~bits[x >> 6] >> (x & 63));
+    if (word)
+      return std::min(end, x + ctz64(word));
+    x = (x | 63) + 1;
+  }
+  return end;
 }
 
-template<>
-inline bool color_equal<GrayscaleTraits>(color_t c1, color_t c2, int tolerance)
+// Returns the first bit of the run of set bits that contains "x".
+int find_run_begin(const uint64_t* bits, int x)
 {
-  return color_equal_16(c1, c2, tolerance);
+  ASSERT(test_bit(bits, x));
+  for (;;) {
+    // Clear bits from "x" to the left (bit "x" goes to bit 63)
+    const uint64_t word = (~bits[x >> 6] << (63 - (x & 63)));
+    if (word)
+      return x - clz64(word) + 1;
+    if (x < 64)
+      return 0;
+    x = (x & ~63) - 1;
+  }
 }
 
-template<>
-inline bool color_equal<IndexedTraits>(color_t c1, color_t c2, int tolerance)
+// Clears bits in the [x1, x2] range.
+void clear_bits(uint64_t* bits, const int x1, const int x2)
 {
-  return color_equal_8(c1, c2, tolerance);
+  for (int x=x1; x<=x2; ) {
+    const int i = (x & 63);
+    const int n = std::min(64 - i, x2 - x + 1);
+    const uint64_t mask = (n == 64 ? ~uint64_t(0): ((uint64_t(1) << n) - 1) << i);
+    bits[x >> 6] &= ~mask;
+    x += n;
+  }
 }
 
-template<>
-inline bool color_equal<TilemapTraits>(color_t c1, color_t c2, int tolerance)
+// Returns true if the "c" pixel is similar to "src", i.e. the
+// difference of each byte is less than or equal to the "tolerance",
+// or if "c" is transparent and "alphaMask" is not zero (all
+// transparent pixels match a transparent source color).
+template<typename pixel_t>
+inline bool match_pixel(const pixel_t c, const pixel_t src,
+                        const int tolerance, const pixel_t alphaMask)
 {
-  return color_equal_32_raw(c1, c2);
+  if (alphaMask && (c & alphaMask) == 0)
+    return true;
+  for (int i=0; i<int(sizeof(pixel_t)); ++i) {
+    const int d = int((c >> (8*i)) & 0xff) - int((src >> (8*i)) & 0xff);
+    if (d > tolerance || -d > tolerance)
+      return false;
+  }
+  return true;
 }
 
+// Sets the bits of the "w" pixels from "p" that match the "src"
+// color. The comparison of each pixel is done by bytes, so we can
+// compare 16 bytes at the same time with SSE2.
+template<typename pixel_t>
+void match_pixels(const pixel_t* p, const int w,
+                  const pixel_t src, const int tolerance,
+                  const pixel_t alphaMask, uint64_t* bits)
+{
+#if defined(__x86_64__) || defined(_WIN64)
+  constexpr int kPixelsPerVector = 16 / sizeof(pixel_t);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i tol = _mm_set1_epi8(char(tolerance));
+  const __m128i transparentMatches = (alphaMask ? _mm_set1_epi8(-1): zero);
+  __m128i srcv, alphav;
+  if constexpr (sizeof(pixel_t) == 4) {
+    srcv = _mm_set1_epi32(int(src));
+    alphav = _mm_set1_epi32(int(alphaMask));
+  }
+  else if constexpr (sizeof(pixel_t) == 2) {
+    srcv = _mm_set1_epi16(short(src));
+    alphav = _mm_set1_epi16(short(alphaMask));
+  }
+  else {
+    srcv = _mm_set1_epi8(char(src));
+    alphav = zero;
+  }
+#endif
 
+  for (int i=0; i<w; i+=64, ++bits) {
+    const int n = std::min(64, w-i);
+    uint64_t word = 0;
+    int j = 0;
+
+#if defined(__x86_64__) || defined(_WIN64)
+    for (; j+kPixelsPerVector<=n; j+=kPixelsPerVector) {
+      const __m128i v = _mm_loadu_si128((const __m128i*)(p+i+j));
+      const __m128i diff = _mm_or_si128(_mm_subs_epu8(v, srcv),
+                                        _mm_subs_epu8(srcv, v));
+      const __m128i over = _mm_subs_epu8(diff, tol);
+      uint64_t m;
+      if constexpr (sizeof(pixel_t) == 4) {
+        const __m128i r = _mm_or_si128(
+          _mm_cmpeq_epi32(over, zero),
+          _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(v, alphav), zero),
+                        transparentMatches));
+        m = _mm_movemask_ps(_mm_castsi128_ps(r));
+      }
+      else if constexpr (sizeof(pixel_t) == 2) {
+        const __m128i r = _mm_or_si128(
+          _mm_cmpeq_epi16(over, zero),
+          _mm_and_si128(_mm_cmpeq_epi16(_mm_and_si128(v, alphav), zero),
+                        transparentMatches));
+        m = (_mm_movemask_epi8(_mm_packs_epi16(r, zero)) & 0xff);
+      }
+      else {
+        m = _mm_movemask_epi8(_mm_cmpeq_epi8(over, zero));
+      }
+      word |= (m << j);
+    }
+#endif
 
-/* flooder:
- *  Fills a horizontal line around the specified position, and adds it
- *  to the list of drawn segments. Returns the first x coordinate after
- *  the part of the line which it has dealt with.
- */
-static int flooder(const Image* image,
-                   const Mask* mask,
-                   int x, int y,
-                   const gfx::Rect& bounds,
-                   color_t src_color, int tolerance, void *data, AlgoHLine proc)
+    for (; j<n; ++j) {
+      if (match_pixel<pixel_t>(p[i+j], src, tolerance, alphaMask))
+        word |= (uint64_t(1) << j);
+    }
+    *bits = word;
+  }
+}
+
+// Calculates the bits of the pixels in the row "y" (in the "bounds"
+// range) that match the "srcColor".
+void match_row(const Image* image,
+               const Mask* mask,
+               const int y,
+               const gfx::Rect& bounds,
+               const color_t srcColor,
+               int tolerance,
+               uint64_t* bits)
 {
-#define MASKED(u, v)                                                    \
-        (mask &&                                                        \
-         (!mask->bounds().contains(u, v) ||                             \
-          (mask->bitmap() &&                                            \
-           !get_pixel_fast<BitmapTraits>(mask->bitmap(),                \
-                                         (u)-mask->bounds().x,          \
-                                         (v)-mask->bounds().y))))
-
-  FLOODED_LINE *p;
-  int left = 0, right = 0;
-  int c;
+  const void* p = image->getPixelAddress(bounds.x, y);
+  tolerance = std::clamp(tolerance, 0, 255);
 
   switch (image->pixelFormat()) {
 
     case IMAGE_RGB:
-      {
-        uint32_t* address = reinterpret_cast<uint32_t*>(image->getPixelAddress(0, y));
-
-        // Check start pixel
-        if (!color_equal_32((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_32((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
-
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_32((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
+      match_pixels<uint32_t>(
+        (const uint32_t*)p, bounds.w, srcColor, tolerance,
+        (rgba_geta(srcColor) == 0 ? rgba_a_mask: 0), bits);
       break;
 
     case IMAGE_GRAYSCALE:
-      {
-        uint16_t* address = reinterpret_cast<uint16_t*>(image->getPixelAddress(0, y));
-
-        // Check start pixel
-        if (!color_equal_16((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_16((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
-
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_16((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
+      match_pixels<uint16_t>(
+        (const uint16_t*)p, bounds.w, uint16_t(srcColor), tolerance,
+        (graya_geta(srcColor) == 0 ? uint16_t(graya_a_mask): 0), bits);
       break;
 
     case IMAGE_INDEXED:
-      {
-        uint8_t* address = image->getPixelAddress(0, y);
-
-        // Check start pixel
-        if (!color_equal_8((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_8((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
-
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_8((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
+      match_pixels<uint8_t>(
+        (const uint8_t*)p, bounds.w, uint8_t(srcColor), tolerance,
+        0, bits);
       break;
 
     case IMAGE_TILEMAP:
-      {
-        // TODO add support for mask
-
-        uint32_t* address = reinterpret_cast<uint32_t*>(image->getPixelAddress(0, y));
-
-        // Check start pixel
-        if (!color_equal_32_raw((int)*(address+x), src_color))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_32_raw((int)*(address+left), src_color))
-            break;
-        }
-
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_32_raw((int)*(address+right), src_color))
-            break;
-        }
-      }
-      break;
+      // Tiles must be exactly the same (and there is no support for
+      // the mask).
+      match_pixels<uint32_t>(
+        (const uint32_t*)p, bounds.w, srcColor, 0, 0, bits);
+      return;
 
     default:
-      // Check start pixel
-      if (get_pixel(image, x, y) != src_color || MASKED(x, y))
-        return x+1;
-
-      // Work left from starting point
-      for (left=x-1; left>=bounds.x; left--) {
-        if (get_pixel(image, left, y) != src_color || MASKED(left, y))
-          break;
-      }
-
-      // Work right from starting point
-      for (right=x+1; right<bounds.x2(); right++) {
-        if (get_pixel(image, right, y) != src_color || MASKED(right, y))
-          break;
+      for (int x=0; x<bounds.w; ++x) {
+        if (get_pixel(image, bounds.x+x, y) == srcColor)
+          bits[x >> 6] |= (uint64_t(1) << (x & 63));
       }
       break;
   }
 
-  left++;
-  right--;
+  if (mask) {
+    const gfx::Rect maskBounds = mask->bounds();
+    const int x1 = std::max(bounds.x, maskBounds.x) - bounds.x;
+    const int x2 = std::min(bounds.x2(), maskBounds.x2()) - bounds.x;
 
-  /* draw the line */
-  (*proc)(left, y, right, data);
-
-  /* store it in the list of flooded segments */
-  c = y;
-  p = FLOOD_LINE(c);
-
-  if (p->flags) {
-    while (p->next) {
-      c = p->next;
-      p = FLOOD_LINE(c);
+    if (y < maskBounds.y || y >= maskBounds.y2() || x1 >= x2) {
+      clear_bits(bits, 0, bounds.w-1);
+      return;
+    }
+    if (x1 > 0)
+      clear_bits(bits, 0, x1-1);
+    if (x2 < bounds.w)
+      clear_bits(bits, x2, bounds.w-1);
+
+    if (const Image* bitmap = mask->bitmap()) {
+      for (int x=x1; x<x2; ++x) {
+        if (!get_pixel_fast<BitmapTraits>(bitmap,
+                                          bounds.x+x-maskBounds.x,
+                                          y-maskBounds.y))
+          bits[x >> 6] &= ~(uint64_t(1) << (x & 63));
+      }
     }
-
-    p->next = c = flood_count++;
-    flood_buf.resize(flood_count);
-    p = FLOOD_LINE(c);
   }
-
-  p->flags = FLOOD_IN_USE;
-  p->lpos = left;
-  p->rpos = right;
-  p->y = y;
-  p->next = 0;
-
-  if (y > bounds.y)
-    p->flags |= FLOOD_TODO_ABOVE;
-
-  if (y+1 < bounds.y2())
-    p->flags |= FLOOD_TODO_BELOW;
-
-  return right+2;
 }
 
-
-
-/* check_flood_line:
- *  Checks a line segment, using the scratch buffer is to store a list of
- *  segments which have already been drawn in order to minimise the required
- *  number of tests.
- */
-static int check_flood_line(const Image* image,
-                            const Mask* mask,
-                            int y, int left, int right,
-                            const gfx::Rect& bounds,
-                            int src_color, int tolerance, void *data, AlgoHLine proc)
+// Scanline flood fill: each filled span is pushed in a stack to
+// check the rows above/below it, and the rows of the image are
+// compared with the source color only when they are needed.
+void contiguous_fill(const Image* image,
+                     const Mask* mask,
+                     const int x, const int y,
+                     const gfx::Rect& bounds,
+                     const color_t srcColor,
+                     const int tolerance,
+                     const bool isEightConnected,
+                     void* data,
+                     AlgoHLine proc)
 {
-  int c;
-  FLOODED_LINE *p;
-  int ret = false;
+  struct Span {
+    int y, x1, x2;              // x1/x2 relative to bounds.x
+  };
+
+  const int w = bounds.w;
+  PixelBits bits(bounds);
+  std::vector<bool> matchedRows(bounds.h, false);
+  std::vector<Span> stack;
+
+  auto row = [&](const int v) -> uint64_t* {
+    const int i = v - bounds.y;
+    uint64_t* r = bits.row(i);
+    if (!matchedRows[i]) {
+      match_row(image, mask, v, bounds, srcColor, tolerance, r);
+      matchedRows[i] = true;
+    }
+    return r;
+  };
+
+  // Fills the whole run of matched pixels that contains "u", returns
+  // the last filled pixel.
+  auto fill_run = [&](uint64_t* r, const int v, const int u) -> int {
+    const int x1 = find_run_begin(r, u);
+    const int x2 = find_clear_bit(r, u, w) - 1;
+    clear_bits(r, x1, x2);
+    (*proc)(bounds.x+x1, v, bounds.x+x2, data);
+    stack.push_back(Span{ v, x1, x2 });
+    return x2;
+  };
+
+  uint64_t* r = row(y);
+  if (!test_bit(r, x - bounds.x))
+    return;
 
-  while (left <= right) {
-    c = y;
+  fill_run(r, y, x - bounds.x);
 
-    for (;;) {
-      p = FLOOD_LINE(c);
+  const int d = (isEightConnected ? 1: 0);
+  while (!stack.empty()) {
+    const Span span = stack.back();
+    stack.pop_back();
 
-      if ((left >= p->lpos) && (left <= p->rpos)) {
-        left = p->rpos+2;
-        break;
-      }
+    const int a = std::max(0, span.x1 - d);
+    const int b = std::min(w-1, span.x2 + d);
 
-      c = p->next;
+    for (const int v : { span.y-1, span.y+1 }) {
+      if (v < bounds.y || v >= bounds.y2())
+        continue;
 
-      if (!c) {
-        left = flooder(image, mask, left, y, bounds, src_color, tolerance, data, proc);
-        ret = true;
-        break;
-      }
+      uint64_t* nr = row(v);
+      int u = a;
+      while ((u = find_set_bit(nr, u, b+1)) <= b)
+        u = fill_run(nr, v, u) + 2; // The pixel after the run doesn't match
     }
   }
-
-  return ret;
 }
 
-template<typename ImageTraits>
-static void replace_color(const Image* image, const gfx::Rect& bounds, int src_color, int tolerance, void* data, AlgoHLine proc)
+// Fills all pixels that match the source color. The rows are compared
+// in several threads, and then the runs of matched pixels are drawn
+// from the calling thread (the "proc" is not thread-safe).
+void non_contiguous_fill(const Image* image,
+                         const gfx::Rect& bounds,
+                         const color_t srcColor,
+                         const int tolerance,
+                         void* data,
+                         AlgoHLine proc)
 {
-  typename ImageTraits::address_t address;
-
-  for (int y=bounds.y; y<bounds.y2(); ++y) {
-    address = reinterpret_cast<typename ImageTraits::address_t>(image->getPixelAddress(bounds.x, y));
-
-    for (int x=bounds.x; x<bounds.x2(); ++x, ++address) {
-      int right = -1;
-
-      if (color_equal<ImageTraits>((int)(*address), src_color, tolerance)) {
-        ++address;
-        for (right=x+1; right<bounds.x2(); ++right, ++address) {
-          if (!color_equal<ImageTraits>((int)(*address), src_color, tolerance))
+  PixelBits bits(bounds);
+  parallel_ranges(
+    bounds.h, kMinRowsPerThread,
+    [&](const int begin, const int end) {
+      for (int i=begin; i<end; ++i)
+        match_row(image, nullptr, bounds.y+i, bounds, srcColor, tolerance,
+                  bits.row(i));
+    });
+
+  const int words = (bounds.w + 63) / 64;
+  for (int i=0; i<bounds.h; ++i) {
+    const uint64_t* r = bits.row(i);
+    const int y = bounds.y+i;
+
+    // Find runs of set bits word by word (a run can continue in the
+    // next word, bits after bounds.w are always zero)
+    int runStart = -1;
+    for (int j=0; j<words; ++j) {
+      const uint64_t word = r[j];
+      int pos = 0;
+      while (pos < 64) {
+        if (runStart < 0) {
+          const uint64_t m = (word >> pos);
+          if (!m)
             break;
+          pos += ctz64(m);
+          runStart = 64*j + pos;
         }
-        (*proc)(x, y, right-1, data);
-        x = right;
+        const uint64_t m = (~word >> pos);
+        if (!m)
+          break;
+        pos += ctz64(m);
+        (*proc)(bounds.x+runStart, y, bounds.x+64*j+pos-1, data);
+        runStart = -1;
       }
     }
+    if (runStart >= 0)
+      (*proc)(bounds.x+runStart, y, bounds.x+bounds.w-1, data);
   }
 }
 
-/* floodfill:
- *  Fills an enclosed area (starting at point x, y) with the specified color.
- */
+} // anonymous namespace
+
 void floodfill(const Image* image,
                const Mask* mask,
                const int x, const int y,
                const gfx::Rect& bounds,
-               const doc::color_t src_color,
+               const doc::color_t srcColor,
                const int tolerance,
                const bool contiguous,
                const bool isEightConnected,
@@ -388,135 +439,22 @@ void floodfill(const Image* image,
       (y < 0) || (y >= image->height()))
     return;
 
-  // Non-contiguous case, we replace colors in the whole image.
+  const gfx::Rect rc = (bounds & image->bounds());
+
+  // Non-contiguous case, we replace colors in the whole image (the
+  // starting point can be outside the bounds).
   if (!contiguous) {
-    switch (image->pixelFormat()) {
-      case IMAGE_RGB:
-        replace_color<RgbTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_GRAYSCALE:
-        replace_color<GrayscaleTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_INDEXED:
-        replace_color<IndexedTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_TILEMAP:
-        replace_color<TilemapTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-    }
+    non_contiguous_fill(image, rc, srcColor, tolerance, data, proc);
     return;
   }
 
-  /* set up the list of flooded segments */
-  flood_buf.resize(image->height());
-  flood_count = image->height();
-  FLOODED_LINE* p = (FLOODED_LINE*)&flood_buf[0];
-  for (int c=0; c<flood_count; c++) {
-    p[c].flags = 0;
-    p[c].lpos = std::numeric_limits<int>::max();
-    p[c].rpos = std::numeric_limits<int>::min();
-    p[c].y = y;
-    p[c].next = 0;
-  }
-
-  // Start up the flood algorithm
-  flooder(image, mask, x, y, bounds, src_color, tolerance, data, proc);
-
-  // Continue as long as there are some segments still to test
-  bool done;
-  do {
-    done = true;
-
-    // For each line on the screen
-    for (int c=0; c<flood_count; c++) {
-      p = FLOOD_LINE(c);
-
-      // Check below the segment?
-      if (p->flags & FLOOD_TODO_BELOW) {
-        p->flags &= ~FLOOD_TODO_BELOW;
-
-        if (isEightConnected) {
-          if (p->lpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y+1, p->lpos+1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->lpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y+1, p->lpos-1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y+1, p->lpos, p->rpos+1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y+1, p->lpos, p->rpos-1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-        }
-
-        if (check_flood_line(image, mask, p->y+1, p->lpos, p->rpos, bounds,
-                             src_color, tolerance, data, proc)) {
-          done = false;
-          p = FLOOD_LINE(c);
-        }
-      }
-
-      // Check above the segment?
-      if (p->flags & FLOOD_TODO_ABOVE) {
-        p->flags &= ~FLOOD_TODO_ABOVE;
-
-        if (isEightConnected) {
-          if (p->lpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y-1, p->lpos+1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->lpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y-1, p->lpos-1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y-1, p->lpos, p->rpos+1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y-1, p->lpos, p->rpos-1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-        }
-
-        if (check_flood_line(image, mask, p->y-1, p->lpos, p->rpos, bounds,
-                             src_color, tolerance, data, proc)) {
-          done = false;
+  // A contiguous fill cannot go outside the bounds, so there is
+  // nothing to fill if we start outside them.
+  if (!rc.contains(gfx::Point(x, y)))
+    return;
 
-          // Special case shortcut for going backwards
-          if ((c > bounds.y) && (c < bounds.y2()))
-            c -= 2;
-        }
-      }
-    }
-  } while (!done);
+  contiguous_fill(image, mask, x, y, rc, srcColor, tolerance,
+                  isEightConnected, data, proc);
 }
 
 } // namespace algorithm
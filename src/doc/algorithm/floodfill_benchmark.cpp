@@ -0,0 +1,121 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/algorithm/floodfill.h"
+
+#include "doc/color.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "gfx/rect.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace doc;
+
+namespace {
+
+enum Pattern {
+  kFlat,       // Everything is filled with one span per row
+  kSerpentine, // One long path through all rows (worst case for the stack)
+  kComb,       // Vertical corridors (one span per pixel row and corridor)
+  kChecker,    // Diagonal connectivity (only with 8-connected pixels)
+};
+
+// Creates a "maze" with walls (opaque pixels) and a path
+// (transparent pixels with some noise to test the tolerance).
+ImageRef make_maze(const PixelFormat pixelFormat,
+                   const int w, const int h,
+                   const Pattern pattern)
+{
+  ImageRef image(Image::create(pixelFormat, w, h));
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      bool wall = false;
+      switch (pattern) {
+        case kFlat:
+          break;
+        case kSerpentine:
+          // Walls in odd rows with a gap at the left/right side
+          wall = ((y & 1) && (y & 2 ? x != 0: x != w-1));
+          break;
+        case kComb:
+          // Walls in odd columns connected by the first row
+          wall = ((x & 1) && y > 0);
+          break;
+        case kChecker:
+          wall = ((x ^ y) & 1);
+          break;
+      }
+
+      color_t c;
+      const int noise = (x*7 + y*13) & 3;
+      switch (pixelFormat) {
+        case IMAGE_RGB:
+          c = (wall ? rgba(0, 0, 0, 255): rgba(200+noise, 100, 50, 255));
+          break;
+        case IMAGE_GRAYSCALE:
+          c = (wall ? graya(0, 255): graya(200+noise, 255));
+          break;
+        default:
+          c = (wall ? 0: 200+noise);
+          break;
+      }
+      put_pixel(image.get(), x, y, c);
+    }
+  }
+  return image;
+}
+
+void count_hline(int x1, int y, int x2, void* data)
+{
+  *((int64_t*)data) += x2-x1+1;
+}
+
+} // anonymous namespace
+
+void BM_FloodFill(benchmark::State& state) {
+  const auto pixelFormat = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  const auto pattern = (Pattern)state.range(3);
+  const int tolerance = state.range(4);
+  const bool contiguous = state.range(5);
+  const bool eightConnected = (pattern == kChecker);
+
+  ImageRef image = make_maze(pixelFormat, w, h, pattern);
+  const color_t srcColor = get_pixel(image.get(), 0, 0);
+  int64_t pixels = 0;
+  for (auto _ : state) {
+    algorithm::floodfill(image.get(), nullptr, 0, 0, image->bounds(),
+                         srcColor, tolerance, contiguous, eightConnected,
+                         &pixels, count_hline);
+  }
+  state.counters["filled_px"] =
+    benchmark::Counter(double(pixels) / state.iterations());
+  state.SetItemsProcessed(state.iterations() * int64_t(w) * h);
+}
+
+#define DEFARGS(FORMAT, SIZE)                             \
+  ->Args({ FORMAT, SIZE, SIZE, kFlat,       4, true })    \
+  ->Args({ FORMAT, SIZE, SIZE, kSerpentine, 4, true })    \
+  ->Args({ FORMAT, SIZE, SIZE, kComb,       4, true })    \
+  ->Args({ FORMAT, SIZE, SIZE, kChecker,    4, true })    \
+  ->Args({ FORMAT, SIZE, SIZE, kChecker,    4, false })
+
+BENCHMARK(BM_FloodFill)
+  DEFARGS(IMAGE_RGB, 1024)
+  DEFARGS(IMAGE_RGB, 4096)
+  DEFARGS(IMAGE_GRAYSCALE, 4096)
+  DEFARGS(IMAGE_INDEXED, 4096)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
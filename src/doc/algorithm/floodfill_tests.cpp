@@ -0,0 +1,180 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/floodfill.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "gfx/rect.h"
+
+#include <vector>
+
+using namespace doc;
+using namespace gfx;
+
+namespace {
+
+// Counts how many times each pixel is filled
+struct Filled {
+  int w;
+  std::vector<int> pixels;
+
+  Filled(const Image* image)
+    : w(image->width())
+    , pixels(image->width() * image->height(), 0) { }
+
+  static void hline(int x1, int y, int x2, void* data) {
+    auto filled = (Filled*)data;
+    for (int x=x1; x<=x2; ++x)
+      ++filled->pixels[y*filled->w + x];
+  }
+};
+
+ImageRef make_image(const std::vector<color_t>& pixels, const int w, const int h)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      image->putPixel(x, y, pixels[y*w + x]);
+  return image;
+}
+
+std::vector<int> fill(const Image* image,
+                      const Mask* mask,
+                      const int x, const int y,
+                      const int tolerance,
+                      const bool contiguous,
+                      const bool isEightConnected)
+{
+  Filled filled(image);
+  algorithm::floodfill(image, mask, x, y, image->bounds(),
+                       image->getPixel(x, y), tolerance,
+                       contiguous, isEightConnected,
+                       &filled, &Filled::hline);
+  return filled.pixels;
+}
+
+} // anonymous namespace
+
+TEST(FloodFill, FourAndEightConnected)
+{
+  ImageRef image = make_image({ 0, 1, 0, 0,
+                                1, 0, 1, 1,
+                                0, 1, 0, 0,
+                                0, 1, 0, 1 }, 4, 4);
+
+  EXPECT_EQ(std::vector<int>({ 1, 0, 0, 0,
+                               0, 0, 0, 0,
+                               0, 0, 0, 0,
+                               0, 0, 0, 0 }),
+            fill(image.get(), nullptr, 0, 0, 0, true, false));
+
+  EXPECT_EQ(std::vector<int>({ 1, 0, 1, 1,
+                               0, 1, 0, 0,
+                               1, 0, 1, 1,
+                               1, 0, 1, 0 }),
+            fill(image.get(), nullptr, 0, 0, 0, true, true));
+}
+
+TEST(FloodFill, Tolerance)
+{
+  ImageRef image = make_image({ 10, 12, 15, 40,
+                                11, 40, 14, 13 }, 4, 2);
+
+  EXPECT_EQ(std::vector<int>({ 1, 1, 0, 0,
+                               1, 0, 0, 0 }),
+            fill(image.get(), nullptr, 0, 0, 2, true, false));
+
+  EXPECT_EQ(std::vector<int>({ 1, 1, 1, 0,
+                               1, 0, 1, 1 }),
+            fill(image.get(), nullptr, 0, 0, 5, true, false));
+}
+
+TEST(FloodFill, NonContiguous)
+{
+  ImageRef image = make_image({ 0, 1, 0, 0,
+                                1, 1, 1, 1,
+                                0, 0, 1, 0 }, 4, 3);
+
+  EXPECT_EQ(std::vector<int>({ 1, 0, 1, 1,
+                               0, 0, 0, 0,
+                               1, 1, 0, 1 }),
+            fill(image.get(), nullptr, 0, 0, 0, false, false));
+}
+
+TEST(FloodFill, StartOutsideBounds)
+{
+  ImageRef image = make_image({ 0, 1, 0, 0,
+                                1, 1, 1, 1,
+                                0, 0, 1, 0 }, 4, 3);
+
+  // Colors are replaced inside the bounds even if the starting point
+  // is outside them (only when the fill is not contiguous)
+  for (const bool contiguous : { false, true }) {
+    Filled filled(image.get());
+    algorithm::floodfill(image.get(), nullptr, 0, 0, Rect(2, 0, 2, 3),
+                         0, 0, contiguous, false,
+                         &filled, &Filled::hline);
+    EXPECT_EQ(contiguous ?
+              std::vector<int>({ 0, 0, 0, 0,
+                                 0, 0, 0, 0,
+                                 0, 0, 0, 0 }):
+              std::vector<int>({ 0, 0, 1, 1,
+                                 0, 0, 0, 0,
+                                 0, 0, 0, 1 }),
+              filled.pixels);
+  }
+
+  // Points outside the image are ignored
+  Filled filled(image.get());
+  algorithm::floodfill(image.get(), nullptr, 4, 0, image->bounds(),
+                       0, 0, false, false,
+                       &filled, &Filled::hline);
+  EXPECT_EQ(std::vector<int>(12, 0), filled.pixels);
+}
+
+TEST(FloodFill, Mask)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, 4, 4));
+  image->clear(0);
+
+  Mask mask;
+  mask.replace(Rect(1, 1, 3, 2));
+  mask.subtract(Rect(2, 1, 1, 1));
+
+  EXPECT_EQ(std::vector<int>({ 0, 0, 0, 0,
+                               0, 1, 0, 1,
+                               0, 1, 1, 1,
+                               0, 0, 0, 0 }),
+            fill(image.get(), &mask, 1, 1, 0, true, false));
+}
+
+TEST(FloodFill, RgbTransparentPixels)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 70, 1));
+  image->clear(rgba(0, 0, 0, 0));
+  image->putPixel(20, 0, rgba(255, 0, 0, 0));   // Transparent with other RGB
+  image->putPixel(40, 0, rgba(255, 0, 0, 255)); // Opaque
+
+  Filled filled(image.get());
+  algorithm::floodfill(image.get(), nullptr, 0, 0, image->bounds(),
+                       rgba(0, 0, 0, 0), 0, true, false,
+                       &filled, &Filled::hline);
+  for (int x=0; x<70; ++x)
+    EXPECT_EQ(x < 40 ? 1: 0, filled.pixels[x]) << "x=" << x;
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,37 +11,474 @@
 
 #include "doc/algorithm/resize_image.h"
 
+#include "base/pi.h"
 #include "doc/algorithm/rotsprite.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
 #include "gfx/point.h"
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+#endif
 
 namespace doc {
 namespace algorithm {
 
+namespace {
+
+// Min number of rows to process in each thread.
+constexpr int kMinRowsPerThread = 64;
+
+// Fixed-point precision of the filter weights (1.0 = 1<<kWeightBits).
+constexpr int kWeightBits = 14;
+
+// Fractional bits kept in the horizontally filtered rows.
+constexpr int kRowBits = 6;
+
+// Source pixels (a range of columns or rows) that contribute to one
+// destination pixel.
+struct Contrib {
+  int start;                    // First source pixel
+  int count;                    // Number of source pixels
+  int weights;                  // Index of the first weight in Weights::weights
+};
+
+struct Weights {
+  std::vector<Contrib> contribs;
+  std::vector<int16_t> weights;
+  int maxCount = 0;
+};
+
+double lanczos3(double x)
+{
+  x = std::fabs(x);
+  if (x < 1e-8)
+    return 1.0;
+  if (x >= 3.0)
+    return 0.0;
+  const double px = PI * x;
+  return 3.0 * std::sin(px) * std::sin(px / 3.0) / (px * px);
+}
+
+// Calculates the fixed-point weights to resample one axis of "srcSize"
+// pixels to "dstSize" pixels.
+Weights calc_weights(const ResizeMethod method,
+                     const int srcSize,
+                     const int dstSize)
+{
+  Weights result;
+  result.contribs.resize(dstSize);
+
+  const double scale = double(srcSize) / double(dstSize);
+  std::vector<double> w;        // Weights from "first" source pixel
+  std::vector<double> ws;       // Weights clamped to the image edges
+
+  for (int i=0; i<dstSize; ++i) {
+    int first = 0;
+    w.clear();
+
+    switch (method) {
+
+      case RESIZE_METHOD_BILINEAR: {
+        // Same mapping as the old bilinear implementation: the
+        // first/last pixels of both images are aligned.
+        const double u = (dstSize > 1 ? i * double(srcSize-1) / double(dstSize-1): 0.0);
+        first = std::clamp(int(std::floor(u)), 0, srcSize-1);
+        const double f = std::clamp(u - first, 0.0, 1.0);
+        w.push_back(1.0 - f);
+        w.push_back(f);
+        break;
+      }
+
+      case RESIZE_METHOD_AREA_AVERAGE: {
+        const double a = i * scale;
+        const double b = (i+1) * scale;
+        first = int(std::floor(a));
+        const int last = std::max(first, int(std::ceil(b))-1);
+        for (int j=first; j<=last; ++j)
+          w.push_back(std::max(0.0, std::min<double>(b, j+1) - std::max<double>(a, j)));
+        break;
+      }
+
+      case RESIZE_METHOD_LANCZOS3: {
+        // When we downscale, the filter is stretched to avoid aliasing
+        const double filterScale = std::max(1.0, scale);
+        const double support = 3.0 * filterScale;
+        const double center = (i + 0.5) * scale - 0.5;
+        first = int(std::ceil(center - support));
+        const int last = int(std::floor(center + support));
+        for (int j=first; j<=last; ++j)
+          w.push_back(lanczos3((j - center) / filterScale));
+        break;
+      }
+
+      default:
+        ASSERT(false);
+        break;
+    }
+
+    // Move the weights of pixels outside the image to the edges
+    const int last = first + int(w.size()) - 1;
+    const int start = std::clamp(first, 0, srcSize-1);
+    const int end = std::clamp(last, 0, srcSize-1);
+    ws.assign(end - start + 1, 0.0);
+    double sum = 0.0;
+    for (int k=0; k<int(w.size()); ++k) {
+      ws[std::clamp(first+k, 0, srcSize-1) - start] += w[k];
+      sum += w[k];
+    }
+    if (std::fabs(sum) < 1e-8) {
+      ws.assign(ws.size(), 0.0);
+      ws[0] = sum = 1.0;
+    }
+
+    // Convert to fixed-point weights that sum exactly 1.0
+    std::vector<int> iw(ws.size());
+    int isum = 0;
+    int maxK = 0;
+    for (int k=0; k<int(ws.size()); ++k) {
+      iw[k] = int(std::round(ws[k] / sum * (1 << kWeightBits)));
+      isum += iw[k];
+      if (std::abs(iw[k]) > std::abs(iw[maxK]))
+        maxK = k;
+    }
+    iw[maxK] += (1 << kWeightBits) - isum;
+
+    // Skip zero weights at both sides
+    int k0 = 0, k1 = int(iw.size())-1;
+    while (k0 < k1 && iw[k0] == 0) ++k0;
+    while (k1 > k0 && iw[k1] == 0) --k1;
+
+    Contrib& c = result.contribs[i];
+    c.start = start + k0;
+    c.count = k1 - k0 + 1;
+    c.weights = int(result.weights.size());
+    for (int k=k0; k<=k1; ++k)
+      result.weights.push_back(int16_t(iw[k]));
+
+    result.maxCount = std::max(result.maxCount, c.count);
+  }
+  return result;
+}
+
+inline uint8_t premultiply(const int c, const int a)
+{
+  const int t = c*a + 128;
+  return uint8_t((t + (t >> 8)) >> 8);
+}
+
+inline int16_t clamp_int16(const int v)
+{
+  return int16_t(std::clamp(v, -32768, 32767));
+}
+
+// acc[i] += row0[i]*w0 + row1[i]*w1
+void accumulate_rows(int32_t* acc,
+                     const int16_t* row0, const int16_t w0,
+                     const int16_t* row1, const int16_t w1,
+                     const int n)
+{
+  int i = 0;
+#if defined(__x86_64__) || defined(_WIN64)
+  // Use SSE2 to multiply pairs of int16 (row0[i], row1[i]) with
+  // (w0, w1) and add them in int32 with one _mm_madd_epi16().
+  const __m128i w = _mm_set1_epi32(int((uint32_t(uint16_t(w1)) << 16) | uint16_t(w0)));
+  for (; i+8<=n; i+=8) {
+    const __m128i a = _mm_loadu_si128((const __m128i*)(row0+i));
+    const __m128i b = _mm_loadu_si128((const __m128i*)(row1+i));
+    const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w);
+    const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w);
+    __m128i* p = (__m128i*)(acc+i);
+    _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), lo));
+    _mm_storeu_si128(p+1, _mm_add_epi32(_mm_loadu_si128(p+1), hi));
+  }
+#endif
+  for (; i<n; ++i)
+    acc[i] += int32_t(row0[i])*w0 + int32_t(row1[i])*w1;
+}
+
+// Separable resampler: each source row is filtered horizontally
+// (and kept in a small cache of rows), then the cached rows are
+// combined vertically to generate each destination row. Pixels are
+// processed as 4 channels (RGBA) of 8-bits.
 template<typename ImageTraits>
-void resize_image_nearest(const Image* src, Image* dst)
+class Resampler {
+public:
+  Resampler(const Image* src, Image* dst,
+            const ResizeMethod method,
+            const Palette* pal,
+            const RgbMap* rgbmap,
+            const color_t maskColor)
+    : m_src(src)
+    , m_dst(dst)
+    , m_pal(pal)
+    , m_rgbmap(rgbmap)
+    , m_maskColor(maskColor)
+    , m_premultiplied(method != RESIZE_METHOD_BILINEAR)
+    , m_wx(calc_weights(method, src->width(), dst->width()))
+    , m_wy(calc_weights(method, src->height(), dst->height())) {
+  }
+
+  void run() {
+    m_dst->unsharePixels();
+
+    // RgbMap::mapColor() caches entries lazily, so we map indexed
+    // colors from one thread only.
+    const int minRows = (m_dst->pixelFormat() == IMAGE_INDEXED ?
+                         m_dst->height(): kMinRowsPerThread);
+    parallel_ranges(
+      m_dst->height(), minRows,
+      [this](const int y0, const int y1){ resampleRows(y0, y1); });
+  }
+
+private:
+  // Resamples the destination rows in [y0, y1)
+  void resampleRows(const int y0, const int y1) {
+    const int dstRowSize = 4*m_dst->width();
+    const int cacheRows = std::max(2, m_wy.maxCount);
+
+    std::vector<uint8_t> srcRow(4*m_src->width());
+    std::vector<int16_t> cache(cacheRows * dstRowSize);
+    std::vector<int> cachedY(cacheRows, -1);
+    std::vector<int32_t> acc(dstRowSize);
+
+    auto getRow = [&](const int y) -> const int16_t* {
+      const int slot = y % cacheRows;
+      int16_t* row = &cache[slot * dstRowSize];
+      if (cachedY[slot] != y) {
+        loadRow(y, srcRow.data());
+        filterRow(srcRow.data(), row);
+        cachedY[slot] = y;
+      }
+      return row;
+    };
+
+    for (int y=y0; y<y1; ++y) {
+      const Contrib& c = m_wy.contribs[y];
+      const int16_t* w = &m_wy.weights[c.weights];
+
+      std::fill(acc.begin(), acc.end(), 0);
+      int k = 0;
+      for (; k+1<c.count; k+=2) {
+        const int16_t* row0 = getRow(c.start+k);
+        const int16_t* row1 = getRow(c.start+k+1);
+        accumulate_rows(acc.data(), row0, w[k], row1, w[k+1], dstRowSize);
+      }
+      if (k < c.count) {
+        const int16_t* row0 = getRow(c.start+k);
+        accumulate_rows(acc.data(), row0, w[k], row0, 0, dstRowSize);
+      }
+
+      storeRow(y, acc.data());
+    }
+  }
+
+  // Converts the source row "y" to RGBA channels.
+  void loadRow(const int y, uint8_t* out) const;
+
+  // Horizontal pass of one row.
+  void filterRow(const uint8_t* in, int16_t* out) const {
+    constexpr int kShift = kWeightBits - kRowBits;
+    const int w = m_dst->width();
+    for (int x=0; x<w; ++x, out+=4) {
+      const Contrib& c = m_wx.contribs[x];
+      const int16_t* wgt = &m_wx.weights[c.weights];
+      const uint8_t* p = in + 4*c.start;
+      int r = 0, g = 0, b = 0, a = 0;
+      for (int k=0; k<c.count; ++k, p+=4) {
+        r += p[0] * wgt[k];
+        g += p[1] * wgt[k];
+        b += p[2] * wgt[k];
+        a += p[3] * wgt[k];
+      }
+      constexpr int kRound = (1 << (kShift-1));
+      out[0] = clamp_int16((r + kRound) >> kShift);
+      out[1] = clamp_int16((g + kRound) >> kShift);
+      out[2] = clamp_int16((b + kRound) >> kShift);
+      out[3] = clamp_int16((a + kRound) >> kShift);
+    }
+  }
+
+  // Converts the accumulated vertical pass to the destination row "y".
+  void storeRow(const int y, const int32_t* acc) const {
+    constexpr int kShift = kWeightBits + kRowBits;
+    constexpr int kRound = (1 << (kShift-1));
+    // Rows are written from several threads, so we use the const
+    // version of the address (pixels were already unshared in run())
+    auto dstPtr = get_pixel_address_fast<ImageTraits>((const Image*)m_dst, 0, y);
+    const int w = m_dst->width();
+    for (int x=0; x<w; ++x, acc+=4, ++dstPtr) {
+      int r = std::clamp((acc[0] + kRound) >> kShift, 0, 255);
+      int g = std::clamp((acc[1] + kRound) >> kShift, 0, 255);
+      int b = std::clamp((acc[2] + kRound) >> kShift, 0, 255);
+      const int a = std::clamp((acc[3] + kRound) >> kShift, 0, 255);
+      if (m_premultiplied) {
+        if (a == 0) {
+          r = g = b = 0;
+        }
+        else if (a < 255) {
+          r = std::min(255, (r*255 + a/2) / a);
+          g = std::min(255, (g*255 + a/2) / a);
+          b = std::min(255, (b*255 + a/2) / a);
+        }
+      }
+      *dstPtr = makePixel(r, g, b, a);
+    }
+  }
+
+  typename ImageTraits::pixel_t makePixel(int r, int g, int b, int a) const;
+
+  const Image* m_src;
+  Image* m_dst;
+  const Palette* m_pal;
+  const RgbMap* m_rgbmap;
+  const color_t m_maskColor;
+  const bool m_premultiplied;
+  const Weights m_wx;
+  const Weights m_wy;
+};
+
+template<>
+void Resampler<RgbTraits>::loadRow(const int y, uint8_t* out) const
+{
+  auto p = get_pixel_address_fast<RgbTraits>(m_src, 0, y);
+  const int w = m_src->width();
+  for (int x=0; x<w; ++x, ++p, out+=4) {
+    const color_t c = *p;
+    const int a = rgba_geta(c);
+    if (m_premultiplied) {
+      out[0] = premultiply(rgba_getr(c), a);
+      out[1] = premultiply(rgba_getg(c), a);
+      out[2] = premultiply(rgba_getb(c), a);
+    }
+    else {
+      out[0] = rgba_getr(c);
+      out[1] = rgba_getg(c);
+      out[2] = rgba_getb(c);
+    }
+    out[3] = a;
+  }
+}
+
+template<>
+void Resampler<GrayscaleTraits>::loadRow(const int y, uint8_t* out) const
 {
-  double x_ratio = double(src->width()) / double(dst->width());
-  double y_ratio = double(src->height()) / double(dst->height());
-  double px, py;
-
-  LockImageBits<ImageTraits> dstBits(dst);
-  auto dstIt = dstBits.begin();
-
-  for (int y=0; y<dst->height(); ++y) {
-    py = std::floor(y * y_ratio);
-    for (int x=0; x<dst->width(); ++x, ++dstIt) {
-      px = std::floor(x * x_ratio);
-      *dstIt = get_pixel_fast<ImageTraits>(src, int(px), int(py));
+  auto p = get_pixel_address_fast<GrayscaleTraits>(m_src, 0, y);
+  const int w = m_src->width();
+  for (int x=0; x<w; ++x, ++p, out+=4) {
+    const color_t c = *p;
+    const int a = graya_geta(c);
+    const int v = (m_premultiplied ? premultiply(graya_getv(c), a):
+                                     graya_getv(c));
+    out[0] = out[1] = out[2] = v;
+    out[3] = a;
+  }
+}
+
+template<>
+void Resampler<IndexedTraits>::loadRow(const int y, uint8_t* out) const
+{
+  auto p = get_pixel_address_fast<IndexedTraits>(m_src, 0, y);
+  const int w = m_src->width();
+  for (int x=0; x<w; ++x, ++p, out+=4) {
+    color_t c = m_pal->getEntry(*p);
+    if (*p == m_maskColor)
+      c &= rgba_rgb_mask;       // Set alpha = 0
+
+    const int a = rgba_geta(c);
+    if (m_premultiplied) {
+      out[0] = premultiply(rgba_getr(c), a);
+      out[1] = premultiply(rgba_getg(c), a);
+      out[2] = premultiply(rgba_getb(c), a);
+    }
+    else {
+      out[0] = rgba_getr(c);
+      out[1] = rgba_getg(c);
+      out[2] = rgba_getb(c);
     }
+    out[3] = a;
   }
 }
 
+template<>
+RgbTraits::pixel_t Resampler<RgbTraits>::makePixel(int r, int g, int b, int a) const
+{
+  return rgba(r, g, b, a);
+}
+
+template<>
+GrayscaleTraits::pixel_t Resampler<GrayscaleTraits>::makePixel(int r, int g, int b, int a) const
+{
+  return graya(r, a);
+}
+
+template<>
+IndexedTraits::pixel_t Resampler<IndexedTraits>::makePixel(int r, int g, int b, int a) const
+{
+  return m_rgbmap->mapColor(r, g, b, a);
+}
+
+template<typename ImageTraits>
+void resize_image_nearest(const Image* src, Image* dst)
+{
+  const int srcW = src->width();
+  const int srcH = src->height();
+  const int dstW = dst->width();
+  const int dstH = dst->height();
+
+  std::vector<int> srcX(dstW);
+  for (int x=0; x<dstW; ++x)
+    srcX[x] = int(int64_t(x) * srcW / dstW);
+
+  // Rows are written from several threads using the const version
+  // of the addresses, so pixels are unshared here
+  dst->unsharePixels();
+  const Image* dstRows = dst;
+
+  parallel_ranges(
+    dstH, kMinRowsPerThread,
+    [&](const int y0, const int y1){
+      for (int y=y0; y<y1; ++y) {
+        const int srcY = int(int64_t(y) * srcH / dstH);
+        if constexpr (ImageTraits::pixels_per_byte == 0) {
+          auto srcPtr = get_pixel_address_fast<ImageTraits>(src, 0, srcY);
+          auto dstPtr = get_pixel_address_fast<ImageTraits>(dstRows, 0, y);
+          for (int x=0; x<dstW; ++x)
+            dstPtr[x] = srcPtr[srcX[x]];
+        }
+        else {
+          for (int x=0; x<dstW; ++x) {
+            auto dstPtr = get_pixel_address_fast<ImageTraits>(dstRows, x, y);
+            const int bit = (1 << (x % ImageTraits::pixels_per_byte));
+            if (get_pixel_fast<ImageTraits>(src, srcX[x], srcY))
+              *dstPtr |= bit;
+            else
+              *dstPtr &= ~bit;
+          }
+        }
+      }
+    });
+}
+
+template<typename ImageTraits>
+void resample_image(const Image* src, Image* dst,
+                    const ResizeMethod method,
+                    const Palette* pal,
+                    const RgbMap* rgbmap,
+                    const color_t maskColor)
+{
+  Resampler<ImageTraits>(src, dst, method, pal, rgbmap, maskColor).run();
+}
+
+} // anonymous namespace
+
 void resize_image(const Image* src,
                   Image* dst,
                   const ResizeMethod method,
@@ -51,7 +488,6 @@ void resize_image(const Image* src,
 {
   switch (method) {
 
-    // TODO optimize this
     case RESIZE_METHOD_NEAREST_NEIGHBOR: {
       ASSERT(src->pixelFormat() == dst->pixelFormat());
 
@@ -60,22 +496,22 @@ void resize_image(const Image* src,
         case IMAGE_GRAYSCALE: resize_image_nearest<GrayscaleTraits>(src, dst); break;
         case IMAGE_INDEXED: resize_image_nearest<IndexedTraits>(src, dst); break;
         case IMAGE_BITMAP: resize_image_nearest<BitmapTraits>(src, dst); break;
+        case IMAGE_TILEMAP: resize_image_nearest<TilemapTraits>(src, dst); break;
       }
       break;
     }
 
-    // TODO optimize this
-    case RESIZE_METHOD_BILINEAR: {
-      uint32_t color[4], dst_color = 0;
-      double u, v, du, dv;
-      int u_floor, u_floor2;
-      int v_floor, v_floor2;
-      int x, y;
+    case RESIZE_METHOD_BILINEAR:
+    case RESIZE_METHOD_AREA_AVERAGE:
+    case RESIZE_METHOD_LANCZOS3: {
+      ASSERT(src->pixelFormat() == dst->pixelFormat());
 
       // We cannot do interpolations between RGB values on indexed
       // images without a palette/rgbmap.
-      if (dst->pixelFormat() == IMAGE_INDEXED &&
-          (!pal || !rgbmap)) {
+      if ((dst->pixelFormat() == IMAGE_INDEXED && (!pal || !rgbmap)) ||
+          (dst->pixelFormat() != IMAGE_RGB &&
+           dst->pixelFormat() != IMAGE_GRAYSCALE &&
+           dst->pixelFormat() != IMAGE_INDEXED)) {
         resize_image(
           src, dst,
           RESIZE_METHOD_NEAREST_NEIGHBOR,
@@ -83,92 +519,10 @@ void resize_image(const Image* src,
         return;
       }
 
-      u = v = 0.0;
-      du = (src->width()-1) * 1.0 / (dst->width()-1);
-      dv = (src->height()-1) * 1.0 / (dst->height()-1);
-      for (y=0; y<dst->height(); ++y) {
-        for (x=0; x<dst->width(); ++x) {
-          u_floor = (int)std::floor(u);
-          v_floor = (int)std::floor(v);
-
-          if (u_floor > src->width()-1) {
-            u_floor = src->width()-1;
-            u_floor2 = src->width()-1;
-          }
-          else if (u_floor == src->width()-1)
-            u_floor2 = u_floor;
-          else
-            u_floor2 = u_floor+1;
-
-          if (v_floor > src->height()-1) {
-            v_floor = src->height()-1;
-            v_floor2 = src->height()-1;
-          }
-          else if (v_floor == src->height()-1)
-            v_floor2 = v_floor;
-          else
-            v_floor2 = v_floor+1;
-
-          // get the four colors
-          color[0] = src->getPixel(u_floor,  v_floor);
-          color[1] = src->getPixel(u_floor2, v_floor);
-          color[2] = src->getPixel(u_floor,  v_floor2);
-          color[3] = src->getPixel(u_floor2, v_floor2);
-
-          // calculate the interpolated color
-          double u1 = u - u_floor;
-          double v1 = v - v_floor;
-          double u2 = 1 - u1;
-          double v2 = 1 - v1;
-
-          switch (dst->pixelFormat()) {
-            case IMAGE_RGB: {
-              int r = int((rgba_getr(color[0])*u2 + rgba_getr(color[1])*u1)*v2 +
-                          (rgba_getr(color[2])*u2 + rgba_getr(color[3])*u1)*v1);
-              int g = int((rgba_getg(color[0])*u2 + rgba_getg(color[1])*u1)*v2 +
-                          (rgba_getg(color[2])*u2 + rgba_getg(color[3])*u1)*v1);
-              int b = int((rgba_getb(color[0])*u2 + rgba_getb(color[1])*u1)*v2 +
-                          (rgba_getb(color[2])*u2 + rgba_getb(color[3])*u1)*v1);
-              int a = int((rgba_geta(color[0])*u2 + rgba_geta(color[1])*u1)*v2 +
-                          (rgba_geta(color[2])*u2 + rgba_geta(color[3])*u1)*v1);
-              dst_color = rgba(r, g, b, a);
-              break;
-            }
-            case IMAGE_GRAYSCALE: {
-              int v = int((graya_getv(color[0])*u2 + graya_getv(color[1])*u1)*v2 +
-                          (graya_getv(color[2])*u2 + graya_getv(color[3])*u1)*v1);
-              int a = int((graya_geta(color[0])*u2 + graya_geta(color[1])*u1)*v2 +
-                          (graya_geta(color[2])*u2 + graya_geta(color[3])*u1)*v1);
-              dst_color = graya(v, a);
-              break;
-            }
-            case IMAGE_INDEXED: {
-              // Convert index to RGBA values
-              for (int i=0; i<4; ++i) {
-                if (color[i] == maskColor)
-                  color[i] = pal->getEntry(color[i]) & rgba_rgb_mask; // Set alpha = 0
-                else
-                  color[i] = pal->getEntry(color[i]);
-              }
-
-              int r = int((rgba_getr(color[0])*u2 + rgba_getr(color[1])*u1)*v2 +
-                          (rgba_getr(color[2])*u2 + rgba_getr(color[3])*u1)*v1);
-              int g = int((rgba_getg(color[0])*u2 + rgba_getg(color[1])*u1)*v2 +
-                          (rgba_getg(color[2])*u2 + rgba_getg(color[3])*u1)*v1);
-              int b = int((rgba_getb(color[0])*u2 + rgba_getb(color[1])*u1)*v2 +
-                          (rgba_getb(color[2])*u2 + rgba_getb(color[3])*u1)*v1);
-              int a = int((rgba_geta(color[0])*u2 + rgba_geta(color[1])*u1)*v2 +
-                          (rgba_geta(color[2])*u2 + rgba_geta(color[3])*u1)*v1);
-              dst_color = rgbmap->mapColor(r, g, b, a);
-              break;
-            }
-          }
-
-          dst->putPixel(x, y, dst_color);
-          u += du;
-        }
-        u = 0.0;
-        v += dv;
+      switch (dst->pixelFormat()) {
+        case IMAGE_RGB: resample_image<RgbTraits>(src, dst, method, pal, rgbmap, maskColor); break;
+        case IMAGE_GRAYSCALE: resample_image<GrayscaleTraits>(src, dst, method, pal, rgbmap, maskColor); break;
+        case IMAGE_INDEXED: resample_image<IndexedTraits>(src, dst, method, pal, rgbmap, maskColor); break;
       }
       break;
     }
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -23,13 +23,17 @@ namespace doc {
       RESIZE_METHOD_NEAREST_NEIGHBOR,
       RESIZE_METHOD_BILINEAR,
       RESIZE_METHOD_ROTSPRITE,
+      RESIZE_METHOD_AREA_AVERAGE, // Box filter (good to downscale)
+      RESIZE_METHOD_LANCZOS3,
     };
 
     // Resizes the source image 'src' to the destination image 'dst'.
     //
     // Warning: If you are using the RESIZE_METHOD_BILINEAR, it is
     // recommended to use 'fixup_image_transparent_colors' function
-    // over the source image 'src' BEFORE using this routine.
+    // over the source image 'src' BEFORE using this routine. The
+    // RESIZE_METHOD_AREA_AVERAGE and RESIZE_METHOD_LANCZOS3 methods
+    // use premultiplied alpha, so they don't need this fixup.
     void resize_image(const Image* src,
                       Image* dst,
                       const ResizeMethod method,
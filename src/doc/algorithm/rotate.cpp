@@ -20,6 +20,7 @@
 #include "fixmath/fixmath.h"
 
 #include <cmath>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
@@ -28,7 +29,8 @@ using namespace fixmath;
 
 static void ase_parallelogram_map_standard(
   Image* bmp, const Image* sprite, const Image* mask,
-  fixed xs[4], fixed ys[4]);
+  fixed xs[4], fixed ys[4],
+  const std::vector<bool>* rows = nullptr);
 
 static void ase_rotate_scale_flip_coordinates(
   fixed w, fixed h,
@@ -172,7 +174,8 @@ void rotate_image(Image* dst, const Image* src, int x, int y, int w, int h,
  */
 void parallelogram(Image* bmp, const Image* sprite, const Image* mask,
   int x1, int y1, int x2, int y2,
-  int x3, int y3, int x4, int y4)
+  int x3, int y3, int x4, int y4,
+  const std::vector<bool>* rows)
 {
   fixed xs[4], ys[4];
 
@@ -185,7 +188,7 @@ void parallelogram(Image* bmp, const Image* sprite, const Image* mask,
   xs[3] = itofix(x4);
   ys[3] = itofix(y4);
 
-  ase_parallelogram_map_standard(bmp, sprite, mask, xs, ys);
+  ase_parallelogram_map_standard(bmp, sprite, mask, xs, ys, rows);
 }
 
 // Scanline drawers.
@@ -342,7 +345,8 @@ template<class Traits, class Delegate>
 static void ase_parallelogram_map(
   Image* bmp, const Image* spr, const Image* mask,
   fixed xs[4], fixed ys[4],
-  int sub_pixel_accuracy, Delegate delegate)
+  int sub_pixel_accuracy, Delegate delegate,
+  const std::vector<bool>* rows)
 {
   /* Index in xs[] and ys[] to topmost point. */
   int top_index;
@@ -593,6 +597,12 @@ static void ase_parallelogram_map(
       r_bmp_y_bottom_i = clip_bottom_i;
     }
 
+    /* Skip scanlines that the caller doesn't need (the edges are
+       calculated incrementally, so we cannot jump directly to the
+       next needed scanline). */
+    if (rows && !(*rows)[bmp_y_i])
+      goto skip_draw;
+
     /* Make left bmp coordinate be an integer and clip it. */
     if (sub_pixel_accuracy)
       l_bmp_x_rounded = l_bmp_x;
@@ -746,31 +756,32 @@ static void ase_parallelogram_map(
  */
 static void ase_parallelogram_map_standard(
   Image* bmp, const Image* sprite, const Image* mask,
-  fixed xs[4], fixed ys[4])
+  fixed xs[4], fixed ys[4],
+  const std::vector<bool>* rows)
 {
   switch (bmp->pixelFormat()) {
 
     case IMAGE_RGB: {
       RgbDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<RgbTraits, RgbDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map<RgbTraits, RgbDelegate>(bmp, sprite, mask, xs, ys, false, delegate, rows);
       break;
     }
 
     case IMAGE_GRAYSCALE: {
       GrayscaleDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<GrayscaleTraits, GrayscaleDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map<GrayscaleTraits, GrayscaleDelegate>(bmp, sprite, mask, xs, ys, false, delegate, rows);
       break;
     }
 
     case IMAGE_INDEXED: {
       IndexedDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<IndexedTraits, IndexedDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map<IndexedTraits, IndexedDelegate>(bmp, sprite, mask, xs, ys, false, delegate, rows);
       break;
     }
 
     case IMAGE_BITMAP: {
       BitmapDelegate delegate;
-      ase_parallelogram_map<BitmapTraits, BitmapDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map<BitmapTraits, BitmapDelegate>(bmp, sprite, mask, xs, ys, false, delegate, rows);
       break;
     }
   }
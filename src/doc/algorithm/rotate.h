@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -8,6 +9,8 @@
 #define DOC_ALGORITHM_ROTATE_H_INCLUDED
 #pragma once
 
+#include <vector>
+
 namespace doc {
   class Image;
 
@@ -21,9 +24,13 @@ namespace doc {
       int x, int y, int w, int h,
       int cx, int cy, double angle);
 
+    // Draws "src" in the given parallelogram of "dst". If "rows" is
+    // specified, only the scanlines "y" of "dst" where rows[y] is
+    // true are drawn.
     void parallelogram(Image* dst, const Image* src, const Image* mask,
       int x1, int y1, int x2, int y2,
-      int x3, int y3, int x4, int y4);
+      int x3, int y3, int x4, int y4,
+      const std::vector<bool>* rows = nullptr);
 
   } // namespace algorithm
 } // namespace doc
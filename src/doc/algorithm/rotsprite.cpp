@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020-2023  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,171 +9,254 @@
 #include "config.h"
 #endif
 
+#include "doc/algorithm/rotsprite.h"
+
+#include "base/task.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/image_impl.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
+#include "fixmath/fixmath.h"
 
 #include <algorithm>
 #include <memory>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
-// More information about EPX/Scale2x:
-// http://en.wikipedia.org/wiki/Pixel_art_scaling_algorithms#EPX.2FScale2.C3.97.2FAdvMAME2.C3.97
-// http://scale2x.sourceforge.net/algorithm.html
-// http://scale2x.sourceforge.net/scale2xandepx.html
-template<typename ImageTraits>
-static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h)
+using namespace fixmath;
+
+// Temporary buffers bigger than this are released after each call
+// (instead of being kept in each thread for the next call), so a big
+// rotation doesn't keep 8x upscaled images in memory forever.
+constexpr std::size_t kMaxKeptBufferSize = 16*1024*1024;
+
+// Number of rows processed between checks of the cancel token.
+constexpr int kRowsPerCancelCheck = 16;
+
+static bool is_canceled(const base::task_token* token)
 {
-#if 0      // TODO complete this implementation that should be faster
-           // than using a lot of get/put_pixel_fast calls.
-  int dst_w = src_w*2;
-  int dst_h = src_h*2;
+  return (token && token->canceled());
+}
 
-  LockImageBits<ImageTraits> dstBits(dst, Image::WriteLock, gfx::Rect(0, 0, dst_w, dst_h));
-  const LockImageBits<ImageTraits> srcBits(src);
+static void release_big_buffer(ImageBufferPtr& buffer)
+{
+  if (buffer && buffer->size() > kMaxKeptBufferSize)
+    buffer.reset();
+}
 
-  LockImageBits<ImageTraits>::iterator dstRow0_it = dstBits.begin();
-  LockImageBits<ImageTraits>::iterator dstRow1_it = dstBits.begin();
-  LockImageBits<ImageTraits>::iterator dstRow0_end = dstBits.end();
-  LockImageBits<ImageTraits>::iterator dstRow1_end = dstBits.end();
+// "dst" is const because rows are written from several threads, the
+// pixels of "dst" must be unshared before (see image_scale2x_tpl()).
+template<typename ImageTraits>
+static void image_scale2x_rows(const Image* dst, const Image* src,
+                               const int src_w, const int src_h,
+                               const int y0, const int y1)
+{
+  using const_address_t = typename ImageTraits::const_address_t;
+  using address_t = typename ImageTraits::address_t;
 
-  // Iterators:
+  // Pixels around P:
   //   A
   // C P B
   //   D
-  //
-  // These iterators are displaced through src image and are modified in this way:
-  //
-  // P: is the simplest one, we just start from (0, 0) to srcEnd.
-  // A: starts from row 0 (so A = P in the first row), then we start
-  //    again from the row 0.
-  // B: It starts from (1, row) and in the last pixel we don't moved it.
-  // C: It starts from (0, 0) and then it is moved with a delay.
-  // D: It starts from row 1 and continues until we reach the last
-  //    row, in that case we start D iterator again.
-  //
-  LockImageBits<ImageTraits>::const_iterator itP, itA, itB, itC, itD, savedD;
-  LockImageBits<ImageTraits>::const_iterator srcEnd = srcBits.end();
-  color_t P, A, B, C, D;
-
-  // Adjust iterators
-  itP = itA = itB = itC = itD = savedD = srcBits.begin();
-  dstRow1_it += dst_w;
-  itD += src->width();
-
-  for (int y=0; y<src_h; ++y) {
-    if (y == 1) itA = srcBits.begin();
-    if (y == src_h-2) savedD = itD;
-    if (y == src_h-1) itD = savedD;
-    ++itB;
+  for (int y=y0; y<y1; ++y) {
+    auto rowA = (const_address_t)src->getPixelAddress(0, std::max(y-1, 0));
+    auto rowP = (const_address_t)src->getPixelAddress(0, y);
+    auto rowD = (const_address_t)src->getPixelAddress(0, std::min(y+1, src_h-1));
+    auto dst0 = (address_t)dst->getPixelAddress(0, 2*y);
+    auto dst1 = (address_t)dst->getPixelAddress(0, 2*y+1);
 
     for (int x=0; x<src_w; ++x) {
-      ASSERT(itP != srcEnd);
-      ASSERT(itA != srcEnd);
-      ASSERT(itB != srcEnd);
-      ASSERT(itC != srcEnd);
-      ASSERT(itD != srcEnd);
-      ASSERT(dstRow0_it != dstRow0_end);
-      ASSERT(dstRow1_it != dstRow1_end);
-
-      P = *itP;
-      A = *itA;                 // y-1
-      B = *itB;                 // x+1
-      C = *itC;                 // x-1
-      D = *itD;                 // y+1
-
-      *dstRow0_it = (C == A && C != D && A != B ? A: P);
-      ++dstRow0_it;
-      *dstRow0_it = (A == B && A != C && B != D ? B: P);
-      ++dstRow0_it;
-
-      *dstRow1_it = (D == C && D != B && C != A ? C: P);
-      ++dstRow1_it;
-      *dstRow1_it = (B == D && B != A && D != C ? D: P);
-      ++dstRow1_it;
-
-      ++itP;
-      ++itA;
-      if (x < src_w-2) ++itB;
-      if (x > 0) ++itC;
-      ++itD;
+      const auto P = rowP[x];
+      const auto A = rowA[x];
+      const auto B = (x < src_w-1 ? rowP[x+1]: P);
+      const auto C = (x > 0 ? rowP[x-1]: P);
+      const auto D = rowD[x];
+
+      *(dst0++) = (C == A && C != D && A != B ? A: P);
+      *(dst0++) = (A == B && A != C && B != D ? B: P);
+      *(dst1++) = (D == C && D != B && C != A ? C: P);
+      *(dst1++) = (B == D && B != A && D != C ? D: P);
     }
-
-    // Adjust iterators for the next two rows.
-    ++itB;
-    ++itC;
-    dstRow0_it += dst_w;
-    if (y < src_h-1)
-      dstRow1_it += dst_w;
   }
+}
+
+// Bitmaps have 8 pixels per byte, so we cannot use the row pointers
+// directly.
+static inline void put_bit(const Image* dst, const int x, const int y,
+                           const color_t color)
+{
+  auto p = get_pixel_address_fast<BitmapTraits>(dst, x, y);
+  if (color)
+    *p |= (1 << (x & 7));
+  else
+    *p &= ~(1 << (x & 7));
+}
 
-  // ASSERT(itP == srcEnd);
-  // ASSERT(itA == srcEnd);
-  // ASSERT(itB == srcEnd);
-  // ASSERT(itC == srcEnd);
-  // ASSERT(itD == srcEnd);
-  ASSERT(dstRow0_it == dstRow0_end);
-  ASSERT(dstRow1_it == dstRow1_end);
-#else
-
-#define A c[0]
-#define B c[1]
-#define C c[2]
-#define D c[3]
-#define P c[4]
-
-  LockImageBits<ImageTraits> dstBits(dst, gfx::Rect(0, 0, src_w*2, src_h*2));
-  auto dstIt = dstBits.begin();
-  auto dstIt2 = dstIt;
-
-  color_t c[5];
-  for (int y=0; y<src_h; ++y) {
-    dstIt2 += src_w*2;
+template<>
+void image_scale2x_rows<BitmapTraits>(const Image* dst, const Image* src,
+                                      const int src_w, const int src_h,
+                                      const int y0, const int y1)
+{
+  for (int y=y0; y<y1; ++y) {
     for (int x=0; x<src_w; ++x) {
-      P = get_pixel_fast<ImageTraits>(src, x, y);
-      A = (y > 0 ? get_pixel_fast<ImageTraits>(src, x, y-1): P);
-      B = (x < src_w-1 ? get_pixel_fast<ImageTraits>(src, x+1, y): P);
-      C = (x > 0 ? get_pixel_fast<ImageTraits>(src, x-1, y): P);
-      D = (y < src_h-1 ? get_pixel_fast<ImageTraits>(src, x, y+1): P);
-
-      *dstIt = (C == A && C != D && A != B ? A: P);
-      ++dstIt;
-      *dstIt = (A == B && A != C && B != D ? B: P);
-      ++dstIt;
-
-      *dstIt2 = (D == C && D != B && C != A ? C: P);
-      ++dstIt2;
-      *dstIt2 = (B == D && B != A && D != C ? D: P);
-      ++dstIt2;
+      const color_t P = get_pixel_fast<BitmapTraits>(src, x, y);
+      const color_t A = (y > 0 ? get_pixel_fast<BitmapTraits>(src, x, y-1): P);
+      const color_t B = (x < src_w-1 ? get_pixel_fast<BitmapTraits>(src, x+1, y): P);
+      const color_t C = (x > 0 ? get_pixel_fast<BitmapTraits>(src, x-1, y): P);
+      const color_t D = (y < src_h-1 ? get_pixel_fast<BitmapTraits>(src, x, y+1): P);
+
+      put_bit(dst, 2*x,   2*y,   (C == A && C != D && A != B ? A: P));
+      put_bit(dst, 2*x+1, 2*y,   (A == B && A != C && B != D ? B: P));
+      put_bit(dst, 2*x,   2*y+1, (D == C && D != B && C != A ? C: P));
+      put_bit(dst, 2*x+1, 2*y+1, (B == D && B != A && D != C ? D: P));
     }
-    dstIt += src_w*2;
   }
+}
 
-#endif
+// More information about EPX/Scale2x:
+// http://en.wikipedia.org/wiki/Pixel_art_scaling_algorithms#EPX.2FScale2.C3.97.2FAdvMAME2.C3.97
+// http://scale2x.sourceforge.net/algorithm.html
+// http://scale2x.sourceforge.net/scale2xandepx.html
+//
+// Each source row generates two destination rows that no other row
+// touches, so rows can be processed in parallel.
+template<typename ImageTraits>
+static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h,
+                              const base::task_token* token)
+{
+  // Minimum number of rows to launch a new thread, a 64x64 image
+  // (a common sprite size) is processed in just one thread.
+  const int minRows = std::max(1, (64*64) / std::max(1, src_w));
+
+  dst->unsharePixels();
+  parallel_ranges(
+    src_h, minRows,
+    [dst, src, src_w, src_h, token](const int y0, const int y1) {
+      for (int y=y0; y<y1 && !is_canceled(token); y+=kRowsPerCancelCheck) {
+        image_scale2x_rows<ImageTraits>(dst, src, src_w, src_h,
+                                        y, std::min(y+kRowsPerCancelCheck, y1));
+      }
+    });
 }
 
-static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h)
+static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h,
+                          const base::task_token* token)
 {
   switch (src->pixelFormat()) {
-    case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_GRAYSCALE: image_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_INDEXED:   image_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h); break;
+    case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h, token); break;
+    case IMAGE_GRAYSCALE: image_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h, token); break;
+    case IMAGE_INDEXED:   image_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h, token); break;
+    case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h, token); break;
   }
 }
 
-void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
-  int x1, int y1, int x2, int y2,
-  int x3, int y3, int x4, int y4)
+RotSpriteCache::RotSpriteCache()
+{
+}
+
+RotSpriteCache::~RotSpriteCache()
+{
+}
+
+void RotSpriteCache::invalidate()
 {
-  static ImageBufferPtr buf[3]; // TODO non-thread safe
+  m_spr.reset();
+  m_msk.reset();
+}
+
+void RotSpriteCache::releaseBuffers()
+{
+  invalidate();
+  m_sprBuffer.reset();
+  m_mskBuffer.reset();
+}
+
+void RotSpriteCache::update(const Image* spr, const Image* mask,
+                            const base::task_token* token)
+{
+  const int scale = 8;
+
+  if (!m_spr ||
+      m_spr->pixelFormat() != spr->pixelFormat() ||
+      m_spr->width() != spr->width()*scale ||
+      m_spr->height() != spr->height()*scale) {
+    // Temporary image for the intermediate Scale2x passes (shared by
+    // all caches of the same thread).
+    thread_local ImageBufferPtr tmpBuffer;
+    if (!tmpBuffer)
+      tmpBuffer = std::make_shared<ImageBuffer>(1);
+    if (!m_sprBuffer)
+      m_sprBuffer = std::make_shared<ImageBuffer>(1);
+
+    // These images are cleared/overwritten below, so we can skip the
+    // initialization of their pixels.
+    const ImageSpec spec((ColorMode)spr->pixelFormat(),
+                         spr->width()*scale, spr->height()*scale);
+    std::unique_ptr<Image> tmp(Image::createUninitialized(spec, tmpBuffer));
+    m_spr.reset(Image::createUninitialized(spec, m_sprBuffer));
+
+    // Three passes alternating the source/destination images, so the
+    // last one leaves the result in m_spr: tmp -> m_spr -> tmp -> m_spr
+    tmp->copy(spr, gfx::Clip(spr->bounds()));
+    Image* src = tmp.get();
+    Image* dst = m_spr.get();
+    for (int i=0; i<3 && !is_canceled(token); ++i) {
+      image_scale2x(dst, src, spr->width()*(1<<i), spr->height()*(1<<i), token);
+      std::swap(src, dst);
+    }
+    tmp.reset();
+    release_big_buffer(tmpBuffer);
+
+    // The upscaled image is incomplete
+    if (is_canceled(token)) {
+      invalidate();
+      return;
+    }
+  }
+  m_spr->setMaskColor(spr->maskColor());
 
-  for (int i=0; i<3; ++i)
-    if (!buf[i])
-      buf[i].reset(new ImageBuffer(1));
+  if (!mask) {
+    m_msk.reset();
+  }
+  else if (!m_msk ||
+           m_msk->width() != mask->width()*scale ||
+           m_msk->height() != mask->height()*scale) {
+    if (!m_mskBuffer)
+      m_mskBuffer = std::make_shared<ImageBuffer>(1);
+
+    m_msk.reset(Image::createUninitialized(ImageSpec(ColorMode::BITMAP, mask->width()*scale, mask->height()*scale), m_mskBuffer));
+    clear_image(m_msk.get(), 0);
+    scale_image(m_msk.get(), mask,
+                0, 0, m_msk->width(), m_msk->height(),
+                0, 0, mask->width(), mask->height());
+  }
+}
+
+// Returns the rows of the source image that scale_image() reads to
+// scale "src_h" rows to "dst_h" rows (it must match the nearest
+// neighbor sampling of image_scale_tpl() in rotate.cpp).
+static std::vector<bool> scaled_rows(const int src_h, const int dst_h)
+{
+  std::vector<bool> rows(src_h, false);
+  const fixed dy = fixdiv(itofix(src_h-1), itofix(dst_h-1));
+  fixed y = 0;
+  for (int v=0; v<dst_h; ++v) {
+    const int i = fixtoi(y);
+    if (i >= 0 && i < src_h)
+      rows[i] = true;
+    y = fixadd(y, dy);
+  }
+  return rows;
+}
 
+void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
+  int x1, int y1, int x2, int y2,
+  int x3, int y3, int x4, int y4,
+  RotSpriteCache* cache,
+  const base::task_token* token)
+{
   int xmin = std::min(x1, std::min(x2, std::min(x3, x4)));
   int xmax = std::max(x1, std::max(x2, std::max(x3, x4)));
   int ymin = std::min(y1, std::min(y2, std::min(y3, y4)));
@@ -184,48 +267,56 @@ void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   if (rot_width == 0 || rot_height == 0)
     return;
 
-  int scale = 8;
-  std::unique_ptr<Image> bmp_copy(Image::create(bmp->pixelFormat(), rot_width*scale, rot_height*scale, buf[0]));
-  std::unique_ptr<Image> tmp_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[1]));
-  std::unique_ptr<Image> spr_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[2]));
-  std::unique_ptr<Image> msk_copy;
+  // Without a cache we re-use the same memory on each call (from the
+  // same thread) as the upscaled images are discarded anyway.
+  thread_local RotSpriteCache tmpCache;
+  if (!cache) {
+    cache = &tmpCache;
+    cache->invalidate();
+  }
+  cache->update(spr, mask, token);
+  if (!cache->image() || is_canceled(token))
+    return;
 
-  color_t maskColor = spr->maskColor();
+  thread_local ImageBufferPtr bmpBuffer;
+  if (!bmpBuffer)
+    bmpBuffer = std::make_shared<ImageBuffer>(1);
 
+  int scale = 8;
+  color_t maskColor = spr->maskColor();
+  std::unique_ptr<Image> bmp_copy(Image::createUninitialized(ImageSpec((ColorMode)bmp->pixelFormat(), rot_width*scale, rot_height*scale), bmpBuffer));
   bmp_copy->setMaskColor(maskColor);
-  tmp_copy->setMaskColor(maskColor);
-  spr_copy->setMaskColor(maskColor);
-
-  spr_copy->clear(maskColor);
-  spr_copy->copy(spr, gfx::Clip(spr->bounds()));
 
-  for (int i=0; i<3; ++i) {
-    // clear_image(tmp_copy, maskColor);
-    image_scale2x(tmp_copy.get(), spr_copy.get(), spr->width()*(1<<i), spr->height()*(1<<i));
-    spr_copy->copy(tmp_copy.get(), gfx::Clip(tmp_copy->bounds()));
-  }
+  const int dst_x = std::max(0, xmin);
+  const int dst_y = std::max(0, ymin);
+  const int dst_w = std::clamp(rot_width, 0, std::max(0, bmp->width() - dst_x));
+  const int dst_h = std::clamp(rot_height, 0, std::max(0, bmp->height() - dst_y));
 
-  if (mask) {
-    // Same ImageBuffer than tmp_copy
-    msk_copy.reset(Image::create(IMAGE_BITMAP, mask->width()*scale, mask->height()*scale, buf[1]));
-    clear_image(msk_copy.get(), 0);
-    scale_image(msk_copy.get(), mask,
-                0, 0, msk_copy->width(), msk_copy->height(),
-                0, 0, mask->width(), mask->height());
-  }
+  // Only 1 of each 8 rows of bmp_copy is read by scale_image(), so
+  // we can skip the others.
+  const std::vector<bool> rows = scaled_rows(bmp_copy->height(), dst_h);
+  for (int y=0; y<bmp_copy->height(); ++y)
+    if (rows[y])
+      fill_rect(bmp_copy.get(), 0, y, bmp_copy->width()-1, y, maskColor);
 
-  clear_image(bmp_copy.get(), maskColor);
   parallelogram(
-    bmp_copy.get(), spr_copy.get(), msk_copy.get(),
+    bmp_copy.get(), cache->image(), cache->mask(),
     (x1-xmin)*scale, (y1-ymin)*scale, (x2-xmin)*scale, (y2-ymin)*scale,
-    (x3-xmin)*scale, (y3-ymin)*scale, (x4-xmin)*scale, (y4-ymin)*scale);
-
-  scale_image(bmp, bmp_copy.get(),
-              std::max(0, xmin),
-              std::max(0, ymin),
-              std::clamp(rot_width, 0, std::max(0, bmp->width() - std::max(0, xmin))),
-              std::clamp(rot_height, 0, std::max(0, bmp->height() - std::max(0, ymin))),
-              0, 0, bmp_copy->width(), bmp_copy->height());
+    (x3-xmin)*scale, (y3-ymin)*scale, (x4-xmin)*scale, (y4-ymin)*scale,
+    &rows);
+
+  if (!is_canceled(token)) {
+    scale_image(bmp, bmp_copy.get(),
+                dst_x, dst_y, dst_w, dst_h,
+                0, 0, bmp_copy->width(), bmp_copy->height());
+  }
+
+  bmp_copy.reset();
+  release_big_buffer(bmpBuffer);
+  if (cache == &tmpCache &&
+      cache->image()->getMemSize() > int(kMaxKeptBufferSize)) {
+    tmpCache.releaseBuffers();
+  }
 }
 
 } // namespace algorithm
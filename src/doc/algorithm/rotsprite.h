@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -8,14 +9,64 @@
 #define DOC_ALGORITHM_ROTSPRITE_H_INCLUDED
 #pragma once
 
+#include "doc/image_buffer.h"
+
+#include <memory>
+
+namespace base {
+  class task_token;
+}
+
 namespace doc {
   class Image;
 
   namespace algorithm {
 
+    // Keeps the 8x upscaled version (three Scale2x passes) of an
+    // image and its mask, so the same image can be rotated several
+    // times with different angles (e.g. when the user transforms a
+    // selection) without upscaling it again on each rotation.
+    //
+    // The cache doesn't know when the pixels of the source image or
+    // mask are modified, invalidate() must be called in that case.
+    class RotSpriteCache {
+    public:
+      RotSpriteCache();
+      ~RotSpriteCache();
+
+      void invalidate();
+
+      // Invalidates the cache and releases the memory of the
+      // upscaled images.
+      void releaseBuffers();
+
+      // Upscales the given image and mask if they are not cached
+      // yet (or if they have a different size/format). If the
+      // "token" is canceled in the middle of the process, the cache
+      // is left empty (image() returns nullptr).
+      void update(const Image* spr, const Image* mask,
+                  const base::task_token* token = nullptr);
+
+      const Image* image() const { return m_spr.get(); }
+      const Image* mask() const { return m_msk.get(); }
+
+    private:
+      std::unique_ptr<Image> m_spr;
+      std::unique_ptr<Image> m_msk;
+      ImageBufferPtr m_sprBuffer;
+      ImageBufferPtr m_mskBuffer;
+    };
+
+    // Rotates/scales the "src" image to the given parallelogram in
+    // "dst" using the RotSprite algorithm. If "cache" is specified,
+    // the upscaled version of "src" is re-used between calls. If the
+    // "token" is canceled, the function returns as soon as possible
+    // (leaving "dst" partially modified).
     void rotsprite_image(Image* dst, const Image* src, const Image* mask,
       int x1, int y1, int x2, int y2,
-      int x3, int y3, int x4, int y4);
+      int x3, int y3, int x4, int y4,
+      RotSpriteCache* cache = nullptr,
+      const base::task_token* token = nullptr);
 
   } // namespace algorithm
 } // namespace doc
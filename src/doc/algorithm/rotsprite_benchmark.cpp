@@ -0,0 +1,62 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/algorithm/rotsprite.h"
+
+#include "doc/algorithm/random_image.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+
+using namespace doc;
+
+// Rotates a selection of WxW pixels a different angle on each
+// iteration (like when the user drags the rotation handle).
+void BM_RotSprite(benchmark::State& state) {
+  const int w = state.range(0);
+  const bool cached = state.range(1);
+
+  ImageRef spr(Image::create(IMAGE_RGB, w, w));
+  algorithm::random_image(spr.get());
+  ImageRef dst(Image::create(IMAGE_RGB, w*3/2, w*3/2));
+
+  algorithm::RotSpriteCache cache;
+  double angle = 0.0;
+  for (auto _ : state) {
+    const double c = std::cos(angle) * w/2;
+    const double s = std::sin(angle) * w/2;
+    const int cx = dst->width()/2;
+    const int cy = dst->height()/2;
+    algorithm::rotsprite_image(
+      dst.get(), spr.get(), nullptr,
+      int(cx - c + s), int(cy - s - c),
+      int(cx + c + s), int(cy + s - c),
+      int(cx + c - s), int(cy + s + c),
+      int(cx - c - s), int(cy - s + c),
+      (cached ? &cache: nullptr));
+    angle += 0.1;
+  }
+  state.SetItemsProcessed(state.iterations() * w * w);
+}
+
+BENCHMARK(BM_RotSprite)
+  ->Args({ 64, false })
+  ->Args({ 64, true })
+  ->Args({ 256, false })
+  ->Args({ 256, true })
+  ->Args({ 1024, false })
+  ->Args({ 1024, true })
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
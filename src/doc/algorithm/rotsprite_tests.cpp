@@ -0,0 +1,137 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/rotsprite.h"
+
+#include "base/task.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+using namespace doc;
+using namespace doc::algorithm;
+
+namespace {
+
+// Blocks of colors (similar to pixel art) so Scale2x has edges to
+// smooth.
+ImageRef make_sprite(const PixelFormat pixelFormat, const int w, const int h)
+{
+  ImageRef image(Image::create(pixelFormat, w, h));
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      const int v = (x/3 + y/2) % 4;
+      put_pixel(image.get(), x, y,
+                (pixelFormat == IMAGE_RGB ? rgba(v*60, 255-v*60, 0, 255):
+                 pixelFormat == IMAGE_BITMAP ? (v & 1): v));
+    }
+  }
+  return image;
+}
+
+ImageRef rotate(const Image* spr, const Image* mask,
+                const int x1, const int y1, const int x2, const int y2,
+                const int x3, const int y3, const int x4, const int y4,
+                RotSpriteCache* cache)
+{
+  ImageRef dst(Image::create(spr->pixelFormat(), 40, 40));
+  dst->clear(0);
+  rotsprite_image(dst.get(), spr, mask, x1, y1, x2, y2, x3, y3, x4, y4, cache);
+  return dst;
+}
+
+bool equal_images(const Image* a, const Image* b)
+{
+  for (int y=0; y<a->height(); ++y)
+    for (int x=0; x<a->width(); ++x)
+      if (get_pixel(a, x, y) != get_pixel(b, x, y))
+        return false;
+  return true;
+}
+
+} // anonymous namespace
+
+TEST(RotSprite, CacheGivesSameResult)
+{
+  for (PixelFormat pixelFormat : { IMAGE_RGB, IMAGE_INDEXED, IMAGE_BITMAP }) {
+    ImageRef spr = make_sprite(pixelFormat, 17, 11);
+    ImageRef mask = make_sprite(IMAGE_BITMAP, 17, 11);
+    RotSpriteCache cache;
+
+    // Different angles re-using the same upscaled image
+    const int corners[][8] = { { 5, 0, 25, 6, 20, 20, 0, 14 },
+                               { 0, 10, 20, 0, 30, 14, 10, 24 },
+                               { 2, 2, 35, 2, 35, 30, 2, 30 } };
+    for (const auto& c : corners) {
+      for (const Image* m : { (const Image*)nullptr, (const Image*)mask.get() }) {
+        ImageRef a = rotate(spr.get(), m, c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7], nullptr);
+        ImageRef b = rotate(spr.get(), m, c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7], &cache);
+        EXPECT_TRUE(equal_images(a.get(), b.get()))
+          << "pixelFormat=" << pixelFormat << " mask=" << (m != nullptr);
+      }
+    }
+  }
+}
+
+TEST(RotSprite, InvalidateCache)
+{
+  ImageRef spr = make_sprite(IMAGE_RGB, 8, 8);
+  RotSpriteCache cache;
+  ImageRef a = rotate(spr.get(), nullptr, 0, 0, 16, 0, 16, 16, 0, 16, &cache);
+
+  // The cache doesn't know that the pixels were changed
+  spr->clear(rgba(0, 0, 255, 255));
+  ImageRef b = rotate(spr.get(), nullptr, 0, 0, 16, 0, 16, 16, 0, 16, &cache);
+  EXPECT_TRUE(equal_images(a.get(), b.get()));
+
+  cache.invalidate();
+  ImageRef c = rotate(spr.get(), nullptr, 0, 0, 16, 0, 16, 16, 0, 16, &cache);
+  EXPECT_EQ(rgba(0, 0, 255, 255), get_pixel(c.get(), 5, 5));
+}
+
+TEST(RotSprite, Cancel)
+{
+  ImageRef spr = make_sprite(IMAGE_RGB, 8, 8);
+  RotSpriteCache cache;
+  base::task_token token;
+  token.cancel();
+
+  // Nothing is drawn and the cache is not filled with an incomplete
+  // upscaled image
+  ImageRef dst(Image::create(IMAGE_RGB, 16, 16));
+  dst->clear(0);
+  rotsprite_image(dst.get(), spr.get(), nullptr,
+                  0, 0, 16, 0, 16, 16, 0, 16, &cache, &token);
+  EXPECT_EQ(nullptr, cache.image());
+  for (int y=0; y<16; ++y)
+    for (int x=0; x<16; ++x)
+      EXPECT_EQ(0, get_pixel(dst.get(), x, y));
+
+  // The cache works after a canceled call
+  ImageRef a = rotate(spr.get(), nullptr, 0, 0, 16, 0, 16, 16, 0, 16, nullptr);
+  ImageRef b = rotate(spr.get(), nullptr, 0, 0, 16, 0, 16, 16, 0, 16, &cache);
+  EXPECT_TRUE(equal_images(a.get(), b.get()));
+}
+
+TEST(RotSprite, Scale2xKeepsFlatAreas)
+{
+  // A flat image scaled to 2x must give the same flat image
+  ImageRef spr(Image::create(IMAGE_INDEXED, 9, 7));
+  spr->clear(4);
+  spr->setMaskColor(0);
+  ImageRef dst = rotate(spr.get(), nullptr, 0, 0, 18, 0, 18, 14, 0, 14, nullptr);
+  for (int y=0; y<14; ++y)
+    for (int x=0; x<18; ++x)
+      EXPECT_EQ(4, get_pixel(dst.get(), x, y)) << "x=" << x << " y=" << y;
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
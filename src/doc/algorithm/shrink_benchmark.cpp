@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -31,6 +31,22 @@ void BM_ShrinkBounds(benchmark::State& state) {
   }
 }
 
+void BM_ShrinkBounds2(benchmark::State& state) {
+  const PixelFormat pixelFormat = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+
+  std::unique_ptr<Image> a(Image::create(pixelFormat, w, h));
+  std::unique_ptr<Image> b(Image::create(pixelFormat, w, h));
+  a->clear(0);
+  b->clear(0);
+  b->putPixel(w/2, h/2, rgba(1, 2, 3, 4));
+  gfx::Rect rc;
+  while (state.KeepRunning()) {
+    doc::algorithm::shrink_bounds2(a.get(), b.get(), a->bounds(), rc);
+  }
+}
+
 #define DEFARGS(MODE)                      \
   ->Args({ MODE, 100, 100 })               \
   ->Args({ MODE, 200, 200 })               \
@@ -56,4 +72,11 @@ BENCHMARK(BM_ShrinkBounds)
   ->Unit(benchmark::kMicrosecond)
   ->UseRealTime();
 
+BENCHMARK(BM_ShrinkBounds2)
+  ->Args({ IMAGE_RGB, 1000, 1000 })
+  ->Args({ IMAGE_RGB, 4000, 4000 })
+  ->Args({ IMAGE_INDEXED, 4000, 4000 })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
 BENCHMARK_MAIN();
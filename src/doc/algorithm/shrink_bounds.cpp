@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -21,221 +21,225 @@
 #include "doc/primitives_fast.h"
 #include "doc/tileset.h"
 
-#include <thread>
+#include <algorithm>
+#include <type_traits>
 
 namespace doc {
 namespace algorithm {
 
 namespace {
 
-template<typename ImageTraits>
-bool is_same_pixel(color_t pixel1, color_t pixel2)
-{
-  static_assert(false && sizeof(ImageTraits), "No is_same_pixel impl");
-  return false;
-}
+// Number of bytes compared without branches before checking if we
+// have found a different pixel (so the compiler can vectorize the
+// loop).
+const int kChunkBytes = 64;
 
-template<>
-bool is_same_pixel<RgbTraits>(color_t pixel1, color_t pixel2)
+// Returns the first "x" in [x1, x2) where diff(x) != 0, or x2 if
+// there is no difference.
+template<typename Diff>
+int find_first_diff(const Diff& diff, int x1, const int x2)
 {
-  return (rgba_geta(pixel1) == 0 && rgba_geta(pixel2) == 0) || (pixel1 == pixel2);
+  constexpr int kChunkSize = kChunkBytes / sizeof(typename Diff::result_t);
+  for (; x1+kChunkSize <= x2; x1 += kChunkSize) {
+    typename Diff::result_t acc = 0;
+    for (int i=0; i<kChunkSize; ++i)
+      acc |= diff(x1+i);
+    if (acc)
+      break;
+  }
+  for (; x1<x2; ++x1)
+    if (diff(x1))
+      return x1;
+  return x2;
 }
 
-template<>
-bool is_same_pixel<GrayscaleTraits>(color_t pixel1, color_t pixel2)
+// Returns the last "x" in [x1, x2) where diff(x) != 0, or x1-1 if
+// there is no difference.
+template<typename Diff>
+int find_last_diff(const Diff& diff, const int x1, int x2)
 {
-  return (graya_geta(pixel1) == 0 && graya_geta(pixel2) == 0) || (pixel1 == pixel2);
+  constexpr int kChunkSize = kChunkBytes / sizeof(typename Diff::result_t);
+  for (; x2-kChunkSize >= x1; x2 -= kChunkSize) {
+    typename Diff::result_t acc = 0;
+    for (int i=x2-kChunkSize; i<x2; ++i)
+      acc |= diff(i);
+    if (acc)
+      break;
+  }
+  for (--x2; x2>=x1; --x2)
+    if (diff(x2))
+      return x2;
+  return x1-1;
 }
 
+// Compares the pixels of a row with a reference pixel. Two pixels
+// are the same if (pixel & mask) == ref (e.g. for RGB images, all
+// transparent pixels are equal to a transparent reference pixel).
+template<typename ImageTraits>
+struct RefPixelDiff {
+  using pixel_t = typename ImageTraits::pixel_t;
+  using result_t = pixel_t;
+  const pixel_t* row;
+  pixel_t mask, ref;
+  result_t operator()(int x) const { return (row[x] & mask) ^ ref; }
+};
+
+// Bitmap pixels are not addressable, we compare them one by one.
 template<>
-bool is_same_pixel<IndexedTraits>(color_t pixel1, color_t pixel2)
-{
-  return pixel1 == pixel2;
-}
+struct RefPixelDiff<BitmapTraits> {
+  using result_t = int;
+  const Image* image;
+  int y;
+  color_t ref;
+  result_t operator()(int x) const {
+    return (get_pixel_fast<BitmapTraits>(image, x, y) != ref);
+  }
+};
+
+// Compares the pixels of the same row in two images.
+template<typename ImageTraits>
+struct ImagesDiff {
+  using pixel_t = typename ImageTraits::pixel_t;
+  using result_t = pixel_t;
+  const pixel_t* a;
+  const pixel_t* b;
+  result_t operator()(int x) const { return a[x] ^ b[x]; }
+};
 
 template<>
-bool is_same_pixel<BitmapTraits>(color_t pixel1, color_t pixel2)
+struct ImagesDiff<BitmapTraits> {
+  using result_t = int;
+  const Image* a;
+  const Image* b;
+  int y;
+  result_t operator()(int x) const {
+    return (get_pixel_fast<BitmapTraits>(a, x, y) !=
+            get_pixel_fast<BitmapTraits>(b, x, y));
+  }
+};
+
+// Finds the bounds of the different pixels in just one pass through
+// the rows: the first and last rows with differences give us the
+// top/bottom sides, and in the rows between them we only check the
+// pixels outside the current left/right sides. "rowDiff(y)" must
+// return a functor to compare pixels of the row "y".
+template<typename RowDiff>
+bool shrink_bounds_rows(gfx::Rect& bounds, const RowDiff& rowDiff)
 {
-  return pixel1 == pixel2;
-}
+  const int x1 = bounds.x;
+  const int x2 = bounds.x2();
+  int y1 = bounds.y;
+  int y2 = bounds.y2()-1;
+  int left = x2;
+  int right = x1-1;
 
-template<typename ImageTraits>
-bool shrink_bounds_left_templ(const Image* image, gfx::Rect& bounds, color_t refpixel, int rowPixels)
-{
-  int u, v;
-  // Shrink left side
-  for (u=bounds.x; u<bounds.x2(); ++u) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u, v=bounds.y);
-    for (; v<bounds.y2(); ++v, ptr+=rowPixels) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
+  // Shrink top side
+  for (; y1<=y2; ++y1) {
+    const auto diff = rowDiff(y1);
+    left = find_first_diff(diff, x1, x2);
+    if (left < x2) {
+      right = find_last_diff(diff, left, x2);
+      break;
     }
-    ++bounds.x;
-    --bounds.w;
   }
-  return (!bounds.isEmpty());
-}
 
-template<typename ImageTraits>
-bool shrink_bounds_right_templ(const Image* image, gfx::Rect& bounds, color_t refpixel, int rowPixels)
-{
-  int u, v;
-  // Shrink right side
-  for (u=bounds.x2()-1; u>=bounds.x; --u) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u, v=bounds.y);
-    for (; v<bounds.y2(); ++v, ptr+=rowPixels) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
-    }
-    --bounds.w;
+  // All pixels are the same
+  if (y1 > y2) {
+    bounds.x = x2;
+    bounds.w = 0;
+    return false;
   }
-  return (!bounds.isEmpty());
-}
 
-template<typename ImageTraits>
-bool shrink_bounds_top_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
-{
-  int u, v;
-  // Shrink top side
-  for (v=bounds.y; v<bounds.y2(); ++v) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u=bounds.x, v);
-    for (; u<bounds.x2(); ++u, ++ptr) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
+  // Shrink bottom side
+  for (; y2>y1; --y2) {
+    const auto diff = rowDiff(y2);
+    const int u = find_first_diff(diff, x1, x2);
+    if (u < x2) {
+      left = std::min(left, u);
+      right = std::max(right, find_last_diff(diff, std::max(u, right+1), x2));
+      break;
     }
-    ++bounds.y;
-    --bounds.h;
   }
-  return (!bounds.isEmpty());
-}
 
-template<typename ImageTraits>
-bool shrink_bounds_bottom_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
-{
-  int u, v;
-  // Shrink bottom side
-  for (v=bounds.y2()-1; v>=bounds.y; --v) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u=bounds.x, v);
-    for (; u<bounds.x2(); ++u, ++ptr) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
-    }
-    --bounds.h;
+  // Shrink left/right sides with the rows in the middle
+  for (int v=y1+1; v<y2 && (left > x1 || right < x2-1); ++v) {
+    const auto diff = rowDiff(v);
+    left = find_first_diff(diff, x1, left);
+    right = find_last_diff(diff, right+1, x2);
   }
-  return (!bounds.isEmpty());
+
+  bounds = gfx::Rect(left, y1, right-left+1, y2-y1+1);
+  return true;
 }
 
 template<typename ImageTraits>
 bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
 {
-  // Pixels per row
-  const int rowPixels = image->rowPixels();
-  const int canvasSize = image->width()*image->height();
-  if ((std::thread::hardware_concurrency() >= 4) &&
-      ((image->pixelFormat() == IMAGE_RGB && canvasSize >= 800*800) ||
-       (image->pixelFormat() != IMAGE_RGB && canvasSize >= 500*500))) {
-    gfx::Rect
-      leftBounds(bounds), rightBounds(bounds),
-      topBounds(bounds), bottomBounds(bounds);
-
-    // TODO use a base::thread_pool and a base::task for each border
-
-    std::thread left  ([&]{ shrink_bounds_left_templ  <ImageTraits>(image, leftBounds, refpixel, rowPixels); });
-    std::thread right ([&]{ shrink_bounds_right_templ <ImageTraits>(image, rightBounds, refpixel, rowPixels); });
-    std::thread top   ([&]{ shrink_bounds_top_templ   <ImageTraits>(image, topBounds, refpixel); });
-    std::thread bottom([&]{ shrink_bounds_bottom_templ<ImageTraits>(image, bottomBounds, refpixel); });
-    left.join();
-    right.join();
-    top.join();
-    bottom.join();
-    bounds = leftBounds;
-    bounds &= rightBounds;
-    bounds &= topBounds;
-    bounds &= bottomBounds;
-    return !bounds.isEmpty();
+  using pixel_t = typename ImageTraits::pixel_t;
+  pixel_t mask = pixel_t(~pixel_t(0));
+  pixel_t ref = pixel_t(refpixel);
+  bool transparentRef = false;
+
+  // All transparent pixels are equal in RGB and grayscale images
+  if constexpr (std::is_same_v<ImageTraits, RgbTraits>) {
+    transparentRef = (rgba_geta(refpixel) == 0);
+    if (transparentRef)
+      mask = rgba_a_mask;
   }
-  else {
-    return
-      shrink_bounds_left_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
-      shrink_bounds_right_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
-      shrink_bounds_top_templ<ImageTraits>(image, bounds, refpixel) &&
-      shrink_bounds_bottom_templ<ImageTraits>(image, bounds, refpixel);
+  else if constexpr (std::is_same_v<ImageTraits, GrayscaleTraits>) {
+    transparentRef = (graya_geta(refpixel) == 0);
+    if (transparentRef)
+      mask = graya_a_mask;
   }
-}
 
-template<typename ImageTraits>
-bool shrink_bounds_templ2(const Image* a, const Image* b, gfx::Rect& bounds)
-{
-  bool shrink;
-  int u, v;
-
-  // Shrink left side
-  for (u=bounds.x; u<bounds.x+bounds.w; ++u) {
-    shrink = true;
-    for (v=bounds.y; v<bounds.y+bounds.h; ++v) {
-      if (get_pixel_fast<ImageTraits>(a, u, v) !=
-          get_pixel_fast<ImageTraits>(b, u, v)) {
-        shrink = false;
-        break;
-      }
-    }
-    if (!shrink)
-      break;
-    ++bounds.x;
-    --bounds.w;
+  if (transparentRef) {
+    ref = 0;
   }
-
-  // Shrink right side
-  for (u=bounds.x+bounds.w-1; u>=bounds.x; --u) {
-    shrink = true;
-    for (v=bounds.y; v<bounds.y+bounds.h; ++v) {
-      if (get_pixel_fast<ImageTraits>(a, u, v) !=
-          get_pixel_fast<ImageTraits>(b, u, v)) {
-        shrink = false;
-        break;
-      }
-    }
-    if (!shrink)
-      break;
-    --bounds.w;
+  // A reference pixel that is out of range is different to all pixels
+  else if (color_t(ref) != refpixel) {
+    mask = 0;
+    ref = 1;
   }
 
-  // Shrink top side
-  for (v=bounds.y; v<bounds.y+bounds.h; ++v) {
-    shrink = true;
-    for (u=bounds.x; u<bounds.x+bounds.w; ++u) {
-      if (get_pixel_fast<ImageTraits>(a, u, v) !=
-          get_pixel_fast<ImageTraits>(b, u, v)) {
-        shrink = false;
-        break;
-      }
-    }
-    if (!shrink)
-      break;
-    ++bounds.y;
-    --bounds.h;
-  }
+  return shrink_bounds_rows(
+    bounds,
+    [image, mask, ref](int y) {
+      return RefPixelDiff<ImageTraits>{
+        (const pixel_t*)image->getPixelAddress(0, y), mask, ref };
+    });
+}
 
-  // Shrink bottom side
-  for (v=bounds.y+bounds.h-1; v>=bounds.y; --v) {
-    shrink = true;
-    for (u=bounds.x; u<bounds.x+bounds.w; ++u) {
-      if (get_pixel_fast<ImageTraits>(a, u, v) !=
-          get_pixel_fast<ImageTraits>(b, u, v)) {
-        shrink = false;
-        break;
-      }
-    }
-    if (!shrink)
-      break;
-    --bounds.h;
-  }
+template<>
+bool shrink_bounds_templ<BitmapTraits>(const Image* image, gfx::Rect& bounds, color_t refpixel)
+{
+  return shrink_bounds_rows(
+    bounds,
+    [image, refpixel](int y) {
+      return RefPixelDiff<BitmapTraits>{ image, y, refpixel };
+    });
+}
 
-  return (!bounds.isEmpty());
+template<typename ImageTraits>
+bool shrink_bounds_templ2(const Image* a, const Image* b, gfx::Rect& bounds)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  return shrink_bounds_rows(
+    bounds,
+    [a, b](int y) {
+      return ImagesDiff<ImageTraits>{
+        (const pixel_t*)a->getPixelAddress(0, y),
+        (const pixel_t*)b->getPixelAddress(0, y) };
+    });
+}
+
+template<>
+bool shrink_bounds_templ2<BitmapTraits>(const Image* a, const Image* b, gfx::Rect& bounds)
+{
+  return shrink_bounds_rows(
+    bounds,
+    [a, b](int y) {
+      return ImagesDiff<BitmapTraits>{ a, b, y };
+    });
 }
 
 bool shrink_bounds_tilemap(const Image* image,
@@ -0,0 +1,89 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/shrink_bounds.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "gfx/rect.h"
+
+using namespace doc;
+using namespace gfx;
+
+TEST(ShrinkBounds, EmptyImage)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 100, 100));
+  image->clear(0);
+
+  Rect bounds;
+  EXPECT_FALSE(algorithm::shrink_bounds(image.get(), 0, nullptr, bounds));
+  EXPECT_TRUE(bounds.isEmpty());
+}
+
+TEST(ShrinkBounds, Pixels)
+{
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE,
+                              IMAGE_INDEXED, IMAGE_BITMAP }) {
+    const color_t c = (format == IMAGE_RGB ? rgba(255, 0, 0, 255):
+                       format == IMAGE_GRAYSCALE ? graya(255, 255): 1);
+    ImageRef image(Image::create(format, 100, 80));
+    image->clear(0);
+    image->putPixel(70, 10, c);
+    image->putPixel(3, 50, c);
+    image->putPixel(40, 60, c);
+
+    Rect bounds;
+    EXPECT_TRUE(algorithm::shrink_bounds(image.get(), 0, nullptr, bounds));
+    EXPECT_EQ(Rect(3, 10, 68, 51), bounds) << "format=" << format;
+
+    EXPECT_TRUE(algorithm::shrink_bounds(image.get(), 0, nullptr,
+                                         Rect(10, 0, 90, 55), bounds));
+    EXPECT_EQ(Rect(70, 10, 1, 1), bounds) << "format=" << format;
+  }
+}
+
+TEST(ShrinkBounds, TransparentRgbPixels)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 40, 40));
+  image->clear(rgba(0, 0, 0, 0));
+  image->putPixel(5, 5, rgba(255, 0, 0, 0));   // Transparent too
+  image->putPixel(20, 30, rgba(255, 0, 0, 255));
+
+  Rect bounds;
+  EXPECT_TRUE(algorithm::shrink_bounds(image.get(), rgba(0, 0, 255, 0),
+                                       nullptr, bounds));
+  EXPECT_EQ(Rect(20, 30, 1, 1), bounds);
+
+  // Compare with an opaque color
+  image->clear(rgba(255, 0, 0, 255));
+  image->putPixel(1, 2, rgba(255, 0, 0, 254));
+  EXPECT_TRUE(algorithm::shrink_bounds(image.get(), rgba(255, 0, 0, 255),
+                                       nullptr, bounds));
+  EXPECT_EQ(Rect(1, 2, 1, 1), bounds);
+}
+
+TEST(ShrinkBounds, DifferencesBetweenImages)
+{
+  ImageRef a(Image::create(IMAGE_INDEXED, 200, 3));
+  a->clear(4);
+  ImageRef b(Image::createCopy(a.get()));
+
+  Rect bounds;
+  EXPECT_FALSE(algorithm::shrink_bounds2(a.get(), b.get(), a->bounds(), bounds));
+
+  b->putPixel(150, 1, 5);
+  b->putPixel(17, 2, 5);
+  EXPECT_TRUE(algorithm::shrink_bounds2(a.get(), b.get(), a->bounds(), bounds));
+  EXPECT_EQ(Rect(17, 1, 134, 2), bounds);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -127,7 +127,7 @@ static void replace_image_colors(
   const bool useBg, color_t bgColor)
 {
   LockImageBits<ImageTraits> bits(image, Image::ReadWriteLock);
-  const LockImageBits<BitmapTraits> maskBits(maskBitmap);
+  const LockImageBits<BitmapTraits> maskBits(maskBitmap, Image::ReadLock);
   bool hasAlpha = false; // True if "image" has a pixel with alpha < 255
   color_t srcMainColor, srcBgColor;
   srcMainColor = srcBgColor = 0;
@@ -191,7 +191,7 @@ static void replace_image_colors_indexed(
   const bool useBg, const color_t bgColor)
 {
   LockImageBits<IndexedTraits> bits(image, Image::ReadWriteLock);
-  const LockImageBits<BitmapTraits> maskBits(maskBitmap);
+  const LockImageBits<BitmapTraits> maskBits(maskBitmap, Image::ReadLock);
   bool hasAlpha = false; // True if "image" has a pixel with the mask color
   color_t maskColor = image->maskColor();
   color_t srcMainColor, srcBgColor;
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -180,7 +180,7 @@ std::vector<gfx::Point> Grid::tilesInCanvasRegion(const gfx::Region& rgn) const
                     tileBounds.y2()-1, 1);
   }
 
-  const LockImageBits<BitmapTraits> bits(tmp.get());
+  const LockImageBits<BitmapTraits> bits(tmp.get(), Image::ReadLock);
   for (auto it=bits.begin(), end=bits.end(); it!=end; ++it) {
     if (*it)
       result.push_back(gfx::Point(it.x()+bounds.x,
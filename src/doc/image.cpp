@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2020 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,15 +17,30 @@
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/rgbmap.h"
+#include "doc/sparse_tiles.h"
+
+#include <atomic>
 
 namespace doc {
 
+// Last version assigned to the pixels of an image (see
+// Image::pixelsVersion())
+static std::atomic<uint64_t> g_pixelsVersion(0);
+
 Image::Image(const ImageSpec& spec)
   : Object(ObjectType::Image)
   , m_spec(spec)
 {
 }
 
+Image::Image(const Image& other)
+  : Object(other)
+  , m_rowBytes(other.m_rowBytes)
+  , m_sharedPixels(other.m_sharedPixels.load())
+  , m_spec(other.m_spec)
+{
+}
+
 Image::~Image()
 {
 }
@@ -35,6 +50,31 @@ int Image::getMemSize() const
   return sizeof(Image) + rowBytes()*height();
 }
 
+uint64_t Image::pixelsVersion() const
+{
+  uint64_t version = m_pixelsVersion.load();
+  if (version == 0) {
+    const uint64_t newVersion = ++g_pixelsVersion;
+    // Other thread could assign a version at the same time
+    if (m_pixelsVersion.compare_exchange_strong(version, newVersion))
+      version = newVersion;
+  }
+  return version;
+}
+
+std::shared_ptr<const SparseTiles> Image::sparseTiles() const
+{
+  const uint64_t version = pixelsVersion();
+  auto tiles = std::atomic_load(&m_sparseTiles);
+  if (!tiles ||
+      tiles->pixelsVersion() != version ||
+      tiles->maskColor() != maskColor()) {
+    tiles = std::make_shared<SparseTiles>(this, version);
+    std::atomic_store(&m_sparseTiles, tiles);
+  }
+  return tiles;
+}
+
 // static
 Image* Image::create(PixelFormat format, int width, int height,
                      const ImageBufferPtr& buffer)
@@ -64,8 +104,61 @@ Image* Image::create(const ImageSpec& spec,
 Image* Image::createCopy(const Image* image, const ImageBufferPtr& buffer)
 {
   ASSERT(image);
-  return crop_image(image, 0, 0, image->width(), image->height(),
-                    image->maskColor(), buffer);
+
+  // Share the pixels between both images, they will be copied on
+  // the first modification of one of them (copy-on-write).
+  if (!buffer) {
+    if (Image* copy = image->createSharedCopy())
+      return copy;
+  }
+
+  // All pixels are copied from the source, so we don't need to
+  // clear the new image first.
+  Image* copy = createUninitialized(
+    ImageSpec(image->colorMode(), image->width(), image->height(),
+              image->maskColor()), buffer);
+  if (copy)
+    copy->copy(image, gfx::Clip(image->bounds()));
+  return copy;
+}
+
+// static
+Image* Image::createUninitialized(const ImageSpec& spec,
+                                  const ImageBufferPtr& buffer)
+{
+  ASSERT(spec.width() >= 1 && spec.height() >= 1);
+  if (spec.width() < 1 || spec.height() < 1)
+    return nullptr;
+
+  switch (spec.colorMode()) {
+    case ColorMode::RGB:       return new ImageImpl<RgbTraits>(spec, buffer, false);
+    case ColorMode::GRAYSCALE: return new ImageImpl<GrayscaleTraits>(spec, buffer, false);
+    case ColorMode::INDEXED:   return new ImageImpl<IndexedTraits>(spec, buffer, false);
+    case ColorMode::BITMAP:    return new ImageImpl<BitmapTraits>(spec, buffer, false);
+    case ColorMode::TILEMAP:   return new ImageImpl<TilemapTraits>(spec, buffer, false);
+  }
+  return nullptr;
+}
+
+// static
+Image* Image::createView(const ImageSpec& spec,
+                         uint8_t* pixels,
+                         const int rowBytes,
+                         const ImageBufferPtr& buffer)
+{
+  ASSERT(spec.width() >= 1 && spec.height() >= 1);
+  ASSERT(pixels);
+  if (spec.width() < 1 || spec.height() < 1 || !pixels)
+    return nullptr;
+
+  switch (spec.colorMode()) {
+    case ColorMode::RGB:       return new ImageImpl<RgbTraits>(spec, pixels, rowBytes, buffer);
+    case ColorMode::GRAYSCALE: return new ImageImpl<GrayscaleTraits>(spec, pixels, rowBytes, buffer);
+    case ColorMode::INDEXED:   return new ImageImpl<IndexedTraits>(spec, pixels, rowBytes, buffer);
+    case ColorMode::BITMAP:    return new ImageImpl<BitmapTraits>(spec, pixels, rowBytes, buffer);
+    case ColorMode::TILEMAP:   return new ImageImpl<TilemapTraits>(spec, pixels, rowBytes, buffer);
+  }
+  return nullptr;
 }
 
 } // namespace doc
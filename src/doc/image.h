@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -19,12 +19,17 @@
 #include "gfx/rect.h"
 #include "gfx/size.h"
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
 namespace doc {
 
   template<typename ImageTraits> class ImageBits;
   class Palette;
   class Pen;
   class RgbMap;
+  class SparseTiles;
 
   class Image : public Object {
   public:
@@ -41,6 +46,21 @@ namespace doc {
     static Image* createCopy(const Image* image,
                              const ImageBufferPtr& buffer = ImageBufferPtr());
 
+    // Creates an image with undefined pixels. Use it only when all
+    // pixels are going to be overwritten by the caller.
+    static Image* createUninitialized(const ImageSpec& spec,
+                                      const ImageBufferPtr& buffer = ImageBufferPtr());
+
+    // Creates an image that uses the given external pixels (e.g. the
+    // memory of a surface) with "rowBytes" bytes between the
+    // beginning of each row. The pixels are not copied or owned by
+    // the image, so they must be valid during the whole life of the
+    // image. The buffer is used only for the table of rows.
+    static Image* createView(const ImageSpec& spec,
+                             uint8_t* pixels,
+                             const int rowBytes,
+                             const ImageBufferPtr& buffer = ImageBufferPtr());
+
     virtual ~Image();
 
     const ImageSpec& spec() const { return m_spec; }
@@ -72,8 +92,38 @@ namespace doc {
 
     virtual int getMemSize() const override;
 
+    // Pixels can be shared between an image and its copies
+    // (copy-on-write, see createCopy()). This must be called before
+    // modifying the pixels through a raw address so this image gets
+    // its own copy of the pixels (it also invalidates the
+    // pixelsVersion()). Threads that modify different rows of the
+    // same image must call it once before starting.
+    void unsharePixels() {
+      if (m_pixelsVersion.load(std::memory_order_relaxed) != 0)
+        m_pixelsVersion.store(0, std::memory_order_relaxed);
+      if (m_sharedPixels)
+        onUnsharePixels();
+    }
+    bool hasSharedPixels() const { return m_sharedPixels; }
+
+    // Returns a number that identifies the current pixels of this
+    // image. A new number (unique in the whole process) is assigned
+    // after each (possible) modification, so it can be used with the
+    // image id to know if a cached version of this image (or of
+    // something rendered from it) is still valid.
+    uint64_t pixelsVersion() const;
+
+    // Returns the index of empty tiles of this image. A new index is
+    // created after the pixels are modified, and each tile is
+    // scanned only when it's requested, so it's cheap to call it
+    // several times (e.g. to render the visible area of the same cel
+    // in each frame of the editor).
+    std::shared_ptr<const SparseTiles> sparseTiles() const;
+
     template<typename ImageTraits>
     ImageBits<ImageTraits> lockBits(LockType lockType, const gfx::Rect& bounds) {
+      if (lockType != ReadLock)
+        unsharePixels();
       return ImageBits<ImageTraits>(this, bounds);
     }
 
@@ -99,13 +149,41 @@ namespace doc {
     virtual void fillRect(int x1, int y1, int x2, int y2, color_t color) = 0;
     virtual void blendRect(int x1, int y1, int x2, int y2, color_t color, int opacity) = 0;
 
+    // Address to modify pixels, it unshares the pixels if needed.
+    uint8_t* getPixelAddress(int x, int y) {
+      unsharePixels();
+      return static_cast<const Image*>(this)->getPixelAddress(x, y);
+    }
+
   protected:
     Image(const ImageSpec& spec);
+    Image(const Image& other);
+
+    // Returns a new image that shares the pixels with this one, or
+    // nullptr if the pixels cannot be shared.
+    virtual Image* createSharedCopy() const = 0;
+
+    // Makes a copy of the shared pixels so they are owned by this
+    // image only.
+    virtual void onUnsharePixels() = 0;
 
     // Number of bytes for each row.
     size_t m_rowBytes;
 
+    // True if the pixels might be shared with other image (it's
+    // atomic because copies can be created from several threads).
+    mutable std::atomic<bool> m_sharedPixels { false };
+
   private:
+    // Version of the pixels, or 0 if they were (possibly) modified
+    // and a new version must be assigned in pixelsVersion().
+    mutable std::atomic<uint64_t> m_pixelsVersion { 0 };
+
+    // Cached result of sparseTiles() (accessed with
+    // std::atomic_load/store as it can be calculated from several
+    // rendering threads at the same time).
+    mutable std::shared_ptr<const SparseTiles> m_sparseTiles;
+
     ImageSpec m_spec;
   };
 
@@ -12,6 +12,7 @@
 #include "base/disable_copying.h"
 #include "base/ints.h"
 #include "doc/aligned_memory.h"
+#include "doc/image_buffer_pool.h"
 
 #include <algorithm>
 #include <cstddef>
@@ -20,18 +21,21 @@
 
 namespace doc {
 
+  // The memory of each ImageBuffer is taken from (and given back to)
+  // the pool of recycled blocks (see image_buffer_pool.h), so the
+  // size() can be bigger than the requested size.
   class ImageBuffer {
   public:
     ImageBuffer(std::size_t size = 1)
       : m_size(doc_align_size(size))
-      , m_buffer((uint8_t*)doc_aligned_alloc(m_size)) {
+      , m_buffer(image_buffer_pool_alloc(m_size)) {
       if (!m_buffer)
         throw std::bad_alloc();
     }
 
     ~ImageBuffer() noexcept {
       if (m_buffer)
-        doc_aligned_free(m_buffer);
+        image_buffer_pool_free(m_buffer, m_size);
     }
 
     std::size_t size() const { return m_size; }
@@ -40,12 +44,12 @@ namespace doc {
     void resizeIfNecessary(std::size_t size) {
       if (size > m_size) {
         if (m_buffer) {
-          doc_aligned_free(m_buffer);
+          image_buffer_pool_free(m_buffer, m_size);
           m_buffer = nullptr;
         }
 
         m_size = doc_align_size(size);
-        m_buffer = (uint8_t*)doc_aligned_alloc(m_size);
+        m_buffer = image_buffer_pool_alloc(m_size);
         if (!m_buffer)
           throw std::bad_alloc();
       }
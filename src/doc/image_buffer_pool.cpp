@@ -0,0 +1,202 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_buffer_pool.h"
+
+#include "base/debug.h"
+#include "doc/aligned_memory.h"
+
+#include <array>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+namespace doc {
+
+namespace {
+
+// Blocks smaller than 4 KB are cheap enough for the regular
+// allocator, and blocks bigger than 1 GB are not worth keeping.
+constexpr int kMinClassBits = 12;
+constexpr int kMaxClassBits = 30;
+
+// Each power of two is divided in 4 size classes, so we waste at
+// most 25% of a block.
+constexpr int kClassesPerBit = 4;
+constexpr int kClasses = (kMaxClassBits - kMinClassBits + 1) * kClassesPerBit;
+
+constexpr std::size_t kDefaultLimit = 128 * 1024 * 1024;
+
+// Returns the size class for the given "size" (and the real
+// capacity of that class in "classSize"), or -1 if the size is not
+// handled by the pool.
+int size_class(const std::size_t size, std::size_t& classSize)
+{
+  if (size <= (std::size_t(1) << kMinClassBits))
+    return -1;
+
+  // Index of the most significant bit of (size-1)
+  int bits = 0;
+  for (std::size_t v=size-1; v>>=1; )
+    ++bits;
+
+  if (bits > kMaxClassBits)
+    return -1;
+
+  const std::size_t step = (std::size_t(1) << (bits - 2));
+  const std::size_t q = (size-1) / step + 1; // Range [5, 8]
+  ASSERT(q >= 5 && q <= 8);
+
+  classSize = q * step;
+  return (bits - kMinClassBits) * kClassesPerBit + int(q - 5);
+}
+
+class Pool {
+public:
+  ~Pool() {
+    clear();
+    s_destroyed = true;
+  }
+
+  static bool destroyed() { return s_destroyed; }
+
+  uint8_t* alloc(std::size_t& size) {
+    std::size_t classSize;
+    const int i = size_class(size, classSize);
+    if (i < 0)
+      return (uint8_t*)doc_aligned_alloc(size);
+
+    size = classSize;
+    {
+      const std::lock_guard lock(m_mutex);
+      auto& blocks = m_blocks[i];
+      if (!blocks.empty()) {
+        uint8_t* ptr = blocks.back();
+        blocks.pop_back();
+        m_stats.residentBytes -= classSize;
+        --m_stats.residentBlocks;
+        ++m_stats.hits;
+        return ptr;
+      }
+      ++m_stats.misses;
+    }
+    return (uint8_t*)doc_aligned_alloc(classSize);
+  }
+
+  void release(uint8_t* ptr, const std::size_t size) {
+    std::size_t classSize;
+    const int i = size_class(size, classSize);
+    if (i >= 0 && classSize == size) {
+      const std::lock_guard lock(m_mutex);
+      if (m_stats.residentBytes + size <= m_stats.limit) {
+        m_blocks[i].push_back(ptr);
+        m_stats.residentBytes += size;
+        ++m_stats.residentBlocks;
+        return;
+      }
+    }
+    doc_aligned_free(ptr);
+  }
+
+  void setLimit(const std::size_t bytes) {
+    {
+      const std::lock_guard lock(m_mutex);
+      m_stats.limit = bytes;
+    }
+    trim();
+  }
+
+  void clear() {
+    const std::lock_guard lock(m_mutex);
+    for (auto& blocks : m_blocks) {
+      for (uint8_t* ptr : blocks)
+        doc_aligned_free(ptr);
+      blocks.clear();
+    }
+    m_stats.residentBytes = 0;
+    m_stats.residentBlocks = 0;
+  }
+
+  ImageBufferPoolStats stats() {
+    const std::lock_guard lock(m_mutex);
+    return m_stats;
+  }
+
+private:
+  // Frees the biggest blocks first until we are below the limit.
+  void trim() {
+    const std::lock_guard lock(m_mutex);
+    for (int i=kClasses-1; i>=0 && m_stats.residentBytes > m_stats.limit; --i) {
+      auto& blocks = m_blocks[i];
+      while (!blocks.empty() && m_stats.residentBytes > m_stats.limit) {
+        const std::size_t classSize =
+          (std::size_t(5 + i % kClassesPerBit)
+           << (kMinClassBits + i / kClassesPerBit - 2));
+        doc_aligned_free(blocks.back());
+        blocks.pop_back();
+        m_stats.residentBytes -= classSize;
+        --m_stats.residentBlocks;
+      }
+    }
+  }
+
+  std::mutex m_mutex;
+  std::array<std::vector<uint8_t*>, kClasses> m_blocks;
+  ImageBufferPoolStats m_stats = { 0, 0, 0, 0, kDefaultLimit };
+  static bool s_destroyed;
+};
+
+bool Pool::s_destroyed = false;
+
+Pool& pool()
+{
+  static Pool instance;
+  return instance;
+}
+
+} // anonymous namespace
+
+uint8_t* image_buffer_pool_alloc(std::size_t& size)
+{
+  if (Pool::destroyed())
+    return (uint8_t*)doc_aligned_alloc(size);
+  return pool().alloc(size);
+}
+
+void image_buffer_pool_free(uint8_t* ptr, std::size_t size)
+{
+  // Images destroyed after the static pool (e.g. in other static
+  // objects) are freed directly.
+  if (Pool::destroyed())
+    doc_aligned_free(ptr);
+  else
+    pool().release(ptr, size);
+}
+
+void image_buffer_pool_set_limit(std::size_t bytes)
+{
+  if (!Pool::destroyed())
+    pool().setLimit(bytes);
+}
+
+void image_buffer_pool_clear()
+{
+  if (!Pool::destroyed())
+    pool().clear();
+}
+
+ImageBufferPoolStats image_buffer_pool_stats()
+{
+  if (Pool::destroyed())
+    return ImageBufferPoolStats();
+  return pool().stats();
+}
+
+} // namespace doc
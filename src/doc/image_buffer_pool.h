@@ -0,0 +1,56 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_BUFFER_POOL_H_INCLUDED
+#define DOC_IMAGE_BUFFER_POOL_H_INCLUDED
+#pragma once
+
+#include "base/ints.h"
+
+#include <cstddef>
+
+namespace doc {
+
+  // Statistics of the global pool of memory blocks used by
+  // ImageBuffer. Only blocks that fit in a size class are counted
+  // as hits/misses (small and huge blocks go directly to the
+  // allocator).
+  struct ImageBufferPoolStats {
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t residentBytes = 0;   // Bytes kept in the pool to be reused
+    std::size_t residentBlocks = 0;
+    std::size_t limit = 0;           // Max number of resident bytes
+
+    double hitRate() const {
+      const std::size_t total = hits + misses;
+      return (total > 0 ? double(hits) / double(total): 0.0);
+    }
+  };
+
+  // Returns a block of memory of at least "size" bytes. The "size"
+  // argument is updated with the real capacity of the block (the
+  // size class). Returns nullptr if there is no memory available.
+  // This function is thread-safe.
+  uint8_t* image_buffer_pool_alloc(std::size_t& size);
+
+  // Gives back a block returned by image_buffer_pool_alloc() with
+  // its capacity. The block might be kept in the pool to be reused
+  // by the next allocation of the same size class.
+  void image_buffer_pool_free(uint8_t* ptr, std::size_t size);
+
+  // Changes the max number of bytes that the pool can keep
+  // (0 disables the pool completely).
+  void image_buffer_pool_set_limit(std::size_t bytes);
+
+  // Frees all the blocks kept in the pool.
+  void image_buffer_pool_clear();
+
+  ImageBufferPoolStats image_buffer_pool_stats();
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,123 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_buffer_pool.h"
+#include "doc/primitives.h"
+
+#include <memory>
+
+using namespace doc;
+
+TEST(ImageBufferPool, SmallBlocksAreNotPooled)
+{
+  image_buffer_pool_clear();
+  const ImageBufferPoolStats before = image_buffer_pool_stats();
+
+  std::size_t size = 100;
+  uint8_t* ptr = image_buffer_pool_alloc(size);
+  ASSERT_NE(nullptr, ptr);
+  EXPECT_EQ(100, size);
+  image_buffer_pool_free(ptr, size);
+
+  const ImageBufferPoolStats after = image_buffer_pool_stats();
+  EXPECT_EQ(before.hits, after.hits);
+  EXPECT_EQ(before.misses, after.misses);
+  EXPECT_EQ(0, after.residentBytes);
+}
+
+TEST(ImageBufferPool, SizeClasses)
+{
+  std::size_t size = 4097;
+  uint8_t* ptr = image_buffer_pool_alloc(size);
+  ASSERT_NE(nullptr, ptr);
+  EXPECT_EQ(5120, size);
+  image_buffer_pool_free(ptr, size);
+
+  size = 8192;
+  ptr = image_buffer_pool_alloc(size);
+  ASSERT_NE(nullptr, ptr);
+  EXPECT_EQ(8192, size);
+  image_buffer_pool_free(ptr, size);
+
+  size = 100000;
+  ptr = image_buffer_pool_alloc(size);
+  ASSERT_NE(nullptr, ptr);
+  EXPECT_EQ(114688, size);
+  image_buffer_pool_free(ptr, size);
+
+  image_buffer_pool_clear();
+}
+
+TEST(ImageBufferPool, ReuseBlocks)
+{
+  image_buffer_pool_clear();
+
+  std::size_t size = 256*256*4;
+  uint8_t* ptr = image_buffer_pool_alloc(size);
+  ASSERT_NE(nullptr, ptr);
+  image_buffer_pool_free(ptr, size);
+
+  ImageBufferPoolStats stats = image_buffer_pool_stats();
+  EXPECT_EQ(size, stats.residentBytes);
+  EXPECT_EQ(1, stats.residentBlocks);
+
+  const std::size_t hits = stats.hits;
+  std::size_t size2 = 256*256*4 - 10;
+  uint8_t* ptr2 = image_buffer_pool_alloc(size2);
+  EXPECT_EQ(ptr, ptr2);
+  EXPECT_EQ(size, size2);
+
+  stats = image_buffer_pool_stats();
+  EXPECT_EQ(hits+1, stats.hits);
+  EXPECT_EQ(0, stats.residentBytes);
+  EXPECT_EQ(0, stats.residentBlocks);
+
+  image_buffer_pool_free(ptr2, size2);
+  image_buffer_pool_clear();
+}
+
+TEST(ImageBufferPool, Limit)
+{
+  image_buffer_pool_clear();
+  image_buffer_pool_set_limit(0);
+
+  std::size_t size = 256*256*4;
+  uint8_t* ptr = image_buffer_pool_alloc(size);
+  image_buffer_pool_free(ptr, size);
+  EXPECT_EQ(0, image_buffer_pool_stats().residentBytes);
+
+  image_buffer_pool_set_limit(128*1024*1024);
+}
+
+TEST(ImageBufferPool, RecycledImagesAreCleared)
+{
+  image_buffer_pool_clear();
+  {
+    std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 128, 128));
+    clear_image(a.get(), rgba(255, 0, 0, 255));
+  }
+  std::unique_ptr<Image> b(Image::create(IMAGE_RGB, 128, 128));
+  for (int y=0; y<b->height(); ++y)
+    for (int x=0; x<b->width(); ++x)
+      ASSERT_EQ(0, get_pixel(b.get(), x, y));
+
+  // createCopy() doesn't need to clear the pixels
+  std::unique_ptr<Image> c(Image::createCopy(b.get()));
+  EXPECT_EQ(0, count_diff_between_images(b.get(), c.get()));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
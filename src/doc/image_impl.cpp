@@ -20,6 +20,8 @@ void copy_bitmaps(Image* dst, const Image* src, gfx::Clip area)
   if (!area.clip(dst->width(), dst->height(), src->width(), src->height()))
     return;
 
+  dst->unsharePixels();
+
   // Copy process
   ImageConstIterator<BitmapTraits> src_it(src, area.srcBounds(), area.src.x, area.src.y);
   ImageIterator<BitmapTraits> dst_it(dst, area.dstBounds(), area.dst.x, area.dst.y);
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -35,6 +35,11 @@ namespace doc {
     address_t* m_rows;
     address_t m_bits;
 
+    // True if m_buffer was created by this image (and not given by
+    // the caller to reuse it), only in this case the buffer can be
+    // shared with other images (copy-on-write).
+    bool m_ownBuffer;
+
     inline address_t getLineAddress(int y) {
       ASSERT(y >= 0 && y < height());
       return m_rows[y];
@@ -45,6 +50,40 @@ namespace doc {
       return m_rows[y];
     }
 
+    std::size_t rowsTableSize() const {
+      return doc_align_size(sizeof(address_t) * height());
+    }
+
+    // Sets up the table of row addresses at the beginning of the
+    // buffer.
+    void initRows() {
+      initRows((address_t)(m_buffer->buffer() + rowsTableSize()));
+    }
+
+    void initRows(address_t bits) {
+      m_rows = (address_t*)m_buffer->buffer();
+      m_bits = bits;
+
+      auto addr = (uint8_t*)m_bits;
+      for (int y=0; y<height(); ++y) {
+        m_rows[y] = (address_t)addr;
+        addr += m_rowBytes;
+      }
+    }
+
+    // Creates a copy that shares the pixels with "other".
+    ImageImpl(const ImageImpl& other)
+      : Image(other)
+      , m_buffer(other.m_buffer)
+      , m_rows(other.m_rows)
+      , m_bits(other.m_bits)
+      , m_ownBuffer(true)
+    {
+      ASSERT(other.m_ownBuffer);
+      m_sharedPixels = true;
+      other.m_sharedPixels = true;
+    }
+
   public:
     inline address_t address(int x, int y) const {
       if constexpr (Traits::pixels_per_byte == 0) {
@@ -56,15 +95,17 @@ namespace doc {
     }
 
     ImageImpl(const ImageSpec& spec,
-              const ImageBufferPtr& buffer)
+              const ImageBufferPtr& buffer,
+              const bool initPixels = true)
       : Image(spec)
       , m_buffer(buffer)
+      , m_ownBuffer(!buffer)
     {
       ASSERT(Traits::color_mode == spec.colorMode());
 
       m_rowBytes = Traits::rowstride_bytes(width());
 
-      const std::size_t for_rows = doc_align_size(sizeof(address_t) * height());
+      const std::size_t for_rows = rowsTableSize();
       const std::size_t for_pixels = m_rowBytes * height();
       const std::size_t required_size = for_pixels + for_rows;
 
@@ -73,19 +114,40 @@ namespace doc {
       else
         m_buffer->resizeIfNecessary(required_size);
 
-      std::fill(m_buffer->buffer(),
-                m_buffer->buffer()+required_size, 0);
+      initRows();
 
-      m_rows = (address_t*)m_buffer->buffer();
-      m_bits = (address_t)(m_buffer->buffer() + for_rows);
+      // The buffer can be a recycled block from the pool, so we have
+      // to clear it (except when the caller will overwrite all pixels).
+      if (initPixels)
+        std::fill((uint8_t*)m_bits, (uint8_t*)m_bits + for_pixels, 0);
+    }
 
-      auto addr = (uint8_t*)m_bits;
-      for (int y=0; y<height(); ++y) {
-        m_rows[y] = (address_t)addr;
-        addr += m_rowBytes;
-      }
+    // Image that uses external pixels (see Image::createView()). The
+    // buffer is only used for the table of rows. As the buffer is
+    // not owned, the pixels are never shared with copies.
+    ImageImpl(const ImageSpec& spec,
+              uint8_t* pixels,
+              const int rowBytes,
+              const ImageBufferPtr& buffer)
+      : Image(spec)
+      , m_buffer(buffer)
+      , m_ownBuffer(false)
+    {
+      ASSERT(Traits::color_mode == spec.colorMode());
+      ASSERT(rowBytes >= Traits::rowstride_bytes(width()));
+
+      m_rowBytes = rowBytes;
+
+      if (!m_buffer)
+        m_buffer = std::make_shared<ImageBuffer>(rowsTableSize());
+      else
+        m_buffer->resizeIfNecessary(rowsTableSize());
+
+      initRows((address_t)pixels);
     }
 
+    using Image::getPixelAddress;
+
     uint8_t* getPixelAddress(int x, int y) const override {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
@@ -103,11 +165,14 @@ namespace doc {
     void putPixel(int x, int y, color_t color) override {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
+      unsharePixels();
 
       *address(x, y) = color;
     }
 
     void clear(color_t color) override {
+      unsharePixels();
+
       const int w = width();
       const int h = height();
       for (int y=0; y<h; ++y) {
@@ -124,6 +189,8 @@ namespace doc {
       if (!area.clip(width(), height(), src->width(), src->height()))
         return;
 
+      unsharePixels();
+
       for (int end_y=area.dst.y+area.size.h;
            area.dst.y<end_y;
            ++area.dst.y, ++area.src.y) {
@@ -137,7 +204,7 @@ namespace doc {
     }
 
     void drawHLine(int x1, int y, int x2, color_t color) override {
-      LockImageBits<Traits> bits(this, gfx::Rect(x1, y, x2 - x1 + 1, 1));
+      LockImageBits<Traits> bits(this, Image::WriteLock, gfx::Rect(x1, y, x2 - x1 + 1, 1));
       typename LockImageBits<Traits>::iterator it(bits.begin());
       typename LockImageBits<Traits>::iterator end(bits.end());
 
@@ -160,6 +227,30 @@ namespace doc {
       fillRect(x1, y1, x2, y2, color);
     }
 
+  protected:
+    Image* createSharedCopy() const override {
+      // Buffers given by the caller are usually reused for other
+      // images, so we cannot share them.
+      if (!m_ownBuffer)
+        return nullptr;
+      return new ImageImpl<Traits>(*this);
+    }
+
+    void onUnsharePixels() override {
+      // If other copies were already unshared/deleted, the buffer is
+      // only ours now.
+      if (m_buffer.use_count() > 1) {
+        const std::size_t for_pixels = m_rowBytes * height();
+        const ImageBufferPtr shared = m_buffer;
+        const auto src = (const uint8_t*)m_bits;
+
+        m_buffer = std::make_shared<ImageBuffer>(rowsTableSize() + for_pixels);
+        initRows();
+        std::copy(src, src + for_pixels, (uint8_t*)m_bits);
+      }
+      m_sharedPixels = false;
+    }
+
   private:
     bool clip_rects(const Image* src, int& dst_x, int& dst_y, int& src_x, int& src_y, int& w, int& h) const {
       // Clip with destionation image
@@ -222,12 +313,26 @@ namespace doc {
 
   template<>
   inline void ImageImpl<IndexedTraits>::clear(color_t color) {
+    unsharePixels();
+    // Views (Image::createView()) can have other pixels between rows
+    if (rowBytes() != IndexedTraits::rowstride_bytes(width())) {
+      for (int y=0; y<height(); ++y)
+        std::fill(address(0, y), address(0, y)+width(), color);
+      return;
+    }
     uint8_t* p = address(0, 0);
     std::fill(p, p+rowBytes()*height(), color);
   }
 
   template<>
   inline void ImageImpl<BitmapTraits>::clear(color_t color) {
+    unsharePixels();
+    if (rowBytes() != BitmapTraits::rowstride_bytes(width())) {
+      for (int y=0; y<height(); ++y)
+        std::fill(address(0, y), address(0, y)+BitmapTraits::width_bytes(width()),
+                  (color ? 0xff: 0x00));
+      return;
+    }
     uint8_t* p = address(0, 0);
     std::fill(p, p+rowBytes()*height(), (color ? 0xff: 0x00));
   }
@@ -245,6 +350,7 @@ namespace doc {
   inline void ImageImpl<BitmapTraits>::putPixel(int x, int y, color_t color) {
     ASSERT(x >= 0 && x < width());
     ASSERT(y >= 0 && y < height());
+    unsharePixels();
 
     std::div_t d = std::div(x, 8);
     if (color)
@@ -102,7 +102,7 @@ namespace doc {
         ++m_y;
 
         if (m_y < m_image->height())
-          m_ptr = get_pixel_address_fast<ImageTraits>(m_image, m_x, m_y);
+          m_ptr = get_pixel_address_fast<ImageTraits>((const Image*)m_image, m_x, m_y);
       }
 
       return *this;
@@ -329,7 +329,7 @@ namespace doc {
         ++m_y;
 
         if (m_y < m_image->height())
-          m_ptr = get_pixel_address_fast<BitmapTraits>(m_image, m_x, m_y);
+          m_ptr = get_pixel_address_fast<BitmapTraits>((const Image*)m_image, m_x, m_y);
         else
           ++m_ptr;
       }
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +15,7 @@
 #include "doc/primitives.h"
 
 #include <memory>
+#include <vector>
 
 using namespace base;
 using namespace doc;
@@ -225,6 +226,95 @@ TYPED_TEST(ImageAllTypes, FillRect)
   }
 }
 
+TYPED_TEST(ImageAllTypes, CopyOnWrite)
+{
+  typedef TypeParam ImageTraits;
+
+  std::unique_ptr<Image> a(Image::create(ImageTraits::pixel_format, 16, 16));
+  a->clear(0);
+  put_pixel(a.get(), 2, 3, 1);
+
+  std::unique_ptr<Image> b(Image::createCopy(a.get()));
+  EXPECT_TRUE(a->hasSharedPixels());
+  EXPECT_TRUE(b->hasSharedPixels());
+  EXPECT_EQ(static_cast<const Image*>(a.get())->getPixelAddress(0, 0),
+            static_cast<const Image*>(b.get())->getPixelAddress(0, 0));
+  EXPECT_EQ(0, count_diff_between_images(a.get(), b.get()));
+
+  // Modify the copy
+  put_pixel(b.get(), 4, 5, 1);
+  EXPECT_FALSE(b->hasSharedPixels());
+  EXPECT_EQ(0, get_pixel(a.get(), 4, 5));
+  EXPECT_EQ(1, get_pixel(b.get(), 4, 5));
+  EXPECT_EQ(1, get_pixel(a.get(), 2, 3));
+  EXPECT_EQ(1, get_pixel(b.get(), 2, 3));
+
+  // The original image is the only owner of its pixels now
+  a->clear(0);
+  EXPECT_FALSE(a->hasSharedPixels());
+  EXPECT_EQ(0, get_pixel(a.get(), 2, 3));
+  EXPECT_EQ(1, get_pixel(b.get(), 2, 3));
+
+  // Write access through LockImageBits
+  std::unique_ptr<Image> c(Image::createCopy(b.get()));
+  {
+    LockImageBits<ImageTraits> bits(c.get(), Image::WriteLock);
+    for (auto it=bits.begin(), end=bits.end(); it!=end; ++it)
+      *it = 0;
+  }
+  EXPECT_EQ(1, get_pixel(b.get(), 2, 3));
+  EXPECT_EQ(0, get_pixel(c.get(), 2, 3));
+}
+
+TYPED_TEST(ImageAllTypes, CreateView)
+{
+  typedef TypeParam ImageTraits;
+
+  // External memory with 3 extra bytes in each row (filled with
+  // 0xAA to check that they are not modified)
+  const int w = 10, h = 4;
+  const int rowBytes = ImageTraits::rowstride_bytes(w) + 3;
+  std::vector<uint8_t> memory(rowBytes*h, 0xAA);
+
+  std::unique_ptr<Image> view(
+    Image::createView(ImageSpec((ColorMode)ImageTraits::color_mode, w, h),
+                      memory.data(), rowBytes));
+  ASSERT_TRUE(view != nullptr);
+  EXPECT_EQ(rowBytes, view->rowBytes());
+  EXPECT_EQ(memory.data() + rowBytes*2, view->getPixelAddress(0, 2));
+
+  view->clear(0);
+  put_pixel(view.get(), 3, 2, 1);
+  EXPECT_EQ(1, get_pixel(view.get(), 3, 2));
+  for (int y=0; y<h; ++y) {
+    for (int i=ImageTraits::rowstride_bytes(w); i<rowBytes; ++i)
+      EXPECT_EQ(0xAA, memory[y*rowBytes + i]) << "y=" << y;
+  }
+
+  // Copies don't share the external pixels
+  std::unique_ptr<Image> copy(Image::createCopy(view.get()));
+  EXPECT_FALSE(copy->hasSharedPixels());
+  EXPECT_EQ(1, get_pixel(copy.get(), 3, 2));
+  put_pixel(view.get(), 3, 2, 0);
+  EXPECT_EQ(1, get_pixel(copy.get(), 3, 2));
+}
+
+TEST(Image, PixelsVersion)
+{
+  std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 4, 4));
+  const uint64_t version = a->pixelsVersion();
+  EXPECT_EQ(version, a->pixelsVersion());
+
+  put_pixel(a.get(), 1, 2, 1);
+  EXPECT_NE(version, a->pixelsVersion());
+
+  // Versions are unique between all images (e.g. an image read from
+  // the undo history with the same ID doesn't get an old version)
+  std::unique_ptr<Image> b(Image::create(IMAGE_RGB, 4, 4));
+  EXPECT_NE(version, b->pixelsVersion());
+  EXPECT_NE(a->pixelsVersion(), b->pixelsVersion());
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
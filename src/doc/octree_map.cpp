@@ -16,119 +16,163 @@
 
 namespace doc {
 
+namespace {
+
+inline int get_hextet(color_t c, int level)
+{
+  return ((c & (0x00000080 >> level)) ? 1 : 0) |
+         ((c & (0x00008000 >> level)) ? 2 : 0) |
+         ((c & (0x00800000 >> level)) ? 4 : 0) |
+         ((c & (0x80000000 >> level)) ? 8 : 0);
+}
+
+inline int get_hextet(int r, int g, int b, int a, int level)
+{
+  return ((r & (0x80 >> level)) ? 1 : 0) |
+         ((g & (0x80 >> level)) ? 2 : 0) |
+         ((b & (0x80 >> level)) ? 4 : 0) |
+         ((a & (0x80 >> level)) ? 8 : 0);
+}
+
+} // anonymous namespace
+
 //////////////////////////////////////////////////////////////////////
-// OctreeNode
+// OctreeMap::LeafColor
 
-void OctreeNode::addColor(color_t c, int level, OctreeNode* parent,
-                          int paletteIndex, int levelDeep)
+color_t OctreeMap::LeafColor::rgbaColor() const
 {
-  m_parent = parent;
-  if (level >= levelDeep) {
-    m_leafColor.add(c);
-    m_paletteIndex = paletteIndex;
-    return;
+  if (pixelCount == 0)
+    return 0;
+
+  // Rounded average of each component
+  const uint64_t n = pixelCount;
+  auto avg = [n](const uint64_t v) -> int {
+    return int(v / n + ((v % n) > n / 2 ? 1: 0));
+  };
+  return rgba(avg(r), avg(g), avg(b), avg(a));
+}
+
+//////////////////////////////////////////////////////////////////////
+// OctreeMap
+
+OctreeMap::OctreeMap()
+{
+  clearNodes();
+}
+
+void OctreeMap::clearNodes()
+{
+  m_children.assign(1, kNoChildren);
+  m_leafIndexes.assign(1, kNoLeaf);
+  m_paletteIndexes.assign(1, -1);
+  m_parents.clear();
+  m_leaves.clear();
+}
+
+OctreeMap::NodeIndex OctreeMap::createChildren(NodeIndex node) const
+{
+  ASSERT(m_children[node] == kNoChildren);
+
+  const NodeIndex first = NodeIndex(m_children.size());
+  m_children.resize(first + 16, kNoChildren);
+  m_leafIndexes.resize(first + 16, kNoLeaf);
+  m_paletteIndexes.resize(first + 16, -1);
+  m_parents.push_back(node);
+  m_children[node] = first;
+  return first;
+}
+
+OctreeMap::LeafColor& OctreeMap::leafColor(NodeIndex node)
+{
+  if (m_leafIndexes[node] == kNoLeaf) {
+    m_leafIndexes[node] = NodeIndex(m_leaves.size());
+    m_leaves.emplace_back();
   }
-  int index = getHextet(c, level);
-  if (!m_children) {
-    m_children.reset(new std::array<OctreeNode, 16>());
+  return m_leaves[m_leafIndexes[node]];
+}
+
+void OctreeMap::addColor(color_t c, int levelDeep, size_t count, int paletteIndex)
+{
+  NodeIndex node = kRoot;
+  for (int level=0; level<levelDeep; ++level) {
+    NodeIndex first = m_children[node];
+    if (first == kNoChildren)
+      first = createChildren(node);
+    node = first + get_hextet(c, level);
   }
-  (*m_children)[index].addColor(c, level + 1, this, paletteIndex, levelDeep);
+  leafColor(node).add(c, count);
+  m_paletteIndexes[node] = paletteIndex;
 }
 
-int OctreeNode::mapColor(int  r, int g, int b, int a, int mask_index,
-                         const Palette* palette, int level,
-                         const OctreeMap* octree) const
+void OctreeMap::mergeNode(NodeIndex node, const OctreeMap& other, NodeIndex otherNode)
 {
-  // New behavior: if mapColor do not have an exact rgba match, it must calculate which
-  // color of the current palette is the bestfit and memorize the index in a octree leaf.
-  if (level >= 8) {
-    if (m_paletteIndex == -1)
-      m_paletteIndex = octree->findBestfit(r, g, b, a, mask_index);
-    return m_paletteIndex;
+  if (other.isLeaf(otherNode)) {
+    // Copy the other leaf before leafColor() reallocates m_leaves
+    // (e.g. when we merge an octree with itself).
+    const LeafColor otherLeaf = other.m_leaves[other.m_leafIndexes[otherNode]];
+    leafColor(node).add(otherLeaf);
+    m_paletteIndexes[node] = other.m_paletteIndexes[otherNode];
+  }
+
+  const NodeIndex otherFirst = other.m_children[otherNode];
+  if (otherFirst != kNoChildren) {
+    if (m_children[node] == kNoChildren)
+      createChildren(node);
+    for (int i=0; i<16; ++i) {
+      const NodeIndex otherChild = otherFirst + i;
+      if (other.isLeaf(otherChild) || other.m_children[otherChild] != kNoChildren)
+        mergeNode(m_children[node] + i, other, otherChild);
+    }
   }
-  int index = getHextet(r, g, b, a, level);
-  if (!m_children)
-    m_children.reset(new std::array<OctreeNode, 16>());
-  return (*m_children)[index].mapColor(r, g, b, a, mask_index, palette, level + 1, octree);
 }
 
-void OctreeNode::collectLeafNodes(OctreeNodes& leavesVector, int& paletteIndex)
+void OctreeMap::collectLeafNodes(NodeIndex node, int& paletteIndex)
 {
+  const NodeIndex first = m_children[node];
   for (int i=0; i<16; i++) {
-    OctreeNode& child = (*m_children)[i];
+    const NodeIndex child = first + i;
 
-    if (child.isLeaf()) {
-      child.paletteIndex(paletteIndex);
-      leavesVector.push_back(&child);
+    if (isLeaf(child)) {
+      m_paletteIndexes[child] = paletteIndex;
+      m_leavesVector.push_back(child);
       paletteIndex++;
     }
-    else if (child.hasChildren()) {
-      child.collectLeafNodes(leavesVector, paletteIndex);
+    else if (m_children[child] != kNoChildren) {
+      collectLeafNodes(child, paletteIndex);
     }
   }
 }
 
-// removeLeaves(): remove leaves from a common parent
-// auxParentVector: i/o addreess of an auxiliary parent leaf Vector from outside this function.
-// rootLeavesVector: i/o address of the m_root->m_leavesVector
-int OctreeNode::removeLeaves(OctreeNodes& auxParentVector,
-                             OctreeNodes& rootLeavesVector)
+int OctreeMap::removeLeaves(NodeIndex node, NodeIndexes& auxParentVector)
 {
-  // Apply to OctreeNode which has children which are leaf nodes
+  // Apply to the node which has children which are leaf nodes
   int result = 0;
+  const NodeIndex first = m_children[node];
   for (int i=15; i>=0; i--) {
-    OctreeNode& child = (*m_children)[i];
+    const NodeIndex child = first + i;
 
-    if (child.isLeaf()) {
-      m_leafColor.add(child.leafColor());
+    if (isLeaf(child)) {
+      const LeafColor childLeaf = m_leaves[m_leafIndexes[child]];
+      leafColor(node).add(childLeaf);
       result++;
-      if (rootLeavesVector[rootLeavesVector.size()-1] == &child)
-        rootLeavesVector.pop_back();
+      if (!m_leavesVector.empty() && m_leavesVector.back() == child)
+        m_leavesVector.pop_back();
     }
   }
-  auxParentVector.push_back(this);
+  auxParentVector.push_back(node);
   return result - 1;
 }
 
-// static
-int OctreeNode::getHextet(color_t c, int level)
-{
-  return ((c & (0x00000080 >> level)) ? 1 : 0) |
-         ((c & (0x00008000 >> level)) ? 2 : 0) |
-         ((c & (0x00800000 >> level)) ? 4 : 0) |
-         ((c & (0x80000000 >> level)) ? 8 : 0);
-}
-
-int OctreeNode::getHextet(int r, int g, int b, int a, int level)
-{
-  return ((r & (0x80 >> level)) ? 1 : 0) |
-         ((g & (0x80 >> level)) ? 2 : 0) |
-         ((b & (0x80 >> level)) ? 4 : 0) |
-         ((a & (0x80 >> level)) ? 8 : 0);
-}
-
-// static
-color_t OctreeNode::hextetToBranchColor(int hextet, int level)
-{
-  return ((hextet & 1) ? 0x00000080 >> level : 0) |
-         ((hextet & 2) ? 0x00008000 >> level : 0) |
-         ((hextet & 4) ? 0x00800000 >> level : 0) |
-         ((hextet & 8) ? 0x80000000 >> level : 0);
-}
-
-//////////////////////////////////////////////////////////////////////
-// OctreeMap
-
 bool OctreeMap::makePalette(Palette* palette,
                             int colorCount,
                             const int levelDeep)
 {
-  if (m_root.hasChildren()) {
+  if (m_children[kRoot] != kNoChildren) {
     // We create paletteIndex to get a "global like" variable, in collectLeafNodes
     // function, the purpose is having a incremental variable in the stack memory
     // sharend between all recursive calls of collectLeafNodes.
     int paletteIndex = 0;
-    m_root.collectLeafNodes(m_leavesVector, paletteIndex);
+    collectLeafNodes(kRoot, paletteIndex);
   }
 
   if (m_maskColor != DOC_OCTREE_IS_OPAQUE)
@@ -141,7 +185,7 @@ bool OctreeMap::makePalette(Palette* palette,
     return false;
 
 
-  OctreeNodes auxLeavesVector; // auxiliary collapsed node accumulator
+  NodeIndexes auxLeavesVector; // auxiliary collapsed node accumulator
   bool keepReducingMap = true;
 
   for (int level = levelDeep; level > -1; level--) {
@@ -158,18 +202,17 @@ bool OctreeMap::makePalette(Palette* palette,
         // the 16 remains colors will collapse in one.
         // So, we have to reduce color with other method:
         // Sort colors by pixelCount (most pixelCount on front of sortedVector),
-        // then:
-        // Blend in pairs from the least pixelCount colors.
+        // then keep the colors with most pixels.
         if (auxLeavesVector.size() <= 16 && colorCount < 16 && colorCount > 0) {
           // Sort colors:
-          OctreeNodes sortedVector;
+          NodeIndexes sortedVector;
           int auxVectorSize = auxLeavesVector.size();
           for (int k=0; k < auxVectorSize; k++) {
-            size_t maximumCount = auxLeavesVector[0]->leafColor().pixelCount();
+            size_t maximumCount = pixelCount(auxLeavesVector[0]);
             int maximumIndex = 0;
             for (int j=1; j < auxLeavesVector.size(); j++) {
-              if (auxLeavesVector[j]->leafColor().pixelCount() > maximumCount) {
-                maximumCount = auxLeavesVector[j]->leafColor().pixelCount();
+              if (pixelCount(auxLeavesVector[j]) > maximumCount) {
+                maximumCount = pixelCount(auxLeavesVector[j]);
                 maximumIndex = j;
               }
             }
@@ -177,18 +220,10 @@ bool OctreeMap::makePalette(Palette* palette,
             auxLeavesVector.erase(auxLeavesVector.begin() + maximumIndex);
           }
           // End Sort colors.
-          // Blend colors:
-          for (;;) {
-            if (sortedVector.size() <= colorCount) {
-              for (int k=0; k<sortedVector.size(); k++)
-                m_leavesVector.push_back(sortedVector[k]);
-              break;
-            }
-            sortedVector[sortedVector.size()-2]->leafColor()
-              .add(sortedVector[sortedVector.size()-1]->leafColor());
-            sortedVector.pop_back();
-          }
-          // End Blend colors:
+          if (sortedVector.size() > colorCount)
+            sortedVector.resize(colorCount);
+          for (int k=0; k<sortedVector.size(); k++)
+            m_leavesVector.push_back(sortedVector[k]);
           keepReducingMap = false;
           break;
         }
@@ -196,7 +231,7 @@ bool OctreeMap::makePalette(Palette* palette,
           break;
       }
 
-      m_leavesVector.back()->parent()->removeLeaves(auxLeavesVector, m_leavesVector);
+      removeLeaves(parent(m_leavesVector.back()), auxLeavesVector);
     }
     if (keepReducingMap) {
       // Copy collapsed leaves to m_leavesVector
@@ -220,7 +255,7 @@ bool OctreeMap::makePalette(Palette* palette,
 
   for (int i=0; i<leafCount; i++)
     palette->setEntry(i+aux,
-                      m_leavesVector[i]->leafColor().rgbaColor());
+                      m_leaves[m_leafIndexes[m_leavesVector[i]]].rgbaColor());
 
   return true;
 }
@@ -232,46 +267,80 @@ void OctreeMap::feedWithImage(const Image* image,
 {
   ASSERT(image);
   ASSERT(image->pixelFormat() == IMAGE_RGB || image->pixelFormat() == IMAGE_GRAYSCALE);
-  color_t forceFullOpacity;
-  const bool imageIsRGBA = (image->pixelFormat() == IMAGE_RGB);
-
-  auto add_color_to_octree =
-    [this, &forceFullOpacity, levelDeep, imageIsRGBA](color_t color) {
-      const int alpha = (imageIsRGBA ? rgba_geta(color) : graya_geta(color));
-      if (alpha) {
-        color |= forceFullOpacity;
-        color = (imageIsRGBA ? color : rgba(graya_getv(color),
-                                            graya_getv(color),
-                                            graya_getv(color),
-                                            alpha));
-        addColor(color, levelDeep);
-      }
-    };
+
+  // Current span of pixels with the same color
+  color_t runColor = 0;
+  size_t runCount = 0;
+  auto add_color = [this, levelDeep, &runColor, &runCount](const color_t color) {
+    if (runCount > 0 && color == runColor) {
+      ++runCount;
+    }
+    else {
+      if (runCount > 0)
+        addColor(runColor, levelDeep, runCount, 0);
+      runColor = color;
+      runCount = 1;
+    }
+  };
+
+  const int w = image->width();
+  const int h = image->height();
 
   switch (image->pixelFormat()) {
     case IMAGE_RGB: {
-      forceFullOpacity = (withAlpha ? 0 : rgba_a_mask);
-      doc::for_each_pixel<RgbTraits>(image, add_color_to_octree);
+      const color_t forceFullOpacity = (withAlpha ? 0 : rgba_a_mask);
+      for (int y=0; y<h; ++y) {
+        auto p = (RgbTraits::const_address_t)image->getPixelAddress(0, y);
+        for (int x=0; x<w; ++x, ++p) {
+          const color_t color = *p;
+          if (rgba_geta(color))
+            add_color(color | forceFullOpacity);
+        }
+      }
       break;
     }
     case IMAGE_GRAYSCALE: {
-      forceFullOpacity = (withAlpha ? 0 : graya_a_mask);
-      doc::for_each_pixel<GrayscaleTraits>(image, add_color_to_octree);
+      for (int y=0; y<h; ++y) {
+        auto p = (GrayscaleTraits::const_address_t)image->getPixelAddress(0, y);
+        for (int x=0; x<w; ++x, ++p) {
+          const color_t color = *p;
+          const int alpha = graya_geta(color);
+          if (alpha) {
+            const int v = graya_getv(color);
+            add_color(rgba(v, v, v, alpha));
+          }
+        }
+      }
       break;
     }
   }
+  if (runCount > 0)
+    addColor(runColor, levelDeep, runCount, 0);
+
   m_maskColor = maskColor;
 }
 
 int OctreeMap::mapColor(color_t rgba) const
 {
-  return m_root.mapColor(rgba_getr(rgba),
-                         rgba_getg(rgba),
-                         rgba_getb(rgba),
-                         rgba_geta(rgba),
-                         m_maskIndex,
-                         m_palette, 0,
-                         this);
+  const int r = rgba_getr(rgba);
+  const int g = rgba_getg(rgba);
+  const int b = rgba_getb(rgba);
+  const int a = rgba_geta(rgba);
+
+  // If we don't have an exact rgba match, we calculate which color
+  // of the current palette is the best fit and memorize the index in
+  // a leaf of the 8th level.
+  NodeIndex node = kRoot;
+  for (int level=0; level<8; ++level) {
+    NodeIndex first = m_children[node];
+    if (first == kNoChildren)
+      first = createChildren(node);
+    node = first + get_hextet(r, g, b, a, level);
+  }
+  int& index = m_paletteIndexes[node];
+  if (index == -1)
+    index = findBestfit(r, g, b, a, m_maskIndex);
+  return index;
 }
 
 void OctreeMap::regenerateMap(const Palette* palette,
@@ -291,7 +360,7 @@ void OctreeMap::regenerateMap(const Palette* palette,
 
   m_palette = palette;
   m_fitCriteria = fitCriteria;
-  m_root = OctreeNode();
+  clearNodes();
   m_leavesVector.clear();
   m_maskIndex = maskIndex;
   int maskColorBestFitIndex;
@@ -309,10 +378,10 @@ void OctreeMap::regenerateMap(const Palette* palette,
 
   for (int i=0; i<palette->size(); i++) {
     if (i == maskIndex) {
-      m_root.addColor(palette->entry(i), 0, &m_root, maskColorBestFitIndex, 8);
+      addColor(palette->entry(i), 8, 1, maskColorBestFitIndex);
       continue;
     }
-    m_root.addColor(palette->entry(i), 0, &m_root, i, 8);
+    addColor(palette->entry(i), 8, 1, i);
   }
 
   m_modifications = palette->getModifications();
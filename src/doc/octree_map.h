@@ -13,8 +13,7 @@
 #include "doc/palette.h"
 #include "doc/rgbmap_base.h"
 
-#include <array>
-#include <memory>
+#include <cstdint>
 #include <vector>
 
 // When this DOC_OCTREE_IS_OPAQUE 'color' is asociated with
@@ -25,106 +24,25 @@
 
 namespace doc {
 
-class OctreeNode;
-class OctreeMap;
-
-using OctreeNodes = std::vector<OctreeNode*>;
-
-class OctreeNode {
-private:
-  class LeafColor {
-  public:
-    LeafColor() :
-      m_r(0),
-      m_g(0),
-      m_b(0),
-      m_a(0),
-      m_pixelCount(0) {
-    }
-
-    LeafColor(int r, int g, int b, int a, size_t pixelCount) :
-      m_r((double)r),
-      m_g((double)g),
-      m_b((double)b),
-      m_a((double)a),
-      m_pixelCount(pixelCount) {
-    }
-
-    void add(color_t c) {
-      m_r += rgba_getr(c);
-      m_g += rgba_getg(c);
-      m_b += rgba_getb(c);
-      m_a += rgba_geta(c);
-      ++m_pixelCount;
-    }
-
-    void add(LeafColor leafColor) {
-      m_r += leafColor.m_r;
-      m_g += leafColor.m_g;
-      m_b += leafColor.m_b;
-      m_a += leafColor.m_a;
-      m_pixelCount += leafColor.m_pixelCount;
-    }
-
-    color_t rgbaColor() const {
-      int auxR = (((int)m_r) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxG = (((int)m_g) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxB = (((int)m_b) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      int auxA = (((int)m_a) % m_pixelCount > m_pixelCount / 2) ? 1: 0;
-      return rgba(int(m_r / m_pixelCount + auxR),
-                  int(m_g / m_pixelCount + auxG),
-                  int(m_b / m_pixelCount + auxB),
-                  int(m_a / m_pixelCount + auxA));
-    }
-
-    size_t pixelCount() const { return m_pixelCount; }
-
-private:
-    double m_r;
-    double m_g;
-    double m_b;
-    double m_a;
-    size_t m_pixelCount;
-  };
-
+class OctreeMap : public RgbMapBase {
 public:
-  OctreeNode* parent() const { return m_parent; }
-  bool hasChildren() const { return m_children != nullptr; }
-  LeafColor leafColor() const { return m_leafColor; }
-
-  void addColor(color_t c, int level, OctreeNode* parent,
-                int paletteIndex = 0, int levelDeep = 7);
-
-  int mapColor(int  r, int g, int b, int a, int mask_index,
-               const Palette* palette, int level,
-               const OctreeMap* octree) const;
-
-  void collectLeafNodes(OctreeNodes& leavesVector, int& paletteIndex);
+  OctreeMap();
 
-  // removeLeaves(): remove leaves from a common parent
-  // auxParentVector: i/o addreess of an auxiliary parent leaf Vector from outside.
-  // rootLeavesVector: i/o address of the m_root->m_leavesVector
-  int removeLeaves(OctreeNodes& auxParentVector,
-                   OctreeNodes& rootLeavesVector);
-
-private:
-  bool isLeaf() { return m_leafColor.pixelCount() > 0; }
-  void paletteIndex(int index) { m_paletteIndex = index; }
-
-  static int getHextet(color_t c, int level);
-  static int getHextet(int r, int g, int b, int a, int level);
-  static color_t hextetToBranchColor(int hextet, int level);
+  void addColor(color_t color, int levelDeep = 7, size_t count = 1) {
+    addColor(color, levelDeep, count, 0);
+  }
 
-  LeafColor m_leafColor;
-  mutable int m_paletteIndex = -1;
-  mutable std::unique_ptr<std::array<OctreeNode, 16>> m_children;
-  OctreeNode* m_parent = nullptr;
-};
+  // Adds all the colors of other octree (created with the same
+  // levelDeep), e.g. to join octrees fed from different threads.
+  void merge(const OctreeMap& other) {
+    mergeNode(kRoot, other, kRoot);
+  }
 
-class OctreeMap : public RgbMapBase {
-public:
-  void addColor(color_t color, int levelDeep = 7) {
-    m_root.addColor(color, 0, &m_root, 0, levelDeep);
+  // Mask color used by makePalette() (it's set automatically by
+  // feedWithImage(), but must be set when colors are added with
+  // addColor() directly).
+  void setMaskColor(const color_t maskColor) {
+    m_maskColor = maskColor;
   }
 
   // makePalette returns true if a 7 level octreeDeep is OK, and false
@@ -133,6 +51,9 @@ public:
                    int colorCount,
                    const int levelDeep = 7);
 
+  // Adds all the pixels of the image processing each row as a span
+  // of pixels (consecutive pixels of the same color are added at
+  // once).
   void feedWithImage(const Image* image,
                      const bool withAlpha,
                      const color_t maskColor,
@@ -154,8 +75,76 @@ public:
   }
 
 private:
-  OctreeNode m_root;
-  OctreeNodes m_leavesVector;
+  // Nodes are identified by their index in the arena. The 16
+  // children of a node are allocated together (consecutive indexes),
+  // so we only need the index of the first child.
+  using NodeIndex = uint32_t;
+  using NodeIndexes = std::vector<NodeIndex>;
+  static constexpr NodeIndex kRoot = 0;
+  static constexpr NodeIndex kNoChildren = 0; // The root cannot be a child
+  static constexpr NodeIndex kNoLeaf = 0xffffffff;
+
+  // Accumulated color of a leaf (or of a collapsed node in
+  // makePalette()).
+  struct LeafColor {
+    uint64_t r = 0;
+    uint64_t g = 0;
+    uint64_t b = 0;
+    uint64_t a = 0;
+    uint64_t pixelCount = 0;
+
+    void add(color_t c, size_t count) {
+      r += uint64_t(rgba_getr(c)) * count;
+      g += uint64_t(rgba_getg(c)) * count;
+      b += uint64_t(rgba_getb(c)) * count;
+      a += uint64_t(rgba_geta(c)) * count;
+      pixelCount += count;
+    }
+
+    void add(const LeafColor& other) {
+      r += other.r;
+      g += other.g;
+      b += other.b;
+      a += other.a;
+      pixelCount += other.pixelCount;
+    }
+
+    color_t rgbaColor() const;
+  };
+
+  void clearNodes();
+  NodeIndex createChildren(NodeIndex node) const;
+  NodeIndex parent(NodeIndex node) const {
+    return (node == kRoot ? kRoot: m_parents[(node-1) / 16]);
+  }
+  bool isLeaf(NodeIndex node) const {
+    return (m_leafIndexes[node] != kNoLeaf &&
+            m_leaves[m_leafIndexes[node]].pixelCount > 0);
+  }
+  size_t pixelCount(NodeIndex node) const {
+    return (m_leafIndexes[node] != kNoLeaf ?
+            m_leaves[m_leafIndexes[node]].pixelCount: 0);
+  }
+  LeafColor& leafColor(NodeIndex node);
+
+  void addColor(color_t c, int levelDeep, size_t count, int paletteIndex);
+  void mergeNode(NodeIndex node, const OctreeMap& other, NodeIndex otherNode);
+  void collectLeafNodes(NodeIndex node, int& paletteIndex);
+
+  // removeLeaves(): remove leaves from a common parent
+  // auxParentVector: i/o address of an auxiliary parent leaf Vector from outside.
+  int removeLeaves(NodeIndex node, NodeIndexes& auxParentVector);
+
+  // Node arena (structure of arrays). These fields are mutable
+  // because mapColor() creates new nodes to memorize the best fit of
+  // new colors.
+  mutable NodeIndexes m_children;       // First child of each node
+  mutable NodeIndexes m_leafIndexes;    // Index in m_leaves of each node
+  mutable std::vector<int> m_paletteIndexes;
+  mutable NodeIndexes m_parents;        // Parent of each block of 16 children
+  std::vector<LeafColor> m_leaves;
+
+  NodeIndexes m_leavesVector;
   color_t m_maskColor = 0;
 };
 
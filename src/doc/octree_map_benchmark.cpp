@@ -0,0 +1,129 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/octree_map.h"
+
+#include "doc/algorithm/random_image.h"
+#include "doc/image_ref.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace doc;
+
+namespace {
+
+// Creates an image similar to pixel art: flat areas of a few colors
+// (like an animation frame) or random noise (worst case, every pixel
+// is a different color).
+ImageRef make_image(const int w, const int h, const bool noise)
+{
+  ImageRef image(Image::create(IMAGE_RGB, w, h));
+  if (noise) {
+    algorithm::random_image(image.get());
+  }
+  else {
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x)
+        put_pixel(image.get(), x, y,
+                  rgba((x/8*37) & 255, (y/8*71) & 255, ((x+y)/16*13) & 255, 255));
+  }
+  return image;
+}
+
+} // anonymous namespace
+
+void BM_OctreeFeedWithImage(benchmark::State& state) {
+  const int w = state.range(0);
+  const int h = state.range(1);
+  const bool noise = state.range(2);
+  const int levelDeep = state.range(3);
+  ImageRef image = make_image(w, h, noise);
+  for (auto _ : state) {
+    OctreeMap octree;
+    octree.feedWithImage(image.get(), true, 0, levelDeep);
+    benchmark::DoNotOptimize(octree);
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+
+void BM_OctreeMakePalette(benchmark::State& state) {
+  const int w = state.range(0);
+  const int h = state.range(1);
+  const bool noise = state.range(2);
+  const int levelDeep = state.range(3);
+  ImageRef image = make_image(w, h, noise);
+  for (auto _ : state) {
+    OctreeMap octree;
+    octree.feedWithImage(image.get(), true, 0, levelDeep);
+    Palette palette(0, 256);
+    octree.makePalette(&palette, palette.size(), levelDeep);
+    benchmark::DoNotOptimize(palette);
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+
+void BM_OctreeMapColor(benchmark::State& state) {
+  const int w = state.range(0);
+  const int h = state.range(1);
+  const bool noise = state.range(2);
+  ImageRef image = make_image(w, h, noise);
+
+  Palette palette(0, 256);
+  for (int i=0; i<palette.size(); ++i)
+    palette.setEntry(i, rgba((i*37) & 255, (i*71) & 255, (i*13) & 255, 255));
+
+  for (auto _ : state) {
+    // A new map each iteration to include the cost of memorizing the
+    // best fit of each new color.
+    OctreeMap octree;
+    octree.regenerateMap(&palette, 0, FitCriteria::DEFAULT);
+    for (int y=0; y<h; ++y) {
+      auto p = (RgbTraits::const_address_t)image->getPixelAddress(0, y);
+      for (int x=0; x<w; ++x, ++p)
+        benchmark::DoNotOptimize(octree.mapColor(*p));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+
+BENCHMARK(BM_OctreeFeedWithImage)
+  ->Args({ 256, 256, false, 7 })
+  ->Args({ 256, 256, true, 7 })
+  ->Args({ 256, 256, true, 8 })
+  ->Args({ 2048, 2048, false, 7 })
+  ->Args({ 2048, 2048, true, 7 })
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_OctreeMakePalette)
+  ->Args({ 256, 256, false, 7 })
+  ->Args({ 256, 256, true, 7 })
+  ->Args({ 256, 256, true, 8 })
+  ->Args({ 2048, 2048, true, 7 })
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_OctreeMapColor)
+  ->Args({ 256, 256, false })
+  ->Args({ 256, 256, true })
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+int main(int argc, char** argv)
+{
+  // Needed by findBestfit() in mapColor()
+  Palette::initBestfit();
+
+  ::benchmark::Initialize(&argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,120 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/parallel.h"
+
+#include "base/thread_pool.h"
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace doc {
+namespace detail {
+
+namespace {
+
+// Threads are created only once (the first time they are needed)
+// instead of launching new threads in each parallel_ranges() call.
+base::thread_pool& parallel_pool()
+{
+  static base::thread_pool pool(
+    std::max(1, int(std::thread::hardware_concurrency())));
+  return pool;
+}
+
+} // anonymous namespace
+
+void parallel_chunks(const int nchunks,
+                     const std::function<void(int)>& func)
+{
+  // The state is shared with the queued tasks because a task can
+  // start after this function returns (if all the chunks were
+  // already processed by other threads).
+  struct State {
+    std::mutex mutex;
+    std::condition_variable done;
+    int next = 1;               // Next chunk to process
+    int running = 0;
+    std::exception_ptr error;
+    const std::function<void(int)>* func;
+  };
+  auto state = std::make_shared<State>();
+  state->func = &func;
+
+  // Processes the chunks that are not started yet, "func" is only
+  // used while this call is waiting for running chunks.
+  auto runChunks = [nchunks](State& st) {
+    for (;;) {
+      int i;
+      {
+        const std::lock_guard lock(st.mutex);
+        if (st.next >= nchunks || st.error)
+          return;
+        i = st.next++;
+        ++st.running;
+      }
+
+      std::exception_ptr error;
+      try {
+        (*st.func)(i);
+      }
+      catch (...) {
+        error = std::current_exception();
+      }
+
+      const std::lock_guard lock(st.mutex);
+      if (error && !st.error)
+        st.error = error;
+      if (--st.running == 0)
+        st.done.notify_all();
+    }
+  };
+
+  try {
+    base::thread_pool& pool = parallel_pool();
+    for (int i=1; i<nchunks; ++i) {
+      pool.execute([state, runChunks]{
+        inside_parallel_ranges = true;
+        runChunks(*state);
+        inside_parallel_ranges = false;
+      });
+    }
+  }
+  catch (...) {
+    // The pool couldn't be created or the task couldn't be queued
+    // (e.g. std::bad_alloc or std::system_error), the remaining
+    // chunks are processed in this thread.
+  }
+
+  // The first chunk is always processed in the calling thread, then
+  // we process the chunks that weren't taken by the pool yet (e.g.
+  // because its threads are busy with chunks of other calls).
+  inside_parallel_ranges = true;
+  try {
+    func(0);
+  }
+  catch (...) {
+    const std::lock_guard lock(state->mutex);
+    if (!state->error)
+      state->error = std::current_exception();
+  }
+  runChunks(*state);
+  inside_parallel_ranges = false;
+
+  std::unique_lock lock(state->mutex);
+  state->done.wait(lock, [&state]{ return state->running == 0; });
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+} // namespace detail
+} // namespace doc
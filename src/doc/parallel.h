@@ -0,0 +1,76 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_PARALLEL_H_INCLUDED
+#define DOC_PARALLEL_H_INCLUDED
+#pragma once
+
+#include "base/ints.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+namespace doc {
+
+  namespace detail {
+    // True while we are running a chunk of parallel_ranges(), used to
+    // avoid launching more threads from nested calls.
+    inline thread_local bool inside_parallel_ranges = false;
+
+    // Calls func(i) for each i in [0, nchunks). The chunk 0 is
+    // processed in the calling thread and the others in the threads
+    // of a pool shared by all calls (or in the calling thread if they
+    // weren't started when it finishes the chunk 0). Waits the
+    // running chunks and rethrows the first exception thrown by
+    // "func" (chunks that weren't started yet are skipped after an
+    // exception).
+    void parallel_chunks(const int nchunks,
+                         const std::function<void(int)>& func);
+  }
+
+  // Returns the max number of threads that parallel_ranges() will use
+  // (1 if it's called from a thread that is already processing a
+  // chunk of parallel_ranges()).
+  inline int parallel_max_threads() {
+    if (detail::inside_parallel_ranges)
+      return 1;
+    return std::max(1, int(std::thread::hardware_concurrency()));
+  }
+
+  // Splits the [0, n) range in consecutive chunks and calls
+  // func(begin, end) for each chunk from a different thread (the
+  // calling thread processes the first chunk, begin == 0). "minChunk"
+  // is the minimum number of items to make worthwhile to use a new
+  // thread. If "func" throws, the exception is rethrown here when all
+  // the running chunks have finished.
+  //
+  // Chunks can be queued in the pool behind chunks of other calls, so
+  // a chunk must not wait for the progress of another chunk.
+  template<typename Func>
+  void parallel_ranges(const int n, const int minChunk, Func&& func) {
+    if (n <= 0)
+      return;
+
+    const int nthreads =
+      std::clamp(n / std::max(1, minChunk), 1, parallel_max_threads());
+    if (nthreads == 1) {
+      func(0, n);
+      return;
+    }
+
+    detail::parallel_chunks(
+      nthreads,
+      [&func, n, nthreads](const int i) {
+        const int begin = int(int64_t(n) * i / nthreads);
+        const int end = int(int64_t(n) * (i+1) / nthreads);
+        func(begin, end);
+      });
+  }
+
+} // namespace doc
+
+#endif
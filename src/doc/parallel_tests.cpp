@@ -0,0 +1,93 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/parallel.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace doc;
+
+TEST(Parallel, EachItemIsProcessedOnce)
+{
+  for (int n : { 0, 1, 7, 100, 1000 }) {
+    std::vector<std::atomic<int>> count(n);
+    parallel_ranges(
+      n, 1,
+      [&](const int begin, const int end) {
+        for (int i=begin; i<end; ++i)
+          ++count[i];
+      });
+    for (int i=0; i<n; ++i)
+      EXPECT_EQ(1, count[i]) << "n=" << n << " i=" << i;
+  }
+}
+
+TEST(Parallel, FirstChunkInCallingThread)
+{
+  const std::thread::id caller = std::this_thread::get_id();
+  for (int k=0; k<100; ++k) {
+    parallel_ranges(
+      100, 1,
+      [&](const int begin, const int end) {
+        if (begin == 0)
+          EXPECT_EQ(caller, std::this_thread::get_id());
+      });
+  }
+}
+
+TEST(Parallel, NestedCallsAreNotParallel)
+{
+  std::atomic<int> items(0);
+  parallel_ranges(
+    100, 1,
+    [&](const int begin, const int end) {
+      EXPECT_EQ(1, parallel_max_threads());
+      parallel_ranges(
+        end-begin, 1,
+        [&](const int begin2, const int end2) {
+          items += end2-begin2;
+        });
+    });
+  EXPECT_EQ(100, items);
+}
+
+TEST(Parallel, ExceptionsAreRethrown)
+{
+  for (int n : { 1, 100 }) {
+    EXPECT_THROW(
+      parallel_ranges(
+        n, 1,
+        [&](const int begin, const int end) {
+          if (end == n)
+            throw std::runtime_error("error");
+        }),
+      std::runtime_error);
+  }
+
+  // The pool threads can be used after an exception
+  std::atomic<int> items(0);
+  parallel_ranges(
+    100, 1,
+    [&](const int begin, const int end) {
+      items += end-begin;
+    });
+  EXPECT_EQ(100, items);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -10,10 +10,10 @@
 #pragma once
 
 #include "doc/color.h"
+#include "doc/image.h"
 #include "doc/image_traits.h"
 
 namespace doc {
-  class Image;
   template<typename ImageTraits> class ImageImpl;
 
   template<class Traits>
@@ -24,6 +24,15 @@ namespace doc {
     return (((ImageImpl<Traits>*)image)->address(x, y));
   }
 
+  // Address to modify pixels, the caller must unshare the pixels
+  // before the loop that modifies them (e.g. with
+  // Image::unsharePixels() or a LockImageBits with WriteLock).
+  template<class Traits>
+  inline typename Traits::address_t get_pixel_address_fast(Image* image, int x, int y) {
+    ASSERT(!image->hasSharedPixels());
+    return get_pixel_address_fast<Traits>(static_cast<const Image*>(image), x, y);
+  }
+
   template<class Traits>
   inline typename Traits::pixel_t get_pixel_fast(const Image* image, int x, int y) {
     ASSERT(x >= 0 && x < image->width());
@@ -32,10 +41,12 @@ namespace doc {
     return *(((ImageImpl<Traits>*)image)->address(x, y));
   }
 
+  // The image must be unshared before (see get_pixel_address_fast())
   template<class Traits>
   inline void put_pixel_fast(Image* image, int x, int y, typename Traits::pixel_t color) {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
+    ASSERT(!image->hasSharedPixels());
 
     *(((ImageImpl<Traits>*)image)->address(x, y)) = color;
   }
@@ -55,11 +66,13 @@ namespace doc {
   inline void put_pixel_fast<BitmapTraits>(Image* image, int x, int y, BitmapTraits::pixel_t color) {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
+    ASSERT(!image->hasSharedPixels());
 
+    uint8_t* p = static_cast<const Image*>(image)->getPixelAddress(x, y);
     if (color)
-      *image->getPixelAddress(x, y) |= (1 << (x % 8));
+      *p |= (1 << (x % 8));
     else
-      *image->getPixelAddress(x, y) &= ~(1 << (x % 8));
+      *p &= ~(1 << (x % 8));
   }
 
 } // namespace doc
@@ -54,6 +54,7 @@ TYPED_TEST(Primitives, IsSameImage)
       doc::algorithm::random_image(a.get());
 
       ImageRef b(Image::createCopy(a.get()));
+      b->unsharePixels();         // Modified with put_pixel_fast()
 #if FULL_TEST
       for (int v=0; v<h; ++v)
       for (int u=0; u<w; ++u) {
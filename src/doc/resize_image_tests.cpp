@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2022 Igara Studio S.A.
+// Copyright (c) 2022-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -101,6 +101,70 @@ TEST(ResizeImage, BilinearInterpRGBType)
 }
 #endif
 
+TEST(ResizeImage, AreaAverageDownscale)
+{
+  color_t data_4x2[8] =
+  {
+    rgba(0, 0, 0, 255), rgba(255, 255, 255, 255), rgba(100, 0, 0, 255), rgba(100, 0, 0, 255),
+    rgba(255, 255, 255, 255), rgba(0, 0, 0, 255), rgba(100, 0, 0, 255), rgba(100, 0, 0, 255)
+  };
+  ImageRef src(create_image_from_data(IMAGE_RGB, data_4x2, 4, 2));
+  ImageRef dst(Image::create(IMAGE_RGB, 2, 1));
+  algorithm::resize_image(src.get(), dst.get(),
+                          algorithm::RESIZE_METHOD_AREA_AVERAGE,
+                          nullptr, nullptr, -1);
+
+  EXPECT_EQ(rgba(128, 128, 128, 255), get_pixel(dst.get(), 0, 0));
+  EXPECT_EQ(rgba(100, 0, 0, 255), get_pixel(dst.get(), 1, 0));
+}
+
+TEST(ResizeImage, AreaAverageIgnoresTransparentColors)
+{
+  // The RGB values of transparent pixels must not be mixed
+  color_t data_2x1[2] = { rgba(255, 0, 0, 255), rgba(0, 0, 255, 0) };
+  ImageRef src(create_image_from_data(IMAGE_RGB, data_2x1, 2, 1));
+  ImageRef dst(Image::create(IMAGE_RGB, 1, 1));
+  algorithm::resize_image(src.get(), dst.get(),
+                          algorithm::RESIZE_METHOD_AREA_AVERAGE,
+                          nullptr, nullptr, -1);
+
+  EXPECT_EQ(rgba(255, 0, 0, 128), get_pixel(dst.get(), 0, 0));
+}
+
+TEST(ResizeImage, ConstantColorIsPreserved)
+{
+  const color_t c = rgba(10, 200, 30, 255);
+  for (auto method : { algorithm::RESIZE_METHOD_BILINEAR,
+                       algorithm::RESIZE_METHOD_AREA_AVERAGE,
+                       algorithm::RESIZE_METHOD_LANCZOS3 }) {
+    ImageRef src(Image::create(IMAGE_RGB, 37, 23));
+    clear_image(src.get(), c);
+
+    for (auto size : { gfx::Size(5, 3), gfx::Size(37, 23), gfx::Size(101, 77) }) {
+      ImageRef dst(Image::create(IMAGE_RGB, size.w, size.h));
+      algorithm::resize_image(src.get(), dst.get(), method,
+                              nullptr, nullptr, -1);
+      for (int y=0; y<size.h; ++y)
+        for (int x=0; x<size.w; ++x)
+          ASSERT_EQ(c, get_pixel(dst.get(), x, y));
+    }
+  }
+}
+
+TEST(ResizeImage, Lanczos3SameSize)
+{
+  color_t data_3x3[9];
+  for (int i=0; i<9; ++i)
+    data_3x3[i] = rgba(i*20, 255-i*20, i*5, 255);
+
+  ImageRef src(create_image_from_data(IMAGE_RGB, data_3x3, 3, 3));
+  ImageRef dst(Image::create(IMAGE_RGB, 3, 3));
+  algorithm::resize_image(src.get(), dst.get(),
+                          algorithm::RESIZE_METHOD_LANCZOS3,
+                          nullptr, nullptr, -1);
+  ASSERT_EQ(0, count_diff_between_images(src.get(), dst.get()));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,112 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/sparse_tiles.h"
+
+#include "base/debug.h"
+#include "doc/image.h"
+#include "doc/image_traits.h"
+
+namespace doc {
+
+namespace {
+
+template<typename ImageTraits>
+bool is_empty_rect(const Image* image,
+                   const gfx::Rect& bounds,
+                   const color_t maskColor)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  const pixel_t mask = pixel_t(maskColor);
+
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    auto p = (const pixel_t*)image->getPixelAddress(0, y);
+
+    // Check the whole span without branches (so it can be
+    // vectorized by the compiler).
+    pixel_t diff = 0;
+    for (int x=bounds.x; x<bounds.x2(); ++x)
+      diff |= (p[x] ^ mask);
+    if (diff)
+      return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+SparseTiles::SparseTiles(const Image* image, const uint64_t pixelsVersion)
+  : m_image(image)
+  , m_pixelsVersion(pixelsVersion)
+  , m_maskColor(image->maskColor())
+  , m_imageBounds(image->bounds())
+  , m_cols((image->width() + kTileSize - 1) / kTileSize)
+  , m_rows((image->height() + kTileSize - 1) / kTileSize)
+  , m_tiles(new std::atomic<uint8_t>[m_cols*m_rows])
+{
+  for (int i=0; i<m_cols*m_rows; ++i)
+    m_tiles[i].store(kUnknown, std::memory_order_relaxed);
+}
+
+bool SparseTiles::isEmptyTile(int u, int v) const
+{
+  ASSERT(u >= 0 && u < m_cols);
+  ASSERT(v >= 0 && v < m_rows);
+
+  // Two threads can scan the same tile at the same time, but both
+  // will store the same result.
+  auto& tile = m_tiles[v*m_cols + u];
+  uint8_t state = tile.load(std::memory_order_relaxed);
+  if (state == kUnknown) {
+    // If the image was modified after this index was created, we
+    // cannot cache the result (it's a new version of the pixels)
+    if (m_image->pixelsVersion() != m_pixelsVersion)
+      return false;
+
+    state = (scanTile(u, v) ? kEmpty: kNonEmpty);
+    tile.store(state, std::memory_order_relaxed);
+  }
+  return (state == kEmpty);
+}
+
+gfx::Rect SparseTiles::tilesInBounds(const gfx::Rect& bounds) const
+{
+  const gfx::Rect rc = bounds.createIntersection(m_imageBounds);
+  if (rc.isEmpty())
+    return gfx::Rect();
+
+  const int u1 = rc.x / kTileSize;
+  const int v1 = rc.y / kTileSize;
+  const int u2 = (rc.x2() + kTileSize - 1) / kTileSize;
+  const int v2 = (rc.y2() + kTileSize - 1) / kTileSize;
+  return gfx::Rect(u1, v1, u2-u1, v2-v1);
+}
+
+gfx::Rect SparseTiles::tilesBounds(int u, int v, int w, int h) const
+{
+  return gfx::Rect(u*kTileSize, v*kTileSize,
+                   w*kTileSize, h*kTileSize).createIntersection(m_imageBounds);
+}
+
+bool SparseTiles::scanTile(int u, int v) const
+{
+  const gfx::Rect bounds = tilesBounds(u, v, 1, 1);
+  switch (m_image->pixelFormat()) {
+    case IMAGE_RGB:       return is_empty_rect<RgbTraits>(m_image, bounds, m_maskColor);
+    case IMAGE_GRAYSCALE: return is_empty_rect<GrayscaleTraits>(m_image, bounds, m_maskColor);
+    case IMAGE_INDEXED:   return is_empty_rect<IndexedTraits>(m_image, bounds, m_maskColor);
+    case IMAGE_TILEMAP:   return is_empty_rect<TilemapTraits>(m_image, bounds, m_maskColor);
+    default:
+      // Bitmaps are not indexed (all tiles are considered non-empty)
+      return false;
+  }
+}
+
+} // namespace doc
@@ -0,0 +1,76 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_SPARSE_TILES_H_INCLUDED
+#define DOC_SPARSE_TILES_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+#include "gfx/rect.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace doc {
+
+  class Image;
+
+  // Index of the empty tiles (squares of kTileSize x kTileSize
+  // pixels where all pixels are equal to the mask color) of an
+  // image. Cel images are usually mostly transparent (a small
+  // character in a big canvas), so these tiles can be skipped when
+  // the image is rendered.
+  //
+  // Tiles are scanned only when they are requested for the first
+  // time, so after a modification only the tiles of the rendered
+  // area must be checked again (not the whole image).
+  //
+  // Use Image::sparseTiles() to get the cached index of an image.
+  class SparseTiles {
+  public:
+    static constexpr int kTileSize = 64;
+
+    SparseTiles(const Image* image, uint64_t pixelsVersion);
+
+    uint64_t pixelsVersion() const { return m_pixelsVersion; }
+    color_t maskColor() const { return m_maskColor; }
+
+    // Number of tiles in each axis.
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+
+    // Returns true if all pixels of the given tile are equal to the
+    // mask color. It can be called from several threads at the same
+    // time.
+    bool isEmptyTile(int u, int v) const;
+
+    // Returns the range of tiles (in tile units) that intersect the
+    // given rectangle of pixels.
+    gfx::Rect tilesInBounds(const gfx::Rect& bounds) const;
+
+    // Returns the bounds of the given range of tiles in pixels
+    // (clipped to the image bounds).
+    gfx::Rect tilesBounds(int u, int v, int w, int h) const;
+
+  private:
+    enum TileState : uint8_t { kUnknown, kEmpty, kNonEmpty };
+
+    bool scanTile(int u, int v) const;
+
+    // The index is cached in the image itself (see
+    // Image::sparseTiles()), so the image outlives it.
+    const Image* m_image;
+    uint64_t m_pixelsVersion;
+    color_t m_maskColor;
+    gfx::Rect m_imageBounds;
+    int m_cols, m_rows;
+    std::unique_ptr<std::atomic<uint8_t>[]> m_tiles;
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,137 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/sparse_tiles.h"
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+using namespace doc;
+using namespace gfx;
+
+static bool all_tiles_empty(const SparseTiles* tiles)
+{
+  for (int v=0; v<tiles->rows(); ++v)
+    for (int u=0; u<tiles->cols(); ++u)
+      if (!tiles->isEmptyTile(u, v))
+        return false;
+  return true;
+}
+
+TEST(SparseTiles, EmptyImage)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 100, 70));
+  image->clear(0);
+
+  auto tiles = image->sparseTiles();
+  EXPECT_EQ(2, tiles->cols());
+  EXPECT_EQ(2, tiles->rows());
+  EXPECT_TRUE(all_tiles_empty(tiles.get()));
+}
+
+TEST(SparseTiles, NonEmptyTiles)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, 200, 130));
+  image->clear(0);
+  put_pixel(image.get(), 70, 10, 1);
+  put_pixel(image.get(), 199, 129, 2);
+
+  auto tiles = image->sparseTiles();
+  ASSERT_EQ(4, tiles->cols());
+  ASSERT_EQ(3, tiles->rows());
+  for (int v=0; v<tiles->rows(); ++v) {
+    for (int u=0; u<tiles->cols(); ++u) {
+      const bool nonEmpty = ((u == 1 && v == 0) ||
+                             (u == 3 && v == 2));
+      EXPECT_EQ(!nonEmpty, tiles->isEmptyTile(u, v)) << u << "," << v;
+    }
+  }
+
+  // Clipped to the image bounds
+  EXPECT_EQ(Rect(64, 128, 136, 2), tiles->tilesBounds(1, 2, 3, 1));
+}
+
+TEST(SparseTiles, Invalidation)
+{
+  ImageRef image(Image::create(IMAGE_GRAYSCALE, 64, 64));
+  image->clear(0);
+
+  auto tiles = image->sparseTiles();
+  EXPECT_TRUE(all_tiles_empty(tiles.get()));
+  EXPECT_EQ(tiles, image->sparseTiles()); // Cached
+
+  image->putPixel(5, 5, graya(255, 255));
+
+  // The old index cannot be used to scan the new pixels
+  EXPECT_NE(tiles, image->sparseTiles());
+  tiles = image->sparseTiles();
+  EXPECT_FALSE(all_tiles_empty(tiles.get()));
+
+  // The mask color is part of the index
+  image->setMaskColor(graya(255, 255));
+  image->clear(graya(255, 255));
+  EXPECT_TRUE(all_tiles_empty(image->sparseTiles().get()));
+}
+
+TEST(SparseTiles, CopyOnWrite)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 128, 64));
+  image->clear(0);
+  EXPECT_TRUE(all_tiles_empty(image->sparseTiles().get()));
+
+  // Modifying the copy must not change the index of the original
+  ImageRef copy(Image::createCopy(image.get()));
+  copy->putPixel(100, 0, rgba(255, 0, 0, 255));
+  EXPECT_TRUE(all_tiles_empty(image->sparseTiles().get()));
+  EXPECT_FALSE(all_tiles_empty(copy->sparseTiles().get()));
+  EXPECT_TRUE(copy->sparseTiles()->isEmptyTile(0, 0));
+  EXPECT_FALSE(copy->sparseTiles()->isEmptyTile(1, 0));
+}
+
+TEST(SparseTiles, TilesInBounds)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 200, 130));
+  image->clear(0);
+
+  auto tiles = image->sparseTiles();
+  EXPECT_EQ(Rect(0, 0, 4, 3), tiles->tilesInBounds(image->bounds()));
+  EXPECT_EQ(Rect(1, 0, 1, 1), tiles->tilesInBounds(Rect(64, 0, 64, 64)));
+  EXPECT_EQ(Rect(0, 1, 2, 2), tiles->tilesInBounds(Rect(63, 64, 2, 1000)));
+  EXPECT_TRUE(tiles->tilesInBounds(Rect(200, 0, 10, 10)).isEmpty());
+}
+
+TEST(SparseTiles, ScanModifiedTiles)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 256, 64));
+  image->clear(0);
+
+  // Only the first tile is scanned with the old pixels
+  auto tiles = image->sparseTiles();
+  EXPECT_TRUE(tiles->isEmptyTile(0, 0));
+
+  // The other tiles of an old index are not scanned with the new
+  // pixels (they are considered non-empty)
+  image->putPixel(0, 0, rgba(255, 0, 0, 255));
+  EXPECT_TRUE(tiles->isEmptyTile(0, 0));
+  EXPECT_FALSE(tiles->isEmptyTile(1, 0));
+
+  tiles = image->sparseTiles();
+  EXPECT_FALSE(tiles->isEmptyTile(0, 0));
+  EXPECT_TRUE(tiles->isEmptyTile(1, 0));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
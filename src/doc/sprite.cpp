@@ -444,25 +444,34 @@ RgbMap* Sprite::rgbMap(const frame_t frame,
                        const RgbMapAlgorithm mapAlgo,
                        const FitCriteria fitCriteria) const
 {
-  if (!m_rgbMap ||
-      m_rgbMap->rgbmapAlgorithm() != mapAlgo ||
-      m_rgbMap->fitCriteria() != fitCriteria) {
+  return rgbMap(frame, forLayer, mapAlgo, fitCriteria, m_rgbMap);
+}
+
+RgbMap* Sprite::rgbMap(const frame_t frame,
+                       const RgbMapFor forLayer,
+                       const RgbMapAlgorithm mapAlgo,
+                       const FitCriteria fitCriteria,
+                       std::unique_ptr<RgbMap>& rgbmap) const
+{
+  if (!rgbmap ||
+      rgbmap->rgbmapAlgorithm() != mapAlgo ||
+      rgbmap->fitCriteria() != fitCriteria) {
     switch (mapAlgo) {
-      case RgbMapAlgorithm::RGB5A3: m_rgbMap.reset(new RgbMapRGB5A3); break;
+      case RgbMapAlgorithm::RGB5A3: rgbmap.reset(new RgbMapRGB5A3); break;
       case RgbMapAlgorithm::DEFAULT:
-      case RgbMapAlgorithm::OCTREE: m_rgbMap.reset(new OctreeMap); break;
+      case RgbMapAlgorithm::OCTREE: rgbmap.reset(new OctreeMap); break;
       default:
-        m_rgbMap.reset(nullptr);
+        rgbmap.reset(nullptr);
         ASSERT(false);
         return nullptr;
     }
-    m_rgbMap->fitCriteria(fitCriteria);
+    rgbmap->fitCriteria(fitCriteria);
   }
   int maskIndex = palette(frame)->findMaskColor();
   maskIndex = (maskIndex == -1 ? (forLayer == RgbMapFor::OpaqueLayer ? -1: 0):
                                  maskIndex);
-  m_rgbMap->regenerateMap(palette(frame), maskIndex, fitCriteria);
-  return m_rgbMap.get();
+  rgbmap->regenerateMap(palette(frame), maskIndex, fitCriteria);
+  return rgbmap.get();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -171,6 +171,15 @@ namespace doc {
                    const RgbMapAlgorithm mapAlgo,
                    const FitCriteria fitCriteria = FitCriteria::DEFAULT) const;
 
+    // Same as rgbMap() but it creates/regenerates the given "rgbmap"
+    // instead of the one cached in the sprite. It can be used from
+    // several threads at the same time (one "rgbmap" per thread).
+    RgbMap* rgbMap(const frame_t frame,
+                   const RgbMapFor forLayer,
+                   const RgbMapAlgorithm mapAlgo,
+                   const FitCriteria fitCriteria,
+                   std::unique_ptr<RgbMap>& rgbmap) const;
+
     ////////////////////////////////////////
     // Frames
 
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A
+// Copyright (c) 2019-2024  Igara Studio S.A
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +11,7 @@
 
 #include "render/error_diffusion.h"
 
+#include "doc/parallel.h"
 #include "gfx/hsl.h"
 #include "gfx/rgb.h"
 
@@ -18,8 +19,14 @@
 
 namespace render {
 
+// Images with less pixels are processed with a serpentine scan from
+// one thread (it gives better results than the wavefront, where all
+// rows go from left to right).
+const int kMinPixelsForWavefront = 256*256;
+
 ErrorDiffusionDither::ErrorDiffusionDither(int transparentIndex)
   : m_transparentIndex(transparentIndex)
+  , m_parallelRows(1)
 {
 }
 
@@ -30,9 +37,18 @@ void ErrorDiffusionDither::start(
 {
   m_srcImage = srcImage;
   m_width = 2+srcImage->width();
-  for (int i=0; i<kChannels; ++i)
-    m_err[i].resize(m_width*2, 0);
-  m_lastY = -1;
+  m_parallelRows =
+    (srcImage->width() * srcImage->height() < kMinPixelsForWavefront ?
+     1: doc::parallel_max_threads());
+
+  // While a row is being processed, the rows that are
+  // parallelRows() behind it could still be using their errors, and
+  // it writes the errors of the next row.
+  m_rows = parallelRows() + 2;
+  for (int i=0; i<kChannels; ++i) {
+    m_err[i].clear();
+    m_err[i].resize(m_width*m_rows, 0);
+  }
   m_factor = int(factor * 100.0);
 }
 
@@ -45,15 +61,16 @@ doc::color_t ErrorDiffusionDither::ditherRgbToIndex2D(
   const doc::RgbMap* rgbmap,
   const doc::Palette* palette)
 {
-  if (y != m_lastY) {
-    for (int i=0; i<kChannels; ++i) {
-      int* row0 = &m_err[i][0];
-      int* row1 = row0 + m_width;
-      int* end1 = row1 + m_width;
-      std::copy(row1, end1, row0);
-      std::fill(row1, end1, 0);
-    }
-    m_lastY = y;
+  const int row0 = (y % m_rows) * m_width;
+  const int row1 = ((y+1) % m_rows) * m_width;
+
+  // Odd rows go from right to left in the serpentine scan
+  const bool rightToLeft = (m_parallelRows == 1 && (y & 1));
+
+  // Clear the errors of the next row when we start a new row
+  if (x == (rightToLeft ? m_srcImage->width()-1: 0)) {
+    for (int i=0; i<kChannels; ++i)
+      std::fill(&m_err[i][row1], &m_err[i][row1] + m_width, 0);
   }
 
   doc::color_t color =
@@ -67,7 +84,7 @@ doc::color_t ErrorDiffusionDither::ditherRgbToIndex2D(
     doc::rgba_geta(color)
   };
   for (int i=0; i<kChannels; ++i) {
-    v[i] += m_err[i][x+1];
+    v[i] += m_err[i][row0+x+1];
     v[i] = std::clamp(v[i], 0, 255);
   }
 
@@ -90,24 +107,25 @@ doc::color_t ErrorDiffusionDither::ditherRgbToIndex2D(
 
   // TODO using Floyd-Steinberg matrix here but it should be configurable
   for (int i=0; i<kChannels; ++i) {
-    int* err = &m_err[i][x];
+    int* err0 = &m_err[i][row0+x];
+    int* err1 = &m_err[i][row1+x];
     const int q = quantError[i] * m_factor / 100;
     const int a = q * 7 / 16;
     const int b = q * 3 / 16;
     const int c = q * 5 / 16;
     const int d = q * 1 / 16;
 
-    if (y & 1) {
-      err[0        ] += a;
-      err[m_width+2] += b;
-      err[m_width+1] += c;
-      err[m_width  ] += d;
+    if (rightToLeft) {
+      err0[0] += a;
+      err1[2] += b;
+      err1[1] += c;
+      err1[0] += d;
     }
     else {
-      err[       +2] += a;
-      err[m_width  ] += b;
-      err[m_width+1] += c;
-      err[m_width+2] += d;
+      err0[2] += a;
+      err1[0] += b;
+      err1[1] += c;
+      err1[2] += d;
     }
   }
 
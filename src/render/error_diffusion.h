@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A
+// Copyright (c) 2019-2024 Igara Studio S.A
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -20,7 +20,8 @@ namespace render {
   public:
     ErrorDiffusionDither(int transparentIndex = -1);
     int dimensions() const override { return 2; }
-    bool zigZag() const override { return true; }
+    int parallelRows() const override { return m_parallelRows; }
+    int parallelRowsLag() const override { return 3; }
     void start(
       const doc::Image* srcImage,
       doc::Image* dstImage,
@@ -33,7 +34,10 @@ namespace render {
   private:
     int m_transparentIndex;
     const doc::Image* m_srcImage;
-    int m_width, m_lastY;
+    int m_width;
+    int m_parallelRows;
+    // The error of each row is in m_err[(y % m_rows)*m_width]
+    int m_rows;
     static const int kChannels = 4;
     std::vector<int> m_err[kChannels];
     int m_factor;
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,11 +11,17 @@
 
 #include "render/ordered_dither.h"
 
+#include "doc/parallel.h"
+#include "doc/primitives_fast.h"
 #include "render/dithering.h"
 #include "render/dithering_matrix.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace render {
@@ -227,6 +233,67 @@ doc::color_t OrderedDither2::ditherRgbPixelToIndex(
     return index;
 }
 
+namespace {
+
+// Min number of rows to dither in each thread with 1D algorithms.
+const int kMinRowsPerThread = 16;
+
+// RgbMap used by each thread to map colors with a shared RgbMap
+// (RgbMap::mapColor() can modify the RgbMap internals, so the shared
+// one is protected with a mutex). Each thread keeps a small cache
+// with the latest mapped colors.
+class RgbMapThreadCache : public doc::RgbMap {
+public:
+  RgbMapThreadCache(const doc::RgbMap* rgbmap,
+                    std::mutex& mutex)
+    : m_rgbmap(rgbmap)
+    , m_mutex(mutex)
+    , m_cache(kCacheSize) {
+  }
+
+  int mapColor(const doc::color_t rgba) const override {
+    Entry& entry = m_cache[(rgba * 2654435761u) >> (32 - kCacheBits)];
+    if (entry.index < 0 || entry.color != rgba) {
+      const std::lock_guard lock(m_mutex);
+      entry.color = rgba;
+      entry.index = m_rgbmap->mapColor(rgba);
+    }
+    return entry.index;
+  }
+
+  void regenerateMap(const doc::Palette* palette,
+                     const int maskIndex,
+                     const doc::FitCriteria fitCriteria) override {
+    ASSERT(false);
+  }
+  void regenerateMap(const doc::Palette* palette,
+                     const int maskIndex) override {
+    ASSERT(false);
+  }
+  int maskIndex() const override { return m_rgbmap->maskIndex(); }
+  doc::RgbMapAlgorithm rgbmapAlgorithm() const override { return m_rgbmap->rgbmapAlgorithm(); }
+  int modifications() const override { return m_rgbmap->modifications(); }
+  doc::FitCriteria fitCriteria() const override { return m_rgbmap->fitCriteria(); }
+  void fitCriteria(const doc::FitCriteria fitCriteria) override {
+    ASSERT(false);
+  }
+
+private:
+  static const int kCacheBits = 12;
+  static const int kCacheSize = (1 << kCacheBits);
+
+  struct Entry {
+    doc::color_t color = 0;
+    int index = -1;
+  };
+
+  const doc::RgbMap* m_rgbmap;
+  std::mutex& m_mutex;
+  mutable std::vector<Entry> m_cache;
+};
+
+} // anonymous namespace
+
 void dither_rgb_image_to_indexed(
   DitheringAlgorithmBase& algorithm,
   const Dithering& dithering,
@@ -239,67 +306,132 @@ void dither_rgb_image_to_indexed(
   const int w = srcImage->width();
   const int h = srcImage->height();
 
+  // Rows are written from different threads using the const version
+  // of the addresses, so pixels are unshared here
+  dstImage->unsharePixels();
+  const doc::Image* dstRows = dstImage;
+
   algorithm.start(srcImage, dstImage, dithering.factor());
 
+  std::mutex rgbmapMutex;
+  std::atomic<int> rowsDone(0);
+  std::atomic<bool> canceled(false);
+
+  // Checks if we can continue and notifies the progress, it's used
+  // only from the calling thread.
+  auto rowDone = [&]() {
+    ++rowsDone;
+    if (delegate) {
+      if (!delegate->continueTask())
+        canceled = true;
+      else
+        delegate->notifyTaskProgress(double(rowsDone) / double(h));
+    }
+  };
+
   if (algorithm.dimensions() == 1) {
-    const doc::LockImageBits<doc::RgbTraits> srcBits(srcImage);
-    doc::LockImageBits<doc::IndexedTraits> dstBits(dstImage);
-    auto srcIt = srcBits.begin();
-    auto dstIt = dstBits.begin();
-
-    for (int y=0; y<h; ++y) {
-      for (int x=0; x<w; ++x, ++srcIt, ++dstIt) {
-        ASSERT(srcIt != srcBits.end());
-        ASSERT(dstIt != dstBits.end());
-        *dstIt = algorithm.ditherRgbPixelToIndex(
-          dithering.matrix(), *srcIt, x, y, rgbmap, palette);
-
-        if (delegate) {
-          if (!delegate->continueTask())
-            return;
-        }
-      }
+    const DitheringMatrix matrix = dithering.matrix();
+
+    // Each thread dithers a range of rows
+    doc::parallel_ranges(
+      h, kMinRowsPerThread,
+      [&](const int begin, const int end) {
+        RgbMapThreadCache threadRgbmap(rgbmap, rgbmapMutex);
+        const doc::RgbMap* map = (rgbmap ? &threadRgbmap: nullptr);
+
+        for (int y=begin; y<end && !canceled; ++y) {
+          auto srcIt = (doc::RgbTraits::const_address_t)srcImage->getPixelAddress(0, y);
+          auto dstIt = doc::get_pixel_address_fast<doc::IndexedTraits>(dstRows, 0, y);
+          for (int x=0; x<w; ++x, ++srcIt, ++dstIt) {
+            *dstIt = algorithm.ditherRgbPixelToIndex(
+              matrix, *srcIt, x, y, map, palette);
+          }
 
-      if (delegate) {
-        delegate->notifyTaskProgress(
-          double(y+1) / double(h));
-      }
-    }
+          if (begin == 0)
+            rowDone();
+          else
+            ++rowsDone;
+        }
+      });
   }
-  else {
-    auto dstIt = doc::get_pixel_address_fast<doc::IndexedTraits>(dstImage, 0, 0);
-    const bool zigZag = algorithm.zigZag();
+  // Serpentine scan from the calling thread (small images or only
+  // one thread available)
+  else if (algorithm.parallelRows() == 1) {
+    auto dstIt = doc::get_pixel_address_fast<doc::IndexedTraits>(dstRows, 0, 0);
 
-    for (int y=0; y<h; ++y) {
-      if (zigZag && (y & 1)) { // Odd row: go from right-to-left
+    for (int y=0; y<h && !canceled; ++y) {
+      if (y & 1) {              // Odd row: go from right-to-left
         dstIt += w-1;
         for (int x=w-1; x>=0; --x, --dstIt) {
-          ASSERT(dstIt == doc::get_pixel_address_fast<doc::IndexedTraits>(dstImage, x, y));
+          ASSERT(dstIt == doc::get_pixel_address_fast<doc::IndexedTraits>(dstRows, x, y));
           *dstIt = algorithm.ditherRgbToIndex2D(x, y, rgbmap, palette);
-          if (delegate) {
-            if (!delegate->continueTask())
-              return;
-          }
         }
         dstIt += w+1;
       }
-      else {                    // Even row: go fromo left-to-right
+      else {                    // Even row: go from left-to-right
         for (int x=0; x<w; ++x, ++dstIt) {
-          ASSERT(dstIt == doc::get_pixel_address_fast<doc::IndexedTraits>(dstImage, x, y));
+          ASSERT(dstIt == doc::get_pixel_address_fast<doc::IndexedTraits>(dstRows, x, y));
           *dstIt = algorithm.ditherRgbToIndex2D(x, y, rgbmap, palette);
-
-          if (delegate) {
-            if (!delegate->continueTask())
-              return;
-          }
         }
       }
-      if (delegate) {
-        delegate->notifyTaskProgress(
-          double(y+1) / double(h));
-      }
+      rowDone();
     }
   }
+  // Wavefront: each thread takes the next row to process, going
+  // "lag" pixels behind the thread of the previous row. Rows are
+  // taken in order, so the previous row is always being processed by
+  // a running thread (chunks of the pool can start in any order).
+  else {
+    const int nthreads =
+      std::clamp(std::min(algorithm.parallelRows(),
+                          doc::parallel_max_threads()), 1, std::max(1, h));
+    const int lag = algorithm.parallelRowsLag();
+
+    // Number of processed pixels of each row
+    std::unique_ptr<std::atomic<int>[]> progress(new std::atomic<int>[h]);
+    for (int y=0; y<h; ++y)
+      progress[y] = 0;
+    std::atomic<int> nextRow(0);
+
+    doc::parallel_ranges(
+      nthreads, 1,
+      [&](const int begin, const int end) {
+        RgbMapThreadCache threadRgbmap(rgbmap, rgbmapMutex);
+        const doc::RgbMap* map = (rgbmap ? &threadRgbmap: nullptr);
+
+        for (int y=nextRow++; y<h && !canceled; y=nextRow++) {
+          auto dstIt = doc::get_pixel_address_fast<doc::IndexedTraits>(dstRows, 0, y);
+          int available = (y == 0 ? w: 0);
+
+          for (int x=0; x<w; ++x, ++dstIt) {
+            // Wait the previous row
+            const int needed = std::min(w, x+lag);
+            while (available < needed) {
+              available = progress[y-1].load(std::memory_order_acquire);
+              if (available < needed) {
+                if (canceled)
+                  return;
+                std::this_thread::yield();
+              }
+            }
+
+            *dstIt = algorithm.ditherRgbToIndex2D(x, y, map, palette);
+
+            if ((x & 15) == 15)
+              progress[y].store(x+1, std::memory_order_release);
+          }
+          progress[y].store(w, std::memory_order_release);
+
+          if (begin == 0)
+            rowDone();
+          else
+            ++rowsDone;
+        }
+      });
+  }
+
+  if (canceled)
+    return;
 
   algorithm.finish();
 }
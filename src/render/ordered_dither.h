@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -27,7 +27,15 @@ namespace render {
     virtual ~DitheringAlgorithmBase() { }
 
     virtual int dimensions() const { return 1; }
-    virtual bool zigZag() const { return false; }
+
+    // Max number of rows that ditherRgbToIndex2D() can process at
+    // the same time from different threads (only for 2D
+    // algorithms). Each row is processed parallelRowsLag() pixels
+    // behind the previous one. If it's 1 (it can be decided in
+    // start()), rows are processed in serpentine order: even rows
+    // from left to right and odd rows from right to left.
+    virtual int parallelRows() const { return 1; }
+    virtual int parallelRowsLag() const { return 0; }
 
     virtual void start(
       const doc::Image* srcImage,
@@ -36,6 +44,8 @@ namespace render {
 
     virtual void finish() { }
 
+    // Used by 1D algorithms, it's called from several threads at the
+    // same time (for different rows).
     virtual doc::color_t ditherRgbPixelToIndex(
       const DitheringMatrix& matrix,
       const doc::color_t color,
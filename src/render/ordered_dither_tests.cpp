@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,9 +11,17 @@
 
 #include <gtest/gtest.h>
 
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "render/dithering.h"
 #include "render/dithering_matrix.h"
+#include "render/error_diffusion.h"
 #include "render/ordered_dither.h"
 
+#include <memory>
+#include <vector>
+
 using namespace doc;
 using namespace render;
 
@@ -65,8 +73,126 @@ TEST(BayerMatrix, CheckD8)
       EXPECT_EQ(expected[c++], matrix(i, j));
 }
 
+TEST(ErrorDiffusion, ExactPaletteColors)
+{
+  Palette pal(frame_t(0), 4);
+  pal.setEntry(0, rgba(0, 0, 0, 255));
+  pal.setEntry(1, rgba(255, 0, 0, 255));
+  pal.setEntry(2, rgba(0, 255, 0, 255));
+  pal.setEntry(3, rgba(0, 0, 255, 255));
+
+  // Big enough to be processed by several threads
+  const int w = 97, h = 71;
+  std::unique_ptr<Image> src(Image::create(IMAGE_RGB, w, h));
+  std::unique_ptr<Image> dst(Image::create(IMAGE_INDEXED, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(src.get(), x, y, pal.getEntry((x/3 + y) & 3));
+
+  // Colors from the palette don't produce quantization error (see
+  // WavefrontMatchesSerialScan to compare images with errors)
+  ErrorDiffusionDither algorithm;
+  dither_rgb_image_to_indexed(
+    algorithm, Dithering(DitheringAlgorithm::ErrorDiffusion),
+    src.get(), dst.get(), nullptr, &pal, nullptr);
+
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      ASSERT_EQ((x/3 + y) & 3, get_pixel(dst.get(), x, y));
+}
+
+namespace {
+
+// Dithers "src" with error diffusion calling ditherRgbToIndex2D()
+// directly from one thread, rows are scanned in the same order used
+// by dither_rgb_image_to_indexed(): serpentine if parallelRows() is
+// 1, or from left to right.
+void serial_error_diffusion(const Image* src, Image* dst, const Palette& pal)
+{
+  ErrorDiffusionDither serial;
+  serial.start(src, dst, 1.0);
+  const bool serpentine = (serial.parallelRows() == 1);
+  for (int y=0; y<src->height(); ++y) {
+    if (serpentine && (y & 1)) {
+      for (int x=src->width()-1; x>=0; --x)
+        put_pixel(dst, x, y, serial.ditherRgbToIndex2D(x, y, nullptr, &pal));
+    }
+    else {
+      for (int x=0; x<src->width(); ++x)
+        put_pixel(dst, x, y, serial.ditherRgbToIndex2D(x, y, nullptr, &pal));
+    }
+  }
+  serial.finish();
+}
+
+void test_error_diffusion_scan(const int w, const int h)
+{
+  Palette pal(frame_t(0), 8);
+  for (int i=0; i<8; ++i)
+    pal.setEntry(i, rgba((i & 1) ? 255: 0,
+                         (i & 2) ? 255: 0,
+                         (i & 4) ? 255: 0, 255));
+
+  // Gradients (colors that are not in the palette) so the
+  // quantization error is propagated to the next pixels and rows
+  std::unique_ptr<Image> src(Image::create(IMAGE_RGB, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(src.get(), x, y,
+                rgba(255*x/w, 255*y/h, (x*7 + y*13) & 255, 255));
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_INDEXED, w, h));
+  serial_error_diffusion(src.get(), expected.get(), pal);
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_INDEXED, w, h));
+  ErrorDiffusionDither algorithm;
+  dither_rgb_image_to_indexed(
+    algorithm, Dithering(DitheringAlgorithm::ErrorDiffusion),
+    src.get(), dst.get(), nullptr, &pal, nullptr);
+
+  int colors = 0;
+  std::vector<bool> used(pal.size(), false);
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      const color_t c = get_pixel(dst.get(), x, y);
+      ASSERT_EQ(get_pixel(expected.get(), x, y), c) << "x=" << x << " y=" << y;
+      if (!used[c]) {
+        used[c] = true;
+        ++colors;
+      }
+    }
+  }
+  // The result is dithered (not just the nearest color)
+  EXPECT_EQ(pal.size(), colors);
+}
+
+} // anonymous namespace
+
+// Small images use a serpentine scan from one thread
+TEST(ErrorDiffusion, SmallImagesUseSerpentineScan)
+{
+  std::unique_ptr<Image> src(Image::create(IMAGE_RGB, 157, 93));
+  std::unique_ptr<Image> dst(Image::create(IMAGE_INDEXED, 157, 93));
+  ErrorDiffusionDither algorithm;
+  algorithm.start(src.get(), dst.get(), 1.0);
+  EXPECT_EQ(1, algorithm.parallelRows());
+  algorithm.finish();
+
+  test_error_diffusion_scan(157, 93);
+}
+
+// Big images use the wavefront (several rows at the same time from
+// different threads, each one from left to right) when there are
+// several threads available, the result must be equal to a serial
+// scan of all rows.
+TEST(ErrorDiffusion, WavefrontMatchesSerialScan)
+{
+  test_error_diffusion_scan(397, 253);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
+  Palette::initBestfit();
   return RUN_ALL_TESTS();
 }
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +15,7 @@
 #include "doc/layer.h"
 #include "doc/octree_map.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
@@ -25,9 +26,12 @@
 #include "render/task_delegate.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace render {
@@ -35,6 +39,86 @@ namespace render {
 using namespace doc;
 using namespace gfx;
 
+namespace {
+
+// Colors of the frames rendered by one thread in
+// create_palette_from_sprite().
+struct FramesHistogram {
+  // For RgbMapAlgorithm::RGB5A3
+  std::unique_ptr<PaletteOptimizer> optimizer;
+
+  // For RgbMapAlgorithm::OCTREE
+  OctreeMap octree;
+
+  // Exact colors and their number of pixels. They are used to create
+  // the 8-level octree (when the 7-level one doesn't have enough
+  // colors) without rendering all frames again. We stop counting
+  // them when there are too many colors (in that case the 8-level
+  // octree is not needed anyway).
+  std::unordered_map<color_t, std::size_t> exactColors;
+  bool tooManyColors = false;
+
+  void addColors(const color_t color,
+                 const std::size_t count,
+                 const std::size_t maxExactColors) {
+    if (tooManyColors) {
+      octree.addColor(color, 7, count);
+      return;
+    }
+
+    exactColors[color] += count;
+    if (exactColors.size() > maxExactColors) {
+      tooManyColors = true;
+      addExactColorsToOctree();
+      exactColors = std::unordered_map<color_t, std::size_t>();
+    }
+  }
+
+  void addExactColorsToOctree() {
+    for (const auto& it : exactColors)
+      octree.addColor(it.first, 7, it.second);
+  }
+
+  // Same as OctreeMap::feedWithImage() but counting runs of the
+  // same color.
+  void feedOctree(const Image* image,
+                  const bool withAlpha,
+                  const std::size_t maxExactColors) {
+    ASSERT(image->pixelFormat() == IMAGE_RGB);
+    const color_t forceFullOpacity = (withAlpha ? 0: rgba_a_mask);
+    color_t runColor = 0;
+    std::size_t runCount = 0;
+
+    for (int y=0; y<image->height(); ++y) {
+      auto p = (RgbTraits::const_address_t)image->getPixelAddress(0, y);
+      for (int x=0; x<image->width(); ++x, ++p) {
+        color_t color = *p;
+        if (!rgba_geta(color))
+          continue;
+
+        color |= forceFullOpacity;
+        if (runCount > 0 && color == runColor) {
+          ++runCount;
+        }
+        else {
+          if (runCount > 0)
+            addColors(runColor, runCount, maxExactColors);
+          runColor = color;
+          runCount = 1;
+        }
+      }
+    }
+    if (runCount > 0)
+      addColors(runColor, runCount, maxExactColors);
+  }
+};
+
+// Max number of threads for RgbMapAlgorithm::RGB5A3 (each thread
+// needs its own 16 MB histogram).
+const int kMaxOptimizerThreads = 4;
+
+} // anonymous namespace
+
 Palette* create_palette_from_sprite(
   const Sprite* sprite,
   const frame_t fromFrame,
@@ -49,9 +133,6 @@ Palette* create_palette_from_sprite(
    if (mapAlgo == doc::RgbMapAlgorithm::DEFAULT)
      mapAlgo = doc::RgbMapAlgorithm::OCTREE;
 
-  PaletteOptimizer optimizer;
-  OctreeMap octreemap;
-
   // Transparent color is needed if we have transparent layers
   int maskIndex;
   if ((sprite->backgroundLayer() && sprite->allLayersCount() == 1) ||
@@ -73,67 +154,144 @@ Palette* create_palette_from_sprite(
   if (!palette)
     palette = new Palette(fromFrame, 256);
 
-  // Add a flat image with the current sprite's frame rendered
-  ImageRef flat_image(Image::create(IMAGE_RGB,
-      sprite->width(), sprite->height()));
+  // Each 7-level octree leaf can contain up to 16 different colors,
+  // so if the 7-level octree cannot fill the palette, there are less
+  // than this number of exact colors.
+  const std::size_t maxExactColors = 16 * std::size_t(palette->size());
+
+  // Render and count the colors of consecutive ranges of frames in
+  // different threads. The calling thread handles the first range
+  // and notifies the progress to the delegate.
+  const int nframes = toFrame - fromFrame + 1;
+  const int minFramesPerThread =
+    (mapAlgo == RgbMapAlgorithm::RGB5A3 ?
+     (nframes + kMaxOptimizerThreads - 1) / kMaxOptimizerThreads: 1);
+  std::mutex mutex;
+  std::map<int, std::unique_ptr<FramesHistogram>> histograms;
+  std::atomic<int> renderedFrames(0);
+  std::atomic<bool> canceled(false);
+
+  auto countColors = [&](const int begin, const int end) {
+    auto histogram = std::make_unique<FramesHistogram>();
+    if (mapAlgo == RgbMapAlgorithm::RGB5A3)
+      histogram->optimizer = std::make_unique<PaletteOptimizer>();
+
+    ImageRef flat_image(Image::create(IMAGE_RGB,
+                                      sprite->width(), sprite->height()));
+    render::Render render;
+    render.setNewBlend(newBlend);
+
+    for (int i=begin; i<end && !canceled; ++i) {
+      render.renderSprite(flat_image.get(), sprite, fromFrame+i);
+
+      switch (mapAlgo) {
+        case RgbMapAlgorithm::RGB5A3:
+          histogram->optimizer->feedWithImage(flat_image.get(), withAlpha);
+          break;
+        case RgbMapAlgorithm::OCTREE:
+          histogram->feedOctree(flat_image.get(), withAlpha, maxExactColors);
+          break;
+        default:
+          ASSERT(false);
+          break;
+      }
+      ++renderedFrames;
+
+      // Only the calling thread can use the delegate
+      if (delegate && begin == 0) {
+        if (!delegate->continueTask())
+          canceled = true;
+        else
+          delegate->notifyTaskProgress(double(renderedFrames) / double(nframes));
+      }
+    }
 
-  render::Render render;
-  render.setNewBlend(newBlend);
+    if (!histogram->tooManyColors)
+      histogram->addExactColorsToOctree();
 
-  // Feed the optimizer with all rendered frames
-  for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-    render.renderSprite(flat_image.get(), sprite, frame);
+    const std::lock_guard lock(mutex);
+    histograms[begin] = std::move(histogram);
+  };
+
+  if (nframes > 0)
+    doc::parallel_ranges(nframes, minFramesPerThread, countColors);
+  else
+    countColors(0, 0);
 
+  if (canceled)
+    return nullptr;
+
+  // Join the histograms in frame order
+  auto it = histograms.begin();
+  FramesHistogram& result = *it->second;
+  bool tooManyColors = result.tooManyColors;
+  for (++it; it != histograms.end(); ++it) {
+    FramesHistogram& other = *it->second;
     switch (mapAlgo) {
       case RgbMapAlgorithm::RGB5A3:
-        optimizer.feedWithImage(flat_image.get(), withAlpha);
+        result.optimizer->merge(*other.optimizer);
         break;
       case RgbMapAlgorithm::OCTREE:
-        octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor);
+        result.octree.merge(other.octree);
+        if (other.tooManyColors)
+          tooManyColors = true;
+        else if (!tooManyColors) {
+          for (const auto& c : other.exactColors)
+            result.exactColors[c.first] += c.second;
+        }
         break;
       default:
-        ASSERT(false);
         break;
     }
-
-    if (delegate) {
-      if (!delegate->continueTask())
-        return nullptr;
-
-      delegate->notifyTaskProgress(
-        double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
-    }
   }
 
   switch (mapAlgo) {
 
     case RgbMapAlgorithm::RGB5A3: {
       // Generate an optimized palette
-      optimizer.calculate(palette, maskIndex);
+      result.optimizer->calculate(palette, maskIndex);
       break;
     }
 
-    case RgbMapAlgorithm::OCTREE:
+    case RgbMapAlgorithm::OCTREE: {
       // TODO check calculateWithTransparent flag
 
+      OctreeMap& octreemap = result.octree;
+      octreemap.setMaskColor(maskColor);
       if (!octreemap.makePalette(palette, palette->size())) {
         // We can use an 8-bit deep octree map, instead of 7-bit of the
         // first attempt.
         octreemap = OctreeMap();
-        for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-          render.renderSprite(flat_image.get(), sprite, frame);
-          octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor , 8);
-          if (delegate) {
-            if (!delegate->continueTask())
-              return nullptr;
-
-            delegate->notifyTaskProgress(
-              double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
+        octreemap.setMaskColor(maskColor);
+
+        // We should have all the exact colors, but if that's not the
+        // case, we render all frames again.
+        if (!tooManyColors) {
+          for (const auto& c : result.exactColors)
+            octreemap.addColor(c.first, 8, c.second);
+        }
+        else {
+          ImageRef flat_image(Image::create(IMAGE_RGB,
+                                            sprite->width(), sprite->height()));
+          render::Render render;
+          render.setNewBlend(newBlend);
+
+          for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
+            render.renderSprite(flat_image.get(), sprite, frame);
+            octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor , 8);
+            if (delegate) {
+              if (!delegate->continueTask())
+                return nullptr;
+
+              delegate->notifyTaskProgress(
+                double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
+            }
           }
         }
         octreemap.makePalette(palette, palette->size(), 8);
       }
       break;
+    }
   }
 
   return palette;
@@ -473,6 +631,13 @@ void PaletteOptimizer::feedWithRgbaColor(color_t color)
   m_histogram.addSamples(color, 1);
 }
 
+void PaletteOptimizer::merge(const PaletteOptimizer& other)
+{
+  m_histogram.merge(other.m_histogram);
+  if (other.m_withAlpha)
+    m_withAlpha = true;
+}
+
 void PaletteOptimizer::calculate(Palette* palette, int maskIndex)
 {
   bool addMask;
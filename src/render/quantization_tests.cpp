@@ -0,0 +1,106 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "render/quantization.h"
+
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+#include <memory>
+
+using namespace doc;
+using namespace render;
+
+namespace {
+
+const int kFrames = 24;
+
+color_t frame_color(const frame_t frame, const int i)
+{
+  return rgba(10*frame, 255 - 10*frame, 40*i, 255);
+}
+
+// Creates a sprite where each frame has two different colors.
+std::unique_ptr<Sprite> make_sprite()
+{
+  std::unique_ptr<Sprite> sprite(
+    Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 8, 8)));
+  sprite->setTotalFrames(kFrames);
+
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  for (frame_t frame=0; frame<kFrames; ++frame) {
+    Cel* cel = layer->cel(frame);
+    if (!cel) {
+      cel = new Cel(frame, ImageRef(Image::create(IMAGE_RGB, 8, 8)));
+      layer->addCel(cel);
+    }
+    Image* image = cel->image();
+    fill_rect(image, 0, 0, 7, 3, frame_color(frame, 0));
+    fill_rect(image, 0, 4, 7, 7, frame_color(frame, 1));
+  }
+  return sprite;
+}
+
+} // anonymous namespace
+
+TEST(Quantization, PaletteFromAllFramesWithOctree)
+{
+  auto sprite = make_sprite();
+  std::unique_ptr<Palette> palette(
+    create_palette_from_sprite(sprite.get(), 0, kFrames-1, false,
+                               nullptr, nullptr, true,
+                               RgbMapAlgorithm::OCTREE));
+  ASSERT_TRUE(palette != nullptr);
+
+  // Few colors: all of them must be in the palette
+  for (frame_t frame=0; frame<kFrames; ++frame) {
+    for (int i=0; i<2; ++i)
+      EXPECT_TRUE(palette->findExactMatch(frame_color(frame, i)));
+  }
+
+  // The result is deterministic
+  std::unique_ptr<Palette> palette2(
+    create_palette_from_sprite(sprite.get(), 0, kFrames-1, false,
+                               nullptr, nullptr, true,
+                               RgbMapAlgorithm::OCTREE));
+  ASSERT_EQ(palette->size(), palette2->size());
+  for (int i=0; i<palette->size(); ++i)
+    EXPECT_EQ(palette->getEntry(i), palette2->getEntry(i));
+}
+
+TEST(Quantization, PaletteFromAllFramesWithRgb5a3)
+{
+  auto sprite = make_sprite();
+  std::unique_ptr<Palette> palette(
+    create_palette_from_sprite(sprite.get(), 0, kFrames-1, false,
+                               nullptr, nullptr, true,
+                               RgbMapAlgorithm::RGB5A3));
+  ASSERT_TRUE(palette != nullptr);
+
+  // Colors in the same order they appear in frames (after the mask
+  // color in index 0)
+  ASSERT_EQ(1 + 2*kFrames, palette->size());
+  for (frame_t frame=0; frame<kFrames; ++frame) {
+    for (int i=0; i<2; ++i)
+      EXPECT_EQ(frame_color(frame, i), palette->getEntry(1 + 2*frame + i));
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -18,11 +18,13 @@
 #include "doc/layer_tilemap.h"
 #include "doc/playback.h"
 #include "doc/render_plan.h"
+#include "doc/sparse_tiles.h"
 #include "doc/tileset.h"
 #include "doc/tilesets.h"
 #include "gfx/clip.h"
 #include "gfx/region.h"
 
+#include <algorithm>
 #include <cmath>
 
 #define TRACE_RENDER_CEL(...) // TRACE
@@ -31,6 +33,12 @@ namespace render {
 
 namespace {
 
+// Maximum memory used to keep the flattened onion skin frames
+constexpr int64_t kMaxOnionskinCacheBytes = 256*1024*1024;
+
+// Maximum memory used to keep the flattened tilemaps
+constexpr int64_t kMaxTilemapCacheBytes = 256*1024*1024;
+
 //////////////////////////////////////////////////////////////////////
 // Scaled composite
 
@@ -335,6 +343,7 @@ void composite_image_general(
     return;
 
   BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, newBlend);
+  dst->unsharePixels();
 
   gfx::Rect dstBounds(
     area.dstBounds().x, area.dstBounds().y,
@@ -410,6 +419,7 @@ void composite_image_general_with_tile_flags(
     return;
 
   BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, newBlend);
+  dst->unsharePixels();
 
   gfx::Rect dstBounds(
     area.dstBounds().x, area.dstBounds().y,
@@ -524,6 +534,77 @@ bool has_visible_reference_layers(const LayerGroup* group)
   return false;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Tilemaps
+
+// Adds the id/version of each tile image of the tileset to
+// "versions", to know when the tileset images are modified.
+void get_tileset_versions(const Tileset* tileset,
+                          std::vector<uint64_t>& versions)
+{
+  for (tile_index i=0; i<tileset->size(); ++i) {
+    const ImageRef tile = tileset->get(i);
+    versions.push_back(tile ? uint64_t(tile->id()): 0);
+    versions.push_back(tile ? tile->pixelsVersion(): 0);
+  }
+}
+
+template<typename ImageTraits>
+void copy_flipped_tile_templ(Image* dst, const Image* tile,
+                             const int x, const int y,
+                             const tile_flags tileFlags)
+{
+  const int w = tile->width();
+  const int h = tile->height();
+  const gfx::Rect bounds =
+    gfx::Rect(x, y, w, h) & dst->bounds();
+  dst->unsharePixels();
+
+  // With a diagonal flip only the square part of the tile can be
+  // used, pixels outside this square are transparent.
+  gfx::Size minSize = tile->size();
+  if (tileFlags & tile_f_dflip)
+    minSize.w = minSize.h = std::min(w, h);
+
+  for (int v=bounds.y-y; v<bounds.y2()-y; ++v) {
+    for (int u=bounds.x-x; u<bounds.x2()-x; ++u) {
+      int srcX = (tileFlags & tile_f_xflip ? w-1-u: u);
+      int srcY = (tileFlags & tile_f_yflip ? h-1-v: v);
+      if (tileFlags & tile_f_dflip)
+        std::swap(srcX, srcY);
+
+      put_pixel_fast<ImageTraits>(
+        dst, x+u, y+v,
+        (srcX < minSize.w && srcY < minSize.h ?
+         get_pixel_fast<ImageTraits>(tile, srcX, srcY):
+         tile->maskColor()));
+    }
+  }
+}
+
+// Copies the "tile" image in the (x, y) position of "dst" applying
+// the flips of the given tile flags.
+void copy_flipped_tile(Image* dst, const Image* tile,
+                       const int x, const int y,
+                       const tile_flags tileFlags)
+{
+  ASSERT(dst->pixelFormat() == tile->pixelFormat());
+
+  if (!tileFlags) {
+    dst->copy(tile, gfx::Clip(x, y, tile->bounds()));
+    return;
+  }
+
+  switch (tile->pixelFormat()) {
+    case IMAGE_RGB:       copy_flipped_tile_templ<RgbTraits>(dst, tile, x, y, tileFlags); break;
+    case IMAGE_GRAYSCALE: copy_flipped_tile_templ<GrayscaleTraits>(dst, tile, x, y, tileFlags); break;
+    case IMAGE_INDEXED:   copy_flipped_tile_templ<IndexedTraits>(dst, tile, x, y, tileFlags); break;
+    default:
+      ASSERT(false);
+      break;
+  }
+}
+
 } // anonymous namespace
 
 Render::Render()
@@ -536,6 +617,7 @@ Render::Render()
   , m_extraCel(nullptr)
   , m_extraImage(nullptr)
   , m_newBlendMethod(true)
+  , m_cacheTilemaps(false)
   , m_globalOpacity(255)
   , m_selectedLayerForOpacity(nullptr)
   , m_selectedLayer(nullptr)
@@ -580,6 +662,13 @@ void Render::setSelectedLayer(const Layer* layer)
   m_selectedLayerForOpacity = layer;
 }
 
+void Render::setCacheTilemaps(const bool state)
+{
+  m_cacheTilemaps = state;
+  if (!state)
+    m_tilemapImages.clear();
+}
+
 void Render::setPreviewImage(const Layer* layer,
                              const frame_t frame,
                              const Image* image,
@@ -884,19 +973,353 @@ void Render::renderOnionskin(
         else if (m_onionskin.type() == OnionskinType::RED_BLUE_TINT)
           blendMode = (frameOut < frame ? BlendMode::RED_TINT: BlendMode::BLUE_TINT);
 
+        // Render background only for "in-front" onion skinning and
+        // when opacity is < 255
+        const bool render_background =
+          (m_globalOpacity < 255 &&
+           m_onionskin.position() == OnionskinPosition::INFRONT);
+
         doc::RenderPlan plan;
         plan.addLayer(onionLayer, frameIn);
-        renderPlan(
-          plan, dstImage,
-          area, frameIn, compositeImage,
-          // Render background only for "in-front" onion skinning and
-          // when opacity is < 255
-          (m_globalOpacity < 255 &&
-           m_onionskin.position() == OnionskinPosition::INFRONT),
-          true, blendMode);
+
+        // Blend the flattened frame (cached from previous calls), so
+        // we don't need to composite all its layers again. The
+        // opacity and tint are applied once to the whole frame
+        // (flattened with the blend mode of each layer), so hidden
+        // parts of the bottom layers are not visible in the onion
+        // skin.
+        if (const Image* flatImage = getOnionskinFrame(
+              plan, dstImage, frameIn, render_background)) {
+          renderImage(
+            dstImage, flatImage, m_sprite->palette(frameIn),
+            gfx::RectF(flatImage->bounds()), area,
+            getImageComposition(dstImage->pixelFormat(),
+                                flatImage->pixelFormat(), nullptr),
+            m_globalOpacity,
+            (blendMode == BlendMode::UNSPECIFIED ? BlendMode::NORMAL:
+                                                   blendMode));
+        }
+        else {
+          renderPlan(
+            plan, dstImage,
+            area, frameIn, compositeImage,
+            render_background, true, blendMode);
+        }
       }
     }
   }
+
+  // Discard flattened frames that weren't used in this call (e.g. far
+  // away frames after moving to other frame)
+  m_onionskinFrames.erase(
+    std::remove_if(m_onionskinFrames.begin(),
+                   m_onionskinFrames.end(),
+                   [](const OnionskinFrame& f) { return !f.used; }),
+    m_onionskinFrames.end());
+  for (auto& f : m_onionskinFrames)
+    f.used = false;
+}
+
+const Image* Render::getOnionskinFrame(
+  const RenderPlan& plan,
+  const Image* dstImage,
+  const frame_t frame,
+  const bool render_background)
+{
+  // Only RGB destinations can blend the flattened frame with any
+  // opacity/tint.
+  if (dstImage->pixelFormat() != IMAGE_RGB)
+    return nullptr;
+
+  std::vector<uint64_t> key;
+  if (!getOnionskinFrameKey(plan, frame, render_background, key))
+    return nullptr;
+
+  OnionskinFrame* entry = nullptr;
+  int64_t usedBytes = 0;
+  for (auto& f : m_onionskinFrames) {
+    if (f.frame == frame && f.background == render_background)
+      entry = &f;
+    else if (f.used)
+      usedBytes += f.image->getMemSize();
+  }
+
+  const int w = m_sprite->width();
+  const int h = m_sprite->height();
+  if (entry &&
+      entry->key == key &&
+      entry->image->width() == w &&
+      entry->image->height() == h) {
+    entry->used = true;
+    return entry->image.get();
+  }
+
+  // Don't keep too many big frames in memory
+  if (usedBytes + int64_t(w) * h * RgbTraits::bytes_per_pixel > kMaxOnionskinCacheBytes)
+    return nullptr;
+
+  if (!entry) {
+    m_onionskinFrames.push_back(OnionskinFrame());
+    entry = &m_onionskinFrames.back();
+    entry->frame = frame;
+    entry->background = render_background;
+  }
+  if (!entry->image ||
+      entry->image->width() != w ||
+      entry->image->height() != h) {
+    entry->image.reset(Image::create(IMAGE_RGB, w, h));
+  }
+  entry->key = std::move(key);
+  entry->used = true;
+
+  // Render all layers of the frame with the original size and
+  // opacity (the zoom, opacity, and tint are applied when the
+  // flattened image is blended in renderOnionskin()).
+  Image* flatImage = entry->image.get();
+  flatImage->clear(0);
+
+  const Projection proj = m_proj;
+  const int globalOpacity = m_globalOpacity;
+  m_proj = Projection();
+  m_globalOpacity = 255;
+
+  CompositeImageFunc compositeImage =
+    getImageComposition(IMAGE_RGB, m_sprite->pixelFormat(), nullptr);
+  if (compositeImage) {
+    renderPlan(const_cast<RenderPlan&>(plan), flatImage,
+               gfx::Clip(flatImage->bounds()), frame, compositeImage,
+               render_background, true, BlendMode::UNSPECIFIED);
+  }
+
+  m_proj = proj;
+  m_globalOpacity = globalOpacity;
+  return flatImage;
+}
+
+bool Render::getOnionskinFrameKey(
+  const RenderPlan& plan,
+  const frame_t frame,
+  const bool render_background,
+  std::vector<uint64_t>& key) const
+{
+  const Palette* pal = m_sprite->palette(frame);
+  key = {
+    uint64_t(m_flags),
+    uint64_t(m_newBlendMethod),
+    uint64_t(m_nonactiveLayersOpacity),
+    uint64_t(m_nonactiveLayersOpacity != 255 && m_selectedLayerForOpacity ?
+             m_selectedLayerForOpacity->id(): 0),
+    uint64_t(m_sprite->transparentColor()),
+    uint64_t(pal->id()),
+    uint64_t(pal->getModifications())
+  };
+
+  for (const auto& item : plan.items()) {
+    const Layer* layer = item.layer;
+    if (!layer->isImage() ||
+        (!render_background &&  layer->isBackground()))
+      continue;
+
+    if (layer->isReference()) {
+      // Reference layers are rendered with sub-pixel precision, they
+      // cannot be flattened with the original sprite size.
+      if (m_flags & Flags::ShowRefLayers)
+        return false;
+      continue;
+    }
+
+    const Cel* cel = (item.cel ? item.cel: layer->cel(frame));
+    if (!cel || !cel->image())
+      continue;
+
+    // The preview image or extra cel can be visible in linked cels,
+    // these frames change while we paint so we don't cache them.
+    if ((m_previewImage || m_previewTileset) &&
+        checkIfWeShouldUsePreview(cel))
+      return false;
+    if (m_extraCel && m_extraImage && layer == m_currentLayer) {
+      const Cel* cel2 = layer->cel(m_extraCel->frame());
+      if (cel2 && cel2->data() == cel->data())
+        return false;
+    }
+
+    const auto imgLayer = static_cast<const LayerImage*>(layer);
+    const Image* image = cel->image();
+    key.insert(key.end(), {
+      uint64_t(layer->id()),
+      uint64_t(imgLayer->opacity()),
+      uint64_t(imgLayer->blendMode()),
+      uint64_t(cel->opacity()),
+      uint64_t(uint32_t(cel->x())),
+      uint64_t(uint32_t(cel->y())),
+      uint64_t(image->id()),
+      image->pixelsVersion(),
+      uint64_t(image->maskColor())
+    });
+
+    // Tilemaps depend on the tileset images
+    if (layer->isTilemap()) {
+      const Tileset* tileset = static_cast<const LayerTilemap*>(layer)->tileset();
+      if (!tileset)
+        continue;
+
+      const Grid& grid = tileset->grid();
+      key.insert(key.end(), {
+        uint64_t(tileset->id()),
+        uint64_t(tileset->size()),
+        uint64_t(uint32_t(grid.origin().x)),
+        uint64_t(uint32_t(grid.origin().y)),
+        uint64_t(uint32_t(grid.tileSize().w)),
+        uint64_t(uint32_t(grid.tileSize().h))
+      });
+      get_tileset_versions(tileset, key);
+    }
+  }
+  return true;
+}
+
+const Image* Render::getTilemapImage(
+  const Image* tilemap,
+  const Tileset* tileset,
+  const Sprite* sprite,
+  const gfx::Size& tileSize)
+{
+  const int w = tilemap->width() * tileSize.w;
+  const int h = tilemap->height() * tileSize.h;
+  if (w < 1 || h < 1)
+    return nullptr;
+
+  const PixelFormat pixelFormat = sprite->pixelFormat();
+  const color_t maskColor = sprite->transparentColor();
+  const int64_t bytes = int64_t(w) * h * bytes_per_pixel_for_colormode(ColorMode(pixelFormat));
+
+  auto isEntry = [tilemap, tileset](const TilemapImage& entry) {
+    return (entry.tilemapId == tilemap->id() &&
+            entry.tilesetId == tileset->id());
+  };
+
+  // Discard the least recently used tilemaps to keep the memory limit
+  int64_t usedBytes = 0;
+  for (const auto& entry : m_tilemapImages) {
+    if (!isEntry(entry))
+      usedBytes += entry.image->getMemSize();
+  }
+  while (usedBytes + bytes > kMaxTilemapCacheBytes) {
+    auto lru = m_tilemapImages.end();
+    for (auto it=m_tilemapImages.begin(); it!=m_tilemapImages.end(); ++it) {
+      if (!isEntry(*it) &&
+          (lru == m_tilemapImages.end() || it->lastUse < lru->lastUse))
+        lru = it;
+    }
+    // This tilemap alone is too big to be cached
+    if (lru == m_tilemapImages.end())
+      return nullptr;
+
+    usedBytes -= lru->image->getMemSize();
+    m_tilemapImages.erase(lru);
+  }
+
+  auto it = std::find_if(m_tilemapImages.begin(),
+                         m_tilemapImages.end(), isEntry);
+  TilemapImage* entry;
+  if (it != m_tilemapImages.end()) {
+    entry = &(*it);
+  }
+  else {
+    m_tilemapImages.push_back(TilemapImage());
+    entry = &m_tilemapImages.back();
+    entry->tilemapId = tilemap->id();
+    entry->tilesetId = tileset->id();
+  }
+  entry->lastUse = ++m_tilemapImagesUse;
+
+  Image* image = entry->image.get();
+  if (!image ||
+      image->pixelFormat() != pixelFormat ||
+      image->width() != w ||
+      image->height() != h ||
+      image->maskColor() != maskColor) {
+    image = Image::create(pixelFormat, w, h);
+    image->setMaskColor(maskColor);
+    image->clear(maskColor);
+    entry->image.reset(image);
+    entry->tiles.assign(std::size_t(tilemap->width()) * tilemap->height(), notile);
+    entry->versions.clear();
+  }
+
+  // Tileset images that were modified since the last call (or that
+  // were added/removed from the tileset)
+  std::vector<uint64_t> versions;
+  get_tileset_versions(tileset, versions);
+  std::vector<bool> modified(std::max(versions.size(), entry->versions.size()) / 2, false);
+  for (std::size_t i=0; i<modified.size(); ++i) {
+    modified[i] = (2*i+1 >= versions.size() ||
+                   2*i+1 >= entry->versions.size() ||
+                   versions[2*i] != entry->versions[2*i] ||
+                   versions[2*i+1] != entry->versions[2*i+1]);
+  }
+  entry->versions = std::move(versions);
+
+  // Copy the tiles of the cells that were modified
+  std::size_t k = 0;
+  for (int v=0; v<tilemap->height(); ++v) {
+    const tile_t* tilemapPtr = get_pixel_address_fast<TilemapTraits>(tilemap, 0, v);
+    for (int u=0; u<tilemap->width(); ++u, ++k, ++tilemapPtr) {
+      const tile_t t = *tilemapPtr;
+      const tile_index i = tile_geti(t);
+      if (t == entry->tiles[k] &&
+          (t == notile || i >= modified.size() || !modified[i]))
+        continue;
+
+      entry->tiles[k] = t;
+
+      const gfx::Rect cellBounds(u*tileSize.w, v*tileSize.h,
+                                 tileSize.w, tileSize.h);
+      const ImageRef tile = (t != notile ? tileset->get(i): ImageRef(nullptr));
+      if (!tile || tile->size() != tileSize)
+        fill_rect(image, cellBounds, maskColor);
+      if (tile)
+        copy_flipped_tile(image, tile.get(), cellBounds.x, cellBounds.y, tile_getf(t));
+    }
+  }
+
+  return image;
+}
+
+void Render::updateFlippedTiles(const Tileset* tileset)
+{
+  std::vector<uint64_t> versions;
+  get_tileset_versions(tileset, versions);
+
+  if (m_flippedTiles.tilesetId != tileset->id() ||
+      m_flippedTiles.versions != versions) {
+    m_flippedTiles.tilesetId = tileset->id();
+    m_flippedTiles.versions = std::move(versions);
+    m_flippedTiles.tiles.clear();
+  }
+}
+
+const Image* Render::getFlippedTile(
+  const Tileset* tileset,
+  const tile_t t)
+{
+  ASSERT(m_flippedTiles.tilesetId == tileset->id());
+
+  const ImageRef tile = tileset->get(tile_geti(t));
+  if (!tile)
+    return nullptr;
+
+  const tile_flags flags = tile_getf(t);
+  if (!flags)
+    return tile.get();
+
+  ImageRef& flipped = m_flippedTiles.tiles[t];
+  if (!flipped) {
+    flipped.reset(Image::create(tile->pixelFormat(), tile->width(), tile->height()));
+    flipped->setMaskColor(tile->maskColor());
+    copy_flipped_tile(flipped.get(), tile.get(), 0, 0, flags);
+  }
+  return flipped.get();
 }
 
 void Render::renderCheckeredBackground(
@@ -1245,6 +1668,29 @@ void Render::renderCel(
         return;
     }
 
+    // Render the whole tilemap as a regular image (a cached image
+    // where only modified cells are copied again), so drawing a
+    // tilemap costs the same as drawing an image layer. This is
+    // possible only when tiles don't overlap and we are rendering
+    // the tilemap of the cel (not a preview/extra image that changes
+    // while we paint).
+    if (m_cacheTilemaps &&
+        dst_image->pixelFormat() != IMAGE_TILEMAP &&
+        blendMode != BlendMode::SRC &&
+        cel && cel_image == cel->image() &&
+        tileset != m_previewTileset &&
+        grid.tileOffset() == gfx::Point(grid.tileSize().w, grid.tileSize().h) &&
+        grid.oddRowOffset() == gfx::Point(0, 0) &&
+        grid.oddColOffset() == gfx::Point(0, 0)) {
+      if (const Image* tilemapImage = getTilemapImage(
+            cel_image, tileset, cel_layer->sprite(), grid.tileSize())) {
+        renderImage(dst_image, tilemapImage, pal,
+                    gfx::RectF(grid.tileToCanvas(cel_image->bounds())),
+                    area, compositeImage, opacity, blendMode);
+        return;
+      }
+    }
+
     gfx::Rect tilesToDraw = grid.canvasToTile(
       m_proj.remove(gfx::Rect(area.src, area.size)));
 
@@ -1266,6 +1712,9 @@ void Render::renderCel(
     TRACE_RENDER_CEL("Drawing tilemap (%d %d %d %d)\n",
                      tilesToDraw.x, tilesToDraw.y, tilesToDraw.w, tilesToDraw.h);
 
+    if (dst_image->pixelFormat() != IMAGE_TILEMAP)
+      updateFlippedTiles(tileset);
+
     for (int v=tilesToDraw.y; v<tilesToDraw.y2(); ++v) {
       for (int u=tilesToDraw.x; u<tilesToDraw.x2(); ++u) {
         auto tileBoundsOnCanvas = grid.tileToCanvas(gfx::Rect(u, v, 1, 1));
@@ -1277,18 +1726,18 @@ void Render::renderCel(
 
         const tile_t t = cel_image->getPixel(u, v);
         if (t != doc::notile) {
-          const tile_index i = tile_geti(t);
-
           if (dst_image->pixelFormat() == IMAGE_TILEMAP) {
             put_pixel(dst_image, u-area.dst.x, v-area.dst.y, t);
           }
           else {
-            const ImageRef tile_image = tileset->get(i);
+            // Flipped tiles are cached, so they can be rendered
+            // with the fast composite functions
+            const Image* tile_image = getFlippedTile(tileset, t);
             if (!tile_image)
               continue;
 
-            renderImage(dst_image, tile_image.get(), pal, tileBoundsOnCanvas,
-                        area, compositeImage, opacity, blendMode, tile_getf(t));
+            renderImage(dst_image, tile_image, pal, tileBoundsOnCanvas,
+                        area, compositeImage, opacity, blendMode);
           }
         }
       }
@@ -1324,6 +1773,86 @@ void Render::renderImage(
       nullptr, tileFlags);
   }
 
+  const double scaleX = m_proj.scaleX() * celBounds.w / double(cel_image->width());
+  const double scaleY = m_proj.scaleY() * celBounds.h / double(cel_image->height());
+
+  // Skip the empty tiles of mostly transparent cels. Pixels equal to
+  // the mask color are ignored by the blenders anyway (see
+  // BlenderHelper), so we can composite only the rectangles of
+  // non-empty tiles. This is done only for integral zoom levels
+  // where each source pixel is mapped to a whole number of
+  // destination pixels (so the result is exactly the same).
+  if (!tileFlags &&
+      dst_image->pixelFormat() == IMAGE_RGB &&
+      (cel_image->pixelFormat() == IMAGE_RGB ||
+       cel_image->pixelFormat() == IMAGE_GRAYSCALE ||
+       (cel_image->pixelFormat() == IMAGE_INDEXED &&
+        blendMode != BlendMode::SRC)) &&
+      scaleX >= 1.0 && scaleX == std::floor(scaleX) &&
+      scaleY >= 1.0 && scaleY == std::floor(scaleY) &&
+      scaledBounds.x == std::floor(scaledBounds.x) &&
+      scaledBounds.y == std::floor(scaledBounds.y)) {
+    const auto tiles = cel_image->sparseTiles();
+
+    // Only the tiles inside the rendered area are checked
+    const gfx::Rect range = tiles->tilesInBounds(
+      gfx::Rect(int(std::floor((srcBounds.x - scaledBounds.x) / scaleX)),
+                int(std::floor((srcBounds.y - scaledBounds.y) / scaleY)),
+                int(std::ceil(srcBounds.w / scaleX)) + 1,
+                int(std::ceil(srcBounds.h / scaleY)) + 1));
+
+    bool hasEmptyTiles = false;
+    for (int v=range.y; v<range.y2() && !hasEmptyTiles; ++v) {
+      for (int u=range.x; u<range.x2(); ++u) {
+        if (tiles->isEmptyTile(u, v)) {
+          hasEmptyTiles = true;
+          break;
+        }
+      }
+    }
+
+    if (hasEmptyTiles) {
+      for (int v=range.y; v<range.y2(); ++v) {
+        // Composite each run of non-empty tiles in this row
+        for (int u=range.x; u<range.x2(); ) {
+          if (tiles->isEmptyTile(u, v)) {
+            ++u;
+            continue;
+          }
+          const int u1 = u;
+          while (u < range.x2() && !tiles->isEmptyTile(u, v))
+            ++u;
+
+          const gfx::Rect rc = tiles->tilesBounds(u1, v, u-u1, 1);
+          const gfx::RectF bounds =
+            gfx::RectF(scaledBounds.x + rc.x*scaleX,
+                       scaledBounds.y + rc.y*scaleY,
+                       rc.w*scaleX,
+                       rc.h*scaleY).createIntersection(srcBounds);
+          if (bounds.isEmpty())
+            continue;
+
+          compositeImage(
+            dst_image, cel_image, pal,
+            gfx::ClipF(
+              double(area.dst.x) + bounds.x - double(area.src.x),
+              double(area.dst.y) + bounds.y - double(area.src.y),
+              bounds.x - scaledBounds.x,
+              bounds.y - scaledBounds.y,
+              bounds.w,
+              bounds.h),
+            opacity,
+            blendMode,
+            scaleX,
+            scaleY,
+            m_newBlendMethod,
+            tileFlags);
+        }
+      }
+      return;
+    }
+  }
+
   compositeImage(
     dst_image, cel_image, pal,
     gfx::ClipF(
@@ -1335,8 +1864,8 @@ void Render::renderImage(
       srcBounds.h),
     opacity,
     blendMode,
-    m_proj.scaleX() * celBounds.w / double(cel_image->width()),
-    m_proj.scaleY() * celBounds.h / double(cel_image->height()),
+    scaleX,
+    scaleY,
     m_newBlendMethod,
     tileFlags);
 }
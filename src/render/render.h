@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,6 +14,7 @@
 #include "doc/color.h"
 #include "doc/doc.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/pixel_format.h"
 #include "doc/tile.h"
 #include "gfx/clip.h"
@@ -24,6 +25,10 @@
 #include "render/onionskin_options.h"
 #include "render/projection.h"
 
+#include <cstdint>
+#include <map>
+#include <vector>
+
 namespace doc {
   class Cel;
   class Image;
@@ -64,6 +69,13 @@ namespace render {
     void setBgOptions(const BgOptions& bg);
     void setSelectedLayer(const Layer* layer);
 
+    // Keeps a flattened image of each rendered tilemap (only the
+    // modified cells are copied again in the next render). It uses
+    // a lot of memory for big tilemaps, so it's useful only for a
+    // renderer that paints the same tilemaps several times (e.g. the
+    // editor).
+    void setCacheTilemaps(const bool state);
+
     // Sets the preview image. This preview image is an alternative
     // image to be used for the given layer/frame.
     void setPreviewImage(const Layer* layer,
@@ -117,6 +129,17 @@ namespace render {
       Image* image,
       const gfx::Clip& area);
 
+    const Image* getTilemapImage(
+      const Image* tilemap,
+      const Tileset* tileset,
+      const Sprite* sprite,
+      const gfx::Size& tileSize);
+
+    void updateFlippedTiles(const Tileset* tileset);
+    const Image* getFlippedTile(
+      const Tileset* tileset,
+      const tile_t t);
+
     void renderImage(
       Image* dst_image,
       const Image* src_image,
@@ -161,6 +184,18 @@ namespace render {
       const frame_t frame,
       const CompositeImageFunc compositeImage);
 
+    const Image* getOnionskinFrame(
+      const doc::RenderPlan& plan,
+      const Image* dstImage,
+      const frame_t frame,
+      const bool render_background);
+
+    bool getOnionskinFrameKey(
+      const doc::RenderPlan& plan,
+      const frame_t frame,
+      const bool render_background,
+      std::vector<uint64_t>& key) const;
+
     void renderPlan(
       doc::RenderPlan& plan,
       Image* image,
@@ -213,6 +248,7 @@ namespace render {
     const Image* m_extraImage;
     BlendMode m_extraBlendMode;
     bool m_newBlendMethod;
+    bool m_cacheTilemaps;
     BgOptions m_bg;
     int m_globalOpacity;
     const Layer* m_selectedLayerForOpacity;
@@ -224,6 +260,43 @@ namespace render {
     BlendMode m_previewBlendMode;
     OnionskinOptions m_onionskin;
     ImageBufferPtr m_tmpBuf;
+
+    // Flattened frames used by renderOnionskin(). Each frame is
+    // rendered without opacity/tint and re-used while its key (the
+    // ids/versions of everything that is rendered in it) doesn't
+    // change.
+    struct OnionskinFrame {
+      frame_t frame = 0;
+      bool background = false;
+      bool used = false;
+      std::vector<uint64_t> key;
+      ImageRef image;
+    };
+    std::vector<OnionskinFrame> m_onionskinFrames;
+
+    // Tilemaps flattened in one image (each tile copied in its cell)
+    // to render them as regular images. When the tilemap or the
+    // tileset change, only the modified cells are copied again.
+    struct TilemapImage {
+      ObjectId tilemapId = NullId;
+      ObjectId tilesetId = NullId;
+      uint64_t lastUse = 0;
+      std::vector<tile_t> tiles;       // Tiles copied in each cell
+      std::vector<uint64_t> versions;  // Ids/versions of the tileset images
+      ImageRef image;
+    };
+    std::vector<TilemapImage> m_tilemapImages;
+    uint64_t m_tilemapImagesUse = 0;
+
+    // Tile images with the flips of the tile flags already applied
+    // (for tilemaps that cannot be flattened), discarded when the
+    // tileset images change.
+    struct FlippedTiles {
+      ObjectId tilesetId = NullId;
+      std::vector<uint64_t> versions;
+      std::map<tile_t, ImageRef> tiles;
+    };
+    FlippedTiles m_flippedTiles;
   };
 
   void composite_image(Image* dst,
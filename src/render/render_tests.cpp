@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,12 +13,16 @@
 
 #include "render/render.h"
 
+#include "doc/blend_funcs.h"
 #include "doc/cel.h"
 #include "doc/document.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
 
 #include <memory>
 
@@ -277,6 +281,270 @@ TEST(Render, BugWithMultiplesOf3ZoomFactors)
   }
 }
 
+TEST(Render, SkipEmptyTilesOfCels)
+{
+  // A big transparent cel with a few pixels in different tiles
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 300, 200)));
+  Image* src = doc->sprite()->root()->firstLayer()->cel(0)->image();
+  clear_image(src, 0);
+  put_pixel(src, 10, 10, rgba(255, 0, 0, 255));
+  put_pixel(src, 150, 70, rgba(0, 255, 0, 128));
+  put_pixel(src, 299, 199, rgba(0, 0, 255, 255));
+  fill_rect(src, 60, 130, 140, 135, rgba(255, 255, 0, 255));
+
+  const color_t bgColor = rgba(32, 64, 96, 255);
+  for (int zoom : { 1, 2, 3 }) {
+    const gfx::Clip area(0, 0, 5*zoom, 3*zoom, 280*zoom, 190*zoom);
+    std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+    clear_image(dst.get(), 0);
+
+    Render render;
+    BgOptions bg;
+    bg.type = BgType::CHECKERED;
+    bg.colorPixelFormat = IMAGE_RGB;
+    bg.color1 = bg.color2 = bgColor;
+    render.setBgOptions(bg);
+    render.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+    render.renderSprite(dst.get(), doc->sprite(), frame_t(0), area);
+
+    for (int y=0; y<dst->height(); ++y) {
+      for (int x=0; x<dst->width(); ++x) {
+        const color_t c = get_pixel(src, (x+area.src.x)/zoom, (y+area.src.y)/zoom);
+        const color_t expected =
+          (rgba_geta(c) == 0 ? bgColor:
+                               rgba_blender_normal(bgColor, c, 255));
+        ASSERT_EQ(expected, get_pixel(dst.get(), x, y))
+          << " zoom=" << zoom << " x=" << x << " y=" << y;
+      }
+    }
+  }
+}
+
+TEST(Render, OnionskinFramesAreUpdated)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 2, 2)));
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  Image* prev = layer->cel(0)->image();
+  clear_image(prev, 0);
+  put_pixel(prev, 0, 0, rgba(255, 0, 0, 255));
+
+  sprite->setTotalFrames(2);
+  ImageRef cur(Image::create(IMAGE_RGB, 2, 2));
+  clear_image(cur.get(), 0);
+  put_pixel(cur.get(), 1, 1, rgba(0, 255, 0, 255));
+  layer->addCel(new Cel(1, cur));
+
+  const color_t bgColor = rgba(255, 255, 255, 255);
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.colorPixelFormat = IMAGE_RGB;
+  bg.color1 = bg.color2 = bgColor;
+  render.setBgOptions(bg);
+
+  OnionskinOptions onionskin(OnionskinType::MERGE);
+  onionskin.prevFrames(1);
+  onionskin.opacityBase(255);
+  render.setOnionskin(onionskin);
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 2, 2));
+  auto renderFrame1 = [&]{
+    clear_image(dst.get(), 0);
+    render.renderSprite(dst.get(), sprite, frame_t(1));
+  };
+
+  renderFrame1();
+  EXPECT_2X2_PIXELS(dst.get(),
+                    rgba(255, 0, 0, 255), bgColor,
+                    bgColor, rgba(0, 255, 0, 255));
+
+  // The previous frame is rendered again when its pixels change
+  put_pixel(prev, 0, 0, rgba(0, 0, 255, 255));
+  renderFrame1();
+  EXPECT_2X2_PIXELS(dst.get(),
+                    rgba(0, 0, 255, 255), bgColor,
+                    bgColor, rgba(0, 255, 0, 255));
+
+  // Or when the cel is moved
+  layer->cel(0)->setPosition(1, 0);
+  renderFrame1();
+  EXPECT_2X2_PIXELS(dst.get(),
+                    bgColor, rgba(0, 0, 255, 255),
+                    bgColor, rgba(0, 255, 0, 255));
+
+  // Opacity is applied to the flattened frame
+  onionskin.opacityBase(128);
+  render.setOnionskin(onionskin);
+  renderFrame1();
+  EXPECT_2X2_PIXELS(dst.get(),
+                    bgColor, rgba_blender_normal(bgColor, rgba(0, 0, 255, 255), 128),
+                    bgColor, rgba(0, 255, 0, 255));
+}
+
+TEST(Render, OnionskinWithSeveralLayers)
+{
+  const color_t red = rgba(255, 0, 0, 255);
+  const color_t blue = rgba(0, 0, 255, 255);
+  const color_t bgColor = rgba(255, 255, 255, 255);
+
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 2, 2)));
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(2);
+
+  // Two layers in the previous frame, overlapped in the first pixel
+  LayerImage* bottom = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  clear_image(bottom->cel(0)->image(), 0);
+  put_pixel(bottom->cel(0)->image(), 0, 0, red);
+  put_pixel(bottom->cel(0)->image(), 1, 0, red);
+
+  LayerImage* top = new LayerImage(sprite);
+  sprite->root()->addLayer(top);
+  ImageRef topImage(Image::create(IMAGE_RGB, 2, 2));
+  clear_image(topImage.get(), 0);
+  put_pixel(topImage.get(), 0, 0, blue);
+  top->addCel(new Cel(0, topImage));
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.colorPixelFormat = IMAGE_RGB;
+  bg.color1 = bg.color2 = bgColor;
+  render.setBgOptions(bg);
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 2, 2));
+  auto renderFrame1 = [&](const OnionskinType type) {
+    OnionskinOptions onionskin(type);
+    onionskin.prevFrames(1);
+    onionskin.opacityBase(128);
+    render.setOnionskin(onionskin);
+
+    clear_image(dst.get(), 0);
+    render.renderSprite(dst.get(), sprite, frame_t(1));
+  };
+
+  // The onion skin opacity and tint are applied to the flattened
+  // frame (the top layer hides the bottom one), not to each layer
+  renderFrame1(OnionskinType::MERGE);
+  EXPECT_2X2_PIXELS(dst.get(),
+                    rgba_blender_normal(bgColor, blue, 128),
+                    rgba_blender_normal(bgColor, red, 128),
+                    bgColor, bgColor);
+
+  renderFrame1(OnionskinType::RED_BLUE_TINT);
+  EXPECT_2X2_PIXELS(dst.get(),
+                    rgba_blender_red_tint(bgColor, blue, 128),
+                    rgba_blender_red_tint(bgColor, red, 128),
+                    bgColor, bgColor);
+}
+
+TEST(Render, TilemapsWithFlippedTiles)
+{
+  const color_t a = rgba(255, 0, 0, 255);
+  const color_t b = rgba(0, 255, 0, 255);
+  const color_t c = rgba(0, 0, 255, 255);
+  const color_t d = rgba(255, 255, 0, 255);
+  const color_t bgColor = rgba(255, 255, 255, 255);
+
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 4, 4)));
+  Sprite* sprite = doc->sprite();
+  clear_image(sprite->root()->firstLayer()->cel(0)->image(), 0);
+
+  sprite->tilesets()->add(new Tileset(sprite, Grid(gfx::Size(2, 2)), 2));
+  LayerTilemap* layer = new LayerTilemap(sprite, 0);
+  sprite->root()->addLayer(layer);
+
+  ImageRef tilemapRef(Image::create(IMAGE_TILEMAP, 2, 2));
+  layer->addCel(new Cel(0, tilemapRef));
+  Image* tilemap = tilemapRef.get();
+  Image* tile = sprite->tilesets()->get(0)->get(1).get();
+  put_pixel(tile, 0, 0, a);
+  put_pixel(tile, 1, 0, b);
+  put_pixel(tile, 0, 1, c);
+  put_pixel(tile, 1, 1, d);
+
+  put_pixel(tilemap, 0, 0, doc::tile(1, 0));
+  put_pixel(tilemap, 1, 0, doc::tile(1, tile_f_xflip));
+  put_pixel(tilemap, 0, 1, doc::tile(1, tile_f_yflip));
+  put_pixel(tilemap, 1, 1, doc::tile(1, tile_f_dflip));
+
+  Render render;
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.colorPixelFormat = IMAGE_RGB;
+  bg.color1 = bg.color2 = bgColor;
+  render.setBgOptions(bg);
+  render.setCacheTilemaps(true);
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 4, 4));
+  std::unique_ptr<Image> dst2(Image::create(IMAGE_RGB, 4, 4));
+  std::unique_ptr<Image> dst3(Image::create(IMAGE_RGB, 4, 4));
+  auto renderTilemap = [&]{
+    // Flattened tilemap
+    clear_image(dst.get(), 0);
+    render.renderSprite(dst.get(), sprite, frame_t(0));
+
+    // Without the cache of flattened tilemaps (the default)
+    Render render2;
+    render2.setBgOptions(bg);
+    clear_image(dst3.get(), 0);
+    render2.renderSprite(dst3.get(), sprite, frame_t(0));
+    EXPECT_EQ(0, count_diff_between_images(dst.get(), dst3.get()));
+
+    // Tile by tile (tiles must be rendered one by one with the SRC
+    // blend mode)
+    clear_image(dst2.get(), bgColor);
+    render.renderCel(dst2.get(), layer->cel(0), sprite, tilemap, layer,
+                     sprite->palette(0), gfx::RectF(0, 0, 2, 2),
+                     gfx::Clip(0, 0, 0, 0, 4, 4), 255, BlendMode::SRC);
+  };
+
+  renderTilemap();
+  EXPECT_4X4_PIXELS(dst.get(),
+                    a, b, b, a,
+                    c, d, d, c,
+                    c, d, a, c,
+                    a, b, b, d);
+  EXPECT_4X4_PIXELS(dst2.get(),
+                    a, b, b, a,
+                    c, d, d, c,
+                    c, d, a, c,
+                    a, b, b, d);
+
+  // Modified tiles are copied again
+  put_pixel(tile, 1, 0, d);
+  renderTilemap();
+  EXPECT_4X4_PIXELS(dst.get(),
+                    a, d, d, a,
+                    c, d, d, c,
+                    c, d, a, c,
+                    a, d, d, d);
+  EXPECT_4X4_PIXELS(dst2.get(),
+                    a, d, d, a,
+                    c, d, d, c,
+                    c, d, a, c,
+                    a, d, d, d);
+
+  // And modified cells of the tilemap
+  put_pixel(tilemap, 0, 0, notile);
+  put_pixel(tilemap, 1, 1, doc::tile(1, tile_f_xflip | tile_f_yflip));
+  renderTilemap();
+  EXPECT_4X4_PIXELS(dst.get(),
+                    bgColor, bgColor, d, a,
+                    bgColor, bgColor, d, c,
+                    c, d, d, c,
+                    a, d, d, a);
+  EXPECT_4X4_PIXELS(dst2.get(),
+                    bgColor, bgColor, d, a,
+                    bgColor, bgColor, d, c,
+                    c, d, d, c,
+                    a, d, d, a);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);